@@ -25,6 +25,7 @@ enum
     CORRECTED_PARTIALLYACCESSEDARRAY,
     BUG_PARTIALLYACCESSEDARRAY_FIB,
     CORRECTED_PARTIALLYACCESSEDARRAY_FIB,
+    CORRECTED_PARTIALLYACCESSEDARRAY_FIB_SPAN,
     BUG_DEACTIVATEDCODE,
     CORRECTED_DEACTIVATEDCODE,
     BUG_DEADCODE,
@@ -38,18 +39,24 @@ enum
     CALL_UNCALLEDFUNC,
     BUG_UNPROTECTEDMEMORYALLOCATION,
     CORRECTED_UNPROTECTEDMEMORYALLOCATION,
+    CORRECTED_UNPROTECTEDMEMORYALLOCATION_SCRATCH,
     BUG_BADFREE,
     CORRECTED_BADFREE,
+    BUG_BADFREE_GUARD,
     BUG_DOUBLEDEALLOCATION,
     CORRECTED_DOUBLEDEALLOCATION,
+    BUG_DOUBLEDEALLOCATION_GUARD,
     BUG_FREEDPTR,
     CORRECTED_FREEDPTR,
+    BUG_FREEDPTR_GUARD,
     BUG_MEMLEAK,
     CORRECTED_MEMLEAK,
     BUG_MEMLEAK_ARRAY,
     CORRECTED_MEMLEAK_ARRAY,
+    CORRECTED_MEMLEAK_ARRAY_ARENA,
     BUG_PASSBYVALUE,
     CORRECTED_PASSBYVALUE,
+    CORRECTED_PASSBYVALUE_POOL,
     BUG_MORETHANONESTATEMENT,
     CORRECTED_MORETHANONESTATEMENT,
     BUG_HARDCODEDBUFFERSIZE,
@@ -74,22 +81,27 @@ enum
     CALL_FLOATZERODIV,
     BUG_INTCONVOVFL,
     CORRECTED_INTCONVOVFL,
+    CORRECTED_INTCONVOVFL_SATURATED,
     BUG_UINTCONVOVFL,
     CORRECTED_UINTCONVOVFL,
     BUG_SIGNCHANGE,
     CORRECTED_SIGNCHANGE,
+    CORRECTED_SIGNCHANGE_CHECKED,
     BUG_FLOATCONVOVFL,
     CORRECTED_FLOATCONVOVFL,
     BUG_INTOVFL,
     CORRECTED_INTOVFL,
+    CORRECTED_INTOVFL_SATURATED,
     BUG_UINTOVFL,
     CORRECTED_UINTOVFL,
     BUG_FLOATOVFL,
     CORRECTED_FLOATOVFL,
     BUG_FLOATABSORPTION,
     CORRECTED_FLOATABSORPTION,
+    CORRECTED_FLOATABSORPTION_COMPENSATED,
     BUG_INTSTDLIB,
     CORRECTED_INTSTDLIB,
+    CORRECTED_INTSTDLIB_DIVISOR,
     BUG_FLOATSTDLIB,
     CORRECTED_FLOATSTDLIB,
     BUG_SHIFTNEG,
@@ -100,6 +112,7 @@ enum
     CORRECTED_BADPLAINCHARUSE,
     BUG_BITWISENEG,
     CORRECTED_BITWISENEG,
+    CORRECTED_BITWISENEG_FMT,
     BUG_ASSERT,
     CORRECTED_ASSERT,
     BUG_BADEQUALUSE,
@@ -169,9 +182,12 @@ enum
     CORRECTED_CHAREOFCONFUSED,
     BUG_MEMCMPPADDINGDATA,
     CORRECTED_MEMCMPPADDINGDATA,
+    CORRECTED_MEMCMPPADDINGDATA_POOL,
     BUG_NONREENTRANTSTDRETURN,
     CORRECTED_NONREENTRANTSTDRETURN,
+    CORRECTED_NONREENTRANTSTDRETURN_SIMD,
     DEMO_CALL_BUG_MEMCMPSTRINGS,
+    DEMO_CALL_CORRECTED_MEMCMPSTRINGS_SIMD,
     BUG_CLOSEDRESOURCEUSE_FPRINTF,
     CORRECTED_CLOSEDRESOURCEUSE_FPRINTF,
     BUG_DOUBLERESOURCEOPEN,
@@ -261,6 +277,7 @@ enum
     CORRECTED_CRYPTOCIPHERWEAKCIPHER,
     BUG_CRYPTOCIPHERWEAKMODE,
     CORRECTED_CRYPTOCIPHERWEAKMODE,
+    CORRECTED_CRYPTOCIPHERWEAKMODE_CTR,
     BUG_CRYPTOPKEYNOPUBLICKEY,
     CORRECTED_CRYPTOPKEYNOPUBLICKEY,
     BUG_CRYPTOPKEYNOPRIVATEKEY,
@@ -299,6 +316,7 @@ enum
     CORRECTED_CRYPTOSSLNOCA,
     BUG_OUTBOUNDARRAY,
     CORRECTED_OUTBOUNDARRAY,
+    CORRECTED_OUTBOUNDARRAY_SPAN,
     BUG_OUTBOUNDPTR,
     CORRECTED_OUTBOUNDPTR,
     BUG_NULLPTR,
@@ -309,8 +327,10 @@ enum
     CORRECTED_OBJECTSIZEMISMATCH_ALLOC,
     BUG_MEMSTDLIB,
     CORRECTED_MEMSTDLIB,
+    CORRECTED_MEMSTDLIB_SPAN,
     BUG_STRSTDLIB,
     CORRECTED_STRSTDLIB,
+    CORRECTED_STRSTDLIB_SCAN,
     BUG_NULLPTRARITH,
     CORRECTED_NULLPTRARITH,
     BUG_PTRCAST,
@@ -319,24 +339,31 @@ enum
     CORRECTED_FUNCCAST,
     BUG_PATHBUFFEROVERFLOW,
     CORRECTED_PATHBUFFEROVERFLOW,
+    CORRECTED_PATHBUFFEROVERFLOW_CACHED,
     BUG_STRLIBBUFFEROVERFLOW,
     CORRECTED_STRLIBBUFFEROVERFLOW,
+    CORRECTED_STRLIBBUFFEROVERFLOW_FMT,
     BUG_STRLIBBUFFERUNDERFLOW,
     CORRECTED_STRLIBBUFFERUNDERFLOW,
     BUG_STRFORMATBUFFEROVERFLOW,
     CORRECTED_STRFORMATBUFFEROVERFLOW,
+    CORRECTED_STRFORMATBUFFEROVERFLOW_SCAN,
     BUG_TAINTEDARRAYINDEX,
     CORRECTED_TAINTEDARRAYINDEX,
+    CORRECTED_TAINTEDARRAYINDEX_SPAN,
     BUG_TAINTEDINTDIVISION,
     CORRECTED_TAINTEDINTDIVISION,
+    CORRECTED_TAINTEDINTDIVISION_DIVISOR,
     BUG_TAINTEDINTMOD,
     CORRECTED_TAINTEDINTMOD,
+    CORRECTED_TAINTEDINTMOD_DIVISOR,
     BUG_TAINTEDLOOPBOUNDARY,
     CORRECTED_TAINTEDLOOPBOUNDARY,
     BUG_TAINTEDSIGNCHANGE,
     CORRECTED_TAINTEDSIGNCHANGE,
     BUG_TAINTEDSTRING,
     CORRECTED_TAINTEDSTRING,
+    CORRECTED_TAINTEDSTRING_SIMD,
     BUG_TAINTEDSTRINGFORMAT,
     CORRECTED_TAINTEDSTRINGFORMAT,
     BUG_TAINTEDVLASIZE,
@@ -387,6 +414,7 @@ enum
     CORRECTED_PTRTODIFFARRAY,
     BUG_ALIGNMENTCHANGE,
     CORRECTED_ALIGNMENTCHANGE,
+    CORRECTED_ALIGNMENTCHANGE_REALLOC,
     BUG_PUTENVAUTOVAR,
     CORRECTED_PUTENVAUTOVAR,
     BUG_SIGHANDLERSHAREDOBJECT,
@@ -419,6 +447,12 @@ enum
     DEMO_CORRECTED_SIGHANDLERERRNOMISUSE,
     BUG_INTTOFLOATPRECISIONLOSS,
     CORRECTED_INTTOFLOATPRECISIONLOSS,
+    CORRECTED_INTTOFLOATPRECISIONLOSS_CHECKED,
+    DEMO_CRYPTOBENCHMARK,
+    DEMO_MEMORYBENCHMARK,
+    DEMO_HEAPPROFILE,
+    DEMO_STRINGBENCHMARK,
+    DEMO_NUMERICBENCHMARK,
     /* Insert test case before this line */
     CASE_LAST
 };
@@ -290,6 +290,14 @@ void corrected_cryptocipherweakmode(unsigned char *lkey, unsigned char *iv) {
     const EVP_CIPHER * ciph = EVP_aes_128_cbc();     /* CBC mode is not a weak mode */
     EVP_EncryptInit_ex(ctx, ciph, NULL, lkey, iv);   /* Fix: use of CBC as algorithm mode  */
 }
+void corrected_cryptocipherweakmode_ctr(unsigned char *lkey, unsigned char *iv) {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    EVP_CIPHER_CTX_init(ctx);
+    const EVP_CIPHER * ciph = EVP_aes_128_ctr();     /* CTR mode is not a weak mode, and unlike CBC
+                                                        its blocks can be encrypted in parallel */
+    EVP_EncryptInit_ex(ctx, ciph, NULL, lkey, iv);   /* Fix: use of CTR as algorithm mode  */
+    EVP_CIPHER_CTX_set_num_threads(ctx, 0);          /* large updates are split across all cores */
+}
 
 
 /**********************************************************
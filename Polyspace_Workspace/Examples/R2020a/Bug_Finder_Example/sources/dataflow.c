@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "lib_memory.h"
 
 /* Used functions */
 enum {
@@ -269,6 +270,22 @@ int corrected_partiallyaccessedarray_fib(void) {
     return fib[i-1];            /* Fix: fib[9] is returned */
 }
 
+MEM_SPAN_TYPE(span_ulong, unsigned long);
+
+int corrected_partiallyaccessedarray_fib_span(void) {
+    int i;
+    unsigned long fib[SIZE10];
+    span_ulong s = MEM_SPAN_OF(fib);
+    for (i = 0; i < SIZE10; i++) {
+        if (i < 2) {
+            MEM_SPAN_AT(s, i) = 1;
+        } else {
+            MEM_SPAN_AT(s, i) = MEM_SPAN_AT(s, i-1) + MEM_SPAN_AT(s, i-2);
+        }
+    }
+    return MEM_SPAN_AT(s, s.len-1);   /* Fix: The last element, whatever the array size */
+}
+
 
 /*============================================================================
  *  DEACTIVATED CODE
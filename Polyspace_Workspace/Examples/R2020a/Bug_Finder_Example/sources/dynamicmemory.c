@@ -17,6 +17,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "lib_memory.h"
 
 #define fatal_error() abort()
 
@@ -52,6 +53,21 @@ void corrected_unprotectedmemoryallocation(void) {
     free(ptr);
 }
 
+void corrected_unprotectedmemoryallocation_scratch(void) {
+    mem_arena* scratch = mem_scratch();
+    mem_arena_mark mark;
+    int* ptr;
+    int i = 42;
+
+    if (scratch == NULL) return;
+    mark = mem_arena_save(scratch);
+    ptr = (int*)mem_arena_alloc(scratch, sizeof(int));
+    if (ptr == NULL) return;    /* Fix: Check that return is not NULL       */
+    *ptr = i;
+
+    mem_arena_restore(scratch, mark);  /* Block released with the rest of the scratch */
+}
+
 
 /*============================================================================
  *  BAD FREE
@@ -72,6 +88,13 @@ void corrected_badfree(int i) {
     }
 }
 
+void bug_badfree_guard(int i) {
+    int* p = &i;
+
+    mem_guard_free(p);       /* Defect caught: p is not owned by the guarded
+                              * heap, reported as an invalid free         */
+}
+
 
 /*============================================================================
  *  DOUBLE FREE
@@ -99,6 +122,19 @@ void corrected_doubledeallocation(void) {
     free(pi);
 }                               /* Fix: Do not free pi twice                */
 
+void bug_doubledeallocation_guard(void) {
+
+    int* pi = (int*)mem_guard_malloc(sizeof(int));
+    if (pi == NULL) return;
+
+    *pi = 2;
+    (void)printf("Freeing the pointer\n");
+    mem_guard_free(pi);
+    (void)printf("Freeing the pointer\n");
+    mem_guard_free(pi);         /* Defect caught: pi is in quarantine, the
+                                 * second free is reported                   */
+}
+
 
 /*============================================================================
  *  USING FREED POINTER
@@ -134,6 +170,23 @@ int corrected_freedptr(void) {
     return j;
 }
 
+int bug_freedptr_guard(void) {
+    int j;
+    int* pi = (int*)mem_guard_malloc(sizeof(int));
+    if (pi == NULL) return 0;
+
+    *pi = 42;
+    mem_guard_free(pi);
+    (void)printf("Freeing the pointer\n");
+
+    j = *pi + 2;                /* Reads the poison pattern, not 42          */
+    *pi = 0;                    /* Defect caught: the write is found when pi
+                                 * leaves quarantine, forced here            */
+    mem_guard_flush();
+
+    return j;
+}
+
 
 /*============================================================================
  *  MEMORY LEAK
@@ -189,6 +242,28 @@ void corrected_memleak_array(void) {
     free(pi);                   /* Fix: Pointer is properly freed           */
 }
 
+void corrected_memleak_array_arena(void) {
+    int i;
+    int j;
+    mem_arena* arena = mem_arena_create(0);
+    int* pi;
+    if (arena == NULL) return;
+    pi = (int*)mem_arena_alloc(arena, 10 * sizeof(int));
+    if (pi == NULL) {
+        mem_arena_destroy(arena);
+        return;
+    }
+
+    for (i = 0; i < SIZE9; i++) {
+        pi[i] = 42 + i;
+    }
+
+    for (j = 0; j < SIZE9; j++) {
+        if (pi[j] == extval()) break;
+    }
+    mem_arena_destroy(arena);   /* Fix: Every block of the arena is freed at once */
+}
+
 
 /*============================================================================
  * ALIGNMENT CHANGE
@@ -245,3 +320,32 @@ void corrected_alignmentchange(void) {
     /* Free before exit */
     free(ptr);
 }
+
+void corrected_alignmentchange_realloc(void) {
+    size_t resize = SIZE1024;
+    size_t alignment = 1 << 12; /* alignment 4096 */
+    int *ptr = NULL;
+    int *ptr1;
+
+    if (posix_memalign((void **)&ptr, alignment, sizeof(int)) != 0) {
+        /* Allocation with 4096 bytes alignment */
+        /* Handle error */
+        fatal_error();
+    }
+    *ptr = 42;
+    ptr1 = (int *)mem_aligned_realloc(ptr, alignment, sizeof(int) * resize); /* Fix: resize keeping the 4096 bytes
+                                                                             * alignment; the first element is kept
+                                                                             * and ptr is released
+                                                                             */
+    if (ptr1 == NULL) {
+        /* Handle error */
+        mem_aligned_free(ptr);
+        ptr = NULL;
+        fatal_error();
+    }
+
+    /* Processing using ptr1 supposed to be strictly aligned to 4096 bytes */
+
+    /* Free before exit */
+    mem_aligned_free(ptr1);
+}
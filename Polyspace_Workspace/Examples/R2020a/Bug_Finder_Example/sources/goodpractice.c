@@ -18,6 +18,7 @@
 #include <string.h>
 #include <signal.h>
 #include <setjmp.h>
+#include "lib_memory.h"
 
 enum {
     SIZE3   = 3,
@@ -62,6 +63,17 @@ void corrected_passbyvalue(void) {
     ptrlargeparamfct(&s);       /* Fix: Pass the large structure by address */
 }
 
+void corrected_passbyvalue_pool(void) {
+    bigstruct* s = POOL_NEW(bigstruct);  /* Fix: the record lives in the pool, only its address is passed */
+    if (s == NULL) return;
+    s->values[0] = 4;
+    s->values[1] = 23;
+    s->count = 2;
+
+    ptrlargeparamfct(s);
+    POOL_DELETE(s);
+}
+
 
 /*============================================================================
  *  MORE THAN ONE STATEMENT ON THE SAME LINE
@@ -0,0 +1,558 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * AES-128 block function and the ECB, CBC and CTR mode loops.
+ *
+ * Two implementations are provided:
+ * - AES-NI, interleaving 8 independent blocks so the aesenc latency is hidden
+ *   for ECB, CTR and CBC decryption (CBC encryption is inherently serial);
+ * - a portable fallback whose S-box lookups scan the whole table, so memory
+ *   access patterns do not depend on key or data.
+ * The choice is made per call from crypto_cpu_features().
+ */
+
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRYPTO_HAVE_AESNI 1
+#include <immintrin.h>
+#define AESNI_TARGET __attribute__((target("aes,sse4.1,ssse3")))
+#endif
+
+static const unsigned char aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static const unsigned char aes_inv_sbox[256] = {
+    0x52, 0x09, 0x6a, 0xd5, 0x30, 0x36, 0xa5, 0x38, 0xbf, 0x40, 0xa3, 0x9e, 0x81, 0xf3, 0xd7, 0xfb,
+    0x7c, 0xe3, 0x39, 0x82, 0x9b, 0x2f, 0xff, 0x87, 0x34, 0x8e, 0x43, 0x44, 0xc4, 0xde, 0xe9, 0xcb,
+    0x54, 0x7b, 0x94, 0x32, 0xa6, 0xc2, 0x23, 0x3d, 0xee, 0x4c, 0x95, 0x0b, 0x42, 0xfa, 0xc3, 0x4e,
+    0x08, 0x2e, 0xa1, 0x66, 0x28, 0xd9, 0x24, 0xb2, 0x76, 0x5b, 0xa2, 0x49, 0x6d, 0x8b, 0xd1, 0x25,
+    0x72, 0xf8, 0xf6, 0x64, 0x86, 0x68, 0x98, 0x16, 0xd4, 0xa4, 0x5c, 0xcc, 0x5d, 0x65, 0xb6, 0x92,
+    0x6c, 0x70, 0x48, 0x50, 0xfd, 0xed, 0xb9, 0xda, 0x5e, 0x15, 0x46, 0x57, 0xa7, 0x8d, 0x9d, 0x84,
+    0x90, 0xd8, 0xab, 0x00, 0x8c, 0xbc, 0xd3, 0x0a, 0xf7, 0xe4, 0x58, 0x05, 0xb8, 0xb3, 0x45, 0x06,
+    0xd0, 0x2c, 0x1e, 0x8f, 0xca, 0x3f, 0x0f, 0x02, 0xc1, 0xaf, 0xbd, 0x03, 0x01, 0x13, 0x8a, 0x6b,
+    0x3a, 0x91, 0x11, 0x41, 0x4f, 0x67, 0xdc, 0xea, 0x97, 0xf2, 0xcf, 0xce, 0xf0, 0xb4, 0xe6, 0x73,
+    0x96, 0xac, 0x74, 0x22, 0xe7, 0xad, 0x35, 0x85, 0xe2, 0xf9, 0x37, 0xe8, 0x1c, 0x75, 0xdf, 0x6e,
+    0x47, 0xf1, 0x1a, 0x71, 0x1d, 0x29, 0xc5, 0x89, 0x6f, 0xb7, 0x62, 0x0e, 0xaa, 0x18, 0xbe, 0x1b,
+    0xfc, 0x56, 0x3e, 0x4b, 0xc6, 0xd2, 0x79, 0x20, 0x9a, 0xdb, 0xc0, 0xfe, 0x78, 0xcd, 0x5a, 0xf4,
+    0x1f, 0xdd, 0xa8, 0x33, 0x88, 0x07, 0xc7, 0x31, 0xb1, 0x12, 0x10, 0x59, 0x27, 0x80, 0xec, 0x5f,
+    0x60, 0x51, 0x7f, 0xa9, 0x19, 0xb5, 0x4a, 0x0d, 0x2d, 0xe5, 0x7a, 0x9f, 0x93, 0xc9, 0x9c, 0xef,
+    0xa0, 0xe0, 0x3b, 0x4d, 0xae, 0x2a, 0xf5, 0xb0, 0xc8, 0xeb, 0xbb, 0x3c, 0x83, 0x53, 0x99, 0x61,
+    0x17, 0x2b, 0x04, 0x7e, 0xba, 0x77, 0xd6, 0x26, 0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
+};
+
+static const unsigned char aes_rcon[AES128_ROUNDS] = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36
+};
+
+
+/*============================================================================
+ * PORTABLE IMPLEMENTATION
+ *==========================================================================*/
+static unsigned char aes_ct_lookup(const unsigned char *table, unsigned char x) {
+    unsigned int r = 0;
+    unsigned int i;
+
+    for (i = 0; i < 256; i++) {
+        unsigned int mask = 0u - ((((i ^ x) - 1u) >> 8) & 1u);   /* all ones iff i == x */
+        r |= table[i] & mask;
+    }
+    return (unsigned char)r;
+}
+
+static unsigned char aes_xtime(unsigned char a) {
+    return (unsigned char)((a << 1) ^ (0x1b & (0u - (a >> 7))));
+}
+
+static unsigned char aes_gmul(unsigned char a, unsigned char b) {
+    unsigned char r = 0;
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        r ^= (unsigned char)(a & (0u - (b & 1u)));
+        a = aes_xtime(a);
+        b >>= 1;
+    }
+    return r;
+}
+
+static void aes_portable_set_key(crypto_aes_key *k, const unsigned char *key) {
+    unsigned char *w = &k->rk[0][0];
+    int i;
+
+    memcpy(w, key, AES128_KEY_SIZE);
+    for (i = 4; i < 4 * (AES128_ROUNDS + 1); i++) {
+        unsigned char t[4];
+        memcpy(t, &w[4 * (i - 1)], 4);
+        if (i % 4 == 0) {
+            unsigned char t0 = t[0];
+            t[0] = aes_ct_lookup(aes_sbox, t[1]) ^ aes_rcon[i / 4 - 1];
+            t[1] = aes_ct_lookup(aes_sbox, t[2]);
+            t[2] = aes_ct_lookup(aes_sbox, t[3]);
+            t[3] = aes_ct_lookup(aes_sbox, t0);
+        }
+        w[4 * i + 0] = w[4 * (i - 4) + 0] ^ t[0];
+        w[4 * i + 1] = w[4 * (i - 4) + 1] ^ t[1];
+        w[4 * i + 2] = w[4 * (i - 4) + 2] ^ t[2];
+        w[4 * i + 3] = w[4 * (i - 4) + 3] ^ t[3];
+    }
+}
+
+static void aes_portable_encrypt(const crypto_aes_key *k, const unsigned char *in, unsigned char *out) {
+    unsigned char s[AES_BLOCK_SIZE];
+    unsigned char t[AES_BLOCK_SIZE];
+    int i;
+    int r;
+    int c;
+
+    for (i = 0; i < AES_BLOCK_SIZE; i++) s[i] = in[i] ^ k->rk[0][i];
+
+    for (r = 1; r <= AES128_ROUNDS; r++) {
+        /* SubBytes and ShiftRows: state byte (row, col) is s[row + 4 * col] */
+        for (c = 0; c < 4; c++) {
+            for (i = 0; i < 4; i++) {
+                t[i + 4 * c] = aes_ct_lookup(aes_sbox, s[i + 4 * ((c + i) & 3)]);
+            }
+        }
+        if (r != AES128_ROUNDS) {
+            for (c = 0; c < 4; c++) {
+                unsigned char *a = &t[4 * c];
+                unsigned char x = a[0] ^ a[1] ^ a[2] ^ a[3];
+                unsigned char a0 = a[0];
+                a[0] ^= x ^ aes_xtime(a[0] ^ a[1]);
+                a[1] ^= x ^ aes_xtime(a[1] ^ a[2]);
+                a[2] ^= x ^ aes_xtime(a[2] ^ a[3]);
+                a[3] ^= x ^ aes_xtime(a[3] ^ a0);
+            }
+        }
+        for (i = 0; i < AES_BLOCK_SIZE; i++) s[i] = t[i] ^ k->rk[r][i];
+    }
+    memcpy(out, s, AES_BLOCK_SIZE);
+}
+
+static void aes_portable_decrypt(const crypto_aes_key *k, const unsigned char *in, unsigned char *out) {
+    unsigned char s[AES_BLOCK_SIZE];
+    unsigned char t[AES_BLOCK_SIZE];
+    int i;
+    int r;
+    int c;
+
+    for (i = 0; i < AES_BLOCK_SIZE; i++) s[i] = in[i] ^ k->rk[AES128_ROUNDS][i];
+
+    for (r = AES128_ROUNDS - 1; r >= 0; r--) {
+        /* InvShiftRows and InvSubBytes */
+        for (c = 0; c < 4; c++) {
+            for (i = 0; i < 4; i++) {
+                t[i + 4 * c] = aes_ct_lookup(aes_inv_sbox, s[i + 4 * ((c - i + 4) & 3)]);
+            }
+        }
+        for (i = 0; i < AES_BLOCK_SIZE; i++) t[i] ^= k->rk[r][i];
+        if (r != 0) {
+            for (c = 0; c < 4; c++) {
+                unsigned char *a = &t[4 * c];
+                unsigned char a0 = a[0], a1 = a[1], a2 = a[2], a3 = a[3];
+                a[0] = aes_gmul(a0, 14) ^ aes_gmul(a1, 11) ^ aes_gmul(a2, 13) ^ aes_gmul(a3, 9);
+                a[1] = aes_gmul(a0, 9) ^ aes_gmul(a1, 14) ^ aes_gmul(a2, 11) ^ aes_gmul(a3, 13);
+                a[2] = aes_gmul(a0, 13) ^ aes_gmul(a1, 9) ^ aes_gmul(a2, 14) ^ aes_gmul(a3, 11);
+                a[3] = aes_gmul(a0, 11) ^ aes_gmul(a1, 13) ^ aes_gmul(a2, 9) ^ aes_gmul(a3, 14);
+            }
+        }
+        memcpy(s, t, AES_BLOCK_SIZE);
+    }
+    memcpy(out, s, AES_BLOCK_SIZE);
+}
+
+static void aes_ctr_increment(unsigned char ctr[AES_BLOCK_SIZE]) {
+    int i;
+
+    for (i = AES_BLOCK_SIZE - 1; i >= 0; i--) {
+        if (++ctr[i] != 0) break;
+    }
+}
+
+
+/*============================================================================
+ * AES-NI IMPLEMENTATION
+ *==========================================================================*/
+#ifdef CRYPTO_HAVE_AESNI
+
+#define AESNI_EXPAND(k, rcon)                                                 \
+    do {                                                                      \
+        __m128i kg_ = _mm_shuffle_epi32(_mm_aeskeygenassist_si128(k, rcon), 0xff); \
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));                           \
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));                           \
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));                           \
+        k = _mm_xor_si128(k, kg_);                                            \
+    } while (0)
+
+AESNI_TARGET static void aesni_set_key(crypto_aes_key *k, const unsigned char *key) {
+    __m128i x = _mm_loadu_si128((const __m128i *)key);
+    __m128i *rk = (__m128i *)k->rk;
+    __m128i *drk = (__m128i *)k->drk;
+    int i;
+
+    rk[0] = x;
+    AESNI_EXPAND(x, 0x01); rk[1] = x;
+    AESNI_EXPAND(x, 0x02); rk[2] = x;
+    AESNI_EXPAND(x, 0x04); rk[3] = x;
+    AESNI_EXPAND(x, 0x08); rk[4] = x;
+    AESNI_EXPAND(x, 0x10); rk[5] = x;
+    AESNI_EXPAND(x, 0x20); rk[6] = x;
+    AESNI_EXPAND(x, 0x40); rk[7] = x;
+    AESNI_EXPAND(x, 0x80); rk[8] = x;
+    AESNI_EXPAND(x, 0x1b); rk[9] = x;
+    AESNI_EXPAND(x, 0x36); rk[10] = x;
+
+    drk[0] = rk[AES128_ROUNDS];
+    for (i = 1; i < AES128_ROUNDS; i++) {
+        drk[i] = _mm_aesimc_si128(rk[AES128_ROUNDS - i]);
+    }
+    drk[AES128_ROUNDS] = rk[0];
+}
+
+/* One AES round applied to the 8 blocks b0..b7 of a pipeline. The blocks
+ * are separate locals rather than an array so they stay in registers. */
+#define AESNI_ROUND8(op, key)                                                 \
+    do {                                                                      \
+        const __m128i k_ = (key);                                             \
+        b0 = op(b0, k_); b1 = op(b1, k_); b2 = op(b2, k_); b3 = op(b3, k_);   \
+        b4 = op(b4, k_); b5 = op(b5, k_); b6 = op(b6, k_); b7 = op(b7, k_);   \
+    } while (0)
+
+#define AESNI_CIPHER8(rk, op, oplast)                                         \
+    do {                                                                      \
+        AESNI_ROUND8(_mm_xor_si128, rk[0]);                                   \
+        AESNI_ROUND8(op, rk[1]); AESNI_ROUND8(op, rk[2]);                     \
+        AESNI_ROUND8(op, rk[3]); AESNI_ROUND8(op, rk[4]);                     \
+        AESNI_ROUND8(op, rk[5]); AESNI_ROUND8(op, rk[6]);                     \
+        AESNI_ROUND8(op, rk[7]); AESNI_ROUND8(op, rk[8]);                     \
+        AESNI_ROUND8(op, rk[9]);                                              \
+        AESNI_ROUND8(oplast, rk[10]);                                         \
+    } while (0)
+
+#define AESNI_LOAD8(p)                                                        \
+    do {                                                                      \
+        b0 = _mm_loadu_si128((const __m128i *)(p) + 0);                       \
+        b1 = _mm_loadu_si128((const __m128i *)(p) + 1);                       \
+        b2 = _mm_loadu_si128((const __m128i *)(p) + 2);                       \
+        b3 = _mm_loadu_si128((const __m128i *)(p) + 3);                       \
+        b4 = _mm_loadu_si128((const __m128i *)(p) + 4);                       \
+        b5 = _mm_loadu_si128((const __m128i *)(p) + 5);                       \
+        b6 = _mm_loadu_si128((const __m128i *)(p) + 6);                       \
+        b7 = _mm_loadu_si128((const __m128i *)(p) + 7);                       \
+    } while (0)
+
+#define AESNI_STORE8(p)                                                       \
+    do {                                                                      \
+        _mm_storeu_si128((__m128i *)(p) + 0, b0);                             \
+        _mm_storeu_si128((__m128i *)(p) + 1, b1);                             \
+        _mm_storeu_si128((__m128i *)(p) + 2, b2);                             \
+        _mm_storeu_si128((__m128i *)(p) + 3, b3);                             \
+        _mm_storeu_si128((__m128i *)(p) + 4, b4);                             \
+        _mm_storeu_si128((__m128i *)(p) + 5, b5);                             \
+        _mm_storeu_si128((__m128i *)(p) + 6, b6);                             \
+        _mm_storeu_si128((__m128i *)(p) + 7, b7);                             \
+    } while (0)
+
+/* Output block j is key stream j XOR input block j */
+#define AESNI_XOR_IN8(p)                                                      \
+    do {                                                                      \
+        b0 = _mm_xor_si128(b0, _mm_loadu_si128((const __m128i *)(p) + 0));    \
+        b1 = _mm_xor_si128(b1, _mm_loadu_si128((const __m128i *)(p) + 1));    \
+        b2 = _mm_xor_si128(b2, _mm_loadu_si128((const __m128i *)(p) + 2));    \
+        b3 = _mm_xor_si128(b3, _mm_loadu_si128((const __m128i *)(p) + 3));    \
+        b4 = _mm_xor_si128(b4, _mm_loadu_si128((const __m128i *)(p) + 4));    \
+        b5 = _mm_xor_si128(b5, _mm_loadu_si128((const __m128i *)(p) + 5));    \
+        b6 = _mm_xor_si128(b6, _mm_loadu_si128((const __m128i *)(p) + 6));    \
+        b7 = _mm_xor_si128(b7, _mm_loadu_si128((const __m128i *)(p) + 7));    \
+    } while (0)
+
+AESNI_TARGET static __m128i aesni_encrypt1(const __m128i *rk, __m128i b) {
+    int r;
+
+    b = _mm_xor_si128(b, rk[0]);
+    for (r = 1; r < AES128_ROUNDS; r++) b = _mm_aesenc_si128(b, rk[r]);
+    return _mm_aesenclast_si128(b, rk[AES128_ROUNDS]);
+}
+
+AESNI_TARGET static __m128i aesni_decrypt1(const __m128i *drk, __m128i b) {
+    int r;
+
+    b = _mm_xor_si128(b, drk[0]);
+    for (r = 1; r < AES128_ROUNDS; r++) b = _mm_aesdec_si128(b, drk[r]);
+    return _mm_aesdeclast_si128(b, drk[AES128_ROUNDS]);
+}
+
+AESNI_TARGET static void aesni_ecb(const __m128i *rk, int enc, const unsigned char *in,
+                                   unsigned char *out, size_t nblocks) {
+    __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+
+    while (nblocks >= 8) {
+        AESNI_LOAD8(in);
+        if (enc) {
+            AESNI_CIPHER8(rk, _mm_aesenc_si128, _mm_aesenclast_si128);
+        } else {
+            AESNI_CIPHER8(rk, _mm_aesdec_si128, _mm_aesdeclast_si128);
+        }
+        AESNI_STORE8(out);
+        in += 128;
+        out += 128;
+        nblocks -= 8;
+    }
+    while (nblocks > 0) {
+        __m128i x = _mm_loadu_si128((const __m128i *)in);
+        x = enc ? aesni_encrypt1(rk, x) : aesni_decrypt1(rk, x);
+        _mm_storeu_si128((__m128i *)out, x);
+        in += 16;
+        out += 16;
+        nblocks--;
+    }
+}
+
+AESNI_TARGET static void aesni_cbc_encrypt(const __m128i *rk, unsigned char *iv, const unsigned char *in,
+                                           unsigned char *out, size_t nblocks) {
+    __m128i c = _mm_loadu_si128((const __m128i *)iv);
+
+    while (nblocks > 0) {
+        c = aesni_encrypt1(rk, _mm_xor_si128(c, _mm_loadu_si128((const __m128i *)in)));
+        _mm_storeu_si128((__m128i *)out, c);
+        in += 16;
+        out += 16;
+        nblocks--;
+    }
+    _mm_storeu_si128((__m128i *)iv, c);
+}
+
+AESNI_TARGET static void aesni_cbc_decrypt(const __m128i *drk, unsigned char *iv, const unsigned char *in,
+                                           unsigned char *out, size_t nblocks) {
+    __m128i prev = _mm_loadu_si128((const __m128i *)iv);
+    __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+    __m128i last;
+
+    while (nblocks >= 8) {
+        /* The whole batch is loaded before any store so in-place decryption
+         * works; chaining values are reloaded from the input afterwards
+         * only when input and output do not overlap */
+        AESNI_LOAD8(in);
+        last = b7;
+        if (in == out) {
+            __m128i c0 = b0, c1 = b1, c2 = b2, c3 = b3, c4 = b4, c5 = b5, c6 = b6;
+            AESNI_CIPHER8(drk, _mm_aesdec_si128, _mm_aesdeclast_si128);
+            b0 = _mm_xor_si128(b0, prev); b1 = _mm_xor_si128(b1, c0);
+            b2 = _mm_xor_si128(b2, c1); b3 = _mm_xor_si128(b3, c2);
+            b4 = _mm_xor_si128(b4, c3); b5 = _mm_xor_si128(b5, c4);
+            b6 = _mm_xor_si128(b6, c5); b7 = _mm_xor_si128(b7, c6);
+        } else {
+            AESNI_CIPHER8(drk, _mm_aesdec_si128, _mm_aesdeclast_si128);
+            b0 = _mm_xor_si128(b0, prev);
+            b1 = _mm_xor_si128(b1, _mm_loadu_si128((const __m128i *)in + 0));
+            b2 = _mm_xor_si128(b2, _mm_loadu_si128((const __m128i *)in + 1));
+            b3 = _mm_xor_si128(b3, _mm_loadu_si128((const __m128i *)in + 2));
+            b4 = _mm_xor_si128(b4, _mm_loadu_si128((const __m128i *)in + 3));
+            b5 = _mm_xor_si128(b5, _mm_loadu_si128((const __m128i *)in + 4));
+            b6 = _mm_xor_si128(b6, _mm_loadu_si128((const __m128i *)in + 5));
+            b7 = _mm_xor_si128(b7, _mm_loadu_si128((const __m128i *)in + 6));
+        }
+        AESNI_STORE8(out);
+        prev = last;
+        in += 128;
+        out += 128;
+        nblocks -= 8;
+    }
+    while (nblocks > 0) {
+        __m128i x = _mm_loadu_si128((const __m128i *)in);
+        _mm_storeu_si128((__m128i *)out, _mm_xor_si128(aesni_decrypt1(drk, x), prev));
+        prev = x;
+        in += 16;
+        out += 16;
+        nblocks--;
+    }
+    _mm_storeu_si128((__m128i *)iv, prev);
+}
+
+AESNI_TARGET static void aesni_ctr(const __m128i *rk, unsigned char ctr[AES_BLOCK_SIZE], const unsigned char *in,
+                                   unsigned char *out, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i b0, b1, b2, b3, b4, b5, b6, b7;
+    uint64_t hi;
+    uint64_t lo;
+
+    memcpy(&hi, ctr, 8);
+    memcpy(&lo, ctr + 8, 8);
+    hi = __builtin_bswap64(hi);
+    lo = __builtin_bswap64(lo);
+
+    while (nblocks >= 8) {
+        if (lo <= UINT64_MAX - 7) {
+            /* No carry into the high half within this batch: the counters
+             * are built with 64-bit lane adds from one broadcast */
+            const __m128i c = _mm_set_epi64x((long long)hi, (long long)lo);
+            const __m128i one = _mm_set_epi64x(0, 1);
+            const __m128i two = _mm_set_epi64x(0, 2);
+            const __m128i c1 = _mm_add_epi64(c, one);
+            const __m128i c2 = _mm_add_epi64(c, two);
+            const __m128i c3 = _mm_add_epi64(c1, two);
+            const __m128i c4 = _mm_add_epi64(c2, two);
+            b0 = _mm_shuffle_epi8(c, bswap);
+            b1 = _mm_shuffle_epi8(c1, bswap);
+            b2 = _mm_shuffle_epi8(c2, bswap);
+            b3 = _mm_shuffle_epi8(c3, bswap);
+            b4 = _mm_shuffle_epi8(c4, bswap);
+            b5 = _mm_shuffle_epi8(_mm_add_epi64(c3, two), bswap);
+            b6 = _mm_shuffle_epi8(_mm_add_epi64(c4, two), bswap);
+            b7 = _mm_shuffle_epi8(_mm_add_epi64(c4, _mm_set_epi64x(0, 3)), bswap);
+            lo += 8;
+            if (lo == 0) hi++;
+        } else {
+#define AESNI_CTR_NEXT(b)                                                     \
+            do {                                                              \
+                b = _mm_shuffle_epi8(_mm_set_epi64x((long long)hi, (long long)lo), bswap); \
+                if (++lo == 0) hi++;                                          \
+            } while (0)
+            AESNI_CTR_NEXT(b0); AESNI_CTR_NEXT(b1); AESNI_CTR_NEXT(b2); AESNI_CTR_NEXT(b3);
+            AESNI_CTR_NEXT(b4); AESNI_CTR_NEXT(b5); AESNI_CTR_NEXT(b6); AESNI_CTR_NEXT(b7);
+#undef AESNI_CTR_NEXT
+        }
+        AESNI_CIPHER8(rk, _mm_aesenc_si128, _mm_aesenclast_si128);
+        AESNI_XOR_IN8(in);
+        AESNI_STORE8(out);
+        in += 128;
+        out += 128;
+        nblocks -= 8;
+    }
+    while (nblocks > 0) {
+        __m128i k = aesni_encrypt1(rk, _mm_shuffle_epi8(_mm_set_epi64x((long long)hi, (long long)lo), bswap));
+        _mm_storeu_si128((__m128i *)out, _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k));
+        if (++lo == 0) hi++;
+        in += 16;
+        out += 16;
+        nblocks--;
+    }
+
+    hi = __builtin_bswap64(hi);
+    lo = __builtin_bswap64(lo);
+    memcpy(ctr, &hi, 8);
+    memcpy(ctr + 8, &lo, 8);
+}
+
+#endif /* CRYPTO_HAVE_AESNI */
+
+
+/*============================================================================
+ * DISPATCH
+ *==========================================================================*/
+void crypto_aes128_set_key(crypto_aes_key *k, const unsigned char *key) {
+#ifdef CRYPTO_HAVE_AESNI
+    if (crypto_cpu_has(CRYPTO_CPU_AESNI | CRYPTO_CPU_SSE41 | CRYPTO_CPU_SSSE3)) {
+        aesni_set_key(k, key);
+        return;
+    }
+#endif
+    aes_portable_set_key(k, key);
+    memset(k->drk, 0, sizeof(k->drk));
+}
+
+void crypto_aes_encrypt_blocks(const crypto_aes_key *k, const unsigned char *in, unsigned char *out, size_t nblocks) {
+#ifdef CRYPTO_HAVE_AESNI
+    if (crypto_cpu_has(CRYPTO_CPU_AESNI | CRYPTO_CPU_SSE41 | CRYPTO_CPU_SSSE3)) {
+        aesni_ecb((const __m128i *)k->rk, 1, in, out, nblocks);
+        return;
+    }
+#endif
+    while (nblocks-- > 0) {
+        aes_portable_encrypt(k, in, out);
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+}
+
+void crypto_aes_decrypt_blocks(const crypto_aes_key *k, const unsigned char *in, unsigned char *out, size_t nblocks) {
+#ifdef CRYPTO_HAVE_AESNI
+    if (crypto_cpu_has(CRYPTO_CPU_AESNI | CRYPTO_CPU_SSE41 | CRYPTO_CPU_SSSE3)) {
+        aesni_ecb((const __m128i *)k->drk, 0, in, out, nblocks);
+        return;
+    }
+#endif
+    while (nblocks-- > 0) {
+        aes_portable_decrypt(k, in, out);
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+}
+
+void crypto_aes_cbc_encrypt(const crypto_aes_key *k, unsigned char iv[AES_BLOCK_SIZE],
+                            const unsigned char *in, unsigned char *out, size_t nblocks) {
+    int i;
+
+#ifdef CRYPTO_HAVE_AESNI
+    if (crypto_cpu_has(CRYPTO_CPU_AESNI | CRYPTO_CPU_SSE41 | CRYPTO_CPU_SSSE3)) {
+        aesni_cbc_encrypt((const __m128i *)k->rk, iv, in, out, nblocks);
+        return;
+    }
+#endif
+    while (nblocks-- > 0) {
+        for (i = 0; i < AES_BLOCK_SIZE; i++) iv[i] ^= in[i];
+        aes_portable_encrypt(k, iv, iv);
+        memcpy(out, iv, AES_BLOCK_SIZE);
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+}
+
+void crypto_aes_cbc_decrypt(const crypto_aes_key *k, unsigned char iv[AES_BLOCK_SIZE],
+                            const unsigned char *in, unsigned char *out, size_t nblocks) {
+    unsigned char c[AES_BLOCK_SIZE];
+    int i;
+
+#ifdef CRYPTO_HAVE_AESNI
+    if (crypto_cpu_has(CRYPTO_CPU_AESNI | CRYPTO_CPU_SSE41 | CRYPTO_CPU_SSSE3)) {
+        aesni_cbc_decrypt((const __m128i *)k->drk, iv, in, out, nblocks);
+        return;
+    }
+#endif
+    while (nblocks-- > 0) {
+        memcpy(c, in, AES_BLOCK_SIZE);
+        aes_portable_decrypt(k, in, out);
+        for (i = 0; i < AES_BLOCK_SIZE; i++) out[i] ^= iv[i];
+        memcpy(iv, c, AES_BLOCK_SIZE);
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+}
+
+void crypto_aes_ctr_blocks(const crypto_aes_key *k, unsigned char ctr[AES_BLOCK_SIZE],
+                           const unsigned char *in, unsigned char *out, size_t nblocks) {
+    unsigned char ks[AES_BLOCK_SIZE];
+    int i;
+
+#ifdef CRYPTO_HAVE_AESNI
+    if (crypto_cpu_has(CRYPTO_CPU_AESNI | CRYPTO_CPU_SSE41 | CRYPTO_CPU_SSSE3)) {
+        aesni_ctr((const __m128i *)k->rk, ctr, in, out, nblocks);
+        return;
+    }
+#endif
+    while (nblocks-- > 0) {
+        aes_portable_encrypt(k, ctr, ks);
+        aes_ctr_increment(ctr);
+        for (i = 0; i < AES_BLOCK_SIZE; i++) out[i] = in[i] ^ ks[i];
+        in += AES_BLOCK_SIZE;
+        out += AES_BLOCK_SIZE;
+    }
+    crypto_cleanse(ks, sizeof(ks));
+}
@@ -0,0 +1,803 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * Throughput benchmarks and dudect-style timing-leak tests for the backend.
+ *
+ * CRYPTO_bench times one operation in a loop and reports calls/s, MB/s and,
+ * when the kernel lets the process read hardware counters, cycles per byte,
+ * instructions per cycle and dTLB load misses per call.
+ *
+ * CRYPTO_timing_leak_test follows "dude, is my code constant time?"
+ * (Reparaz, Balasch, Verbauwhede, 2017): inputs of two classes, a fixed one
+ * and a random one, are interleaved at random, each call is timed with the
+ * cycle counter, and Welch's t-test compares the two timing distributions.
+ * The test is run on the raw timings, on timings cropped at 100 percentiles
+ * (which removes the long tail of interrupts and cache misses) and as a
+ * second-order test on the centred, squared raw timings. |t| above 4.5 is
+ * reported as a leak, above 10 as certain.
+ *
+ * The two suites run these over the primitives behind the corrected_crypto*
+ * examples, with the same algorithms and parameters, so that fast paths
+ * (AES-NI pipelines, multi-buffer SHA-256, cached Montgomery contexts and
+ * blinding pairs) are measured before they are relied upon.
+ *
+ * The SSL session suite does the same for the shared context state: the
+ * client and server of the stand-in handshake talk over a socketpair(),
+ * with contexts made and freed per connection, and the suite checks which
+ * connections resume a cached session before timing full and resumed
+ * handshakes.
+ */
+
+#define _GNU_SOURCE  /* For syscall */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "lib_crypto_cipher_fixed.h"
+#include "lib_crypto_internal.h"
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum {
+    LEAK_BATCH        = 1000,           /* measurements per batch */
+    LEAK_PERCENTILES  = 100,            /* cropped tests */
+    LEAK_TESTS        = 1 + LEAK_PERCENTILES + 1,
+    LEAK_MIN_SAMPLES  = 500             /* per class before a t value counts */
+};
+
+#define LEAK_T_THRESHOLD         4.5
+#define LEAK_T_THRESHOLD_CERTAIN 10.0
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Serialised cycle counter, or nanoseconds where there is none */
+static uint64_t bench_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t t;
+
+    _mm_lfence();
+    t = __rdtsc();
+    _mm_lfence();
+    return t;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+
+/*============================================================================
+ * PERFORMANCE COUNTERS
+ *==========================================================================*/
+/* Cycles, instructions and dTLB load misses of this thread; fds are -1 when
+ * unavailable, e.g. with perf_event_paranoid set or inside most containers.
+ * The dTLB counter is a group of its own: not every PMU can schedule it
+ * alongside the other two */
+typedef struct bench_counters {
+    int cycles_fd, instr_fd, dtlb_fd;
+} bench_counters;
+
+#if defined(__linux__)
+static int bench_counter_open(uint32_t type, uint64_t config, int group) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = type;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void bench_counters_start(bench_counters *c) {
+    c->cycles_fd = bench_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    c->instr_fd = c->cycles_fd >= 0 ? bench_counter_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, c->cycles_fd)
+                                    : -1;
+    c->dtlb_fd = bench_counter_open(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                    (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1);
+    if (c->cycles_fd >= 0) {
+        ioctl(c->cycles_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(c->cycles_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    if (c->dtlb_fd >= 0) {
+        ioctl(c->dtlb_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(c->dtlb_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+static void bench_counters_stop(bench_counters *c, uint64_t *cycles, uint64_t *instr, uint64_t *dtlb) {
+    *cycles = 0;
+    *instr = 0;
+    *dtlb = 0;
+    if (c->dtlb_fd >= 0) {
+        ioctl(c->dtlb_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(c->dtlb_fd, dtlb, sizeof(*dtlb)) != (ssize_t)sizeof(*dtlb)) *dtlb = 0;
+        close(c->dtlb_fd);
+    }
+    if (c->cycles_fd >= 0) {
+        ioctl(c->cycles_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        if (read(c->cycles_fd, cycles, sizeof(*cycles)) != (ssize_t)sizeof(*cycles)) *cycles = 0;
+        close(c->cycles_fd);
+    }
+    if (c->instr_fd >= 0) {
+        if (read(c->instr_fd, instr, sizeof(*instr)) != (ssize_t)sizeof(*instr)) *instr = 0;
+        close(c->instr_fd);
+    }
+}
+#else
+static void bench_counters_start(bench_counters *c) {
+    c->cycles_fd = -1;
+    c->instr_fd = -1;
+    c->dtlb_fd = -1;
+}
+
+static void bench_counters_stop(bench_counters *c, uint64_t *cycles, uint64_t *instr, uint64_t *dtlb) {
+    (void)c;
+    *cycles = 0;
+    *instr = 0;
+    *dtlb = 0;
+}
+#endif
+
+
+/*============================================================================
+ * THROUGHPUT
+ *==========================================================================*/
+int CRYPTO_bench(FILE *report, const char *name, int (*fn)(void *arg), void *arg, size_t bytes, double seconds) {
+    bench_counters c;
+    uint64_t cycles, instr, dtlb;
+    unsigned long calls = 0;
+    double start, elapsed = 0.0;
+
+    if (fn == NULL || name == NULL) return 0;
+    if (fn(arg) <= 0) {                 /* warm-up, and a check that it works */
+        if (report != NULL) fprintf(report, "%-44s failed\n", name);
+        return 0;
+    }
+
+    bench_counters_start(&c);
+    start = bench_now();
+    do {
+        if (fn(arg) <= 0) break;
+        calls++;
+        elapsed = bench_now() - start;
+    } while (elapsed < seconds);
+    bench_counters_stop(&c, &cycles, &instr, &dtlb);
+    if (calls == 0) {
+        if (report != NULL) fprintf(report, "%-44s failed\n", name);
+        return 0;
+    }
+
+    if (report != NULL) {
+        fprintf(report, "%-44s %10.1f calls/s %9.3f ms/call", name, calls / elapsed, elapsed * 1e3 / calls);
+        if (bytes > 0) fprintf(report, " %9.1f MB/s", (double)bytes * calls / elapsed / 1e6);
+        if (cycles > 0 && bytes > 0) fprintf(report, " %7.2f cyc/B", (double)cycles / ((double)bytes * calls));
+        if (cycles > 0 && instr > 0) fprintf(report, " %5.2f IPC", (double)instr / cycles);
+        if (dtlb > 0) fprintf(report, " %9.1f dTLB-miss/call", (double)dtlb / calls);
+        fprintf(report, "\n");
+    }
+    return calls > 0;
+}
+
+
+/*============================================================================
+ * TIMING LEAKS
+ *==========================================================================*/
+/* Welford accumulators for the two classes of one t-test */
+typedef struct leak_ttest {
+    double mean[2], m2[2], n[2];
+} leak_ttest;
+
+static void leak_push(leak_ttest *t, double x, int cls) {
+    double delta;
+
+    t->n[cls] += 1.0;
+    delta = x - t->mean[cls];
+    t->mean[cls] += delta / t->n[cls];
+    t->m2[cls] += delta * (x - t->mean[cls]);
+}
+
+static double leak_t(const leak_ttest *t) {
+    double v0, v1, den;
+
+    if (t->n[0] < LEAK_MIN_SAMPLES || t->n[1] < LEAK_MIN_SAMPLES) return 0.0;
+    v0 = t->m2[0] / (t->n[0] - 1.0);
+    v1 = t->m2[1] / (t->n[1] - 1.0);
+    den = sqrt(v0 / t->n[0] + v1 / t->n[1]);
+    return den > 0.0 ? (t->mean[0] - t->mean[1]) / den : 0.0;
+}
+
+static int leak_cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Cropping thresholds at percentiles 1 - 0.5^(10 (i + 1) / 100), as in
+ * dudect: dense near the top, where the noise is */
+static void leak_percentiles(const uint64_t *ticks, size_t n, uint64_t *crop) {
+    uint64_t *sorted = (uint64_t *)malloc(n * sizeof(uint64_t));
+    double q = 1.0;
+    size_t i;
+
+    if (sorted == NULL) {
+        for (i = 0; i < LEAK_PERCENTILES; i++) crop[i] = UINT64_MAX;
+        return;
+    }
+    memcpy(sorted, ticks, n * sizeof(uint64_t));
+    qsort(sorted, n, sizeof(uint64_t), leak_cmp_u64);
+    for (i = 0; i < LEAK_PERCENTILES; i++) {
+        q *= 0.93303299153680741598;    /* 0.5^0.1 */
+        crop[i] = sorted[(size_t)((1.0 - q) * (double)n)];
+    }
+    free(sorted);
+}
+
+int CRYPTO_timing_leak_test(FILE *report, const char *name, void (*prepare)(void *arg, int cls, unsigned char *input),
+                            void (*fn)(void *arg, const unsigned char *input), void *arg, size_t input_len,
+                            size_t measurements) {
+    leak_ttest *tests = (leak_ttest *)calloc(LEAK_TESTS, sizeof(leak_ttest));
+    unsigned char *inputs = (unsigned char *)malloc(LEAK_BATCH * (input_len ? input_len : 1));
+    unsigned char classes[LEAK_BATCH];
+    uint64_t ticks[LEAK_BATCH];
+    uint64_t crop[LEAK_PERCENTILES];
+    size_t done = 0, batch, i, j;
+    double t, max_t = 0.0;
+    int first = 1, worst = 0;
+    int result = -1;
+
+    if (tests == NULL || inputs == NULL || fn == NULL || prepare == NULL) goto out;
+
+    while (done < measurements) {
+        batch = measurements - done < LEAK_BATCH ? measurements - done : LEAK_BATCH;
+        if (RAND_bytes(classes, (int)batch) != 1) goto out;
+        for (i = 0; i < batch; i++) {
+            classes[i] &= 1;
+            prepare(arg, classes[i], inputs + i * input_len);
+        }
+        for (i = 0; i < batch; i++) {
+            uint64_t t0 = bench_ticks();
+            fn(arg, inputs + i * input_len);
+            ticks[i] = bench_ticks() - t0;
+        }
+
+        /* the first batch warms caches and predictors and only sets the
+         * cropping thresholds */
+        if (first) {
+            leak_percentiles(ticks, batch, crop);
+            first = 0;
+            continue;
+        }
+        for (i = 0; i < batch; i++) {
+            double x = (double)ticks[i];
+            int cls = classes[i];
+
+            leak_push(&tests[0], x, cls);
+            for (j = 0; j < LEAK_PERCENTILES; j++) {
+                if (ticks[i] < crop[j]) leak_push(&tests[1 + j], x, cls);
+            }
+            if (tests[0].n[0] > 10000 && tests[0].n[1] > 10000) {
+                double c = x - tests[0].mean[cls];
+                leak_push(&tests[LEAK_TESTS - 1], c * c, cls);
+            }
+        }
+        done += batch;
+    }
+
+    for (i = 0; i < LEAK_TESTS; i++) {
+        t = fabs(leak_t(&tests[i]));
+        if (t > max_t) {
+            max_t = t;
+            worst = (int)i;
+        }
+    }
+    result = max_t < LEAK_T_THRESHOLD;
+
+    if (report != NULL) {
+        fprintf(report, "%-44s n=%-8.0f fixed %9.0f rand %9.0f ticks  max |t| %6.2f (%s)  %s\n", name,
+                tests[0].n[0] + tests[0].n[1], tests[0].mean[0], tests[0].mean[1], max_t,
+                worst == 0 ? "raw" : worst == LEAK_TESTS - 1 ? "2nd order" : "cropped",
+                max_t >= LEAK_T_THRESHOLD_CERTAIN ? "LEAK: definitely not constant time" :
+                max_t >= LEAK_T_THRESHOLD ? "LEAK: probably not constant time" : "no leak detected");
+    }
+
+out:
+    free(tests);
+    free(inputs);
+    return result;
+}
+
+
+/*============================================================================
+ * SUITES
+ *==========================================================================*/
+enum {
+    BENCH_BUF = 16 * 1024,
+    BENCH_RSA_BITS = 2048,
+    BENCH_RSA_BYTES = BENCH_RSA_BITS / 8,
+    BENCH_BATCH_LANES = 8
+};
+
+#define BENCH_SECONDS 0.5
+
+typedef struct bench_state {
+    EVP_CIPHER_CTX *cctx;
+    const EVP_CIPHER *cipher;
+    int enc;
+    unsigned char key[AES128_KEY_SIZE], iv[AES_BLOCK_SIZE];
+    unsigned char in[BENCH_BUF + AES_BLOCK_SIZE], out[BENCH_BUF + 2 * AES_BLOCK_SIZE];
+    crypto_aes_key aes;
+    crypto_aes128_cbc fixed_cbc;
+    RSA *rsa;
+    unsigned char fixed[BENCH_RSA_BYTES];       /* the fixed-class input */
+    unsigned char rsa_in[BENCH_RSA_BYTES], rsa_out[BENCH_RSA_BYTES];
+    size_t len;
+} bench_state;
+
+/* corrected_cryptocipher*: EVP_CipherInit_ex with a fresh key and IV, one
+ * update over the buffer and the final block */
+static int bench_cipher(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int outl = 0, finl = 0;
+
+    if (EVP_CipherInit_ex(st->cctx, st->cipher, NULL, st->key, st->iv, st->enc) != 1) return 0;
+    if (EVP_CipherUpdate(st->cctx, st->out, &outl, st->in, (int)st->len) != 1) return 0;
+    if (EVP_CipherFinal_ex(st->cctx, st->out + outl, &finl) != 1) return 0;
+    return 1;
+}
+
+/* Short records under one key: EVP re-initialised with the IV only, and the
+ * compile-time specialisation of the same cipher */
+static int bench_record_evp(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int outl = 0, finl = 0;
+
+    if (EVP_CipherInit_ex(st->cctx, NULL, NULL, NULL, st->iv, 1) != 1) return 0;
+    if (EVP_CipherUpdate(st->cctx, st->out, &outl, st->in, (int)st->len) != 1) return 0;
+    return EVP_CipherFinal_ex(st->cctx, st->out + outl, &finl);
+}
+
+static int bench_record_fixed(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    crypto_aes128_cbc_init(&st->fixed_cbc, NULL, st->iv);
+    return crypto_aes128_cbc_encrypt(&st->fixed_cbc, st->out, st->in, st->len) > 0;
+}
+
+/* corrected_cryptorsalowexponent and the pkey examples: EVP_PKEY_keygen
+ * with a 2048-bit modulus and e = 65537 */
+static int bench_keygen(void *arg) {
+    EVP_PKEY_CTX *ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    EVP_PKEY *pkey = NULL;
+    int ok;
+
+    (void)arg;
+    ok = ctx != NULL && EVP_PKEY_keygen_init(ctx) == 1 &&
+         EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, BENCH_RSA_BITS) == 1 && EVP_PKEY_keygen(ctx, &pkey) == 1;
+    EVP_PKEY_free(pkey);
+    EVP_PKEY_CTX_free(ctx);
+    return ok;
+}
+
+/* corrected_cryptorsaweakpadding: RSA_public_encrypt with OAEP */
+static int bench_rsa_oaep_encrypt(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    return RSA_public_encrypt(32, st->in, st->rsa_out, st->rsa, RSA_PKCS1_OAEP_PADDING) == BENCH_RSA_BYTES;
+}
+
+/* corrected_cryptorsanoblinding: blinded RSA_private_decrypt with OAEP */
+static int bench_rsa_oaep_decrypt(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    return RSA_private_decrypt(BENCH_RSA_BYTES, st->rsa_in, st->rsa_out, st->rsa, RSA_PKCS1_OAEP_PADDING) == 32;
+}
+
+/* corrected_cryptorsabadpadding: the private operation on a padded block */
+static int bench_rsa_sign_raw(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    return RSA_private_encrypt(BENCH_RSA_BYTES, st->fixed, st->rsa_out, st->rsa, RSA_NO_PADDING) == BENCH_RSA_BYTES;
+}
+
+/* corrected_cryptomd*: SHA-256 through EVP_SignInit_ex / EVP_SignUpdate */
+static int bench_digest(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+    unsigned int n = 0;
+    int ok;
+
+    ok = ctx != NULL && EVP_SignInit_ex(ctx, EVP_sha256(), NULL) == 1 && EVP_SignUpdate(ctx, st->in, st->len) == 1 &&
+         EVP_DigestFinal_ex(ctx, st->out, &n) == 1;
+    EVP_MD_CTX_destroy(ctx);
+    return ok;
+}
+
+static int bench_digest_batch(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    const unsigned char *data[BENCH_BATCH_LANES];
+    size_t len[BENCH_BATCH_LANES];
+    size_t i;
+
+    for (i = 0; i < BENCH_BATCH_LANES; i++) {
+        data[i] = st->in + i * (BENCH_BUF / BENCH_BATCH_LANES);
+        len[i] = BENCH_BUF / BENCH_BATCH_LANES;
+    }
+    return SHA256_batch(BENCH_BATCH_LANES, data, len, st->out);
+}
+
+static bench_state *bench_state_new(void) {
+    bench_state *st = (bench_state *)calloc(1, sizeof(bench_state));
+
+    if (st == NULL) return NULL;
+    st->cctx = EVP_CIPHER_CTX_new();
+    st->rsa = crypto_rsa_generate(BENCH_RSA_BITS, RSA_KEYGEN_DEFAULT_E, 0);
+    if (st->cctx == NULL || st->rsa == NULL || RAND_bytes(st->key, sizeof(st->key)) != 1 ||
+        RAND_bytes(st->iv, sizeof(st->iv)) != 1 || RAND_bytes(st->in, sizeof(st->in)) != 1 ||
+        RAND_bytes(st->fixed, sizeof(st->fixed)) != 1 ||
+        RSA_public_encrypt(32, st->in, st->rsa_in, st->rsa, RSA_PKCS1_OAEP_PADDING) != BENCH_RSA_BYTES) {
+        EVP_CIPHER_CTX_free(st->cctx);
+        RSA_free(st->rsa);
+        free(st);
+        return NULL;
+    }
+    st->fixed[0] = 0;                   /* below the modulus */
+    RSA_blinding_on(st->rsa, NULL);
+    crypto_aes128_set_key(&st->aes, st->key);
+    return st;
+}
+
+static void bench_state_free(bench_state *st) {
+    if (st == NULL) return;
+    EVP_CIPHER_CTX_free(st->cctx);
+    RSA_free(st->rsa);
+    crypto_cleanse(st, sizeof(*st));
+    free(st);
+}
+
+int CRYPTO_bench_suite(FILE *report) {
+    static const struct {
+        const char *name;
+        const EVP_CIPHER *(*cipher)(void);
+        int enc;
+        size_t len;
+    } ciphers[] = {
+        { "corrected_cryptocipher aes-128-cbc enc 16K", EVP_aes_128_cbc, 1, BENCH_BUF },
+        { "corrected_cryptocipher aes-128-cbc dec 16K", EVP_aes_128_cbc, 0, BENCH_BUF },
+        { "corrected_cryptocipher aes-128-ctr 16K", EVP_aes_128_ctr, 1, BENCH_BUF },
+        { "corrected_cryptocipher aes-128-cbc enc 64B", EVP_aes_128_cbc, 1, 64 }
+    };
+    bench_state *st = bench_state_new();
+    int failed = 0;
+    size_t i;
+
+    if (st == NULL) return -1;
+    if (report != NULL) fprintf(report, "# throughput, cpu features %#x\n", crypto_cpu_features() & 0x7fffffffu);
+
+    for (i = 0; i < sizeof(ciphers) / sizeof(ciphers[0]); i++) {
+        st->cipher = ciphers[i].cipher();
+        st->enc = ciphers[i].enc;
+        st->len = ciphers[i].len;
+        if (!st->enc) {
+            /* decrypt what encryption produced so the padding checks out */
+            int outl = 0, finl = 0;
+            EVP_CipherInit_ex(st->cctx, st->cipher, NULL, st->key, st->iv, 1);
+            EVP_CipherUpdate(st->cctx, st->out, &outl, st->in, (int)st->len);
+            EVP_CipherFinal_ex(st->cctx, st->out + outl, &finl);
+            memcpy(st->in, st->out, (size_t)(outl + finl));
+            st->len = (size_t)(outl + finl);
+        }
+        failed += !CRYPTO_bench(report, ciphers[i].name, bench_cipher, st, st->len, BENCH_SECONDS);
+    }
+
+    st->len = 64;
+    EVP_CipherInit_ex(st->cctx, EVP_aes_128_cbc(), NULL, st->key, st->iv, 1);
+    crypto_aes128_cbc_init(&st->fixed_cbc, st->key, st->iv);
+    failed += !CRYPTO_bench(report, "aes-128-cbc 64B record, EVP", bench_record_evp, st, st->len, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "aes-128-cbc 64B record, fixed", bench_record_fixed, st, st->len, BENCH_SECONDS);
+
+    st->len = BENCH_BUF;
+    failed += !CRYPTO_bench(report, "corrected_cryptomd sha256 16K", bench_digest, st, st->len, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "SHA256_batch 8 x 2K", bench_digest_batch, st, BENCH_BUF, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_cryptorsaweakpadding oaep enc", bench_rsa_oaep_encrypt, st, 0,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_cryptorsanoblinding oaep dec", bench_rsa_oaep_decrypt, st, 0,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_cryptorsabadpadding private op", bench_rsa_sign_raw, st, 0,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_cryptorsalowexponent keygen", bench_keygen, st, 0, 4 * BENCH_SECONDS);
+
+    bench_state_free(st);
+    return failed;
+}
+
+/* Leak test inputs: class 0 repeats the fixed input, class 1 draws a fresh
+ * random one. For RSA both stay below the modulus. */
+static void leak_prepare_aes(void *arg, int cls, unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    if (cls == 0) memcpy(input, st->fixed, AES_BLOCK_SIZE * 4);
+    else RAND_bytes(input, AES_BLOCK_SIZE * 4);
+}
+
+static void leak_aes_encrypt(void *arg, const unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    crypto_aes_encrypt_blocks(&st->aes, input, st->out, 4);
+}
+
+static void leak_aes_decrypt(void *arg, const unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    crypto_aes_decrypt_blocks(&st->aes, input, st->out, 4);
+}
+
+static void leak_prepare_key(void *arg, int cls, unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    if (cls == 0) memcpy(input, st->fixed, AES128_KEY_SIZE);
+    else RAND_bytes(input, AES128_KEY_SIZE);
+}
+
+static void leak_aes_key(void *arg, const unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    crypto_aes_key k;
+    crypto_aes128_set_key(&k, input);
+    st->out[0] = k.rk[AES128_ROUNDS][0];
+}
+
+/* Compare: equal to the secret vs differing in the first byte, the case a
+ * short-circuiting compare answers fastest */
+static void leak_prepare_cmp(void *arg, int cls, unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    memcpy(input, st->fixed, 64);
+    if (cls == 1) {
+        RAND_bytes(input, 64);
+        input[0] = (unsigned char)(st->fixed[0] ^ 0x80);
+    }
+}
+
+static void leak_memcmp(void *arg, const unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    st->out[0] = (unsigned char)CRYPTO_memcmp(input, st->fixed, 64);
+}
+
+static void leak_prepare_rsa(void *arg, int cls, unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    if (cls == 0) {
+        memcpy(input, st->fixed, BENCH_RSA_BYTES);
+    } else {
+        RAND_bytes(input, BENCH_RSA_BYTES);
+        input[0] = 0;
+    }
+}
+
+static void leak_rsa_private(void *arg, const unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    RSA_private_encrypt(BENCH_RSA_BYTES, input, st->rsa_out, st->rsa, RSA_NO_PADDING);
+}
+
+/* OAEP decryption of a valid ciphertext vs random (invalid) ones: a
+ * difference here is a padding oracle */
+static void leak_prepare_oaep(void *arg, int cls, unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    if (cls == 0) {
+        memcpy(input, st->rsa_in, BENCH_RSA_BYTES);
+    } else {
+        RAND_bytes(input, BENCH_RSA_BYTES);
+        input[0] = 0;
+    }
+}
+
+static void leak_rsa_oaep(void *arg, const unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    RSA_private_decrypt(BENCH_RSA_BYTES, input, st->rsa_out, st->rsa, RSA_PKCS1_OAEP_PADDING);
+}
+
+static void leak_prepare_sha(void *arg, int cls, unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    if (cls == 0) memcpy(input, st->fixed, 4 * 64);
+    else RAND_bytes(input, 4 * 64);
+}
+
+static void leak_sha_batch(void *arg, const unsigned char *input) {
+    bench_state *st = (bench_state *)arg;
+    const unsigned char *data[4] = { input, input + 64, input + 128, input + 192 };
+    size_t len[4] = { 64, 64, 64, 64 };
+    SHA256_batch(4, data, len, st->out);
+}
+
+int CRYPTO_timing_leak_suite(FILE *report) {
+    static const struct {
+        const char *name;
+        void (*prepare)(void *, int, unsigned char *);
+        void (*fn)(void *, const unsigned char *);
+        size_t input_len;
+        size_t measurements;
+    } tests[] = {
+        { "aes-128 encrypt 4 blocks", leak_prepare_aes, leak_aes_encrypt, 4 * AES_BLOCK_SIZE, 1000000 },
+        { "aes-128 decrypt 4 blocks", leak_prepare_aes, leak_aes_decrypt, 4 * AES_BLOCK_SIZE, 1000000 },
+        { "aes-128 key schedule", leak_prepare_key, leak_aes_key, AES128_KEY_SIZE, 1000000 },
+        { "CRYPTO_memcmp 64B", leak_prepare_cmp, leak_memcmp, 64, 1000000 },
+        { "SHA256_batch 4 x 64B", leak_prepare_sha, leak_sha_batch, 4 * 64, 200000 },
+        { "rsa-2048 private op (blinded, CRT)", leak_prepare_rsa, leak_rsa_private, BENCH_RSA_BYTES, 20000 },
+        { "rsa-2048 oaep decrypt valid/invalid", leak_prepare_oaep, leak_rsa_oaep, BENCH_RSA_BYTES, 20000 }
+    };
+    bench_state *st = bench_state_new();
+    int leaks = 0;
+    size_t i;
+
+    if (st == NULL) return -1;
+    if (report != NULL) fprintf(report, "# timing leaks, cpu features %#x\n", crypto_cpu_features() & 0x7fffffffu);
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (CRYPTO_timing_leak_test(report, tests[i].name, tests[i].prepare, tests[i].fn, st, tests[i].input_len,
+                                    tests[i].measurements) != 1) {
+            leaks++;
+        }
+    }
+    bench_state_free(st);
+    return leaks;
+}
+
+
+/*============================================================================
+ * SSL SESSIONS
+ *==========================================================================*/
+/* One DER SEQUENCE each, all the stand-in handshake reads of a certificate;
+ * the client trusts the first one only */
+static const char ssl_check_trusted_pem[] = "-----BEGIN CERTIFICATE-----\nMAMCAQE=\n-----END CERTIFICATE-----\n";
+static const char ssl_check_untrusted_pem[] = "-----BEGIN CERTIFICATE-----\nMAMCAQI=\n-----END CERTIFICATE-----\n";
+
+typedef struct ssl_check_state {
+    char dir[64];
+    char trusted[96], untrusted[96];
+    char host_buf[64];
+    const char *cert;                   /* the server's */
+    const char *host;
+    long options;                       /* the client's */
+    unsigned int serial;
+    int fd;                             /* the server's end */
+    int reused;
+} ssl_check_state;
+
+static int ssl_check_write(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    int ok;
+
+    if (f == NULL) return 0;
+    ok = fputs(text, f) >= 0;
+    return fclose(f) == 0 && ok;
+}
+
+static void *ssl_check_server(void *arg) {
+    ssl_check_state *st = (ssl_check_state *)arg;
+    SSL_CTX *ctx = SSL_CTX_new(SSLv23_server_method());
+    SSL *s = NULL;
+
+    if (ctx != NULL && SSL_CTX_use_certificate_file(ctx, st->cert, SSL_FILETYPE_PEM) == 1) s = SSL_new(ctx);
+    if (s == NULL || SSL_set_fd(s, st->fd) != 1 || SSL_accept(s) != 1) shutdown(st->fd, SHUT_RDWR);
+    SSL_free(s);
+    SSL_CTX_free(ctx);
+    return NULL;
+}
+
+/* One connection over a socketpair() to a server thread, each side with a
+ * context made for it and freed after, as the examples do; 1 when the
+ * client's handshake succeeds, with st->reused set */
+static int ssl_check_connect(void *arg) {
+    ssl_check_state *st = (ssl_check_state *)arg;
+    SSL_verify_cb cb;
+    SSL_CTX *ctx;
+    SSL *s = NULL;
+    pthread_t server;
+    int sv[2], ok = 0;
+
+    st->reused = 0;
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) return 0;
+    st->fd = sv[1];
+    if (pthread_create(&server, NULL, ssl_check_server, st) != 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return 0;
+    }
+    memset(&cb, 0, sizeof(cb));
+    ctx = SSL_CTX_new(SSLv23_client_method());
+    if (ctx != NULL && SSL_CTX_load_verify_locations(ctx, st->trusted, NULL) == 1) {
+        SSL_CTX_set_options(ctx, st->options);
+        SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, cb);
+        s = SSL_new(ctx);
+    }
+    if (s != NULL && SSL_set_fd(s, sv[0]) == 1 && SSL_set_tlsext_host_name(s, st->host) == 1 &&
+        SSL_connect(s) == 1) {
+        st->reused = SSL_session_reused(s);
+        ok = 1;
+    } else {
+        shutdown(sv[0], SHUT_RDWR);     /* the server stops waiting */
+    }
+    pthread_join(server, NULL);
+    SSL_free(s);
+    SSL_CTX_free(ctx);
+    close(sv[0]);
+    close(sv[1]);
+    return ok;
+}
+
+/* A new host name per call, which has no session to resume */
+static int ssl_bench_full(void *arg) {
+    ssl_check_state *st = (ssl_check_state *)arg;
+
+    snprintf(st->host_buf, sizeof(st->host_buf), "full-%u.example", ++st->serial);
+    st->host = st->host_buf;
+    return ssl_check_connect(st) && !st->reused;
+}
+
+static int ssl_bench_resumed(void *arg) {
+    ssl_check_state *st = (ssl_check_state *)arg;
+
+    st->host = "a.example";
+    return ssl_check_connect(st) && st->reused;
+}
+
+static int ssl_check(FILE *report, const char *name, int ok) {
+    if (report != NULL) fprintf(report, "%-44s %s\n", name, ok ? "ok" : "FAILED");
+    return !ok;
+}
+
+int CRYPTO_ssl_session_suite(FILE *report) {
+    ssl_check_state *st = (ssl_check_state *)calloc(1, sizeof(ssl_check_state));
+    int failed = 0;
+
+    if (st == NULL) return -1;
+    strcpy(st->dir, "/tmp/crypto_ssl_XXXXXX");
+    if (mkdtemp(st->dir) == NULL) {
+        free(st);
+        return -1;
+    }
+    snprintf(st->trusted, sizeof(st->trusted), "%s/trusted.pem", st->dir);
+    snprintf(st->untrusted, sizeof(st->untrusted), "%s/untrusted.pem", st->dir);
+    if (!ssl_check_write(st->trusted, ssl_check_trusted_pem) ||
+        !ssl_check_write(st->untrusted, ssl_check_untrusted_pem)) {
+        failed = -1;
+        goto out;
+    }
+    if (report != NULL) fprintf(report, "# ssl sessions, stand-in handshakes over a socketpair\n");
+
+    st->cert = st->trusted;
+    st->host = "a.example";
+    failed += ssl_check(report, "first connect to a host: full handshake", ssl_check_connect(st) && !st->reused);
+    failed += ssl_check(report, "second connect to the host: resumed", ssl_check_connect(st) && st->reused);
+    st->host = "b.example";
+    failed += ssl_check(report, "another host: full handshake", ssl_check_connect(st) && !st->reused);
+    st->host = "a.example";
+    st->options = SSL_OP_NO_SSLv2;
+    failed += ssl_check(report, "same host, other options: full handshake", ssl_check_connect(st) && !st->reused);
+    st->options = 0;
+
+    /* Resumed first: the full handshakes' host names evict a.example */
+    failed += !CRYPTO_bench(report, "ssl handshake, resumed", ssl_bench_resumed, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "ssl handshake, full", ssl_bench_full, st, 0, BENCH_SECONDS);
+
+    st->cert = st->untrusted;
+    st->host = "a.example";
+    failed += ssl_check(report, "untrusted certificate: rejected", !ssl_check_connect(st));
+
+out:
+    unlink(st->trusted);
+    unlink(st->untrusted);
+    rmdir(st->dir);
+    free(st);
+    return failed;
+}
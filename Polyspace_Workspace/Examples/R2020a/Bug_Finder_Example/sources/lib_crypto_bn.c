@@ -0,0 +1,727 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * Fixed-size unsigned big numbers: the BIGNUM entry points, limb vector
+ * primitives and Montgomery arithmetic for the RSA engine.
+ *
+ * Everything that may touch a private value runs in time that depends on the
+ * limb count only: no branch and no memory index is derived from a secret.
+ * Modular exponentiation uses a fixed 5-bit window; the table entry for each
+ * window is gathered by reading the whole table under a mask. Pairs of
+ * exponentiations of equal size go through AVX-512 IFMA when the CPU has it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CRYPTO_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+typedef unsigned __int128 bn_dlimb;
+
+enum {
+    BN_EXP_WINDOW = 5,
+    BN_EXP_TABLE  = 1 << BN_EXP_WINDOW
+};
+
+
+/*============================================================================
+ * LIMB VECTORS
+ *==========================================================================*/
+uint64_t crypto_limbs_add(uint64_t *r, const uint64_t *a, const uint64_t *b, size_t k) {
+    uint64_t c = 0;
+    size_t i;
+
+    for (i = 0; i < k; i++) {
+        bn_dlimb t = (bn_dlimb)a[i] + b[i] + c;
+        r[i] = (uint64_t)t;
+        c = (uint64_t)(t >> 64);
+    }
+    return c;
+}
+
+uint64_t crypto_limbs_sub(uint64_t *r, const uint64_t *a, const uint64_t *b, size_t k) {
+    uint64_t borrow = 0;
+    size_t i;
+
+    for (i = 0; i < k; i++) {
+        bn_dlimb t = (bn_dlimb)a[i] - b[i] - borrow;
+        r[i] = (uint64_t)t;
+        borrow = (uint64_t)(t >> 64) & 1;
+    }
+    return borrow;
+}
+
+/* r[0..ka+kb-1] = a * b; r must not overlap a or b */
+void crypto_limbs_mul(uint64_t *r, const uint64_t *a, size_t ka, const uint64_t *b, size_t kb) {
+    size_t i, j;
+
+    memset(r, 0, (ka + kb) * sizeof(uint64_t));
+    for (i = 0; i < kb; i++) {
+        uint64_t c = 0;
+        for (j = 0; j < ka; j++) {
+            bn_dlimb t = (bn_dlimb)a[j] * b[i] + r[i + j] + c;
+            r[i + j] = (uint64_t)t;
+            c = (uint64_t)(t >> 64);
+        }
+        r[i + ka] = c;
+    }
+}
+
+/* r = a * w over k limbs; returns the carry limb. r may equal a */
+uint64_t crypto_limbs_mul_word(uint64_t *r, const uint64_t *a, uint64_t w, size_t k) {
+    uint64_t c = 0;
+    size_t i;
+
+    for (i = 0; i < k; i++) {
+        bn_dlimb t = (bn_dlimb)a[i] * w + c;
+        r[i] = (uint64_t)t;
+        c = (uint64_t)(t >> 64);
+    }
+    return c;
+}
+
+/* q = a / w (q may be NULL or equal a); returns a mod w */
+uint64_t crypto_limbs_div_word(uint64_t *q, const uint64_t *a, uint64_t w, size_t k) {
+    uint64_t rem = 0;
+    size_t i;
+
+    for (i = k; i-- > 0;) {
+        bn_dlimb t = ((bn_dlimb)rem << 64) | a[i];
+        if (q != NULL) q[i] = (uint64_t)(t / w);
+        rem = (uint64_t)(t % w);
+    }
+    return rem;
+}
+
+/* r = mask ? a : b, mask being all ones or zero */
+void crypto_limbs_select(uint64_t *r, const uint64_t *a, const uint64_t *b, uint64_t mask, size_t k) {
+    size_t i;
+
+    for (i = 0; i < k; i++) {
+        r[i] = (a[i] & mask) | (b[i] & ~mask);
+    }
+}
+
+uint64_t crypto_limbs_lt(const uint64_t *a, const uint64_t *b, size_t k) {
+    uint64_t borrow = 0;
+    size_t i;
+
+    for (i = 0; i < k; i++) {
+        bn_dlimb t = (bn_dlimb)a[i] - b[i] - borrow;
+        borrow = (uint64_t)(t >> 64) & 1;
+    }
+    return 0 - borrow;
+}
+
+size_t crypto_limbs_bits(const uint64_t *a, size_t k) {
+    while (k > 0 && a[k - 1] == 0) k--;
+    if (k == 0) return 0;
+    return 64 * k - (size_t)__builtin_clzll(a[k - 1]);
+}
+
+/* Big-endian bytes to k limbs; bytes beyond 8k are ignored */
+void crypto_limbs_from_bytes(uint64_t *r, size_t k, const unsigned char *in, size_t len) {
+    size_t i;
+
+    memset(r, 0, k * sizeof(uint64_t));
+    for (i = 0; i < len && i < 8 * k; i++) {
+        r[i / 8] |= (uint64_t)in[len - 1 - i] << (8 * (i % 8));
+    }
+}
+
+/* k limbs to exactly len big-endian bytes, left-padded with zeros */
+void crypto_limbs_to_bytes(unsigned char *out, size_t len, const uint64_t *a, size_t k) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        out[len - 1 - i] = i < 8 * k ? (unsigned char)(a[i / 8] >> (8 * (i % 8))) : 0;
+    }
+}
+
+static int limbs_is_zero(const uint64_t *a, size_t k) {
+    uint64_t acc = 0;
+    size_t i;
+
+    for (i = 0; i < k; i++) acc |= a[i];
+    return acc == 0;
+}
+
+/* a = a / 2, taking top as the bit shifted in at the top */
+static void limbs_half(uint64_t *a, size_t k, uint64_t top) {
+    size_t i;
+
+    for (i = 0; i + 1 < k; i++) {
+        a[i] = (a[i] >> 1) | (a[i + 1] << 63);
+    }
+    a[k - 1] = (a[k - 1] >> 1) | (top << 63);
+}
+
+/* x = x / 2 mod n for odd n */
+static void limbs_half_mod(uint64_t *x, const uint64_t *n, size_t k) {
+    uint64_t t[BN_MAX_LIMBS];
+    uint64_t odd = x[0] & 1;
+    uint64_t c = crypto_limbs_add(t, x, n, k);
+
+    crypto_limbs_select(x, t, x, 0 - odd, k);
+    limbs_half(x, k, c & odd);
+}
+
+/* x = x - y mod n for x, y < n */
+static void limbs_sub_mod(uint64_t *x, const uint64_t *y, const uint64_t *n, size_t k) {
+    uint64_t t[BN_MAX_LIMBS];
+    uint64_t borrow = crypto_limbs_sub(x, x, y, k);
+
+    crypto_limbs_add(t, x, n, k);
+    crypto_limbs_select(x, t, x, 0 - borrow, k);
+}
+
+/* Binary extended Euclid. The blinding code only feeds it values masked by a
+ * fresh random factor, so its variable running time reveals nothing. */
+int crypto_limbs_mod_inverse(uint64_t *r, const uint64_t *a, const uint64_t *n, size_t k) {
+    uint64_t u[BN_MAX_LIMBS], v[BN_MAX_LIMBS];
+    uint64_t x1[BN_MAX_LIMBS], x2[BN_MAX_LIMBS];
+    int ok = 0;
+
+    if (k == 0 || k > BN_MAX_LIMBS || (n[0] & 1) == 0) return 0;
+    memcpy(u, a, k * sizeof(uint64_t));
+    memcpy(v, n, k * sizeof(uint64_t));
+    memset(x1, 0, k * sizeof(uint64_t));
+    memset(x2, 0, k * sizeof(uint64_t));
+    x1[0] = 1;
+
+    while (!limbs_is_zero(u, k)) {
+        while ((u[0] & 1) == 0) {
+            limbs_half(u, k, 0);
+            limbs_half_mod(x1, n, k);
+        }
+        while ((v[0] & 1) == 0) {
+            limbs_half(v, k, 0);
+            limbs_half_mod(x2, n, k);
+        }
+        if (crypto_limbs_lt(u, v, k)) {
+            crypto_limbs_sub(v, v, u, k);
+            limbs_sub_mod(x2, x1, n, k);
+        } else {
+            crypto_limbs_sub(u, u, v, k);
+            limbs_sub_mod(x1, x2, n, k);
+        }
+    }
+    /* u reached zero: v holds gcd(a, n) and x2 * a = v mod n */
+    if (v[0] == 1 && crypto_limbs_bits(v, k) == 1) {
+        memcpy(r, x2, k * sizeof(uint64_t));
+        ok = 1;
+    }
+    crypto_cleanse(u, sizeof(u));
+    crypto_cleanse(v, sizeof(v));
+    crypto_cleanse(x1, sizeof(x1));
+    crypto_cleanse(x2, sizeof(x2));
+    return ok;
+}
+
+
+/*============================================================================
+ * MONTGOMERY ARITHMETIC
+ *==========================================================================*/
+/* r = t - n if that does not borrow (counting the extra top limb), else t */
+static void mont_final_sub(const crypto_mont *m, uint64_t *r, const uint64_t *t, uint64_t top) {
+    uint64_t s[BN_MAX_LIMBS];
+    uint64_t borrow = crypto_limbs_sub(s, t, m->n, m->k);
+
+    /* keep t only when top == 0 and the subtraction borrowed */
+    crypto_limbs_select(r, t, s, (0 - borrow) & ~(0 - top), m->k);
+}
+
+/* Finely integrated operand scanning: each pass over the limbs adds both
+ * a * b[i] and q * n, so t makes one trip through memory per limb.
+ * r = a * b / R mod n */
+void crypto_mont_mul(const crypto_mont *m, uint64_t *r, const uint64_t *a, const uint64_t *b) {
+    uint64_t t[BN_MAX_LIMBS + 1];
+    const size_t k = m->k;
+    const uint64_t *n = m->n;
+    size_t i, j;
+
+    memset(t, 0, (k + 1) * sizeof(uint64_t));
+    for (i = 0; i < k; i++) {
+        const uint64_t bi = b[i];
+        bn_dlimb s = (bn_dlimb)a[0] * bi + t[0];
+        uint64_t c1 = (uint64_t)(s >> 64);
+        uint64_t q = (uint64_t)s * m->n0;
+        bn_dlimb u = (bn_dlimb)q * n[0] + (uint64_t)s;
+        uint64_t c2 = (uint64_t)(u >> 64);
+
+#pragma GCC unroll 4
+        for (j = 1; j < k; j++) {
+            s = (bn_dlimb)a[j] * bi + t[j] + c1;
+            c1 = (uint64_t)(s >> 64);
+            u = (bn_dlimb)q * n[j] + (uint64_t)s + c2;
+            c2 = (uint64_t)(u >> 64);
+            t[j - 1] = (uint64_t)u;
+        }
+        s = (bn_dlimb)t[k] + c1 + c2;
+        t[k - 1] = (uint64_t)s;
+        t[k] = (uint64_t)(s >> 64);
+    }
+    mont_final_sub(m, r, t, t[k]);
+}
+
+/* Montgomery reduction of a double-width value: r = t / R mod n */
+static void mont_redc(const crypto_mont *m, uint64_t *r, const uint64_t *t, size_t tk) {
+    uint64_t x[2 * BN_MAX_LIMBS + 1];
+    const size_t k = m->k;
+    uint64_t top = 0;
+    size_t i, j;
+
+    memset(x, 0, sizeof(x));
+    memcpy(x, t, tk * sizeof(uint64_t));
+    for (i = 0; i < k; i++) {
+        uint64_t q = x[i] * m->n0;
+        uint64_t c = 0;
+        bn_dlimb s;
+
+        for (j = 0; j < k; j++) {
+            s = (bn_dlimb)q * m->n[j] + x[i + j] + c;
+            x[i + j] = (uint64_t)s;
+            c = (uint64_t)(s >> 64);
+        }
+        /* the carry enters at limb i + k; the bit above it is kept in top */
+        s = (bn_dlimb)x[i + k] + c + top;
+        x[i + k] = (uint64_t)s;
+        top = (uint64_t)(s >> 64);
+    }
+    mont_final_sub(m, r, x + k, top);
+    crypto_cleanse(x, sizeof(x));
+}
+
+void crypto_mont_reduce(const crypto_mont *m, uint64_t *r, const uint64_t *t, size_t tk) {
+    uint64_t x[BN_MAX_LIMBS];
+
+    mont_redc(m, x, t, tk);
+    crypto_mont_mul(m, r, x, m->rr);
+    crypto_cleanse(x, sizeof(x));
+}
+
+void crypto_mont_init(crypto_mont *m, const uint64_t *n, size_t k) {
+    uint64_t x[BN_MAX_LIMBS], t[BN_MAX_LIMBS];
+    uint64_t inv = n[0];
+    size_t i;
+
+    memset(m, 0, sizeof(*m));
+    m->k = k;
+    memcpy(m->n, n, k * sizeof(uint64_t));
+
+    /* Newton iteration doubles the correct low bits: 3, 6, ... 96 */
+    for (i = 0; i < 5; i++) inv *= 2 - n[0] * inv;
+    m->n0 = 0 - inv;
+
+    /* R^2 mod n by 128k modular doublings of 1, without branching on n
+     * (the primes of a private key come through here) */
+    memset(x, 0, sizeof(x));
+    x[0] = 1;
+    for (i = 0; i < 128 * k; i++) {
+        uint64_t carry = crypto_limbs_add(x, x, x, k);
+        uint64_t borrow = crypto_limbs_sub(t, x, n, k);
+        crypto_limbs_select(x, t, x, (0 - carry) | (0 - (borrow ^ 1)), k);
+    }
+    memcpy(m->rr, x, k * sizeof(uint64_t));
+    crypto_mont_mul(m, m->rrr, m->rr, m->rr);
+    crypto_cleanse(x, sizeof(x));
+    crypto_cleanse(t, sizeof(t));
+}
+
+static unsigned int exp_window(const uint64_t *e, size_t ebits, size_t pos) {
+    unsigned int w = 0;
+    int b;
+
+    for (b = BN_EXP_WINDOW - 1; b >= 0; b--) {
+        size_t bit = pos + (size_t)b;
+        w <<= 1;
+        if (bit < ebits) w |= (unsigned int)(e[bit / 64] >> (bit % 64)) & 1;
+    }
+    return w;
+}
+
+/* r = table[w], reading every entry */
+static void exp_gather(uint64_t *r, const uint64_t *table, unsigned int w, size_t k) {
+    unsigned int i;
+    size_t j;
+
+    memset(r, 0, k * sizeof(uint64_t));
+    for (i = 0; i < BN_EXP_TABLE; i++) {
+        uint64_t mask = 0 - (((uint64_t)(i ^ w) - 1) >> 63);
+        for (j = 0; j < k; j++) r[j] |= table[i * k + j] & mask;
+    }
+}
+
+void crypto_mont_exp(const crypto_mont *m, uint64_t *r, const uint64_t *a, const uint64_t *e, size_t ebits) {
+    uint64_t table[BN_EXP_TABLE * BN_MAX_LIMBS];
+    uint64_t acc[BN_MAX_LIMBS], x[BN_MAX_LIMBS];
+    const size_t k = m->k;
+    size_t nwin = (ebits + BN_EXP_WINDOW - 1) / BN_EXP_WINDOW;
+    size_t i;
+    int s;
+
+    /* table[i] = a^i in Montgomery form; table[0] = R mod n */
+    memset(x, 0, sizeof(x));
+    x[0] = 1;
+    crypto_mont_mul(m, table, m->rr, x);
+    crypto_mont_mul(m, table + k, a, m->rr);
+    for (i = 2; i < BN_EXP_TABLE; i++) {
+        crypto_mont_mul(m, table + i * k, table + (i - 1) * k, table + k);
+    }
+
+    memcpy(acc, table, k * sizeof(uint64_t));
+    for (i = nwin; i-- > 0;) {
+        for (s = 0; s < BN_EXP_WINDOW; s++) crypto_mont_mul(m, acc, acc, acc);
+        exp_gather(x, table, exp_window(e, ebits, i * BN_EXP_WINDOW), k);
+        crypto_mont_mul(m, acc, acc, x);
+    }
+
+    memset(x, 0, sizeof(x));
+    x[0] = 1;
+    crypto_mont_mul(m, r, acc, x);
+    crypto_cleanse(table, sizeof(table));
+    crypto_cleanse(acc, sizeof(acc));
+}
+
+void crypto_mont_exp_public(const crypto_mont *m, uint64_t *r, const uint64_t *a, const uint64_t *e, size_t ek) {
+    uint64_t base[BN_MAX_LIMBS], acc[BN_MAX_LIMBS], one[BN_MAX_LIMBS];
+    size_t bits = crypto_limbs_bits(e, ek);
+    size_t i;
+
+    memset(one, 0, sizeof(one));
+    one[0] = 1;
+    crypto_mont_mul(m, base, a, m->rr);
+    crypto_mont_mul(m, acc, m->rr, one);
+    for (i = bits; i-- > 0;) {
+        crypto_mont_mul(m, acc, acc, acc);
+        if ((e[i / 64] >> (i % 64)) & 1) crypto_mont_mul(m, acc, acc, base);
+    }
+    crypto_mont_mul(m, r, acc, one);
+}
+
+
+/*============================================================================
+ * AVX-512 IFMA
+ *==========================================================================*/
+/* Two independent exponentiations (the CRT halves of an RSA private key)
+ * run in lockstep on 52-bit limbs held in 64-bit lanes: vpmadd52luq and
+ * vpmadd52huq add the low and high halves of 52x52-bit products, so a lane
+ * can absorb dozens of partial products before carries must be propagated.
+ * Interleaving the two moduli hides the serial dependency of each Montgomery
+ * step through the lowest lane.
+ *
+ * The multiplication is "almost" Montgomery: with R = 2^(52 kl) > 4n,
+ * inputs below 2n give an output below 2n, and only the final result is
+ * fully reduced. */
+#ifdef CRYPTO_HAVE_X86_SIMD
+
+#define IFMA_TARGET __attribute__((target("avx512f,avx512ifma")))
+#define BN52_MASK 0xfffffffffffffULL
+
+enum {
+    BN52_MAX_VECS  = 5,                 /* 40 limbs: primes of up to 2048 bits */
+    BN52_MAX_LIMBS = 8 * BN52_MAX_VECS
+};
+
+/* 64-bit limbs to 52-bit limbs, kl of them */
+static void bn52_from_limbs(uint64_t *r, size_t kl, const uint64_t *a, size_t k) {
+    uint64_t t[BN_MAX_LIMBS + 1];
+    size_t j;
+
+    memset(t, 0, sizeof(t));
+    memcpy(t, a, k * sizeof(uint64_t));
+    memset(r, 0, BN52_MAX_LIMBS * sizeof(uint64_t));
+    for (j = 0; j < kl; j++) {
+        size_t bit = 52 * j;
+        size_t off = bit % 64;
+        uint64_t v = t[bit / 64] >> off;
+        if (off > 12 && bit / 64 + 1 <= BN_MAX_LIMBS) v |= t[bit / 64 + 1] << (64 - off);
+        r[j] = v & BN52_MASK;
+    }
+    crypto_cleanse(t, sizeof(t));
+}
+
+static void bn52_to_limbs(uint64_t *r, size_t k, const uint64_t *a, size_t kl) {
+    size_t j;
+
+    memset(r, 0, k * sizeof(uint64_t));
+    for (j = 0; j < kl; j++) {
+        size_t bit = 52 * j;
+        size_t off = bit % 64;
+        if (bit / 64 < k) r[bit / 64] |= a[j] << off;
+        if (off > 12 && bit / 64 + 1 < k) r[bit / 64 + 1] |= a[j] >> (64 - off);
+    }
+}
+
+/* r1 = a1 b1 / R mod n1 and r2 = a2 b2 / R mod n2, both below 2n */
+static inline __attribute__((always_inline)) IFMA_TARGET
+void amm52x2(uint64_t *r1, const uint64_t *a1, const uint64_t *b1, const uint64_t *n1, uint64_t k1,
+             uint64_t *r2, const uint64_t *a2, const uint64_t *b2, const uint64_t *n2, uint64_t k2,
+             size_t kl, const int nv) {
+    _Alignas(64) uint64_t t1[BN52_MAX_LIMBS], t2[BN52_MAX_LIMBS];
+    __m512i acc1[BN52_MAX_VECS], acc2[BN52_MAX_VECS];
+    const __m512i zero = _mm512_setzero_si512();
+    uint64_t c1 = 0, c2 = 0;
+    size_t i, j;
+    int v;
+
+    #pragma GCC unroll 8
+
+    for (v = 0; v < nv; v++) acc1[v] = acc2[v] = zero;
+    for (i = 0; i < kl; i++) {
+        __m512i x1 = _mm512_set1_epi64((long long)a1[i]);
+        __m512i x2 = _mm512_set1_epi64((long long)a2[i]);
+        __m512i q1, q2, lo1, lo2;
+
+        #pragma GCC unroll 8
+
+        for (v = 0; v < nv; v++) {
+            acc1[v] = _mm512_madd52lo_epu64(acc1[v], x1, _mm512_loadu_si512(b1 + 8 * v));
+            acc2[v] = _mm512_madd52lo_epu64(acc2[v], x2, _mm512_loadu_si512(b2 + 8 * v));
+        }
+        q1 = _mm512_set1_epi64((long long)(((uint64_t)_mm_cvtsi128_si64(_mm512_castsi512_si128(acc1[0])) * k1) & BN52_MASK));
+        q2 = _mm512_set1_epi64((long long)(((uint64_t)_mm_cvtsi128_si64(_mm512_castsi512_si128(acc2[0])) * k2) & BN52_MASK));
+        #pragma GCC unroll 8
+        for (v = 0; v < nv; v++) {
+            acc1[v] = _mm512_madd52lo_epu64(acc1[v], q1, _mm512_loadu_si512(n1 + 8 * v));
+            acc2[v] = _mm512_madd52lo_epu64(acc2[v], q2, _mm512_loadu_si512(n2 + 8 * v));
+        }
+
+        /* lane 0 is now a multiple of 2^52: drop it and carry its top bits */
+        lo1 = _mm512_maskz_srli_epi64(1, acc1[0], 52);
+        lo2 = _mm512_maskz_srli_epi64(1, acc2[0], 52);
+        #pragma GCC unroll 8
+        for (v = 0; v < nv - 1; v++) {
+            acc1[v] = _mm512_alignr_epi64(acc1[v + 1], acc1[v], 1);
+            acc2[v] = _mm512_alignr_epi64(acc2[v + 1], acc2[v], 1);
+        }
+        acc1[nv - 1] = _mm512_alignr_epi64(zero, acc1[nv - 1], 1);
+        acc2[nv - 1] = _mm512_alignr_epi64(zero, acc2[nv - 1], 1);
+        acc1[0] = _mm512_add_epi64(acc1[0], lo1);
+        acc2[0] = _mm512_add_epi64(acc2[0], lo2);
+
+        #pragma GCC unroll 8
+
+        for (v = 0; v < nv; v++) {
+            acc1[v] = _mm512_madd52hi_epu64(acc1[v], x1, _mm512_loadu_si512(b1 + 8 * v));
+            acc1[v] = _mm512_madd52hi_epu64(acc1[v], q1, _mm512_loadu_si512(n1 + 8 * v));
+            acc2[v] = _mm512_madd52hi_epu64(acc2[v], x2, _mm512_loadu_si512(b2 + 8 * v));
+            acc2[v] = _mm512_madd52hi_epu64(acc2[v], q2, _mm512_loadu_si512(n2 + 8 * v));
+        }
+    }
+
+    #pragma GCC unroll 8
+
+    for (v = 0; v < nv; v++) {
+        _mm512_store_si512(t1 + 8 * v, acc1[v]);
+        _mm512_store_si512(t2 + 8 * v, acc2[v]);
+    }
+    for (j = 0; j < (size_t)(8 * nv); j++) {
+        uint64_t s1 = t1[j] + c1;
+        uint64_t s2 = t2[j] + c2;
+        r1[j] = s1 & BN52_MASK;
+        r2[j] = s2 & BN52_MASK;
+        c1 = s1 >> 52;
+        c2 = s2 >> 52;
+    }
+}
+
+#define BN52_AMM_NV(nv)                                                       \
+    IFMA_TARGET static void amm52x2_##nv(uint64_t *r1, const uint64_t *a1, const uint64_t *b1, \
+                                         const uint64_t *n1, uint64_t k1,     \
+                                         uint64_t *r2, const uint64_t *a2, const uint64_t *b2, \
+                                         const uint64_t *n2, uint64_t k2, size_t kl) { \
+        amm52x2(r1, a1, b1, n1, k1, r2, a2, b2, n2, k2, kl, nv);              \
+    }
+
+BN52_AMM_NV(3)
+BN52_AMM_NV(4)
+BN52_AMM_NV(5)
+
+typedef void (*bn52_amm_fn)(uint64_t *, const uint64_t *, const uint64_t *, const uint64_t *, uint64_t,
+                            uint64_t *, const uint64_t *, const uint64_t *, const uint64_t *, uint64_t, size_t);
+
+/* r1 = t1[w1] and r2 = t2[w2], reading every entry */
+IFMA_TARGET static void bn52_gather2(uint64_t *r1, uint64_t *r2, const uint64_t *t1, const uint64_t *t2,
+                                     unsigned int w1, unsigned int w2, int nv) {
+    const __m512i want1 = _mm512_set1_epi64(w1);
+    const __m512i want2 = _mm512_set1_epi64(w2);
+    unsigned int i;
+    int v;
+
+    for (v = 0; v < nv; v++) {
+        __m512i x1 = _mm512_setzero_si512();
+        __m512i x2 = _mm512_setzero_si512();
+        for (i = 0; i < BN_EXP_TABLE; i++) {
+            const __m512i idx = _mm512_set1_epi64(i);
+            __mmask8 hit1 = _mm512_cmpeq_epi64_mask(idx, want1);
+            __mmask8 hit2 = _mm512_cmpeq_epi64_mask(idx, want2);
+            x1 = _mm512_mask_mov_epi64(x1, hit1, _mm512_load_si512(t1 + i * BN52_MAX_LIMBS + 8 * v));
+            x2 = _mm512_mask_mov_epi64(x2, hit2, _mm512_load_si512(t2 + i * BN52_MAX_LIMBS + 8 * v));
+        }
+        _mm512_store_si512(r1 + 8 * v, x1);
+        _mm512_store_si512(r2 + 8 * v, x2);
+    }
+}
+
+/* Montgomery constants of m in 52-bit limbs: n and R52^2 mod n */
+static void bn52_setup(const crypto_mont *m, uint64_t *n52, uint64_t *rr52, size_t kl) {
+    uint64_t t[BN_MAX_LIMBS], x[BN_MAX_LIMBS];
+    size_t d = 104 * kl - 128 * m->k;           /* R52^2 = R^3 2^d / R */
+
+    memset(t, 0, sizeof(t));
+    t[d / 64] = (uint64_t)1 << (d % 64);
+    crypto_mont_mul(m, x, m->rrr, t);
+    bn52_from_limbs(n52, kl, m->n, m->k);
+    bn52_from_limbs(rr52, kl, x, m->k);
+}
+
+/* Final step: below 2n to below n, then back to 64-bit limbs */
+static void bn52_output(const crypto_mont *m, uint64_t *r, const uint64_t *a52, size_t kl) {
+    uint64_t x[BN_MAX_LIMBS + 1], s[BN_MAX_LIMBS];
+    uint64_t borrow;
+
+    bn52_to_limbs(x, m->k + 1, a52, kl);
+    borrow = crypto_limbs_sub(s, x, m->n, m->k);
+    borrow = (borrow > x[m->k]) ? 1 : 0;
+    crypto_limbs_select(r, x, s, 0 - borrow, m->k);
+}
+
+static void mont_exp2_ifma(const crypto_mont *m1, uint64_t *r1, const uint64_t *a1, const uint64_t *e1,
+                           const crypto_mont *m2, uint64_t *r2, const uint64_t *a2, const uint64_t *e2,
+                           size_t ebits, size_t kl, int nv) {
+    static const bn52_amm_fn amm_by_nv[BN52_MAX_VECS + 1] = { NULL, NULL, NULL, amm52x2_3, amm52x2_4, amm52x2_5 };
+    const bn52_amm_fn amm = amm_by_nv[nv];
+    _Alignas(64) uint64_t table1[BN_EXP_TABLE * BN52_MAX_LIMBS], table2[BN_EXP_TABLE * BN52_MAX_LIMBS];
+    _Alignas(64) uint64_t n1[BN52_MAX_LIMBS], n2[BN52_MAX_LIMBS], rr1[BN52_MAX_LIMBS], rr2[BN52_MAX_LIMBS];
+    _Alignas(64) uint64_t x1[BN52_MAX_LIMBS], x2[BN52_MAX_LIMBS], acc1[BN52_MAX_LIMBS], acc2[BN52_MAX_LIMBS];
+    _Alignas(64) uint64_t one[BN52_MAX_LIMBS];
+    const uint64_t k1 = m1->n0 & BN52_MASK, k2 = m2->n0 & BN52_MASK;
+    size_t nwin = (ebits + BN_EXP_WINDOW - 1) / BN_EXP_WINDOW;
+    size_t i;
+    int s;
+
+    bn52_setup(m1, n1, rr1, kl);
+    bn52_setup(m2, n2, rr2, kl);
+    memset(one, 0, sizeof(one));
+    one[0] = 1;
+
+    /* table[0] = R, table[1] = a R, table[i] = a^i R */
+    bn52_from_limbs(x1, kl, a1, m1->k);
+    bn52_from_limbs(x2, kl, a2, m2->k);
+    amm(table1, one, rr1, n1, k1, table2, one, rr2, n2, k2, kl);
+    amm(table1 + BN52_MAX_LIMBS, x1, rr1, n1, k1, table2 + BN52_MAX_LIMBS, x2, rr2, n2, k2, kl);
+    for (i = 2; i < BN_EXP_TABLE; i++) {
+        amm(table1 + i * BN52_MAX_LIMBS, table1 + (i - 1) * BN52_MAX_LIMBS, table1 + BN52_MAX_LIMBS, n1, k1,
+            table2 + i * BN52_MAX_LIMBS, table2 + (i - 1) * BN52_MAX_LIMBS, table2 + BN52_MAX_LIMBS, n2, k2, kl);
+    }
+
+    memcpy(acc1, table1, sizeof(acc1));
+    memcpy(acc2, table2, sizeof(acc2));
+    for (i = nwin; i-- > 0;) {
+        for (s = 0; s < BN_EXP_WINDOW; s++) amm(acc1, acc1, acc1, n1, k1, acc2, acc2, acc2, n2, k2, kl);
+        bn52_gather2(x1, x2, table1, table2, exp_window(e1, ebits, i * BN_EXP_WINDOW),
+                     exp_window(e2, ebits, i * BN_EXP_WINDOW), nv);
+        amm(acc1, acc1, x1, n1, k1, acc2, acc2, x2, n2, k2, kl);
+    }
+    amm(acc1, acc1, one, n1, k1, acc2, acc2, one, n2, k2, kl);
+
+    bn52_output(m1, r1, acc1, kl);
+    bn52_output(m2, r2, acc2, kl);
+    crypto_cleanse(table1, sizeof(table1));
+    crypto_cleanse(table2, sizeof(table2));
+    crypto_cleanse(acc1, sizeof(acc1));
+    crypto_cleanse(acc2, sizeof(acc2));
+    crypto_cleanse(x1, sizeof(x1));
+    crypto_cleanse(x2, sizeof(x2));
+}
+
+#endif /* CRYPTO_HAVE_X86_SIMD */
+
+void crypto_mont_exp2(const crypto_mont *m1, uint64_t *r1, const uint64_t *a1, const uint64_t *e1,
+                      const crypto_mont *m2, uint64_t *r2, const uint64_t *a2, const uint64_t *e2, size_t ebits) {
+#ifdef CRYPTO_HAVE_X86_SIMD
+    if (m1->k == m2->k && crypto_cpu_has(CRYPTO_CPU_AVX512F | CRYPTO_CPU_AVX512IFMA)) {
+        /* 52 kl bits must cover 4n */
+        size_t kl = (64 * m1->k + 2 + 51) / 52;
+        int nv = (int)((kl + 7) / 8);
+        if (nv >= 3 && nv <= BN52_MAX_VECS) {
+            mont_exp2_ifma(m1, r1, a1, e1, m2, r2, a2, e2, ebits, kl, nv);
+            return;
+        }
+    }
+#endif
+    crypto_mont_exp(m1, r1, a1, e1, ebits);
+    crypto_mont_exp(m2, r2, a2, e2, ebits);
+}
+
+
+/*============================================================================
+ * BIGNUM
+ *==========================================================================*/
+static void bn_fix_top(BIGNUM *a) {
+    int top = BN_MAX_LIMBS;
+
+    while (top > 0 && a->d[top - 1] == 0) top--;
+    a->top = top;
+}
+
+void crypto_bn_set_limbs(BIGNUM *a, const uint64_t *v, size_t k) {
+    memset(a->d, 0, sizeof(a->d));
+    memcpy(a->d, v, k * sizeof(uint64_t));
+    bn_fix_top(a);
+}
+
+BIGNUM *BN_new(void) {
+    return (BIGNUM *)calloc(1, sizeof(BIGNUM));
+}
+
+void BN_free(BIGNUM *a) {
+    free(a);
+}
+
+void BN_clear_free(BIGNUM *a) {
+    if (a == NULL) return;
+    crypto_cleanse(a, sizeof(*a));
+    free(a);
+}
+
+int BN_set_word(BIGNUM *a, unsigned long w) {
+    if (a == NULL) return 0;
+    memset(a->d, 0, sizeof(a->d));
+    a->d[0] = w;
+    bn_fix_top(a);
+    return 1;
+}
+
+BIGNUM *BN_bin2bn(const unsigned char *s, int len, BIGNUM *ret) {
+    BIGNUM *a = ret;
+
+    if (len < 0 || (s == NULL && len > 0)) return NULL;
+    while (len > 0 && *s == 0) {
+        s++;
+        len--;
+    }
+    if (len > BN_MAX_BITS / 8) return NULL;
+    if (a == NULL) {
+        a = BN_new();
+        if (a == NULL) return NULL;
+    }
+    crypto_limbs_from_bytes(a->d, BN_MAX_LIMBS, s, (size_t)len);
+    bn_fix_top(a);
+    return a;
+}
+
+int BN_bn2bin(const BIGNUM *a, unsigned char *to) {
+    int n = BN_num_bytes(a);
+
+    crypto_limbs_to_bytes(to, (size_t)n, a->d, (size_t)a->top);
+    return n;
+}
+
+int BN_num_bits(const BIGNUM *a) {
+    return (int)crypto_limbs_bits(a->d, (size_t)a->top);
+}
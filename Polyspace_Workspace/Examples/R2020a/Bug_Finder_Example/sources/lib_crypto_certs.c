@@ -0,0 +1,438 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * Certificate files and trust stores shared by every SSL_CTX that names them.
+ *
+ * A PEM or DER file is decoded once into its DER certificates and kept in a
+ * process-wide table keyed by path and type. Later loads of the same path
+ * cost one stat(): the entry is reused while the file's device, inode, size
+ * and modification time are unchanged, and reparsed otherwise. Trust stores
+ * (a CAfile and/or a CApath directory) are cached the same way, the
+ * directory being rescanned when it or one of its files changes; files that
+ * did not change come back from the file table without being parsed again.
+ *
+ * Entries are immutable once published and reference counted, so a context
+ * keeps using the certificates it loaded while a newer version of the file
+ * replaces them in the table.
+ */
+
+#define _GNU_SOURCE  /* For O_CLOEXEC, struct stat timespecs */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lib_crypto_internal.h"
+
+enum {
+    CERT_FILE_MAX       = 1 << 20,      /* larger files are refused */
+    CERT_FILE_MAX_CERTS = 256,
+    CERT_RECHECK_NS     = 1000000000    /* directory stores are re-stat'ed once a second */
+};
+
+static const char pem_begin[] = "-----BEGIN CERTIFICATE-----";
+static const char pem_end[] = "-----END CERTIFICATE-----";
+
+static pthread_mutex_t cert_lock = PTHREAD_MUTEX_INITIALIZER;
+static crypto_cert_file *cert_files;    /* newest version of each path */
+static crypto_cert_store *cert_stores;
+
+static int64_t cert_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void cert_file_id(const struct stat *st, uint64_t id[4]) {
+    id[0] = (uint64_t)st->st_dev;
+    id[1] = (uint64_t)st->st_ino;
+    id[2] = (uint64_t)st->st_size;
+    id[3] = (uint64_t)st->st_mtim.tv_sec * 1000000000u + (uint64_t)st->st_mtim.tv_nsec;
+}
+
+
+/*============================================================================
+ * DECODING
+ *==========================================================================*/
+/* Length of the DER element at der when it is a SEQUENCE filling exactly
+ * len bytes, 0 otherwise */
+static size_t cert_der_check(const unsigned char *der, size_t len) {
+    size_t n, hdr = 2, i;
+
+    if (len < 2 || der[0] != 0x30) return 0;
+    n = der[1];
+    if (n & 0x80) {
+        size_t bytes = n & 0x7f;
+        if (bytes == 0 || bytes > 4 || len < 2 + bytes) return 0;
+        for (n = 0, i = 0; i < bytes; i++) n = (n << 8) | der[2 + i];
+        hdr += bytes;
+    }
+    return hdr + n == len ? len : 0;
+}
+
+static int cert_b64_value(unsigned char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+') return 62;
+    if (c == '/') return 63;
+    return -1;
+}
+
+/* Decodes base64 into out, skipping white space; returns the length or -1 */
+static long cert_b64_decode(unsigned char *out, const char *in, size_t len) {
+    uint32_t acc = 0;
+    int bits = 0, pad = 0;
+    long n = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)in[i];
+        int v;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+        if (c == '=') {
+            pad++;
+            continue;
+        }
+        v = cert_b64_value(c);
+        if (v < 0 || pad) return -1;
+        acc = (acc << 6) | (uint32_t)v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out[n++] = (unsigned char)(acc >> bits);
+        }
+    }
+    return pad > 2 ? -1 : n;
+}
+
+static int cert_file_add(crypto_cert_file *f, const unsigned char *der, size_t len) {
+    unsigned char *copy;
+
+    if (f->count == CERT_FILE_MAX_CERTS || cert_der_check(der, len) == 0) return 0;
+    copy = (unsigned char *)malloc(len);
+    if (copy == NULL) return 0;
+    memcpy(copy, der, len);
+    f->der[f->count] = copy;
+    f->der_len[f->count] = len;
+    f->count++;
+    return 1;
+}
+
+static int cert_parse_pem(crypto_cert_file *f, const char *text, size_t len) {
+    unsigned char *der = (unsigned char *)malloc(len);
+    const char *p = text, *end = text + len;
+    int ok = 1;
+
+    if (der == NULL) return 0;
+    while (ok) {
+        const char *b = memmem(p, (size_t)(end - p), pem_begin, sizeof(pem_begin) - 1);
+        const char *e;
+        long n;
+        if (b == NULL) break;
+        b += sizeof(pem_begin) - 1;
+        e = memmem(b, (size_t)(end - b), pem_end, sizeof(pem_end) - 1);
+        if (e == NULL) {
+            ok = 0;
+            break;
+        }
+        n = cert_b64_decode(der, b, (size_t)(e - b));
+        ok = n > 0 && cert_file_add(f, der, (size_t)n);
+        p = e + sizeof(pem_end) - 1;
+    }
+    free(der);
+    return ok && f->count > 0;
+}
+
+static int cert_read_file(const char *path, char **data, size_t *len, struct stat *st) {
+    char *buf;
+    size_t got = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) return 0;
+    if (fstat(fd, st) != 0 || !S_ISREG(st->st_mode) || st->st_size > CERT_FILE_MAX) {
+        close(fd);
+        return 0;
+    }
+    buf = (char *)malloc((size_t)st->st_size + 1);
+    if (buf == NULL) {
+        close(fd);
+        return 0;
+    }
+    while (got < (size_t)st->st_size) {
+        ssize_t n = read(fd, buf + got, (size_t)st->st_size - got);
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    close(fd);
+    buf[got] = '\0';
+    *data = buf;
+    *len = got;
+    return 1;
+}
+
+static void cert_file_destroy(crypto_cert_file *f) {
+    size_t i;
+
+    for (i = 0; i < f->count; i++) free(f->der[i]);
+    free(f->der);
+    free(f->der_len);
+    free(f->path);
+    free(f);
+}
+
+static crypto_cert_file *cert_file_load(const char *path, int type) {
+    crypto_cert_file *f = (crypto_cert_file *)calloc(1, sizeof(crypto_cert_file));
+    struct stat st;
+    char *data = NULL;
+    size_t len = 0;
+    int ok;
+
+    if (f == NULL) return NULL;
+    f->references = 1;
+    f->type = type;
+    f->path = strdup(path);
+    f->der = (unsigned char **)calloc(CERT_FILE_MAX_CERTS, sizeof(unsigned char *));
+    f->der_len = (size_t *)calloc(CERT_FILE_MAX_CERTS, sizeof(size_t));
+    ok = f->path != NULL && f->der != NULL && f->der_len != NULL && cert_read_file(path, &data, &len, &st);
+    if (ok) {
+        cert_file_id(&st, f->id);
+        if (type == SSL_FILETYPE_PEM) ok = cert_parse_pem(f, data, len);
+        else ok = cert_file_add(f, (const unsigned char *)data, len);
+    }
+    free(data);
+    if (!ok) {
+        cert_file_destroy(f);
+        return NULL;
+    }
+    return f;
+}
+
+
+/*============================================================================
+ * FILE TABLE
+ *==========================================================================*/
+void crypto_cert_file_put(crypto_cert_file *f) {
+    if (f == NULL) return;
+    if (__atomic_sub_fetch(&f->references, 1, __ATOMIC_ACQ_REL) == 0) cert_file_destroy(f);
+}
+
+/* Called with cert_lock held */
+static crypto_cert_file *cert_file_find_locked(const char *path, int type, const uint64_t id[4]) {
+    crypto_cert_file *f;
+
+    for (f = cert_files; f != NULL; f = f->next) {
+        if (f->type == type && strcmp(f->path, path) == 0) {
+            return memcmp(f->id, id, sizeof(f->id)) == 0 ? f : NULL;
+        }
+    }
+    return NULL;
+}
+
+/* Publishes f as the newest version of its path; called with cert_lock held */
+static void cert_file_publish_locked(crypto_cert_file *f) {
+    crypto_cert_file **pp;
+
+    for (pp = &cert_files; *pp != NULL; pp = &(*pp)->next) {
+        if ((*pp)->type == f->type && strcmp((*pp)->path, f->path) == 0) {
+            crypto_cert_file *old = *pp;
+            *pp = old->next;
+            crypto_cert_file_put(old);
+            break;
+        }
+    }
+    f->next = cert_files;
+    cert_files = f;
+    __atomic_add_fetch(&f->references, 1, __ATOMIC_RELAXED);
+}
+
+crypto_cert_file *crypto_cert_file_get(const char *path, int type) {
+    crypto_cert_file *f, *hit;
+    struct stat st;
+    uint64_t id[4];
+
+    if (path == NULL || stat(path, &st) != 0) return NULL;
+    cert_file_id(&st, id);
+
+    pthread_mutex_lock(&cert_lock);
+    f = cert_file_find_locked(path, type, id);
+    if (f != NULL) __atomic_add_fetch(&f->references, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&cert_lock);
+    if (f != NULL) return f;
+
+    /* Parse outside the lock; a concurrent loader of the same version wins */
+    f = cert_file_load(path, type);
+    if (f == NULL) return NULL;
+    pthread_mutex_lock(&cert_lock);
+    hit = cert_file_find_locked(path, type, f->id);
+    if (hit != NULL) {
+        __atomic_add_fetch(&hit->references, 1, __ATOMIC_RELAXED);
+    } else {
+        cert_file_publish_locked(f);
+    }
+    pthread_mutex_unlock(&cert_lock);
+    if (hit != NULL) {
+        crypto_cert_file_put(f);
+        return hit;
+    }
+    return f;
+}
+
+
+/*============================================================================
+ * TRUST STORES
+ *==========================================================================*/
+static void cert_store_destroy(crypto_cert_store *s) {
+    size_t i;
+
+    for (i = 0; i < s->count; i++) crypto_cert_file_put(s->files[i]);
+    free(s->files);
+    free(s->ca_file);
+    free(s->ca_path);
+    free(s);
+}
+
+void crypto_cert_store_put(crypto_cert_store *s) {
+    if (s == NULL) return;
+    if (__atomic_sub_fetch(&s->references, 1, __ATOMIC_ACQ_REL) == 0) cert_store_destroy(s);
+}
+
+static int cert_store_add(crypto_cert_store *s, crypto_cert_file *f) {
+    if (s->count == s->cap) {
+        size_t cap = s->cap ? 2 * s->cap : 16;
+        crypto_cert_file **files = (crypto_cert_file **)realloc(s->files, cap * sizeof(*files));
+        if (files == NULL) return 0;
+        s->files = files;
+        s->cap = cap;
+    }
+    s->files[s->count++] = f;
+    return 1;
+}
+
+static int cert_strcmp_null(const char *a, const char *b) {
+    if (a == NULL || b == NULL) return a != b;
+    return strcmp(a, b);
+}
+
+/* Directory identity; files that are not certificates are skipped */
+static int cert_store_scan(crypto_cert_store *s) {
+    struct stat st;
+    DIR *dir;
+    struct dirent *de;
+
+    if (stat(s->ca_path, &st) != 0 || !S_ISDIR(st.st_mode)) return 0;
+    cert_file_id(&st, s->dir_id);
+    dir = opendir(s->ca_path);
+    if (dir == NULL) return 0;
+    while ((de = readdir(dir)) != NULL) {
+        char path[4096];
+        crypto_cert_file *f;
+        if (de->d_name[0] == '.') continue;
+        if ((size_t)snprintf(path, sizeof(path), "%s/%s", s->ca_path, de->d_name) >= sizeof(path)) continue;
+        f = crypto_cert_file_get(path, SSL_FILETYPE_PEM);
+        if (f != NULL && !cert_store_add(s, f)) crypto_cert_file_put(f);
+    }
+    closedir(dir);
+    return 1;
+}
+
+static crypto_cert_store *cert_store_load(const char *ca_file, const char *ca_path) {
+    crypto_cert_store *s = (crypto_cert_store *)calloc(1, sizeof(crypto_cert_store));
+    int ok = 1;
+
+    if (s == NULL) return NULL;
+    s->references = 1;
+    s->checked_ns = cert_now_ns();
+    if (ca_file != NULL) {
+        crypto_cert_file *f = crypto_cert_file_get(ca_file, SSL_FILETYPE_PEM);
+        s->ca_file = strdup(ca_file);
+        ok = f != NULL && s->ca_file != NULL && cert_store_add(s, f);
+        if (!ok) crypto_cert_file_put(f);
+    }
+    if (ok && ca_path != NULL) {
+        s->ca_path = strdup(ca_path);
+        ok = s->ca_path != NULL && cert_store_scan(s);
+    }
+    if (!ok) {
+        cert_store_destroy(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* Whether the files behind s are unchanged; stats at most once a second */
+static int cert_store_fresh(crypto_cert_store *s) {
+    int64_t now = cert_now_ns();
+    struct stat st;
+    uint64_t id[4];
+    size_t i;
+
+    if (now - __atomic_load_n(&s->checked_ns, __ATOMIC_RELAXED) < CERT_RECHECK_NS) return 1;
+    if (s->ca_path != NULL) {
+        if (stat(s->ca_path, &st) != 0) return 0;
+        cert_file_id(&st, id);
+        if (memcmp(id, s->dir_id, sizeof(id)) != 0) return 0;
+    }
+    for (i = 0; i < s->count; i++) {
+        if (stat(s->files[i]->path, &st) != 0) return 0;
+        cert_file_id(&st, id);
+        if (memcmp(id, s->files[i]->id, sizeof(id)) != 0) return 0;
+    }
+    __atomic_store_n(&s->checked_ns, now, __ATOMIC_RELAXED);
+    return 1;
+}
+
+crypto_cert_store *crypto_cert_store_get(const char *ca_file, const char *ca_path) {
+    crypto_cert_store **pp, *s;
+
+    if (ca_file == NULL && ca_path == NULL) return NULL;
+    pthread_mutex_lock(&cert_lock);
+    for (pp = &cert_stores; *pp != NULL; pp = &(*pp)->next) {
+        if (cert_strcmp_null((*pp)->ca_file, ca_file) == 0 && cert_strcmp_null((*pp)->ca_path, ca_path) == 0) break;
+    }
+    s = *pp;
+    if (s != NULL && cert_store_fresh(s)) {
+        __atomic_add_fetch(&s->references, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&cert_lock);
+        return s;
+    }
+    if (s != NULL) {
+        *pp = s->next;
+        crypto_cert_store_put(s);
+    }
+    pthread_mutex_unlock(&cert_lock);
+
+    /* Unchanged member files come back from the file table */
+    s = cert_store_load(ca_file, ca_path);
+    if (s == NULL) return NULL;
+    pthread_mutex_lock(&cert_lock);
+    for (pp = &cert_stores; *pp != NULL; pp = &(*pp)->next) {
+        if (cert_strcmp_null((*pp)->ca_file, ca_file) == 0 && cert_strcmp_null((*pp)->ca_path, ca_path) == 0) {
+            crypto_cert_store *old = *pp;
+            *pp = old->next;
+            crypto_cert_store_put(old);
+            break;
+        }
+    }
+    s->next = cert_stores;
+    cert_stores = s;
+    __atomic_add_fetch(&s->references, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&cert_lock);
+    return s;
+}
+
+int crypto_cert_store_contains(const crypto_cert_store *s, const unsigned char *der, size_t len) {
+    size_t i, j;
+
+    for (i = 0; i < s->count; i++) {
+        const crypto_cert_file *f = s->files[i];
+        for (j = 0; j < f->count; j++) {
+            if (f->der_len[j] == len && memcmp(f->der[j], der, len) == 0) return 1;
+        }
+    }
+    return 0;
+}
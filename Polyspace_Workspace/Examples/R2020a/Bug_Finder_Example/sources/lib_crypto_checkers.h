@@ -20,7 +20,7 @@ struct crypto_cipher_ctx;
 typedef struct crypto_cipher_ctx EVP_CIPHER_CTX;
 
 struct crypto_pkey;
-typedef struct crypto_cipher EVP_PKEY;
+typedef struct crypto_pkey EVP_PKEY;
 
 struct crypto_pkey_ctx;
 typedef struct crypto_pkey_ctx EVP_PKEY_CTX;
@@ -63,10 +63,21 @@ typedef struct crypto_bn_ctx BN_CTX;
 void EVP_CIPHER_CTX_init(EVP_CIPHER_CTX *a);
 EVP_CIPHER_CTX *EVP_CIPHER_CTX_new(void);
 int EVP_CIPHER_CTX_cleanup(EVP_CIPHER_CTX *a);
+void EVP_CIPHER_CTX_free(EVP_CIPHER_CTX *a);
+int EVP_CIPHER_CTX_set_padding(EVP_CIPHER_CTX *c, int pad);
+
+/* Not in OpenSSL: lets ECB, CTR and CBC decryption split large updates
+ * across threads (1 = serial, the default; 0 = one per online CPU) */
+int EVP_CIPHER_CTX_set_num_threads(EVP_CIPHER_CTX *ctx, int num_threads);
 
 int EVP_CipherInit_ex(EVP_CIPHER_CTX* ctx,const EVP_CIPHER *cipher, ENGINE *impl, const unsigned char *key, const unsigned char *iv, int enc);
 
 int EVP_DecryptInit_ex(EVP_CIPHER_CTX *ctx,const EVP_CIPHER *cipher, ENGINE *impl, const unsigned char *key, const unsigned char *iv);
+int EVP_DecryptUpdate(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl);
+int EVP_DecryptFinal_ex(EVP_CIPHER_CTX *ctx, unsigned char *outm, int *outl);
+
+int EVP_CipherUpdate(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl);
+int EVP_CipherFinal_ex(EVP_CIPHER_CTX *ctx, unsigned char *outm, int *outl);
 
 int EVP_EncryptInit(EVP_CIPHER_CTX* ctx,const EVP_CIPHER *cipher, const unsigned char *key, const unsigned char *iv);
 int EVP_EncryptInit_ex(EVP_CIPHER_CTX* ctx,const EVP_CIPHER *cipher, ENGINE *impl, const unsigned char *key, const unsigned char *iv);
@@ -76,6 +87,7 @@ int EVP_EncryptFinal_ex(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl);
 const EVP_CIPHER* EVP_des_cbc(void);
 const EVP_CIPHER* EVP_aes_128_cbc(void);
 const EVP_CIPHER* EVP_aes_128_ecb(void);
+const EVP_CIPHER* EVP_aes_128_ctr(void);
 
 int RAND_bytes(unsigned char *buf,int num);
 int RAND_pseudo_bytes(unsigned char *buf,int num);
@@ -157,6 +169,7 @@ int RAND_pseudo_bytes(unsigned char *buf,int num);
 /* EVP_PKEY, EVP_PKEY_CTX functions */
 
 EVP_PKEY *EVP_PKEY_new(void);
+void EVP_PKEY_free(EVP_PKEY *pkey);
 EVP_PKEY_CTX *EVP_PKEY_CTX_new(EVP_PKEY *pkey, ENGINE *impl);
 EVP_PKEY_CTX *EVP_PKEY_CTX_new_id(int id, ENGINE *impl);
 void EVP_PKEY_CTX_free(EVP_PKEY_CTX *ctx);
@@ -179,20 +192,43 @@ int EVP_PKEY_CTX_ctrl(EVP_PKEY_CTX *ctx, int keytype, int optype, int cmd, int p
 
 int EVP_PKEY_set1_RSA(EVP_PKEY *pkey,RSA *key);
 int EVP_PKEY_set1_DSA(EVP_PKEY *pkey,DSA *key);
+RSA *EVP_PKEY_get1_RSA(EVP_PKEY *pkey);
 
 /* RSA functions */
 RSA * RSA_new(void);
+void RSA_free(RSA *r);
+int RSA_up_ref(RSA *r);
+int RSA_size(const RSA *rsa);
+
+/* The RSA object takes ownership of the given BIGNUMs */
+int RSA_set0_key(RSA *r, BIGNUM *n, BIGNUM *e, BIGNUM *d);
+int RSA_set0_factors(RSA *r, BIGNUM *p, BIGNUM *q);
+int RSA_set0_crt_params(RSA *r, BIGNUM *dmp1, BIGNUM *dmq1, BIGNUM *iqmp);
+void RSA_get0_key(const RSA *r, const BIGNUM **n, const BIGNUM **e, const BIGNUM **d);
+
+/* Not in OpenSSL: a background thread keeps up to depth keys of the given
+ * size and public exponent (NULL: 65537) ready, and EVP_PKEY_keygen hands
+ * them out before searching for primes; depth 0 drops the queue */
+int RSA_keygen_queue(int bits, const BIGNUM *e, int depth);
 
 /* BIGNUM functions */
 
 BIGNUM *BN_new(void);
+void BN_free(BIGNUM *a);
+void BN_clear_free(BIGNUM *a);
 
 int BN_set_word(BIGNUM *a, unsigned long w);
 
+BIGNUM *BN_bin2bn(const unsigned char *s, int len, BIGNUM *ret);
+int BN_bn2bin(const BIGNUM *a, unsigned char *to);
+int BN_num_bits(const BIGNUM *a);
+# define BN_num_bytes(a) ((BN_num_bits(a)+7)/8)
+
 /* low level: RSA functions */
 int RSA_blinding_on(RSA *rsa, BN_CTX *ctx);
 void RSA_blinding_off(RSA *rsa);
 
+/* RSA_PKCS1_OAEP_PADDING uses SHA-256 for the label hash and for MGF1 */
 int RSA_private_decrypt(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding);
 int RSA_private_encrypt(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding);
 int RSA_public_encrypt(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding);
@@ -216,6 +252,8 @@ const EVP_MD* EVP_sha256(void);
 const EVP_MD* EVP_md5(void);
 
 EVP_MD_CTX *EVP_MD_CTX_create(void);
+void EVP_MD_CTX_destroy(EVP_MD_CTX *ctx);
+int EVP_MD_size(const EVP_MD *md);
 
 int EVP_DigestInit_ex(EVP_MD_CTX *ctx, const EVP_MD *type, ENGINE *impl);
 int EVP_DigestUpdate(EVP_MD_CTX *ctx, const void *d, size_t cnt);
@@ -226,16 +264,55 @@ int EVP_DigestFinal(EVP_MD_CTX *ctx, unsigned char *md, unsigned int *s);
 
 int EVP_SignFinal(EVP_MD_CTX *ctx,unsigned char *sig,unsigned int *s, EVP_PKEY *pkey);
 
+unsigned char *SHA256(const unsigned char *d, size_t n, unsigned char *md);
+
+/* Not in OpenSSL: hashes count independent messages at once (interleaved
+ * across SIMD lanes when available); digest i is written at md + 32 * i */
+int SHA256_batch(size_t count, const unsigned char *const data[], const size_t len[], unsigned char *md);
+
 int EVP_DigestSignFinal(EVP_MD_CTX *ctx, unsigned char *sig, size_t *siglen);
 
 int EVP_DigestVerifyInit(EVP_MD_CTX *ctx, EVP_PKEY_CTX **pctx, const EVP_MD *type, ENGINE *e, EVP_PKEY *pkey);
 
+/* Utility functions */
+
+int CRYPTO_memcmp(const void *a, const void *b, size_t len);
+
+/* Not in OpenSSL: calls fn(arg) until seconds have passed and writes one
+ * line with calls/s, MB/s for bytes per call and, where hardware counters
+ * can be read, cycles per byte and IPC; 0 when fn fails */
+int CRYPTO_bench(FILE *report, const char *name, int (*fn)(void *arg), void *arg, size_t bytes, double seconds);
+
+/* Not in OpenSSL: dudect-style fixed-vs-random timing test. prepare writes
+ * an input of input_len bytes for class 0 (fixed) or 1 (random) and fn is
+ * timed on it; 1 when no leak is found, 0 on a leak, -1 on error */
+int CRYPTO_timing_leak_test(FILE *report, const char *name, void (*prepare)(void *arg, int cls, unsigned char *input),
+                            void (*fn)(void *arg, const unsigned char *input), void *arg, size_t input_len,
+                            size_t measurements);
+
+/* Not in OpenSSL: the two above over the primitives behind the
+ * corrected_crypto* examples; the number of failed benchmarks or leaking
+ * primitives, -1 on error */
+int CRYPTO_bench_suite(FILE *report);
+int CRYPTO_timing_leak_suite(FILE *report);
+
+/* Not in OpenSSL: loopback handshakes through the session cache; the
+ * second connection to a host must resume, one to another host or with
+ * other options must not, and an untrusted certificate must be rejected.
+ * The number of failed checks and benchmarks, -1 on error */
+int CRYPTO_ssl_session_suite(FILE *report);
+
 /* SSL functions */
 
 #define X509_FILETYPE_PEM   1
 #define X509_FILETYPE_ASN1   2
 
 #define SSL_CTRL_OPTIONS 32
+#define SSL_CTRL_SET_TLSEXT_HOSTNAME 55
+
+#define SSL_VERIFY_NONE 0x00
+#define SSL_VERIFY_PEER 0x01
+#define SSL_VERIFY_FAIL_IF_NO_PEER_CERT 0x02
 
 #define SSL_OP_NO_SSLv2 0x01000000L
 #define SSL_OP_NO_SSLv3 0x02000000L
@@ -247,6 +324,7 @@ int EVP_DigestVerifyInit(EVP_MD_CTX *ctx, EVP_PKEY_CTX **pctx, const EVP_MD *typ
 #define SSL_FILETYPE_PEM X509_FILETYPE_PEM
 
 #define SSL_CTX_set_options(ctx, op) SSL_CTX_ctrl((ctx), SSL_CTRL_OPTIONS, (op), NULL)
+#define SSL_set_tlsext_host_name(s, name) SSL_ctrl((s), SSL_CTRL_SET_TLSEXT_HOSTNAME, 0, (void *)(name))
 
 int SSL_library_init(void);
 
@@ -269,8 +347,14 @@ const SSL_METHOD *TLSv1_2_client_method(void);
 const SSL_METHOD *TLSv1_2_server_method(void);
 const SSL_METHOD *TLSv1_2_method(void);
 
+/* Not in OpenSSL: contexts with the same method, options and certificate
+ * and CA file names share one parsed copy of the files, and on the client
+ * side one cache of resumable sessions, even across SSL_CTX_free/SSL_CTX_new */
 SSL_CTX *SSL_CTX_new(const SSL_METHOD *meth);
+int SSL_CTX_up_ref(SSL_CTX *ctx);
+void SSL_CTX_free(SSL_CTX *ctx);
 SSL *SSL_new(SSL_CTX *ctx);
+void SSL_free(SSL *ssl);
 
 long SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg);
 long SSL_ctrl(SSL *ssl, int cmd, long larg, void *parg);
@@ -283,5 +367,6 @@ int SSL_set_fd(SSL *ssl, int fd);
 
 int SSL_connect(SSL *ssl);
 int SSL_accept(SSL *ssl);
+int SSL_session_reused(const SSL *s);
 
 #endif /* LIB_CRYPTO_CHECKERS_H */
@@ -0,0 +1,479 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * EVP_CIPHER registry and the EVP_Encrypt* / EVP_Decrypt* entry points.
+ *
+ * ECB, CTR and CBC decryption have no dependency between blocks, so a large
+ * update can be split across the crypto thread pool once the context has been
+ * configured with EVP_CIPHER_CTX_set_num_threads(). Each worker gets its own
+ * block range: CTR offsets its counter, CBC decryption takes the ciphertext
+ * block preceding its range as chaining value.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum {
+    NID_aes_128_ecb = 418,
+    NID_aes_128_cbc = 419,
+    NID_aes_128_ctr = 904
+};
+
+enum {
+    CIPHER_SPLIT_MIN_BLOCKS = 4096,     /* 64 KiB per worker at least */
+    CIPHER_SPLIT_MAX_CHUNKS = 64
+};
+
+static const EVP_CIPHER cipher_aes_128_ecb = { NID_aes_128_ecb, CRYPTO_MODE_ECB, AES_BLOCK_SIZE, AES128_KEY_SIZE, 0 };
+static const EVP_CIPHER cipher_aes_128_cbc = { NID_aes_128_cbc, CRYPTO_MODE_CBC, AES_BLOCK_SIZE, AES128_KEY_SIZE, AES_BLOCK_SIZE };
+static const EVP_CIPHER cipher_aes_128_ctr = { NID_aes_128_ctr, CRYPTO_MODE_CTR, 1, AES128_KEY_SIZE, AES_BLOCK_SIZE };
+
+const EVP_CIPHER* EVP_aes_128_ecb(void) {
+    return &cipher_aes_128_ecb;
+}
+
+const EVP_CIPHER* EVP_aes_128_cbc(void) {
+    return &cipher_aes_128_cbc;
+}
+
+const EVP_CIPHER* EVP_aes_128_ctr(void) {
+    return &cipher_aes_128_ctr;
+}
+
+const EVP_CIPHER* EVP_des_cbc(void) {
+    return NULL;                        /* DES is deliberately not provided */
+}
+
+
+/*============================================================================
+ * CONTEXT LIFE CYCLE
+ *==========================================================================*/
+static void cipher_ctx_reset(EVP_CIPHER_CTX *ctx) {
+    crypto_cleanse(ctx, sizeof(*ctx));
+    ctx->encrypt = -1;
+    ctx->padding = 1;
+    ctx->num_threads = 1;
+}
+
+EVP_CIPHER_CTX *EVP_CIPHER_CTX_new(void) {
+    EVP_CIPHER_CTX *ctx = (EVP_CIPHER_CTX *)malloc(sizeof(EVP_CIPHER_CTX));
+    if (ctx == NULL) return NULL;
+    cipher_ctx_reset(ctx);
+    return ctx;
+}
+
+void EVP_CIPHER_CTX_init(EVP_CIPHER_CTX *a) {
+    if (a != NULL) cipher_ctx_reset(a);
+}
+
+int EVP_CIPHER_CTX_cleanup(EVP_CIPHER_CTX *a) {
+    if (a == NULL) return 0;
+    cipher_ctx_reset(a);
+    return 1;
+}
+
+void EVP_CIPHER_CTX_free(EVP_CIPHER_CTX *a) {
+    if (a == NULL) return;
+    crypto_cleanse(a, sizeof(*a));
+    free(a);
+}
+
+int EVP_CIPHER_CTX_set_padding(EVP_CIPHER_CTX *ctx, int pad) {
+    if (ctx == NULL) return 0;
+    ctx->padding = pad ? 1 : 0;
+    return 1;
+}
+
+int EVP_CIPHER_CTX_set_num_threads(EVP_CIPHER_CTX *ctx, int num_threads) {
+    if (ctx == NULL || num_threads < 0) return 0;
+    ctx->num_threads = num_threads;
+    return 1;
+}
+
+
+/*============================================================================
+ * INITIALIZATION
+ *==========================================================================*/
+int EVP_CipherInit_ex(EVP_CIPHER_CTX* ctx,const EVP_CIPHER *cipher, ENGINE *impl, const unsigned char *key, const unsigned char *iv, int enc) {
+    if (ctx == NULL || impl != NULL) return 0;     /* engines are not supported */
+
+    if (cipher != NULL) {
+        if (cipher != ctx->cipher) {
+            ctx->key_set = 0;
+            memset(ctx->iv, 0, sizeof(ctx->iv));
+        }
+        ctx->cipher = cipher;
+    } else if (ctx->cipher == NULL) {
+        return 0;                                   /* no algorithm to initialize */
+    }
+
+    if (enc != -1) {
+        ctx->encrypt = enc ? 1 : 0;
+    } else if (ctx->encrypt == -1) {
+        ctx->encrypt = 1;
+    }
+
+    if (key != NULL) {
+        crypto_aes128_set_key(&ctx->key, key);
+        ctx->key_set = 1;
+    }
+    if (iv != NULL && ctx->cipher->iv_len > 0) {
+        memcpy(ctx->iv, iv, (size_t)ctx->cipher->iv_len);
+    }
+
+    ctx->buf_len = 0;
+    ctx->final_used = 0;
+    ctx->ks_num = 0;
+    return 1;
+}
+
+int EVP_EncryptInit_ex(EVP_CIPHER_CTX* ctx,const EVP_CIPHER *cipher, ENGINE *impl, const unsigned char *key, const unsigned char *iv) {
+    return EVP_CipherInit_ex(ctx, cipher, impl, key, iv, 1);
+}
+
+int EVP_EncryptInit(EVP_CIPHER_CTX* ctx,const EVP_CIPHER *cipher, const unsigned char *key, const unsigned char *iv) {
+    return EVP_CipherInit_ex(ctx, cipher, NULL, key, iv, 1);
+}
+
+int EVP_DecryptInit_ex(EVP_CIPHER_CTX *ctx,const EVP_CIPHER *cipher, ENGINE *impl, const unsigned char *key, const unsigned char *iv) {
+    return EVP_CipherInit_ex(ctx, cipher, impl, key, iv, 0);
+}
+
+
+/*============================================================================
+ * BULK BLOCK PROCESSING
+ *==========================================================================*/
+struct cipher_split {
+    const EVP_CIPHER_CTX *ctx;
+    const unsigned char *in;
+    unsigned char *out;
+    size_t nblocks;
+    size_t chunk;                                           /* blocks per task */
+    unsigned char iv[CIPHER_SPLIT_MAX_CHUNKS][AES_BLOCK_SIZE]; /* counter or chaining value per task */
+};
+
+static void ctr128_add(unsigned char ctr[AES_BLOCK_SIZE], uint64_t n) {
+    int i;
+
+    for (i = AES_BLOCK_SIZE - 1; i >= 0 && n != 0; i--) {
+        n += ctr[i];
+        ctr[i] = (unsigned char)n;
+        n >>= 8;
+    }
+}
+
+static void cipher_blocks_serial(const EVP_CIPHER_CTX *ctx, unsigned char *iv, const unsigned char *in,
+                                 unsigned char *out, size_t nblocks) {
+    switch (ctx->cipher->mode) {
+    case CRYPTO_MODE_ECB:
+        if (ctx->encrypt) crypto_aes_encrypt_blocks(&ctx->key, in, out, nblocks);
+        else crypto_aes_decrypt_blocks(&ctx->key, in, out, nblocks);
+        break;
+    case CRYPTO_MODE_CBC:
+        if (ctx->encrypt) crypto_aes_cbc_encrypt(&ctx->key, iv, in, out, nblocks);
+        else crypto_aes_cbc_decrypt(&ctx->key, iv, in, out, nblocks);
+        break;
+    case CRYPTO_MODE_CTR:
+        crypto_aes_ctr_blocks(&ctx->key, iv, in, out, nblocks);
+        break;
+    default:
+        break;
+    }
+}
+
+static void cipher_split_task(void *arg, size_t index) {
+    struct cipher_split *s = (struct cipher_split *)arg;
+    size_t first = index * s->chunk;
+    size_t n = s->nblocks - first < s->chunk ? s->nblocks - first : s->chunk;
+
+    cipher_blocks_serial(s->ctx, s->iv[index], s->in + first * AES_BLOCK_SIZE,
+                         s->out + first * AES_BLOCK_SIZE, n);
+}
+
+/* Processes whole blocks, splitting them across the pool when the mode
+ * allows it and the range is large enough to pay for the hand-off. */
+static void cipher_blocks(EVP_CIPHER_CTX *ctx, const unsigned char *in, unsigned char *out, size_t nblocks) {
+    struct cipher_split *s;
+    size_t nchunks;
+    size_t i;
+    int splittable = ctx->cipher->mode != CRYPTO_MODE_CBC || !ctx->encrypt;
+
+    nchunks = nblocks / CIPHER_SPLIT_MIN_BLOCKS;
+    if (ctx->num_threads > 0 && nchunks > (size_t)ctx->num_threads) nchunks = (size_t)ctx->num_threads;
+    if (nchunks > CIPHER_SPLIT_MAX_CHUNKS) nchunks = CIPHER_SPLIT_MAX_CHUNKS;
+
+    if (!splittable || ctx->num_threads == 1 || nchunks < 2 ||
+        (s = (struct cipher_split *)malloc(sizeof(*s))) == NULL) {
+        cipher_blocks_serial(ctx, ctx->iv, in, out, nblocks);
+        return;
+    }
+
+    s->ctx = ctx;
+    s->in = in;
+    s->out = out;
+    s->nblocks = nblocks;
+    s->chunk = (nblocks + nchunks - 1) / nchunks;
+    nchunks = (nblocks + s->chunk - 1) / s->chunk;
+
+    /* Per-task starting state is captured before any output is written, so
+     * in-place CBC decryption still sees the original ciphertext */
+    for (i = 0; i < nchunks; i++) {
+        if (ctx->cipher->mode == CRYPTO_MODE_CTR) {
+            memcpy(s->iv[i], ctx->iv, AES_BLOCK_SIZE);
+            ctr128_add(s->iv[i], (uint64_t)(i * s->chunk));
+        } else if (i == 0) {
+            memcpy(s->iv[i], ctx->iv, AES_BLOCK_SIZE);
+        } else {
+            memcpy(s->iv[i], in + (i * s->chunk - 1) * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+        }
+    }
+    if (ctx->cipher->mode == CRYPTO_MODE_CTR) {
+        ctr128_add(ctx->iv, (uint64_t)nblocks);
+    } else if (ctx->cipher->mode == CRYPTO_MODE_CBC) {
+        memcpy(ctx->iv, in + (nblocks - 1) * AES_BLOCK_SIZE, AES_BLOCK_SIZE);
+    }
+
+    crypto_pool_parallel_for(nchunks, cipher_split_task, s, ctx->num_threads);
+
+    crypto_cleanse(s, sizeof(*s));
+    free(s);
+}
+
+static void cipher_ctr_update(EVP_CIPHER_CTX *ctx, unsigned char *out, const unsigned char *in, size_t len) {
+    unsigned int n = ctx->ks_num;
+    size_t nblocks;
+
+    /* Key stream left over from a previous partial block */
+    while (n != 0 && len > 0) {
+        *out++ = *in++ ^ ctx->ks[n];
+        n = (n + 1) % AES_BLOCK_SIZE;
+        len--;
+    }
+
+    nblocks = len / AES_BLOCK_SIZE;
+    if (nblocks > 0) {
+        cipher_blocks(ctx, in, out, nblocks);
+        in += nblocks * AES_BLOCK_SIZE;
+        out += nblocks * AES_BLOCK_SIZE;
+        len -= nblocks * AES_BLOCK_SIZE;
+    }
+
+    if (len > 0) {
+        crypto_aes_encrypt_blocks(&ctx->key, ctx->iv, ctx->ks, 1);
+        ctr128_add(ctx->iv, 1);
+        while (len > 0) {
+            *out++ = *in++ ^ ctx->ks[n];
+            n++;
+            len--;
+        }
+    }
+    ctx->ks_num = n;
+}
+
+/* Buffers partial blocks and processes every complete block */
+static int cipher_block_update(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl) {
+    size_t len = (size_t)inl;
+    size_t done = 0;
+    size_t nblocks;
+
+    if (ctx->buf_len > 0) {
+        size_t need = AES_BLOCK_SIZE - (size_t)ctx->buf_len;
+        if (len < need) {
+            memcpy(ctx->buf + ctx->buf_len, in, len);
+            ctx->buf_len += inl;
+            *outl = 0;
+            return 1;
+        }
+        memcpy(ctx->buf + ctx->buf_len, in, need);
+        cipher_blocks(ctx, ctx->buf, out, 1);
+        ctx->buf_len = 0;
+        in += need;
+        len -= need;
+        out += AES_BLOCK_SIZE;
+        done = AES_BLOCK_SIZE;
+    }
+
+    nblocks = len / AES_BLOCK_SIZE;
+    if (nblocks > 0) {
+        cipher_blocks(ctx, in, out, nblocks);
+        in += nblocks * AES_BLOCK_SIZE;
+        len -= nblocks * AES_BLOCK_SIZE;
+        done += nblocks * AES_BLOCK_SIZE;
+    }
+
+    if (len > 0) {
+        memcpy(ctx->buf, in, len);
+        ctx->buf_len = (int)len;
+    }
+    *outl = (int)done;
+    return 1;
+}
+
+
+/*============================================================================
+ * PKCS#7
+ *==========================================================================*/
+#if defined(__SSE2__)
+/* One 16-byte vector per block: a lane mask selects the pad bytes, and the
+ * check folds the comparison of every lane into a movemask */
+void crypto_pkcs7_pad(unsigned char block[AES_BLOCK_SIZE], unsigned int used) {
+    const __m128i idx = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    __m128i b = _mm_loadu_si128((const __m128i *)block);
+    __m128i keep = _mm_cmpgt_epi8(_mm_set1_epi8((char)used), idx);
+    __m128i pad = _mm_set1_epi8((char)(AES_BLOCK_SIZE - used));
+
+    b = _mm_or_si128(_mm_and_si128(keep, b), _mm_andnot_si128(keep, pad));
+    _mm_storeu_si128((__m128i *)block, b);
+}
+
+unsigned int crypto_pkcs7_check(const unsigned char block[AES_BLOCK_SIZE]) {
+    const __m128i rev = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    __m128i b = _mm_loadu_si128((const __m128i *)block);
+    unsigned int pad = block[AES_BLOCK_SIZE - 1];
+    __m128i padv = _mm_set1_epi8((char)pad);
+    __m128i in_pad = _mm_cmplt_epi8(rev, padv);                        /* i >= 16 - pad */
+    __m128i wrong = _mm_andnot_si128(_mm_cmpeq_epi8(b, padv), in_pad);
+    unsigned int bad = (unsigned int)_mm_movemask_epi8(wrong);
+
+    bad |= ((pad - 1u) >> 8) | ((AES_BLOCK_SIZE - pad) >> 8);          /* pad == 0 or pad > 16 */
+    bad = 0u - ((bad | (0u - bad)) >> 31);
+    return pad & ~bad;
+}
+#else
+void crypto_pkcs7_pad(unsigned char block[AES_BLOCK_SIZE], unsigned int used) {
+    memset(block + used, (int)(AES_BLOCK_SIZE - used), AES_BLOCK_SIZE - used);
+}
+
+unsigned int crypto_pkcs7_check(const unsigned char block[AES_BLOCK_SIZE]) {
+    unsigned int pad = block[AES_BLOCK_SIZE - 1];
+    unsigned int bad = ((pad - 1u) >> 8) | ((AES_BLOCK_SIZE - pad) >> 8);
+    int i;
+
+    for (i = 0; i < AES_BLOCK_SIZE; i++) {
+        unsigned int in_pad = ((unsigned int)(AES_BLOCK_SIZE - 1 - i) - pad) >> 8 & 1u;  /* i >= 16 - pad */
+        bad |= (0u - in_pad) & (block[i] ^ pad);
+    }
+    bad = 0u - ((bad | (0u - bad)) >> 31);
+    return pad & ~bad;
+}
+#endif
+
+
+/*============================================================================
+ * ENCRYPTION
+ *==========================================================================*/
+int EVP_EncryptUpdate(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl) {
+    if (ctx == NULL || ctx->cipher == NULL || !ctx->key_set || ctx->encrypt != 1) return 0;
+    if (outl == NULL || inl < 0) return 0;
+    if (inl == 0) {
+        *outl = 0;
+        return 1;
+    }
+    if (in == NULL || out == NULL) return 0;
+
+    if (ctx->cipher->mode == CRYPTO_MODE_CTR) {
+        cipher_ctr_update(ctx, out, in, (size_t)inl);
+        *outl = inl;
+        return 1;
+    }
+    return cipher_block_update(ctx, out, outl, in, inl);
+}
+
+int EVP_EncryptFinal_ex(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl) {
+    if (ctx == NULL || ctx->cipher == NULL || !ctx->key_set || ctx->encrypt != 1 || outl == NULL) return 0;
+
+    *outl = 0;
+    if (ctx->cipher->mode == CRYPTO_MODE_CTR) return 1;
+    if (!ctx->padding) return ctx->buf_len == 0;    /* data not a multiple of the block size */
+    if (out == NULL) return 0;
+
+    /* PKCS#7: always at least one byte of padding */
+    crypto_pkcs7_pad(ctx->buf, (unsigned int)ctx->buf_len);
+    cipher_blocks(ctx, ctx->buf, out, 1);
+    ctx->buf_len = 0;
+    *outl = AES_BLOCK_SIZE;
+    return 1;
+}
+
+
+/*============================================================================
+ * DECRYPTION
+ *==========================================================================*/
+int EVP_DecryptUpdate(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl) {
+    int fix_len = 0;
+    int ret;
+
+    if (ctx == NULL || ctx->cipher == NULL || !ctx->key_set || ctx->encrypt != 0) return 0;
+    if (outl == NULL || inl < 0) return 0;
+    if (inl == 0) {
+        *outl = 0;
+        return 1;
+    }
+    if (in == NULL || out == NULL) return 0;
+
+    if (ctx->cipher->mode == CRYPTO_MODE_CTR) {
+        cipher_ctr_update(ctx, out, in, (size_t)inl);
+        *outl = inl;
+        return 1;
+    }
+    if (!ctx->padding) return cipher_block_update(ctx, out, outl, in, inl);
+
+    /* With padding the last complete block is held back until
+     * EVP_DecryptFinal_ex, since it may be the padding block */
+    if (ctx->final_used) {
+        memcpy(out, ctx->final, AES_BLOCK_SIZE);
+        out += AES_BLOCK_SIZE;
+        fix_len = 1;
+    }
+    ret = cipher_block_update(ctx, out, outl, in, inl);
+    if (!ret) return 0;
+
+    if (ctx->buf_len == 0) {
+        *outl -= AES_BLOCK_SIZE;
+        memcpy(ctx->final, out + *outl, AES_BLOCK_SIZE);
+        ctx->final_used = 1;
+    } else {
+        ctx->final_used = 0;
+    }
+    if (fix_len) *outl += AES_BLOCK_SIZE;
+    return 1;
+}
+
+int EVP_DecryptFinal_ex(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl) {
+    unsigned int pad;
+
+    if (ctx == NULL || ctx->cipher == NULL || !ctx->key_set || ctx->encrypt != 0 || outl == NULL) return 0;
+
+    *outl = 0;
+    if (ctx->cipher->mode == CRYPTO_MODE_CTR) return 1;
+    if (!ctx->padding) return ctx->buf_len == 0;
+    if (ctx->buf_len != 0 || !ctx->final_used || out == NULL) return 0;
+
+    pad = crypto_pkcs7_check(ctx->final);
+    ctx->final_used = 0;
+    if (pad == 0) return 0;
+
+    memcpy(out, ctx->final, AES_BLOCK_SIZE - pad);
+    *outl = (int)(AES_BLOCK_SIZE - pad);
+    return 1;
+}
+
+
+/*============================================================================
+ * DIRECTION-AGNOSTIC ENTRY POINTS
+ *==========================================================================*/
+int EVP_CipherUpdate(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl, const unsigned char *in, int inl) {
+    if (ctx == NULL) return 0;
+    return ctx->encrypt == 1 ? EVP_EncryptUpdate(ctx, out, outl, in, inl)
+                             : EVP_DecryptUpdate(ctx, out, outl, in, inl);
+}
+
+int EVP_CipherFinal_ex(EVP_CIPHER_CTX *ctx, unsigned char *out, int *outl) {
+    if (ctx == NULL) return 0;
+    return ctx->encrypt == 1 ? EVP_EncryptFinal_ex(ctx, out, outl)
+                             : EVP_DecryptFinal_ex(ctx, out, outl);
+}
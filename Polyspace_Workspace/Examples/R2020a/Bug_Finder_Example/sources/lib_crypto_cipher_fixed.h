@@ -0,0 +1,166 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * Ciphers specialised at compile time.
+ *
+ * CRYPTO_CIPHER_FIXED(name, ALG, MODE) defines a context type `name` and
+ * static inline functions over it for one algorithm and one mode, e.g.
+ *
+ *     CRYPTO_CIPHER_FIXED(rec_cipher, AES128, CBC)
+ *
+ *     rec_cipher c;
+ *     rec_cipher_init(&c, key, iv);
+ *     n = rec_cipher_encrypt(&c, out, in, len);     // PKCS#7, one pass
+ *
+ * Where an EVP_CIPHER_CTX goes through the EVP_CIPHER chosen at init time,
+ * the mode switch and the partial-block buffer on every update and a separate
+ * call for the padding block, these functions call the mode kernel directly
+ * (its block function is inlined in its loop) and pad in place, so a short
+ * record is one kernel call. name_from_ctx / name_to_ctx move key and IV,
+ * and the CTR key stream left by a partial block, between the two, for code
+ * that sets keys up through the EVP API; a CTR stream continues across them.
+ *
+ * Encryption writes at most len + block size bytes; decryption returns the
+ * plaintext length, or -1 for a bad length or bad padding (checked in
+ * constant time). CTR has neither padding nor length constraints.
+ */
+
+#ifndef LIB_CRYPTO_CIPHER_FIXED_H
+#define LIB_CRYPTO_CIPHER_FIXED_H
+
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+/*============================================================================
+ * ALGORITHMS
+ *==========================================================================*/
+typedef crypto_aes_key crypto_fixed_AES128_key;
+
+enum {
+    CRYPTO_FIXED_AES128_BLOCK = AES_BLOCK_SIZE
+};
+
+#define crypto_fixed_AES128_set_key crypto_aes128_set_key
+
+/*============================================================================
+ * MODES
+ *==========================================================================*/
+/* Kernels share one signature: whole blocks, iv is the chaining value or
+ * counter and is advanced */
+static inline void crypto_fixed_AES128_ECB_enc(const crypto_aes_key *k, unsigned char *iv, const unsigned char *in,
+                                               unsigned char *out, size_t nblocks) {
+    (void)iv;
+    crypto_aes_encrypt_blocks(k, in, out, nblocks);
+}
+
+static inline void crypto_fixed_AES128_ECB_dec(const crypto_aes_key *k, unsigned char *iv, const unsigned char *in,
+                                               unsigned char *out, size_t nblocks) {
+    (void)iv;
+    crypto_aes_decrypt_blocks(k, in, out, nblocks);
+}
+
+#define crypto_fixed_AES128_CBC_enc crypto_aes_cbc_encrypt
+#define crypto_fixed_AES128_CBC_dec crypto_aes_cbc_decrypt
+#define crypto_fixed_AES128_CTR_enc crypto_aes_ctr_blocks
+#define crypto_fixed_AES128_CTR_dec crypto_aes_ctr_blocks
+
+#define crypto_fixed_AES128_ECB_evp EVP_aes_128_ecb
+#define crypto_fixed_AES128_CBC_evp EVP_aes_128_cbc
+#define crypto_fixed_AES128_CTR_evp EVP_aes_128_ctr
+
+enum {
+    CRYPTO_FIXED_ECB_PADDED = 1,
+    CRYPTO_FIXED_CBC_PADDED = 1,
+    CRYPTO_FIXED_CTR_PADDED = 0,
+    CRYPTO_FIXED_ECB_IV = 0,
+    CRYPTO_FIXED_CBC_IV = 1,
+    CRYPTO_FIXED_CTR_IV = 1
+};
+
+/*============================================================================
+ * SPECIALISATION
+ *==========================================================================*/
+#define CRYPTO_CIPHER_FIXED(name, ALG, MODE)                                                          \
+typedef struct name {                                                                                 \
+    crypto_fixed_##ALG##_key key;                                                                     \
+    _Alignas(16) unsigned char iv[CRYPTO_FIXED_##ALG##_BLOCK];                                        \
+    unsigned char ks[CRYPTO_FIXED_##ALG##_BLOCK];     /* CTR key stream left by a partial block */    \
+    unsigned int ks_num;                               /* bytes of ks consumed; 0: none left */       \
+} name;                                                                                               \
+                                                                                                      \
+/* Starts a new message, or a new stream for CTR */                                                   \
+static inline void name##_init(name *c, const unsigned char *key, const unsigned char *iv) {          \
+    if (key != NULL) crypto_fixed_##ALG##_set_key(&c->key, key);                                      \
+    if (CRYPTO_FIXED_##MODE##_IV && iv != NULL) memcpy(c->iv, iv, CRYPTO_FIXED_##ALG##_BLOCK);        \
+    c->ks_num = 0;                                                                                    \
+}                                                                                                     \
+                                                                                                      \
+/* 0 unless ctx was initialised with the same algorithm and mode and a key,                           \
+ * and holds no partial block: one would be lost */                                                   \
+static inline int name##_from_ctx(name *c, const EVP_CIPHER_CTX *ctx) {                               \
+    if (ctx == NULL || ctx->cipher != crypto_fixed_##ALG##_##MODE##_evp() || !ctx->key_set) return 0; \
+    if (ctx->buf_len != 0 || ctx->final_used) return 0;                                               \
+    memcpy(&c->key, &ctx->key, sizeof(c->key));                                                       \
+    memcpy(c->iv, ctx->iv, CRYPTO_FIXED_##ALG##_BLOCK);                                               \
+    memcpy(c->ks, ctx->ks, CRYPTO_FIXED_##ALG##_BLOCK);                                               \
+    c->ks_num = ctx->ks_num;                                                                          \
+    return 1;                                                                                         \
+}                                                                                                     \
+                                                                                                      \
+/* Hands the advanced IV, and the unused CTR key stream, back so that EVP                             \
+ * calls continue the stream */                                                                       \
+static inline int name##_to_ctx(const name *c, EVP_CIPHER_CTX *ctx) {                                 \
+    if (ctx == NULL || ctx->cipher != crypto_fixed_##ALG##_##MODE##_evp()) return 0;                  \
+    memcpy(ctx->iv, c->iv, CRYPTO_FIXED_##ALG##_BLOCK);                                               \
+    memcpy(ctx->ks, c->ks, CRYPTO_FIXED_##ALG##_BLOCK);                                               \
+    ctx->ks_num = c->ks_num;                                                                          \
+    return 1;                                                                                         \
+}                                                                                                     \
+                                                                                                      \
+static inline size_t name##_encrypt(name *c, unsigned char *out, const unsigned char *in, size_t len) { \
+    const size_t bs = CRYPTO_FIXED_##ALG##_BLOCK;                                                     \
+    size_t full, rem, i, done = 0;                                                                    \
+                                                                                                      \
+    if (CRYPTO_FIXED_##MODE##_PADDED) {                                                               \
+        /* copy, pad in place and run the kernel once over everything */                              \
+        full = len / bs;                                                                              \
+        if (out != in) memmove(out, in, len);                                                         \
+        crypto_pkcs7_pad(out + full * bs, (unsigned int)(len % bs));                                  \
+        crypto_fixed_##ALG##_##MODE##_enc(&c->key, c->iv, out, out, full + 1);                        \
+        return (full + 1) * bs;                                                                       \
+    }                                                                                                 \
+    /* key stream left over from a previous partial block */                                          \
+    for (; c->ks_num != 0 && done < len; done++) {                                                    \
+        out[done] = in[done] ^ c->ks[c->ks_num];                                                      \
+        c->ks_num = (unsigned int)((c->ks_num + 1) % bs);                                             \
+    }                                                                                                 \
+    full = (len - done) / bs;                                                                         \
+    rem = (len - done) % bs;                                                                          \
+    crypto_fixed_##ALG##_##MODE##_enc(&c->key, c->iv, in + done, out + done, full);                   \
+    done += full * bs;                                                                                \
+    if (rem > 0) {                                                                                    \
+        /* a block of key stream, of which the next call uses the rest */                             \
+        memset(c->ks, 0, bs);                                                                         \
+        crypto_fixed_##ALG##_##MODE##_enc(&c->key, c->iv, c->ks, c->ks, 1);                           \
+        for (i = 0; i < rem; i++) out[done + i] = in[done + i] ^ c->ks[i];                            \
+        c->ks_num = (unsigned int)rem;                                                                \
+    }                                                                                                 \
+    return len;                                                                                       \
+}                                                                                                     \
+                                                                                                      \
+static inline long name##_decrypt(name *c, unsigned char *out, const unsigned char *in, size_t len) { \
+    const size_t bs = CRYPTO_FIXED_##ALG##_BLOCK;                                                     \
+    unsigned int pad;                                                                                 \
+                                                                                                      \
+    if (!CRYPTO_FIXED_##MODE##_PADDED) return (long)name##_encrypt(c, out, in, len);                  \
+    if (len == 0 || len % bs != 0) return -1;                                                         \
+    crypto_fixed_##ALG##_##MODE##_dec(&c->key, c->iv, in, out, len / bs);                             \
+    pad = crypto_pkcs7_check(out + len - bs);                                                         \
+    return pad != 0 ? (long)(len - pad) : -1;                                                         \
+}
+
+/* The AES-128 modes of the EVP layer */
+CRYPTO_CIPHER_FIXED(crypto_aes128_ecb, AES128, ECB)
+CRYPTO_CIPHER_FIXED(crypto_aes128_cbc, AES128, CBC)
+CRYPTO_CIPHER_FIXED(crypto_aes128_ctr, AES128, CTR)
+
+#endif /* LIB_CRYPTO_CIPHER_FIXED_H */
@@ -0,0 +1,232 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * EVP_MD registry and the EVP_Digest* entry points (which EVP_Sign*,
+ * EVP_Verify* and EVP_DigestSign* map to), plus one-shot and batch SHA-256.
+ *
+ * MD5 is only here so that the weak-hash examples run; it is kept portable
+ * and is not meant to be fast.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+enum {
+    NID_md5    = 4,
+    NID_sha256 = 672
+};
+
+
+/*============================================================================
+ * MD5
+ *==========================================================================*/
+static const uint32_t md5_t[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const unsigned char md5_r[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static void md5_blocks(uint32_t h[4], const unsigned char *p, size_t nblocks) {
+    uint32_t m[16];
+    int i;
+
+    while (nblocks-- > 0) {
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (i = 0; i < 16; i++) {
+            m[i] = (uint32_t)p[4 * i] | ((uint32_t)p[4 * i + 1] << 8) |
+                   ((uint32_t)p[4 * i + 2] << 16) | ((uint32_t)p[4 * i + 3] << 24);
+        }
+        for (i = 0; i < 64; i++) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) & 15;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) & 15;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) & 15;
+            }
+            f += a + md5_t[i] + m[g];
+            a = d;
+            d = c;
+            c = b;
+            b += (f << md5_r[i]) | (f >> (32 - md5_r[i]));
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+        p += MD5_CBLOCK;
+    }
+}
+
+static void md5_init(void *state) {
+    crypto_md5_state *s = (crypto_md5_state *)state;
+
+    s->h[0] = 0x67452301;
+    s->h[1] = 0xefcdab89;
+    s->h[2] = 0x98badcfe;
+    s->h[3] = 0x10325476;
+    s->nbytes = 0;
+    s->num = 0;
+}
+
+static void md5_update(void *state, const void *data, size_t len) {
+    crypto_md5_state *s = (crypto_md5_state *)state;
+    const unsigned char *p = (const unsigned char *)data;
+
+    s->nbytes += len;
+    while (len > 0) {
+        size_t n = MD5_CBLOCK - s->num;
+        if (n > len) n = len;
+        memcpy(s->buf + s->num, p, n);
+        s->num += (unsigned int)n;
+        p += n;
+        len -= n;
+        if (s->num == MD5_CBLOCK) {
+            md5_blocks(s->h, s->buf, 1);
+            s->num = 0;
+        }
+    }
+}
+
+static void md5_final(void *state, unsigned char *md) {
+    crypto_md5_state *s = (crypto_md5_state *)state;
+    uint64_t bits = s->nbytes << 3;
+    unsigned char pad[MD5_CBLOCK + 8];
+    size_t padlen = (s->num < 56 ? 56 : 120) - s->num;
+    int i;
+
+    memset(pad, 0, sizeof(pad));
+    pad[0] = 0x80;
+    for (i = 0; i < 8; i++) pad[padlen + i] = (unsigned char)(bits >> (8 * i));
+    md5_update(s, pad, padlen + 8);
+    for (i = 0; i < 16; i++) md[i] = (unsigned char)(s->h[i / 4] >> (8 * (i % 4)));
+    crypto_cleanse(s, sizeof(*s));
+}
+
+
+/*============================================================================
+ * REGISTRY
+ *==========================================================================*/
+static void sha256_md_init(void *state) {
+    crypto_sha256_init((crypto_sha256_state *)state);
+}
+
+static void sha256_md_update(void *state, const void *data, size_t len) {
+    crypto_sha256_update((crypto_sha256_state *)state, data, len);
+}
+
+static void sha256_md_final(void *state, unsigned char *md) {
+    crypto_sha256_final((crypto_sha256_state *)state, md);
+}
+
+static const EVP_MD md_sha256 = {
+    NID_sha256, SHA256_DIGEST_LENGTH, SHA256_CBLOCK, sha256_md_init, sha256_md_update, sha256_md_final
+};
+
+static const EVP_MD md_md5 = {
+    NID_md5, MD5_DIGEST_LENGTH, MD5_CBLOCK, md5_init, md5_update, md5_final
+};
+
+const EVP_MD* EVP_sha256(void) {
+    return &md_sha256;
+}
+
+const EVP_MD* EVP_md5(void) {
+    return &md_md5;
+}
+
+int EVP_MD_size(const EVP_MD *md) {
+    return md != NULL ? md->md_size : -1;
+}
+
+
+/*============================================================================
+ * EVP_MD_CTX
+ *==========================================================================*/
+EVP_MD_CTX *EVP_MD_CTX_create(void) {
+    return (EVP_MD_CTX *)calloc(1, sizeof(EVP_MD_CTX));
+}
+
+void EVP_MD_CTX_destroy(EVP_MD_CTX *ctx) {
+    if (ctx == NULL) return;
+    crypto_cleanse(ctx, sizeof(*ctx));
+    free(ctx);
+}
+
+int EVP_DigestInit_ex(EVP_MD_CTX *ctx, const EVP_MD *type, ENGINE *impl) {
+    if (ctx == NULL || type == NULL || impl != NULL) return 0;
+    ctx->digest = type;
+    ctx->finalized = 0;
+    type->init(&ctx->state);
+    return 1;
+}
+
+int EVP_DigestInit(EVP_MD_CTX *ctx, const EVP_MD *type) {
+    return EVP_DigestInit_ex(ctx, type, NULL);
+}
+
+int EVP_DigestUpdate(EVP_MD_CTX *ctx, const void *d, size_t cnt) {
+    if (ctx == NULL || ctx->digest == NULL || ctx->finalized) return 0;
+    if (cnt == 0) return 1;
+    if (d == NULL) return 0;
+    ctx->digest->update(&ctx->state, d, cnt);
+    return 1;
+}
+
+int EVP_DigestFinal_ex(EVP_MD_CTX *ctx, unsigned char *md, unsigned int *s) {
+    if (ctx == NULL || ctx->digest == NULL || ctx->finalized || md == NULL) return 0;
+    ctx->digest->final(&ctx->state, md);
+    ctx->finalized = 1;
+    if (s != NULL) *s = (unsigned int)ctx->digest->md_size;
+    return 1;
+}
+
+int EVP_DigestFinal(EVP_MD_CTX *ctx, unsigned char *md, unsigned int *s) {
+    int ret = EVP_DigestFinal_ex(ctx, md, s);
+
+    if (ctx != NULL) {
+        crypto_cleanse(ctx, sizeof(*ctx));
+    }
+    return ret;
+}
+
+
+/*============================================================================
+ * ONE-SHOT AND BATCH SHA-256
+ *==========================================================================*/
+unsigned char *SHA256(const unsigned char *d, size_t n, unsigned char *md) {
+    static unsigned char m[SHA256_DIGEST_LENGTH];
+
+    if (md == NULL) md = m;
+    crypto_sha256(d, n, md);
+    return md;
+}
+
+int SHA256_batch(size_t count, const unsigned char *const data[], const size_t len[], unsigned char *md) {
+    size_t i;
+
+    if (count == 0) return 1;
+    if (data == NULL || len == NULL || md == NULL) return 0;
+    for (i = 0; i < count; i++) {
+        if (data[i] == NULL && len[i] != 0) return 0;
+    }
+    crypto_sha256_multi(count, data, len, md);
+    return 1;
+}
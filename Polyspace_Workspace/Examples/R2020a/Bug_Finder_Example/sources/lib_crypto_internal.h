@@ -0,0 +1,385 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * Definitions shared between the lib_crypto_*.c translation units. These are
+ * not part of the demo interface: the example sources only see the opaque
+ * types declared in lib_crypto_checkers.h.
+ */
+
+#ifndef LIB_CRYPTO_INTERNAL_H
+#define LIB_CRYPTO_INTERNAL_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "lib_crypto_checkers.h"
+
+/*============================================================================
+ * CPU FEATURES
+ *==========================================================================*/
+enum {
+    CRYPTO_CPU_SSSE3      = 1 << 0,
+    CRYPTO_CPU_SSE41      = 1 << 1,
+    CRYPTO_CPU_AESNI      = 1 << 2,
+    CRYPTO_CPU_PCLMUL     = 1 << 3,
+    CRYPTO_CPU_AVX2       = 1 << 4,
+    CRYPTO_CPU_BMI2       = 1 << 5,
+    CRYPTO_CPU_ADX        = 1 << 6,
+    CRYPTO_CPU_SHANI      = 1 << 7,
+    CRYPTO_CPU_AVX512F    = 1 << 8,
+    CRYPTO_CPU_AVX512IFMA = 1 << 9
+};
+
+/* Detected once; CRYPTO_CPU_MASK in the environment (hex) clears features */
+unsigned int crypto_cpu_features(void);
+
+#define crypto_cpu_has(f) ((crypto_cpu_features() & (f)) == (f))
+
+/*============================================================================
+ * THREAD POOL
+ *==========================================================================*/
+typedef void (*crypto_pool_fn)(void *arg, size_t index);
+
+/* Runs fn(arg, 0..ntasks-1) on up to nthreads threads (the caller included)
+ * and returns once every task has completed. */
+void crypto_pool_parallel_for(size_t ntasks, crypto_pool_fn fn, void *arg, int nthreads);
+
+/*============================================================================
+ * AES
+ *==========================================================================*/
+enum {
+    AES_BLOCK_SIZE  = 16,
+    AES128_KEY_SIZE = 16,
+    AES128_ROUNDS   = 10
+};
+
+typedef struct crypto_aes_key {
+    _Alignas(16) unsigned char rk[AES128_ROUNDS + 1][AES_BLOCK_SIZE];   /* encryption schedule */
+    _Alignas(16) unsigned char drk[AES128_ROUNDS + 1][AES_BLOCK_SIZE];  /* AES-NI equivalent inverse schedule */
+} crypto_aes_key;
+
+void crypto_aes128_set_key(crypto_aes_key *k, const unsigned char *key);
+void crypto_aes_encrypt_blocks(const crypto_aes_key *k, const unsigned char *in, unsigned char *out, size_t nblocks);
+void crypto_aes_decrypt_blocks(const crypto_aes_key *k, const unsigned char *in, unsigned char *out, size_t nblocks);
+
+/* CBC over whole blocks; iv is updated to the last ciphertext block */
+void crypto_aes_cbc_encrypt(const crypto_aes_key *k, unsigned char iv[AES_BLOCK_SIZE],
+                            const unsigned char *in, unsigned char *out, size_t nblocks);
+void crypto_aes_cbc_decrypt(const crypto_aes_key *k, unsigned char iv[AES_BLOCK_SIZE],
+                            const unsigned char *in, unsigned char *out, size_t nblocks);
+
+/* Counter mode over whole blocks; ctr is a 128-bit big-endian counter that is
+ * advanced by nblocks. */
+void crypto_aes_ctr_blocks(const crypto_aes_key *k, unsigned char ctr[AES_BLOCK_SIZE],
+                           const unsigned char *in, unsigned char *out, size_t nblocks);
+
+/*============================================================================
+ * SHA-256
+ *==========================================================================*/
+enum {
+    SHA256_DIGEST_LENGTH = 32,
+    SHA256_CBLOCK        = 64
+};
+
+typedef struct crypto_sha256_state {
+    uint32_t h[8];
+    uint64_t nbytes;
+    unsigned char buf[SHA256_CBLOCK];
+    unsigned int num;
+} crypto_sha256_state;
+
+void crypto_sha256_blocks(uint32_t h[8], const unsigned char *p, size_t nblocks);
+void crypto_sha256_init(crypto_sha256_state *s);
+void crypto_sha256_update(crypto_sha256_state *s, const void *data, size_t len);
+void crypto_sha256_final(crypto_sha256_state *s, unsigned char md[SHA256_DIGEST_LENGTH]);
+void crypto_sha256(const void *data, size_t len, unsigned char md[SHA256_DIGEST_LENGTH]);
+void crypto_hmac_sha256(const void *key, size_t key_len, const void *data, size_t len,
+                        unsigned char md[SHA256_DIGEST_LENGTH]);
+
+/* Hashes count independent messages; digest i is written at md + 32 * i */
+void crypto_sha256_multi(size_t count, const unsigned char *const data[], const size_t len[], unsigned char *md);
+
+/*============================================================================
+ * MESSAGE DIGESTS
+ *==========================================================================*/
+enum {
+    MD5_DIGEST_LENGTH = 16,
+    MD5_CBLOCK        = 64,
+    EVP_MAX_MD_SIZE   = 64
+};
+
+typedef struct crypto_md5_state {
+    uint32_t h[4];
+    uint64_t nbytes;
+    unsigned char buf[MD5_CBLOCK];
+    unsigned int num;
+} crypto_md5_state;
+
+struct crypto_md {
+    int type;
+    int md_size;
+    int block_size;
+    void (*init)(void *state);
+    void (*update)(void *state, const void *data, size_t len);
+    void (*final)(void *state, unsigned char *md);
+};
+
+struct crypto_md_ctx {
+    const EVP_MD *digest;
+    int finalized;
+    union {
+        crypto_sha256_state sha256;
+        crypto_md5_state md5;
+    } state;
+};
+
+/*============================================================================
+ * SYMMETRIC CIPHERS
+ *==========================================================================*/
+enum {
+    CRYPTO_MODE_ECB = 1,
+    CRYPTO_MODE_CBC = 2,
+    CRYPTO_MODE_CTR = 5
+};
+
+struct crypto_cipher {
+    int nid;
+    int mode;
+    int block_size;     /* 1 for stream modes */
+    int key_len;
+    int iv_len;
+};
+
+struct crypto_cipher_ctx {
+    const EVP_CIPHER *cipher;
+    int encrypt;                        /* 1 encrypt, 0 decrypt, -1 not initialized */
+    int key_set;
+    int padding;
+    int num_threads;
+    crypto_aes_key key;
+    _Alignas(16) unsigned char iv[AES_BLOCK_SIZE];      /* chaining value or counter */
+    unsigned char buf[AES_BLOCK_SIZE];                  /* pending partial block */
+    int buf_len;
+    unsigned char final[AES_BLOCK_SIZE];                /* held back block on decryption */
+    int final_used;
+    unsigned char ks[AES_BLOCK_SIZE];                   /* unused CTR key stream */
+    unsigned int ks_num;                                /* bytes of ks already consumed */
+};
+
+/* PKCS#7 on one block: pad fills bytes used..15 with 16 - used (used < 16);
+ * check returns the pad length, or 0 when the padding is malformed, in time
+ * independent of the block's contents */
+void crypto_pkcs7_pad(unsigned char block[AES_BLOCK_SIZE], unsigned int used);
+unsigned int crypto_pkcs7_check(const unsigned char block[AES_BLOCK_SIZE]);
+
+/*============================================================================
+ * BIG NUMBERS
+ *==========================================================================*/
+enum {
+    BN_MAX_BITS  = 4096,
+    BN_MAX_LIMBS = BN_MAX_BITS / 64
+};
+
+/* Unsigned, little-endian 64-bit limbs; d[top..] are always zero */
+struct crypto_bignum {
+    int top;
+    uint64_t d[BN_MAX_LIMBS];
+};
+
+/* Limb vectors of explicit length k. Unless marked variable time, these run
+ * in time that depends on k only. */
+uint64_t crypto_limbs_add(uint64_t *r, const uint64_t *a, const uint64_t *b, size_t k);
+uint64_t crypto_limbs_sub(uint64_t *r, const uint64_t *a, const uint64_t *b, size_t k);
+void crypto_limbs_mul(uint64_t *r, const uint64_t *a, size_t ka, const uint64_t *b, size_t kb);
+uint64_t crypto_limbs_mul_word(uint64_t *r, const uint64_t *a, uint64_t w, size_t k);
+uint64_t crypto_limbs_div_word(uint64_t *q, const uint64_t *a, uint64_t w, size_t k);  /* variable time */
+void crypto_limbs_select(uint64_t *r, const uint64_t *a, const uint64_t *b, uint64_t mask, size_t k);
+uint64_t crypto_limbs_lt(const uint64_t *a, const uint64_t *b, size_t k);   /* all-ones mask when a < b */
+size_t crypto_limbs_bits(const uint64_t *a, size_t k);                      /* variable time */
+void crypto_limbs_from_bytes(uint64_t *r, size_t k, const unsigned char *in, size_t len);
+void crypto_limbs_to_bytes(unsigned char *out, size_t len, const uint64_t *a, size_t k);
+
+/* Inverse of a modulo an odd n (variable time); 0 when gcd(a, n) != 1 */
+int crypto_limbs_mod_inverse(uint64_t *r, const uint64_t *a, const uint64_t *n, size_t k);
+
+/* Sets a to the k limbs of v, k <= BN_MAX_LIMBS */
+void crypto_bn_set_limbs(BIGNUM *a, const uint64_t *v, size_t k);
+
+/* Montgomery arithmetic modulo an odd n of k limbs, R = 2^(64k) */
+typedef struct crypto_mont {
+    size_t k;
+    uint64_t n0;                        /* -n^-1 mod 2^64 */
+    uint64_t n[BN_MAX_LIMBS];
+    uint64_t rr[BN_MAX_LIMBS];          /* R^2 mod n */
+    uint64_t rrr[BN_MAX_LIMBS];         /* R^3 mod n */
+} crypto_mont;
+
+void crypto_mont_init(crypto_mont *m, const uint64_t *n, size_t k);
+void crypto_mont_mul(const crypto_mont *m, uint64_t *r, const uint64_t *a, const uint64_t *b);
+/* r = t mod n for t of up to 2k limbs with t < n * R */
+void crypto_mont_reduce(const crypto_mont *m, uint64_t *r, const uint64_t *t, size_t tk);
+/* r = a^e mod n in time independent of a and of the value of e; e is taken
+ * as ebits bits wide and a must be below n */
+void crypto_mont_exp(const crypto_mont *m, uint64_t *r, const uint64_t *a, const uint64_t *e, size_t ebits);
+/* Two independent exponentiations, e.g. the CRT halves of an RSA key; the
+ * moduli must have the same limb count for the vectorized path */
+void crypto_mont_exp2(const crypto_mont *m1, uint64_t *r1, const uint64_t *a1, const uint64_t *e1,
+                      const crypto_mont *m2, uint64_t *r2, const uint64_t *a2, const uint64_t *e2, size_t ebits);
+/* Same result for public exponents, variable time */
+void crypto_mont_exp_public(const crypto_mont *m, uint64_t *r, const uint64_t *a, const uint64_t *e, size_t ek);
+
+/*============================================================================
+ * RSA
+ *==========================================================================*/
+enum {
+    RSA_BLINDING_REFRESH = 32           /* squarings before new random factors */
+};
+
+struct crypto_rsa {
+    int references;
+    int blinding;                       /* RSA_blinding_on / RSA_blinding_off */
+    BIGNUM *n, *e, *d;
+    BIGNUM *p, *q, *dmp1, *dmq1, *iqmp;
+    pthread_mutex_t lock;               /* guards everything below */
+    int mont_ready;                     /* 1 once the contexts match the key */
+    int use_crt;                        /* p, q and the CRT exponents are usable */
+    crypto_mont mont_n, mont_p, mont_q;
+    int blind_ready;
+    unsigned int blind_uses;
+    uint64_t blind_a[BN_MAX_LIMBS];     /* r^e mod n */
+    uint64_t blind_ai[BN_MAX_LIMBS];    /* r^-1 mod n */
+};
+
+/* Raw private and public operations on k = RSA_size() byte strings */
+int crypto_rsa_private(RSA *rsa, const unsigned char *in, unsigned char *out);
+int crypto_rsa_public(RSA *rsa, const unsigned char *in, unsigned char *out);
+
+/* Padding; decoders return the message length or -1, in time that does not
+ * depend on where or whether the padding is broken */
+int crypto_rsa_pad_pkcs1(unsigned char *em, size_t k, const unsigned char *m, size_t mlen, int block_type);
+int crypto_rsa_unpad_pkcs1(unsigned char *m, size_t mmax, const unsigned char *em, size_t k);
+int crypto_rsa_pad_oaep(unsigned char *em, size_t k, const unsigned char *m, size_t mlen);
+int crypto_rsa_unpad_oaep(unsigned char *m, size_t mmax, const unsigned char *em, size_t k);
+
+/* EMSA-PSS encoding of a SHA-256 message hash into em for a modulus of
+ * mod_bits bits; salt_len as for RSA_padding_add_PKCS1_PSS */
+int crypto_rsa_pad_pss(unsigned char *em, size_t mod_bits, const unsigned char *mhash, int salt_len);
+
+/*============================================================================
+ * KEY GENERATION
+ *==========================================================================*/
+enum {
+    RSA_KEYGEN_DEFAULT_BITS = 2048,
+    RSA_KEYGEN_MIN_BITS     = 512,
+    RSA_KEYGEN_DEFAULT_E    = 65537
+};
+
+struct crypto_pkey {
+    int references;
+    int type;                           /* EVP_PKEY_RSA, or 0 while empty */
+    RSA *rsa;
+};
+
+struct crypto_pkey_ctx {
+    EVP_PKEY *pkey;                     /* NULL when made by EVP_PKEY_CTX_new_id */
+    int id;
+    int operation;                      /* EVP_PKEY_OP_* of the last *_init */
+    int keygen_bits;
+    BIGNUM *keygen_pubexp;              /* owned; NULL for the default */
+    int padding;
+};
+
+/* Checks a modulus size and public exponent (NULL: 65537) for generation */
+int crypto_rsa_keygen_params(int bits, const BIGNUM *e, uint64_t *ew);
+/* New key; p and q are searched on up to nthreads threads (0: one per CPU) */
+RSA *crypto_rsa_generate(int bits, uint64_t e, int nthreads);
+/* A key from the pre-generation queue for (bits, e), or NULL */
+RSA *crypto_rsa_keyq_pop(int bits, uint64_t e);
+
+/*============================================================================
+ * CERTIFICATES
+ *==========================================================================*/
+/* The DER certificates of one file; immutable once published */
+typedef struct crypto_cert_file {
+    int references;
+    struct crypto_cert_file *next;      /* file table link */
+    int type;                           /* SSL_FILETYPE_PEM or SSL_FILETYPE_ASN1 */
+    char *path;
+    uint64_t id[4];                     /* device, inode, size, mtime when parsed */
+    size_t count;
+    unsigned char **der;
+    size_t *der_len;
+} crypto_cert_file;
+
+/* Certificates of a CAfile and/or every file of a CApath directory */
+typedef struct crypto_cert_store {
+    int references;
+    struct crypto_cert_store *next;
+    char *ca_file, *ca_path;
+    uint64_t dir_id[4];
+    int64_t checked_ns;                 /* last time the files were stat'ed */
+    size_t count, cap;
+    crypto_cert_file **files;
+} crypto_cert_store;
+
+/* Take a reference on the cached, parsed contents; NULL when the file
+ * cannot be read or holds no well-formed certificate */
+crypto_cert_file *crypto_cert_file_get(const char *path, int type);
+void crypto_cert_file_put(crypto_cert_file *f);
+crypto_cert_store *crypto_cert_store_get(const char *ca_file, const char *ca_path);
+void crypto_cert_store_put(crypto_cert_store *s);
+int crypto_cert_store_contains(const crypto_cert_store *s, const unsigned char *der, size_t len);
+
+/*============================================================================
+ * SSL
+ *==========================================================================*/
+enum {
+    SSL_MASTER_SIZE  = 32,
+    SSL_RANDOM_SIZE  = 32,
+    SSL_TICKET_SIZE  = 16 + 48 + 16     /* nonce, encrypted state, tag */
+};
+
+struct crypto_ssl_method {
+    int client;                         /* may connect */
+    int server;                         /* may accept */
+    unsigned int versions;              /* SSL_VERSION_* mask */
+};
+
+struct crypto_ssl_verify_cb {
+    int (*fn)(int preverify_ok, void *store_ctx);
+};
+
+/* Parsed certificates, trust store, ticket keys and client sessions shared
+ * by every SSL_CTX with the same method, options and file names */
+struct crypto_ssl_shared;
+
+struct crypto_ssl_ctx {
+    int references;
+    const SSL_METHOD *method;
+    pthread_mutex_t lock;               /* guards the fields below */
+    long options;
+    int verify_mode;
+    SSL_verify_cb verify_cb;
+    char *cert_file;
+    int cert_type;
+    char *ca_file, *ca_path;
+    struct crypto_ssl_shared *shared;   /* resolved by SSL_new, dropped on change */
+};
+
+struct crypto_ssl {
+    SSL_CTX *ctx;
+    struct crypto_ssl_shared *shared;
+    int fd;
+    long options;
+    int verify_mode;
+    SSL_verify_cb verify_cb;
+    char *hostname;
+    int version;                        /* bit index of the negotiated version, -1 before */
+    int resumed;
+    unsigned char master[SSL_MASTER_SIZE];
+};
+
+/* Best-effort wipe that the compiler may not elide */
+void crypto_cleanse(void *p, size_t len);
+
+#endif /* LIB_CRYPTO_INTERNAL_H */
@@ -0,0 +1,147 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * EVP_PKEY objects, EVP_PKEY_CTX and the EVP_PKEY_keygen entry point.
+ *
+ * EVP_PKEY_keygen first asks the RSA pre-generation queue for a key of the
+ * requested size and exponent (see RSA_keygen_queue); only when none is
+ * ready does it search for primes, p and q in parallel.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+
+/*============================================================================
+ * KEY OBJECT
+ *==========================================================================*/
+EVP_PKEY *EVP_PKEY_new(void) {
+    EVP_PKEY *pkey = (EVP_PKEY *)calloc(1, sizeof(EVP_PKEY));
+
+    if (pkey == NULL) return NULL;
+    pkey->references = 1;
+    return pkey;
+}
+
+void EVP_PKEY_free(EVP_PKEY *pkey) {
+    if (pkey == NULL) return;
+    if (__atomic_sub_fetch(&pkey->references, 1, __ATOMIC_ACQ_REL) > 0) return;
+    RSA_free(pkey->rsa);
+    free(pkey);
+}
+
+/* Takes over the caller's reference */
+static void pkey_assign_rsa(EVP_PKEY *pkey, RSA *rsa) {
+    RSA_free(pkey->rsa);
+    pkey->rsa = rsa;
+    pkey->type = EVP_PKEY_RSA;
+}
+
+int EVP_PKEY_set1_RSA(EVP_PKEY *pkey, RSA *key) {
+    if (pkey == NULL || key == NULL) return 0;
+    RSA_up_ref(key);
+    pkey_assign_rsa(pkey, key);
+    return 1;
+}
+
+RSA *EVP_PKEY_get1_RSA(EVP_PKEY *pkey) {
+    if (pkey == NULL || pkey->type != EVP_PKEY_RSA) return NULL;
+    RSA_up_ref(pkey->rsa);
+    return pkey->rsa;
+}
+
+
+/*============================================================================
+ * CONTEXT
+ *==========================================================================*/
+static EVP_PKEY_CTX *pkey_ctx_new(EVP_PKEY *pkey, int id) {
+    EVP_PKEY_CTX *ctx = (EVP_PKEY_CTX *)calloc(1, sizeof(EVP_PKEY_CTX));
+
+    if (ctx == NULL) return NULL;
+    if (pkey != NULL) __atomic_add_fetch(&pkey->references, 1, __ATOMIC_RELAXED);
+    ctx->pkey = pkey;
+    ctx->id = id;
+    ctx->operation = EVP_PKEY_OP_UNDEFINED;
+    ctx->keygen_bits = RSA_KEYGEN_DEFAULT_BITS;
+    ctx->padding = RSA_PKCS1_PADDING;
+    return ctx;
+}
+
+/* An empty key gives a context that no operation accepts */
+EVP_PKEY_CTX *EVP_PKEY_CTX_new(EVP_PKEY *pkey, ENGINE *impl) {
+    (void)impl;
+    if (pkey == NULL) return NULL;
+    return pkey_ctx_new(pkey, pkey->type);
+}
+
+EVP_PKEY_CTX *EVP_PKEY_CTX_new_id(int id, ENGINE *impl) {
+    (void)impl;
+    if (id != EVP_PKEY_RSA) return NULL;
+    return pkey_ctx_new(NULL, id);
+}
+
+void EVP_PKEY_CTX_free(EVP_PKEY_CTX *ctx) {
+    if (ctx == NULL) return;
+    EVP_PKEY_free(ctx->pkey);
+    BN_free(ctx->keygen_pubexp);
+    free(ctx);
+}
+
+int EVP_PKEY_CTX_ctrl(EVP_PKEY_CTX *ctx, int keytype, int optype, int cmd, int p1, void *p2) {
+    if (ctx == NULL || ctx->id != EVP_PKEY_RSA) return -2;
+    if (keytype != -1 && keytype != ctx->id) return -1;
+    if (ctx->operation == EVP_PKEY_OP_UNDEFINED) return -1;
+    if (optype != -1 && (ctx->operation & optype) == 0) return -1;
+
+    switch (cmd) {
+    case EVP_PKEY_CTRL_RSA_KEYGEN_BITS:
+        if (p1 < RSA_KEYGEN_MIN_BITS || p1 > BN_MAX_BITS) return -2;
+        ctx->keygen_bits = p1;
+        return 1;
+    case EVP_PKEY_CTRL_RSA_KEYGEN_PUBEXP:
+        /* the context owns the exponent from here on, as in OpenSSL */
+        if (p2 == NULL) return -2;
+        BN_free(ctx->keygen_pubexp);
+        ctx->keygen_pubexp = (BIGNUM *)p2;
+        return 1;
+    case EVP_PKEY_CTRL_RSA_PADDING:
+        if (p1 < RSA_PKCS1_PADDING || p1 > RSA_PKCS1_PSS_PADDING) return -2;
+        ctx->padding = p1;
+        return 1;
+    default:
+        return -2;
+    }
+}
+
+
+/*============================================================================
+ * KEY GENERATION
+ *==========================================================================*/
+int EVP_PKEY_keygen_init(EVP_PKEY_CTX *ctx) {
+    if (ctx == NULL || ctx->id != EVP_PKEY_RSA) return -2;
+    ctx->operation = EVP_PKEY_OP_KEYGEN;
+    return 1;
+}
+
+int EVP_PKEY_keygen(EVP_PKEY_CTX *ctx, EVP_PKEY **ppkey) {
+    uint64_t e;
+    RSA *rsa;
+
+    if (ctx == NULL || ctx->id != EVP_PKEY_RSA) return -2;
+    if (ctx->operation != EVP_PKEY_OP_KEYGEN || ppkey == NULL) return -1;
+    if (!crypto_rsa_keygen_params(ctx->keygen_bits, ctx->keygen_pubexp, &e)) return 0;
+
+    rsa = crypto_rsa_keyq_pop(ctx->keygen_bits, e);
+    if (rsa == NULL) rsa = crypto_rsa_generate(ctx->keygen_bits, e, 0);
+    if (rsa == NULL) return 0;
+
+    if (*ppkey == NULL) {
+        *ppkey = EVP_PKEY_new();
+        if (*ppkey == NULL) {
+            RSA_free(rsa);
+            return 0;
+        }
+    }
+    pkey_assign_rsa(*ppkey, rsa);
+    return 1;
+}
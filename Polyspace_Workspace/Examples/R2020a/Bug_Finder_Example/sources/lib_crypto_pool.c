@@ -0,0 +1,133 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * Process-wide worker pool used to split bulk operations (counter mode
+ * ranges, independent digests, prime searches) across cores.
+ *
+ * Workers are started lazily on the first parallel request and stay parked on
+ * a condition variable between jobs. One job runs at a time; the submitting
+ * thread takes part in the work, so a failed thread creation only costs
+ * parallelism, never correctness.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "lib_crypto_internal.h"
+
+enum {
+    CRYPTO_POOL_MAX = 64
+};
+
+struct crypto_pool_job {
+    crypto_pool_fn fn;
+    void *arg;
+    size_t ntasks;
+    size_t next;            /* next task index to hand out */
+    int max_workers;        /* helpers allowed on this job */
+    int joined;             /* helpers that picked the job up */
+    int active;             /* helpers still holding a reference to the job */
+};
+
+static pthread_mutex_t pool_submit = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_idle = PTHREAD_COND_INITIALIZER;
+static struct crypto_pool_job *pool_job;
+static unsigned long pool_generation;
+static int pool_workers;
+
+static void crypto_pool_drain(struct crypto_pool_job *job) {
+    for (;;) {
+        size_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->ntasks) break;
+        job->fn(job->arg, i);
+    }
+}
+
+static void *crypto_pool_worker(void *unused) {
+    unsigned long seen = 0;
+    (void)unused;
+
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        struct crypto_pool_job *job;
+        while (pool_generation == seen || pool_job == NULL) {
+            seen = pool_generation;
+            pthread_cond_wait(&pool_wake, &pool_lock);
+        }
+        seen = pool_generation;
+        job = pool_job;
+        if (job->joined >= job->max_workers) continue;
+        job->joined++;
+        job->active++;
+        pthread_mutex_unlock(&pool_lock);
+
+        crypto_pool_drain(job);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--job->active == 0) pthread_cond_broadcast(&pool_idle);
+    }
+    return NULL;
+}
+
+static int crypto_pool_grow(int wanted) {
+    pthread_attr_t attr;
+
+    if (wanted > CRYPTO_POOL_MAX) wanted = CRYPTO_POOL_MAX;
+    if (pool_workers >= wanted) return pool_workers;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (pool_workers < wanted) {
+        pthread_t tid;
+        if (pthread_create(&tid, &attr, crypto_pool_worker, NULL) != 0) break;
+        pool_workers++;
+    }
+    pthread_attr_destroy(&attr);
+    return pool_workers;
+}
+
+void crypto_pool_parallel_for(size_t ntasks, crypto_pool_fn fn, void *arg, int nthreads) {
+    struct crypto_pool_job job;
+    long ncpu;
+    size_t i;
+
+    if (nthreads <= 0) {
+        ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = ncpu > 0 ? (int)ncpu : 1;
+    }
+    if ((size_t)nthreads > ntasks) nthreads = (int)ntasks;
+
+    if (nthreads <= 1) {
+        for (i = 0; i < ntasks; i++) fn(arg, i);
+        return;
+    }
+
+    job.fn = fn;
+    job.arg = arg;
+    job.ntasks = ntasks;
+    job.next = 0;
+    job.joined = 0;
+    job.active = 0;
+
+    pthread_mutex_lock(&pool_submit);
+    pthread_mutex_lock(&pool_lock);
+    job.max_workers = crypto_pool_grow(nthreads - 1);
+    if (job.max_workers > nthreads - 1) job.max_workers = nthreads - 1;
+    pool_job = &job;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_lock);
+
+    crypto_pool_drain(&job);
+
+    /* Every task has been handed out. The job lives on this stack frame:
+     * stop new helpers from joining and wait for the ones still running */
+    pthread_mutex_lock(&pool_lock);
+    pool_job = NULL;
+    while (job.active != 0) {
+        pthread_cond_wait(&pool_idle, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    pthread_mutex_unlock(&pool_submit);
+}
@@ -0,0 +1,270 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * RAND_bytes / RAND_pseudo_bytes: a per-thread ChaCha20 generator with
+ * fast-key-erasure.
+ *
+ * Each thread seeds a 256-bit key once from getrandom(). A refill runs
+ * ChaCha20 over a buffer of blocks; the first 32 bytes immediately replace
+ * the key and the rest is handed out, every byte being wiped from the buffer
+ * as it is returned. A later compromise of the thread's state therefore says
+ * nothing about output already produced. Requests of a few bytes cost a copy,
+ * with no lock and no system call.
+ *
+ * A forked child must not replay its parent's stream. The state lives on a
+ * page marked MADV_WIPEONFORK, which the kernel hands to the child zeroed,
+ * so the child finds an unseeded state and reseeds. Kernels without
+ * MADV_WIPEONFORK are covered by a pthread_atfork() generation counter.
+ */
+
+#define _GNU_SOURCE  /* For getrandom, MADV_DONTDUMP */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include "lib_crypto_internal.h"
+
+#ifndef MADV_WIPEONFORK
+#define MADV_WIPEONFORK 18
+#endif
+
+enum {
+    CHACHA20_BLOCK      = 64,
+    CHACHA20_KEY_SIZE   = 32,
+    RAND_BUF_BLOCKS     = 16,
+    RAND_BUF_SIZE       = RAND_BUF_BLOCKS * CHACHA20_BLOCK,
+    RAND_DIRECT_MIN     = 4 * RAND_BUF_SIZE     /* larger requests bypass the buffer */
+};
+
+struct crypto_rand_state {
+    int seeded;                                 /* 0 on a fresh or wiped page */
+    unsigned long fork_generation;
+    uint32_t key[CHACHA20_KEY_SIZE / 4];
+    unsigned int pos;                           /* next unread byte of buf */
+    _Alignas(64) unsigned char buf[RAND_BUF_SIZE];
+};
+
+static __thread struct crypto_rand_state *rand_tls;
+static pthread_once_t rand_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rand_key;
+static int rand_key_ok;
+static unsigned long rand_fork_generation;
+
+
+/*============================================================================
+ * CHACHA20
+ *==========================================================================*/
+static void rand_store_le32(unsigned char *out, const uint32_t x[16]) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(out, x, CHACHA20_BLOCK);
+#else
+    int i;
+    for (i = 0; i < 16; i++) {
+        out[4 * i + 0] = (unsigned char)x[i];
+        out[4 * i + 1] = (unsigned char)(x[i] >> 8);
+        out[4 * i + 2] = (unsigned char)(x[i] >> 16);
+        out[4 * i + 3] = (unsigned char)(x[i] >> 24);
+    }
+#endif
+}
+
+#define CHACHA_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define CHACHA_QR(a, b, c, d)                                                 \
+    do {                                                                      \
+        a += b; d ^= a; d = CHACHA_ROTL(d, 16);                               \
+        c += d; b ^= c; b = CHACHA_ROTL(b, 12);                               \
+        a += b; d ^= a; d = CHACHA_ROTL(d, 8);                                \
+        c += d; b ^= c; b = CHACHA_ROTL(b, 7);                                \
+    } while (0)
+
+/* Key stream blocks counter, counter+1, ... with an all-zero nonce: every key
+ * is used for a single refill, so the nonce never needs to vary */
+static void chacha20_blocks(const uint32_t key[8], uint32_t counter, unsigned char *out, size_t nblocks) {
+    static const uint32_t sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    uint32_t in[16];
+    uint32_t x[16];
+
+    while (nblocks-- > 0) {
+        int i;
+
+        memcpy(&in[0], sigma, sizeof(sigma));
+        memcpy(&in[4], key, CHACHA20_KEY_SIZE);
+        in[12] = counter++;
+        in[13] = in[14] = in[15] = 0;
+        memcpy(x, in, sizeof(x));
+
+        for (i = 0; i < 10; i++) {
+            CHACHA_QR(x[0], x[4], x[ 8], x[12]);
+            CHACHA_QR(x[1], x[5], x[ 9], x[13]);
+            CHACHA_QR(x[2], x[6], x[10], x[14]);
+            CHACHA_QR(x[3], x[7], x[11], x[15]);
+            CHACHA_QR(x[0], x[5], x[10], x[15]);
+            CHACHA_QR(x[1], x[6], x[11], x[12]);
+            CHACHA_QR(x[2], x[7], x[ 8], x[13]);
+            CHACHA_QR(x[3], x[4], x[ 9], x[14]);
+        }
+        for (i = 0; i < 16; i++) {
+            x[i] += in[i];
+        }
+        rand_store_le32(out, x);
+        out += CHACHA20_BLOCK;
+    }
+    crypto_cleanse(x, sizeof(x));
+    crypto_cleanse(in, sizeof(in));
+}
+
+
+/*============================================================================
+ * SEEDING
+ *==========================================================================*/
+static int rand_os_bytes(void *buf, size_t len) {
+    unsigned char *p = (unsigned char *)buf;
+    int fd;
+
+    while (len > 0) {
+        ssize_t n = getrandom(p, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    if (len == 0) return 1;
+
+    /* getrandom() missing (ENOSYS) or filtered: fall back on the device */
+    fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        len -= (size_t)n;
+    }
+    (void)close(fd);
+    return len == 0;
+}
+
+static void rand_atfork_child(void) {
+    __atomic_add_fetch(&rand_fork_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void rand_thread_exit(void *p) {
+    rand_tls = NULL;                    /* later destructors get a fresh state */
+    crypto_cleanse(p, sizeof(struct crypto_rand_state));
+    (void)munmap(p, sizeof(struct crypto_rand_state));
+}
+
+static void rand_init_once(void) {
+    rand_key_ok = pthread_key_create(&rand_key, rand_thread_exit) == 0;
+    (void)pthread_atfork(NULL, NULL, rand_atfork_child);
+}
+
+static struct crypto_rand_state *rand_state_new(void) {
+    struct crypto_rand_state *st;
+    void *p;
+
+    (void)pthread_once(&rand_once, rand_init_once);
+    p = mmap(NULL, sizeof(*st), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    (void)madvise(p, sizeof(*st), MADV_WIPEONFORK);
+    (void)madvise(p, sizeof(*st), MADV_DONTDUMP);
+    if (rand_key_ok) (void)pthread_setspecific(rand_key, p);
+    return (struct crypto_rand_state *)p;
+}
+
+/* Returns the calling thread's generator, seeded, or NULL when no entropy
+ * could be obtained */
+static struct crypto_rand_state *rand_state(void) {
+    struct crypto_rand_state *st = rand_tls;
+    unsigned long gen;
+
+    if (st == NULL) {
+        st = rand_state_new();
+        if (st == NULL) return NULL;
+        rand_tls = st;
+    }
+
+    gen = __atomic_load_n(&rand_fork_generation, __ATOMIC_RELAXED);
+    if (st->seeded && st->fork_generation == gen) return st;
+
+    crypto_cleanse(st->buf, sizeof(st->buf));
+    if (!rand_os_bytes(st->key, sizeof(st->key))) {
+        st->seeded = 0;
+        return NULL;
+    }
+    st->pos = RAND_BUF_SIZE;
+    st->fork_generation = gen;
+    st->seeded = 1;
+    return st;
+}
+
+
+/*============================================================================
+ * GENERATOR
+ *==========================================================================*/
+static void rand_rekey(struct crypto_rand_state *st, const unsigned char *block) {
+    memcpy(st->key, block, CHACHA20_KEY_SIZE);
+}
+
+static void rand_refill(struct crypto_rand_state *st) {
+    chacha20_blocks(st->key, 0, st->buf, RAND_BUF_BLOCKS);
+    rand_rekey(st, st->buf);
+    crypto_cleanse(st->buf, CHACHA20_KEY_SIZE);
+    st->pos = CHACHA20_KEY_SIZE;
+}
+
+/* Large requests: whole blocks go straight to the caller's buffer from
+ * counter 1 on, block 0 becomes the next key */
+static void rand_direct(struct crypto_rand_state *st, unsigned char *out, size_t len) {
+    _Alignas(64) unsigned char block[CHACHA20_BLOCK];
+
+    chacha20_blocks(st->key, 1, out, len / CHACHA20_BLOCK);
+    chacha20_blocks(st->key, 0, block, 1);
+    rand_rekey(st, block);
+    crypto_cleanse(block, sizeof(block));
+}
+
+static int rand_generate(unsigned char *buf, int num) {
+    struct crypto_rand_state *st;
+    size_t len;
+
+    if (num < 0 || (buf == NULL && num > 0)) return 0;
+    st = rand_state();
+    if (st == NULL) return 0;
+    len = (size_t)num;
+
+    if (len >= RAND_DIRECT_MIN) {
+        size_t whole = len - len % CHACHA20_BLOCK;
+        rand_direct(st, buf, whole);
+        buf += whole;
+        len -= whole;
+    }
+    while (len > 0) {
+        size_t n;
+        if (st->pos == RAND_BUF_SIZE) rand_refill(st);
+        n = RAND_BUF_SIZE - st->pos;
+        if (n > len) n = len;
+        memcpy(buf, st->buf + st->pos, n);
+        memset(st->buf + st->pos, 0, n);
+        st->pos += (unsigned int)n;
+        buf += n;
+        len -= n;
+    }
+    return 1;
+}
+
+int RAND_bytes(unsigned char *buf, int num) {
+    return rand_generate(buf, num);
+}
+
+/* Same generator: the distinction only matters to OpenSSL builds whose pool
+ * can run out of entropy, which a seeded ChaCha20 state cannot */
+int RAND_pseudo_bytes(unsigned char *buf, int num) {
+    return rand_generate(buf, num);
+}
@@ -0,0 +1,438 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * RSA keys and the private key engine behind RSA_private_decrypt and
+ * RSA_private_encrypt.
+ *
+ * A private operation runs as two half-size exponentiations modulo p and q
+ * (CRT) whenever the factors and CRT exponents are set, and checks its
+ * result with the public exponent before releasing it. Montgomery contexts
+ * for n, p and q are built on first use and cached in the key.
+ *
+ * Blinding multiplies the input by r^e and the result by r^-1 for a random
+ * r. Generating the pair costs an inversion, so it is done once and then
+ * advanced by squaring both halves ((r^2)^e = (r^e)^2) on each operation;
+ * fresh factors are drawn every RSA_BLINDING_REFRESH operations.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+static size_t bn_limbs(const BIGNUM *a) {
+    return (size_t)a->top;
+}
+
+
+/*============================================================================
+ * KEY OBJECT
+ *==========================================================================*/
+RSA *RSA_new(void) {
+    RSA *r = (RSA *)calloc(1, sizeof(RSA));
+
+    if (r == NULL) return NULL;
+    r->references = 1;
+    r->blinding = 1;
+    if (pthread_mutex_init(&r->lock, NULL) != 0) {
+        free(r);
+        return NULL;
+    }
+    return r;
+}
+
+void RSA_free(RSA *r) {
+    if (r == NULL) return;
+    if (__atomic_sub_fetch(&r->references, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+    BN_free(r->n);
+    BN_free(r->e);
+    BN_clear_free(r->d);
+    BN_clear_free(r->p);
+    BN_clear_free(r->q);
+    BN_clear_free(r->dmp1);
+    BN_clear_free(r->dmq1);
+    BN_clear_free(r->iqmp);
+    pthread_mutex_destroy(&r->lock);
+    crypto_cleanse(r, sizeof(*r));
+    free(r);
+}
+
+int RSA_up_ref(RSA *r) {
+    __atomic_add_fetch(&r->references, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+int RSA_size(const RSA *rsa) {
+    return rsa->n != NULL ? BN_num_bytes(rsa->n) : 0;
+}
+
+/* Any change of key material drops the cached contexts and blinding pair */
+static void rsa_invalidate(RSA *r) {
+    pthread_mutex_lock(&r->lock);
+    r->mont_ready = 0;
+    r->use_crt = 0;
+    r->blind_ready = 0;
+    crypto_cleanse(&r->mont_p, sizeof(r->mont_p));
+    crypto_cleanse(&r->mont_q, sizeof(r->mont_q));
+    crypto_cleanse(r->blind_a, sizeof(r->blind_a));
+    crypto_cleanse(r->blind_ai, sizeof(r->blind_ai));
+    pthread_mutex_unlock(&r->lock);
+}
+
+static void rsa_replace(BIGNUM **slot, BIGNUM *v, int secret) {
+    if (v == NULL) return;
+    if (secret) BN_clear_free(*slot);
+    else BN_free(*slot);
+    *slot = v;
+}
+
+int RSA_set0_key(RSA *r, BIGNUM *n, BIGNUM *e, BIGNUM *d) {
+    if ((r->n == NULL && n == NULL) || (r->e == NULL && e == NULL)) return 0;
+    rsa_replace(&r->n, n, 0);
+    rsa_replace(&r->e, e, 0);
+    rsa_replace(&r->d, d, 1);
+    rsa_invalidate(r);
+    return 1;
+}
+
+int RSA_set0_factors(RSA *r, BIGNUM *p, BIGNUM *q) {
+    if ((r->p == NULL && p == NULL) || (r->q == NULL && q == NULL)) return 0;
+    rsa_replace(&r->p, p, 1);
+    rsa_replace(&r->q, q, 1);
+    rsa_invalidate(r);
+    return 1;
+}
+
+int RSA_set0_crt_params(RSA *r, BIGNUM *dmp1, BIGNUM *dmq1, BIGNUM *iqmp) {
+    if ((r->dmp1 == NULL && dmp1 == NULL) || (r->dmq1 == NULL && dmq1 == NULL) ||
+        (r->iqmp == NULL && iqmp == NULL)) return 0;
+    rsa_replace(&r->dmp1, dmp1, 1);
+    rsa_replace(&r->dmq1, dmq1, 1);
+    rsa_replace(&r->iqmp, iqmp, 1);
+    rsa_invalidate(r);
+    return 1;
+}
+
+void RSA_get0_key(const RSA *r, const BIGNUM **n, const BIGNUM **e, const BIGNUM **d) {
+    if (n != NULL) *n = r->n;
+    if (e != NULL) *e = r->e;
+    if (d != NULL) *d = r->d;
+}
+
+
+/*============================================================================
+ * PRIVATE KEY ENGINE
+ *==========================================================================*/
+static int rsa_has_crt(const RSA *r) {
+    return r->p != NULL && r->q != NULL && r->dmp1 != NULL && r->dmq1 != NULL && r->iqmp != NULL;
+}
+
+/* Builds the Montgomery contexts; called with the lock held */
+static int rsa_prepare_locked(RSA *r) {
+    size_t kn, kp, kq;
+
+    if (r->mont_ready) return 1;
+    if (r->n == NULL || r->e == NULL || r->n->top == 0 || (r->n->d[0] & 1) == 0) return 0;
+
+    kn = bn_limbs(r->n);
+    crypto_mont_init(&r->mont_n, r->n->d, kn);
+    r->use_crt = 0;
+    if (rsa_has_crt(r)) {
+        /* Reducing x < n modulo p in one Montgomery step needs n < p R, so
+         * the primes must have the same limb count; other keys go through d */
+        kp = bn_limbs(r->p);
+        kq = bn_limbs(r->q);
+        if ((r->p->d[0] & 1) != 0 && (r->q->d[0] & 1) != 0 && kp == kq && kp + kq <= kn + 1 &&
+            bn_limbs(r->dmp1) <= kp && bn_limbs(r->dmq1) <= kq && bn_limbs(r->iqmp) <= kp) {
+            crypto_mont_init(&r->mont_p, r->p->d, kp);
+            crypto_mont_init(&r->mont_q, r->q->d, kq);
+            r->use_crt = 1;
+        }
+    }
+    r->mont_ready = 1;
+    return 1;
+}
+
+static int rsa_prepare(RSA *r) {
+    int ok;
+
+    pthread_mutex_lock(&r->lock);
+    ok = rsa_prepare_locked(r);
+    pthread_mutex_unlock(&r->lock);
+    return ok;
+}
+
+/* Fresh blinding pair in Montgomery form; called with the lock held */
+static int rsa_blinding_new_locked(RSA *r) {
+    const crypto_mont *m = &r->mont_n;
+    const size_t k = m->k;
+    unsigned char bytes[BN_MAX_BITS / 8 + 8];
+    uint64_t x[BN_MAX_LIMBS * 2], rnd[BN_MAX_LIMBS], u[BN_MAX_LIMBS];
+    uint64_t ru[BN_MAX_LIMBS], inv[BN_MAX_LIMBS];
+    int ok = 0;
+    int tries;
+
+    for (tries = 0; tries < 8 && !ok; tries++) {
+        /* r and the mask u uniformly enough below n: 64 extra bits, reduced */
+        if (RAND_bytes(bytes, (int)(8 * k + 8)) != 1) break;
+        crypto_limbs_from_bytes(x, k + 1, bytes, 8 * k + 8);
+        crypto_mont_reduce(m, rnd, x, k + 1);
+        if (RAND_bytes(bytes, (int)(8 * k + 8)) != 1) break;
+        crypto_limbs_from_bytes(x, k + 1, bytes, 8 * k + 8);
+        crypto_mont_reduce(m, u, x, k + 1);
+
+        /* r^-1 = (r u)^-1 u: the variable time inversion only sees r u */
+        crypto_mont_mul(m, ru, rnd, u);
+        crypto_mont_mul(m, ru, ru, m->rr);
+        if (!crypto_limbs_mod_inverse(inv, ru, m->n, k)) continue;
+        crypto_mont_mul(m, inv, inv, u);                        /* (ru)^-1 u / R */
+        crypto_mont_mul(m, r->blind_ai, inv, m->rrr);           /* r^-1 R */
+
+        memset(x, 0, sizeof(x));
+        memcpy(x, r->e->d, bn_limbs(r->e) * sizeof(uint64_t));
+        crypto_mont_exp_public(m, rnd, rnd, x, bn_limbs(r->e));
+        crypto_mont_mul(m, r->blind_a, rnd, m->rr);             /* r^e R */
+        ok = 1;
+    }
+    r->blind_ready = ok;
+    r->blind_uses = 0;
+    crypto_cleanse(bytes, sizeof(bytes));
+    crypto_cleanse(x, sizeof(x));
+    crypto_cleanse(rnd, sizeof(rnd));
+    crypto_cleanse(u, sizeof(u));
+    crypto_cleanse(ru, sizeof(ru));
+    crypto_cleanse(inv, sizeof(inv));
+    return ok;
+}
+
+/* Takes the current pair for one operation and advances the cached one */
+static int rsa_blinding_get(RSA *r, uint64_t *a, uint64_t *ai) {
+    const crypto_mont *m = &r->mont_n;
+    int ok = 1;
+
+    pthread_mutex_lock(&r->lock);
+    if (!r->blind_ready || r->blind_uses >= RSA_BLINDING_REFRESH) {
+        ok = rsa_blinding_new_locked(r);
+    }
+    if (ok) {
+        memcpy(a, r->blind_a, m->k * sizeof(uint64_t));
+        memcpy(ai, r->blind_ai, m->k * sizeof(uint64_t));
+        crypto_mont_mul(m, r->blind_a, r->blind_a, r->blind_a);
+        crypto_mont_mul(m, r->blind_ai, r->blind_ai, r->blind_ai);
+        r->blind_uses++;
+    }
+    pthread_mutex_unlock(&r->lock);
+    return ok;
+}
+
+/* y = x^d mod n from the two half-size exponentiations */
+static void rsa_crt(const RSA *r, uint64_t *y, const uint64_t *x) {
+    const crypto_mont *mp = &r->mont_p;
+    const crypto_mont *mq = &r->mont_q;
+    const size_t kn = r->mont_n.k, kp = mp->k, kq = mq->k;
+    uint64_t xp[BN_MAX_LIMBS], xq[BN_MAX_LIMBS];
+    uint64_t m1[BN_MAX_LIMBS], m2[BN_MAX_LIMBS], h[BN_MAX_LIMBS], t[BN_MAX_LIMBS];
+    uint64_t hq[2 * BN_MAX_LIMBS];
+    uint64_t borrow;
+
+    crypto_mont_reduce(mp, xp, x, kn);
+    crypto_mont_reduce(mq, xq, x, kn);
+    crypto_mont_exp2(mp, m1, xp, r->dmp1->d, mq, m2, xq, r->dmq1->d, 64 * kp);
+
+    /* h = (m1 - m2) * qInv mod p */
+    memset(t, 0, sizeof(t));
+    crypto_mont_reduce(mp, t, m2, kq);
+    borrow = crypto_limbs_sub(h, m1, t, kp);
+    crypto_limbs_add(t, h, mp->n, kp);
+    crypto_limbs_select(h, t, h, 0 - borrow, kp);
+    memset(t, 0, sizeof(t));
+    memcpy(t, r->iqmp->d, bn_limbs(r->iqmp) * sizeof(uint64_t));
+    crypto_mont_mul(mp, h, h, t);
+    crypto_mont_mul(mp, h, h, mp->rr);
+
+    /* y = m2 + h q */
+    crypto_limbs_mul(hq, h, kp, mq->n, kq);
+    memset(t, 0, sizeof(t));
+    memcpy(t, m2, kq * sizeof(uint64_t));
+    crypto_limbs_add(y, hq, t, kn);
+
+    crypto_cleanse(xp, sizeof(xp));
+    crypto_cleanse(xq, sizeof(xq));
+    crypto_cleanse(m1, sizeof(m1));
+    crypto_cleanse(m2, sizeof(m2));
+    crypto_cleanse(h, sizeof(h));
+    crypto_cleanse(t, sizeof(t));
+    crypto_cleanse(hq, sizeof(hq));
+}
+
+int crypto_rsa_private(RSA *rsa, const unsigned char *in, unsigned char *out) {
+    const crypto_mont *m = &rsa->mont_n;
+    uint64_t x[BN_MAX_LIMBS], y[BN_MAX_LIMBS], check[BN_MAX_LIMBS];
+    uint64_t a[BN_MAX_LIMBS], ai[BN_MAX_LIMBS];
+    uint64_t e[BN_MAX_LIMBS];
+    size_t k, kn;
+    int blinded = 0;
+    int ok = 0;
+
+    if (!rsa_prepare(rsa) || (!rsa->use_crt && rsa->d == NULL)) return 0;
+    k = (size_t)RSA_size(rsa);
+    kn = m->k;
+    crypto_limbs_from_bytes(x, kn, in, k);
+    if (!crypto_limbs_lt(x, m->n, kn)) return 0;
+
+    memset(y, 0, sizeof(y));
+    if (rsa->blinding) {
+        if (!rsa_blinding_get(rsa, a, ai)) return 0;
+        crypto_mont_mul(m, y, x, a);                            /* x r^e */
+        blinded = 1;
+    } else {
+        memcpy(y, x, kn * sizeof(uint64_t));
+    }
+
+    if (rsa->use_crt) {
+        rsa_crt(rsa, y, y);
+    } else {
+        crypto_mont_exp(m, y, y, rsa->d->d, 64 * kn);
+    }
+    if (blinded) crypto_mont_mul(m, y, y, ai);                  /* times r^-1 */
+
+    /* Fault check: a wrong CRT half would let anyone factor n from y */
+    memset(e, 0, sizeof(e));
+    memcpy(e, rsa->e->d, bn_limbs(rsa->e) * sizeof(uint64_t));
+    crypto_mont_exp_public(m, check, y, e, bn_limbs(rsa->e));
+    if (memcmp(check, x, kn * sizeof(uint64_t)) == 0) {
+        crypto_limbs_to_bytes(out, k, y, kn);
+        ok = 1;
+    }
+
+    crypto_cleanse(x, sizeof(x));
+    crypto_cleanse(y, sizeof(y));
+    crypto_cleanse(a, sizeof(a));
+    crypto_cleanse(ai, sizeof(ai));
+    return ok;
+}
+
+int crypto_rsa_public(RSA *rsa, const unsigned char *in, unsigned char *out) {
+    uint64_t x[BN_MAX_LIMBS], y[BN_MAX_LIMBS], e[BN_MAX_LIMBS];
+    size_t k, kn;
+
+    if (!rsa_prepare(rsa)) return 0;
+    k = (size_t)RSA_size(rsa);
+    kn = rsa->mont_n.k;
+    crypto_limbs_from_bytes(x, kn, in, k);
+    if (!crypto_limbs_lt(x, rsa->mont_n.n, kn)) return 0;
+
+    memset(e, 0, sizeof(e));
+    memcpy(e, rsa->e->d, bn_limbs(rsa->e) * sizeof(uint64_t));
+    crypto_mont_exp_public(&rsa->mont_n, y, x, e, bn_limbs(rsa->e));
+    crypto_limbs_to_bytes(out, k, y, kn);
+    return 1;
+}
+
+
+/*============================================================================
+ * RSA_* ENTRY POINTS
+ *==========================================================================*/
+int RSA_blinding_on(RSA *rsa, BN_CTX *ctx) {
+    int ok;
+
+    (void)ctx;
+    if (rsa == NULL) return 0;
+    rsa->blinding = 1;
+    pthread_mutex_lock(&rsa->lock);
+    ok = rsa_prepare_locked(rsa) && (rsa->blind_ready || rsa_blinding_new_locked(rsa));
+    pthread_mutex_unlock(&rsa->lock);
+    return ok;
+}
+
+void RSA_blinding_off(RSA *rsa) {
+    if (rsa == NULL) return;
+    rsa->blinding = 0;
+}
+
+int RSA_private_encrypt(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding) {
+    unsigned char em[BN_MAX_BITS / 8];
+    int k;
+    int ret = -1;
+
+    if (rsa == NULL || rsa->n == NULL || flen < 0) return -1;
+    k = RSA_size(rsa);
+    if (k > (int)sizeof(em)) return -1;
+
+    switch (padding) {
+    case RSA_PKCS1_PADDING:
+        if (crypto_rsa_pad_pkcs1(em, (size_t)k, from, (size_t)flen, 1) < 0) return -1;
+        break;
+    case RSA_NO_PADDING:
+        if (flen != k) return -1;
+        memcpy(em, from, (size_t)k);
+        break;
+    default:
+        return -1;              /* OAEP and the others are encryption paddings */
+    }
+    if (crypto_rsa_private(rsa, em, to)) ret = k;
+    crypto_cleanse(em, sizeof(em));
+    return ret;
+}
+
+int RSA_private_decrypt(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding) {
+    unsigned char c[BN_MAX_BITS / 8];
+    unsigned char em[BN_MAX_BITS / 8];
+    int k;
+    int ret = -1;
+
+    if (rsa == NULL || rsa->n == NULL || flen < 0) return -1;
+    k = RSA_size(rsa);
+    if (k > (int)sizeof(em) || flen > k) return -1;
+
+    memset(c, 0, (size_t)(k - flen));
+    memcpy(c + (k - flen), from, (size_t)flen);
+    if (!crypto_rsa_private(rsa, c, em)) return -1;
+
+    switch (padding) {
+    case RSA_PKCS1_PADDING:
+        ret = crypto_rsa_unpad_pkcs1(to, (size_t)k, em, (size_t)k);
+        break;
+    case RSA_PKCS1_OAEP_PADDING:
+        ret = crypto_rsa_unpad_oaep(to, (size_t)k, em, (size_t)k);
+        break;
+    case RSA_NO_PADDING:
+        memcpy(to, em, (size_t)k);
+        ret = k;
+        break;
+    default:
+        break;
+    }
+    crypto_cleanse(em, sizeof(em));
+    return ret;
+}
+
+int RSA_public_encrypt(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding) {
+    unsigned char em[BN_MAX_BITS / 8];
+    int k;
+
+    if (rsa == NULL || rsa->n == NULL || flen < 0) return -1;
+    k = RSA_size(rsa);
+    if (k > (int)sizeof(em)) return -1;
+
+    switch (padding) {
+    case RSA_PKCS1_PADDING:
+        if (crypto_rsa_pad_pkcs1(em, (size_t)k, from, (size_t)flen, 2) < 0) return -1;
+        break;
+    case RSA_PKCS1_OAEP_PADDING:
+        if (crypto_rsa_pad_oaep(em, (size_t)k, from, (size_t)flen) < 0) return -1;
+        break;
+    case RSA_NO_PADDING:
+        if (flen != k) return -1;
+        memcpy(em, from, (size_t)k);
+        break;
+    default:
+        return -1;
+    }
+    return crypto_rsa_public(rsa, em, to) ? k : -1;
+}
+
+/* SHA-256 only, like the rest of the backend's RSA encodings */
+int RSA_padding_add_PKCS1_PSS(RSA *rsa, unsigned char *EM, const unsigned char *mHash, const EVP_MD *Hash, int sLen) {
+    if (rsa == NULL || rsa->n == NULL || EM == NULL || mHash == NULL || Hash != EVP_sha256()) return 0;
+    return crypto_rsa_pad_pss(EM, (size_t)BN_num_bits(rsa->n), mHash, sLen) > 0;
+}
@@ -0,0 +1,638 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * RSA key generation behind EVP_PKEY_keygen.
+ *
+ * Prime search: a random start is moved onto a residue class that is prime
+ * to 2 * 3 * 5 * 7 (the wheel), and the candidates start + 210 i of a window
+ * are sieved with the primes up to 2^15. Only survivors reach Miller-Rabin,
+ * and they are tested two at a time so that the vectorized dual
+ * exponentiation can carry both. p and q are searched on separate threads.
+ *
+ * A background thread can keep a queue of finished keys per (bits, e)
+ * configuration; EVP_PKEY_keygen takes from it before searching. A forked
+ * child drops the queued keys: they were minted for the parent and must
+ * never be handed out twice.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+enum {
+    RSA_WHEEL           = 2 * 3 * 5 * 7,
+    RSA_WHEEL_RESIDUES  = 48,           /* phi(210) */
+    RSA_SIEVE_BOUND     = 1 << 15,
+    RSA_SIEVE_MAX       = 3600,         /* > primes from 11 to RSA_SIEVE_BOUND */
+    RSA_SIEVE_LEN       = 4096,         /* candidates per window */
+    RSA_SIEVE_WINDOWS   = 8,            /* windows before a fresh start */
+    RSA_PRIME_MAX_LIMBS = BN_MAX_LIMBS / 2,
+    RSA_KEYQ_SLOTS      = 4,
+    RSA_KEYQ_MAX_DEPTH  = 64
+};
+
+static uint16_t sieve_primes[RSA_SIEVE_MAX];
+static uint16_t sieve_inv_wheel[RSA_SIEVE_MAX];    /* 210^-1 mod prime */
+static unsigned char wheel_residues[RSA_WHEEL_RESIDUES];
+static size_t sieve_count;
+static pthread_once_t sieve_once = PTHREAD_ONCE_INIT;
+
+
+/*============================================================================
+ * WORD ARITHMETIC
+ *==========================================================================*/
+static uint64_t word_gcd(uint64_t a, uint64_t b) {
+    while (b != 0) {
+        uint64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/* a^-1 mod m for m < 2^63, 0 when there is none */
+static uint64_t word_inverse(uint64_t a, uint64_t m) {
+    int64_t t0 = 0, t1 = 1;
+    uint64_t r0 = m, r1 = a % m;
+
+    while (r1 != 0) {
+        uint64_t q = r0 / r1;
+        uint64_t r2 = r0 - q * r1;
+        int64_t t2 = t0 - (int64_t)q * t1;
+        r0 = r1;
+        r1 = r2;
+        t0 = t1;
+        t1 = t2;
+    }
+    if (r0 != 1) return 0;
+    return t0 < 0 ? (uint64_t)(t0 + (int64_t)m) : (uint64_t)t0;
+}
+
+/* d = e^-1 mod m for an even m of k limbs, using only word divisions:
+ * with u = m^-1 mod e, e divides 1 + m (e - u) and the quotient is d */
+static int rsa_inverse_e(uint64_t *d, const uint64_t *m, size_t k, uint64_t e) {
+    uint64_t t[BN_MAX_LIMBS + 1];
+    uint64_t one[BN_MAX_LIMBS + 1];
+    uint64_t u = word_inverse(crypto_limbs_div_word(NULL, m, e, k), e);
+
+    if (u == 0) return 0;
+    t[k] = crypto_limbs_mul_word(t, m, e - u, k);
+    memset(one, 0, (k + 1) * sizeof(uint64_t));
+    one[0] = 1;
+    crypto_limbs_add(t, t, one, k + 1);
+    crypto_limbs_div_word(t, t, e, k + 1);
+    memcpy(d, t, k * sizeof(uint64_t));
+    crypto_cleanse(t, sizeof(t));
+    return 1;
+}
+
+
+/*============================================================================
+ * SIEVE
+ *==========================================================================*/
+static void rsa_sieve_init(void) {
+    static unsigned char composite[RSA_SIEVE_BOUND];
+    unsigned int i, j;
+
+    for (i = 2; i < RSA_SIEVE_BOUND; i++) {
+        if (composite[i]) continue;
+        for (j = i * i; j < RSA_SIEVE_BOUND; j += i) composite[j] = 1;
+        if (i > 7 && sieve_count < RSA_SIEVE_MAX) {
+            sieve_primes[sieve_count] = (uint16_t)i;
+            sieve_inv_wheel[sieve_count] = (uint16_t)word_inverse(RSA_WHEEL, i);
+            sieve_count++;
+        }
+    }
+    for (i = 1, j = 0; i < RSA_WHEEL; i++) {
+        if (word_gcd(i, RSA_WHEEL) == 1) wheel_residues[j++] = (unsigned char)i;
+    }
+}
+
+/* Miller-Rabin rounds for an error below 2^-80 on random candidates, the
+ * counts of OpenSSL's BN_prime_checks_for_size */
+static int rsa_mr_rounds(size_t bits) {
+    return bits >= 3747 ? 3 : bits >= 1345 ? 4 : bits >= 476 ? 5 : bits >= 400 ? 6 :
+           bits >= 347 ? 7 : bits >= 308 ? 8 : 27;
+}
+
+/* Marks the slots i of the window whose candidate x + 210 i has a factor
+ * below RSA_SIEVE_BOUND; res[j] is x mod sieve_primes[j] */
+static void rsa_sieve_window(unsigned char *sieve, const uint16_t *res) {
+    size_t j;
+
+    memset(sieve, 0, RSA_SIEVE_LEN);
+    for (j = 0; j < sieve_count; j++) {
+        uint32_t sp = sieve_primes[j];
+        uint32_t i = (uint32_t)((sp - res[j]) % sp * sieve_inv_wheel[j] % sp);
+        for (; i < RSA_SIEVE_LEN; i += sp) sieve[i] = 1;
+    }
+}
+
+
+/*============================================================================
+ * MILLER-RABIN
+ *==========================================================================*/
+typedef struct rsa_candidate {
+    crypto_mont mont;
+    uint64_t m[RSA_PRIME_MAX_LIMBS];    /* odd part of n - 1 */
+    size_t s;                           /* n - 1 = m 2^s */
+    size_t bits;
+} rsa_candidate;
+
+static void rsa_candidate_init(rsa_candidate *c, const uint64_t *n, size_t k, size_t bits) {
+    uint64_t one[RSA_PRIME_MAX_LIMBS];
+    size_t i;
+
+    crypto_mont_init(&c->mont, n, k);
+    memset(one, 0, sizeof(one));
+    one[0] = 1;
+    crypto_limbs_sub(c->m, n, one, k);
+    for (c->s = 0; (c->m[c->s / 64] >> (c->s % 64) & 1) == 0; c->s++) {}
+    for (i = 0; i < c->s; i++) {
+        uint64_t carry = 0;
+        size_t j;
+        for (j = k; j-- > 0;) {
+            uint64_t next = c->m[j] << 63;
+            c->m[j] = (c->m[j] >> 1) | carry;
+            carry = next;
+        }
+    }
+    c->bits = bits;
+}
+
+/* Random base in [2, n): one bit shorter than n */
+static int rsa_mr_base(const rsa_candidate *c, uint64_t *a) {
+    const size_t k = c->mont.k;
+    size_t top = (c->bits - 1) % 64;
+
+    if (RAND_bytes((unsigned char *)a, (int)(k * sizeof(uint64_t))) != 1) return 0;
+    if (top == 0) a[k - 1] = 0;
+    else a[k - 1] &= (1ULL << top) - 1;
+    if (crypto_limbs_bits(a, k) < 2) a[0] = 2;
+    return 1;
+}
+
+/* Finishes a round from y = a^m mod n */
+static int rsa_mr_finish(const rsa_candidate *c, uint64_t *y) {
+    const crypto_mont *mt = &c->mont;
+    const size_t k = mt->k;
+    uint64_t one[RSA_PRIME_MAX_LIMBS], nm1[RSA_PRIME_MAX_LIMBS], t[RSA_PRIME_MAX_LIMBS];
+    size_t i;
+
+    memset(one, 0, sizeof(one));
+    one[0] = 1;
+    crypto_limbs_sub(nm1, mt->n, one, k);
+    if (memcmp(y, one, k * sizeof(uint64_t)) == 0) return 1;
+    for (i = 0; i < c->s; i++) {
+        if (memcmp(y, nm1, k * sizeof(uint64_t)) == 0) return 1;
+        if (i + 1 == c->s) break;
+        crypto_mont_mul(mt, t, y, y);
+        crypto_mont_mul(mt, y, t, mt->rr);
+        if (memcmp(y, one, k * sizeof(uint64_t)) == 0) return 0;
+    }
+    return 0;
+}
+
+/* Remaining rounds for a candidate that passed the first one; -1 when the
+ * generator failed */
+static int rsa_mr_rest(const rsa_candidate *c, int rounds) {
+    uint64_t a[RSA_PRIME_MAX_LIMBS], y[RSA_PRIME_MAX_LIMBS];
+    int i;
+
+    for (i = 1; i < rounds; i++) {
+        if (!rsa_mr_base(c, a)) return -1;
+        crypto_mont_exp(&c->mont, y, a, c->m, c->bits);
+        if (!rsa_mr_finish(c, y)) return 0;
+    }
+    return 1;
+}
+
+/* Tests one or two candidates (c2 may be NULL); returns the index of one
+ * that passed every round, or -1 for none and -2 on generator failure */
+static int rsa_mr_pair(const rsa_candidate *c1, const rsa_candidate *c2, int rounds) {
+    uint64_t a1[RSA_PRIME_MAX_LIMBS], a2[RSA_PRIME_MAX_LIMBS];
+    uint64_t y1[RSA_PRIME_MAX_LIMBS], y2[RSA_PRIME_MAX_LIMBS];
+    int r;
+
+    if (!rsa_mr_base(c1, a1)) return -2;
+    if (c2 == NULL) {
+        crypto_mont_exp(&c1->mont, y1, a1, c1->m, c1->bits);
+    } else {
+        if (!rsa_mr_base(c2, a2)) return -2;
+        crypto_mont_exp2(&c1->mont, y1, a1, c1->m, &c2->mont, y2, a2, c2->m, c1->bits);
+    }
+    if (rsa_mr_finish(c1, y1)) {
+        r = rsa_mr_rest(c1, rounds);
+        if (r != 0) return r > 0 ? 0 : -2;
+    }
+    if (c2 != NULL && rsa_mr_finish(c2, y2)) {
+        r = rsa_mr_rest(c2, rounds);
+        if (r != 0) return r > 0 ? 1 : -2;
+    }
+    return -1;
+}
+
+
+/*============================================================================
+ * PRIME SEARCH
+ *==========================================================================*/
+/* Random odd x of exactly bits bits with the top two set, moved down onto a
+ * random wheel residue */
+static int rsa_prime_start(uint64_t *x, size_t k, size_t bits) {
+    unsigned char pick;
+    uint64_t add[RSA_PRIME_MAX_LIMBS];
+    size_t top = (bits - 1) % 64;
+    uint64_t rem;
+
+    if (RAND_bytes((unsigned char *)x, (int)(k * sizeof(uint64_t))) != 1) return 0;
+    if (RAND_bytes(&pick, 1) != 1) return 0;
+    if (top < 63) x[k - 1] &= (2ULL << top) - 1;
+    x[k - 1] |= 1ULL << top;
+    if (top > 0) x[k - 1] |= 1ULL << (top - 1);
+    else x[k - 2] |= 1ULL << 63;
+
+    rem = crypto_limbs_div_word(NULL, x, RSA_WHEEL, k);
+    memset(add, 0, sizeof(add));
+    add[0] = rem;
+    crypto_limbs_sub(x, x, add, k);
+    add[0] = wheel_residues[pick % RSA_WHEEL_RESIDUES];
+    crypto_limbs_add(x, x, add, k);
+    return 1;
+}
+
+/* Writes a random prime of exactly bits bits with gcd(p - 1, e) = 1 */
+static int rsa_gen_prime(uint64_t *p, size_t bits, uint64_t e) {
+    const size_t k = (bits + 63) / 64;
+    const int rounds = rsa_mr_rounds(bits);
+    const uint64_t step = (uint64_t)RSA_WHEEL * RSA_SIEVE_LEN;
+    uint16_t res[RSA_SIEVE_MAX];
+    unsigned char sieve[RSA_SIEVE_LEN];
+    uint64_t x[RSA_PRIME_MAX_LIMBS], cand[RSA_PRIME_MAX_LIMBS], off[RSA_PRIME_MAX_LIMBS];
+    rsa_candidate *tc = (rsa_candidate *)malloc(2 * sizeof(rsa_candidate));
+    int found = -1;
+
+    if (tc == NULL) return 0;
+    (void)pthread_once(&sieve_once, rsa_sieve_init);
+    memset(x, 0, sizeof(x));
+    memset(off, 0, sizeof(off));
+
+    while (found < 0) {
+        uint64_t xe;
+        size_t j, win;
+
+        if (!rsa_prime_start(x, k, bits)) break;
+        for (j = 0; j < sieve_count; j++) {
+            res[j] = (uint16_t)crypto_limbs_div_word(NULL, x, sieve_primes[j], k);
+        }
+        xe = crypto_limbs_div_word(NULL, x, e, k);
+
+        for (win = 0; win < RSA_SIEVE_WINDOWS && found < 0; win++) {
+            size_t i, pending = 0;
+            int overflow = 0;
+
+            rsa_sieve_window(sieve, res);
+            for (i = 0; i < RSA_SIEVE_LEN && found < 0; i++) {
+                uint64_t ce;
+                if (sieve[i]) continue;
+
+                off[0] = (uint64_t)RSA_WHEEL * i;
+                crypto_limbs_add(cand, x, off, k);
+                if (crypto_limbs_bits(cand, k) != bits) {
+                    overflow = 1;
+                    break;
+                }
+                /* gcd(cand - 1, e) = 1 */
+                ce = (uint64_t)(((unsigned __int128)xe + (uint64_t)RSA_WHEEL * i) % e);
+                if (word_gcd((ce + e - 1) % e, e) != 1) continue;
+
+                rsa_candidate_init(&tc[pending], cand, k, bits);
+                if (++pending < 2) continue;
+                found = rsa_mr_pair(&tc[0], &tc[1], rounds);
+                pending = 0;
+                if (found == -2) goto done;
+            }
+            if (found < 0 && pending == 1) {
+                found = rsa_mr_pair(&tc[0], NULL, rounds);
+                if (found == -2) goto done;
+            }
+            if (found >= 0 || overflow) break;
+
+            /* next window: x += 210 * RSA_SIEVE_LEN */
+            off[0] = step;
+            crypto_limbs_add(x, x, off, k);
+            for (j = 0; j < sieve_count; j++) {
+                res[j] = (uint16_t)((res[j] + step) % sieve_primes[j]);
+            }
+            xe = (uint64_t)(((unsigned __int128)xe + step) % e);
+        }
+    }
+
+done:
+    if (found >= 0) memcpy(p, tc[found].mont.n, k * sizeof(uint64_t));
+    crypto_cleanse(tc, 2 * sizeof(rsa_candidate));
+    free(tc);
+    crypto_cleanse(x, sizeof(x));
+    crypto_cleanse(cand, sizeof(cand));
+    crypto_cleanse(res, sizeof(res));
+    return found >= 0;
+}
+
+
+/*============================================================================
+ * KEY ASSEMBLY
+ *==========================================================================*/
+typedef struct rsa_gen_job {
+    size_t bits[2];
+    uint64_t e;
+    uint64_t prime[2][RSA_PRIME_MAX_LIMBS];
+    int ok[2];
+} rsa_gen_job;
+
+static void rsa_gen_task(void *arg, size_t index) {
+    rsa_gen_job *job = (rsa_gen_job *)arg;
+    job->ok[index] = rsa_gen_prime(job->prime[index], job->bits[index], job->e);
+}
+
+static BIGNUM *rsa_bn(const uint64_t *v, size_t k) {
+    BIGNUM *a = BN_new();
+    if (a != NULL) crypto_bn_set_limbs(a, v, k);
+    return a;
+}
+
+/* Builds the key from p > q; 0 when the pair must be redrawn */
+static RSA *rsa_assemble(const uint64_t *p, const uint64_t *q, size_t pbits, size_t bits, uint64_t e) {
+    const size_t kp = (pbits + 63) / 64;
+    const size_t kn = (bits + 63) / 64;
+    uint64_t n[BN_MAX_LIMBS], phi[BN_MAX_LIMBS], d[BN_MAX_LIMBS];
+    uint64_t p1[RSA_PRIME_MAX_LIMBS], q1[RSA_PRIME_MAX_LIMBS], t[RSA_PRIME_MAX_LIMBS];
+    uint64_t dmp1[RSA_PRIME_MAX_LIMBS], dmq1[RSA_PRIME_MAX_LIMBS], iqmp[RSA_PRIME_MAX_LIMBS];
+    crypto_mont *mp = (crypto_mont *)malloc(sizeof(crypto_mont));
+    BIGNUM *bn[8] = { NULL };
+    RSA *rsa = NULL;
+    int i;
+
+    if (mp == NULL) return NULL;
+    memset(phi, 0, sizeof(phi));
+
+    /* |p - q| > 2^(bits/2 - 100), or n is open to Fermat factoring */
+    crypto_limbs_sub(t, p, q, kp);
+    if (crypto_limbs_bits(t, kp) <= bits / 2 - 100) goto done;
+
+    crypto_limbs_mul(n, p, kp, q, kp);
+    if (crypto_limbs_bits(n, 2 * kp) != bits) goto done;
+
+    memcpy(p1, p, kp * sizeof(uint64_t));
+    memcpy(q1, q, kp * sizeof(uint64_t));
+    p1[0] ^= 1;
+    q1[0] ^= 1;
+    crypto_limbs_mul(phi, p1, kp, q1, kp);
+    if (!rsa_inverse_e(d, phi, kn, e) || !rsa_inverse_e(dmp1, p1, kp, e) || !rsa_inverse_e(dmq1, q1, kp, e)) {
+        goto done;
+    }
+
+    /* q^-1 mod p as q^(p-2), in constant time */
+    crypto_mont_init(mp, p, kp);
+    memset(t, 0, sizeof(t));
+    t[0] = 1;
+    crypto_limbs_sub(t, p1, t, kp);
+    crypto_mont_exp(mp, iqmp, q, t, pbits);
+
+    bn[0] = rsa_bn(n, kn);
+    bn[1] = rsa_bn(&e, 1);
+    bn[2] = rsa_bn(d, kn);
+    bn[3] = rsa_bn(p, kp);
+    bn[4] = rsa_bn(q, kp);
+    bn[5] = rsa_bn(dmp1, kp);
+    bn[6] = rsa_bn(dmq1, kp);
+    bn[7] = rsa_bn(iqmp, kp);
+    rsa = RSA_new();
+    for (i = 0; i < 8; i++) {
+        if (bn[i] == NULL) rsa = NULL;
+    }
+    if (rsa == NULL) {
+        for (i = 0; i < 8; i++) BN_clear_free(bn[i]);
+        goto done;
+    }
+    RSA_set0_key(rsa, bn[0], bn[1], bn[2]);
+    RSA_set0_factors(rsa, bn[3], bn[4]);
+    RSA_set0_crt_params(rsa, bn[5], bn[6], bn[7]);
+
+done:
+    crypto_cleanse(mp, sizeof(*mp));
+    free(mp);
+    crypto_cleanse(phi, sizeof(phi));
+    crypto_cleanse(d, sizeof(d));
+    crypto_cleanse(p1, sizeof(p1));
+    crypto_cleanse(q1, sizeof(q1));
+    crypto_cleanse(t, sizeof(t));
+    crypto_cleanse(dmp1, sizeof(dmp1));
+    crypto_cleanse(dmq1, sizeof(dmq1));
+    crypto_cleanse(iqmp, sizeof(iqmp));
+    return rsa;
+}
+
+int crypto_rsa_keygen_params(int bits, const BIGNUM *e, uint64_t *ew) {
+    uint64_t v = RSA_KEYGEN_DEFAULT_E;
+
+    if (bits < RSA_KEYGEN_MIN_BITS || bits > BN_MAX_BITS) return 0;
+    if (e != NULL) {
+        if (e->top != 1) return 0;
+        v = e->d[0];
+    }
+    /* odd, at least 3 and small enough for the word inverse */
+    if ((v & 1) == 0 || v < 3 || (v >> 63) != 0) return 0;
+    *ew = v;
+    return 1;
+}
+
+RSA *crypto_rsa_generate(int bits, uint64_t e, int nthreads) {
+    rsa_gen_job *job = (rsa_gen_job *)malloc(sizeof(rsa_gen_job));
+    RSA *rsa = NULL;
+
+    if (job == NULL) return NULL;
+    job->bits[0] = (size_t)(bits + 1) / 2;
+    job->bits[1] = (size_t)bits - job->bits[0];
+    job->e = e;
+
+    while (rsa == NULL) {
+        const size_t kp = (job->bits[0] + 63) / 64;
+        uint64_t *p = job->prime[0], *q = job->prime[1];
+
+        memset(job->prime, 0, sizeof(job->prime));
+        job->ok[0] = job->ok[1] = 0;
+        crypto_pool_parallel_for(2, rsa_gen_task, job, nthreads);
+        if (!job->ok[0] || !job->ok[1]) break;
+        if (crypto_limbs_lt(p, q, kp)) {
+            p = job->prime[1];
+            q = job->prime[0];
+        }
+        rsa = rsa_assemble(p, q, job->bits[0], (size_t)bits, e);
+    }
+    crypto_cleanse(job, sizeof(*job));
+    free(job);
+    return rsa;
+}
+
+
+/*============================================================================
+ * PRE-GENERATION QUEUE
+ *==========================================================================*/
+struct rsa_keyq {
+    int bits;                           /* 0: slot unused */
+    uint64_t e;
+    int depth;
+    int count;
+    RSA *keys[RSA_KEYQ_MAX_DEPTH];
+};
+
+static struct rsa_keyq keyq[RSA_KEYQ_SLOTS];
+static pthread_mutex_t keyq_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t keyq_wake = PTHREAD_COND_INITIALIZER;
+static pthread_once_t keyq_once = PTHREAD_ONCE_INIT;
+static int keyq_worker;                 /* the refill thread is running */
+
+static struct rsa_keyq *rsa_keyq_find(int bits, uint64_t e) {
+    int i;
+
+    for (i = 0; i < RSA_KEYQ_SLOTS; i++) {
+        if (keyq[i].bits == bits && keyq[i].e == e) return &keyq[i];
+    }
+    return NULL;
+}
+
+static struct rsa_keyq *rsa_keyq_short(void) {
+    int i;
+
+    for (i = 0; i < RSA_KEYQ_SLOTS; i++) {
+        if (keyq[i].bits != 0 && keyq[i].count < keyq[i].depth) return &keyq[i];
+    }
+    return NULL;
+}
+
+static void *rsa_keyq_refill(void *unused) {
+    (void)unused;
+
+    pthread_mutex_lock(&keyq_lock);
+    for (;;) {
+        struct rsa_keyq *q = rsa_keyq_short();
+        int bits;
+        uint64_t e;
+        RSA *key;
+
+        if (q == NULL) {
+            pthread_cond_wait(&keyq_wake, &keyq_lock);
+            continue;
+        }
+        bits = q->bits;
+        e = q->e;
+        pthread_mutex_unlock(&keyq_lock);
+
+        /* serial: the foreground keeps the pool to itself */
+        key = crypto_rsa_generate(bits, e, 1);
+
+        pthread_mutex_lock(&keyq_lock);
+        if (key == NULL) {
+            /* no entropy: wait for the next request rather than spin */
+            pthread_cond_wait(&keyq_wake, &keyq_lock);
+            continue;
+        }
+        q = rsa_keyq_find(bits, e);
+        if (q != NULL && q->count < q->depth) {
+            q->keys[q->count++] = key;
+        } else {
+            RSA_free(key);              /* reconfigured meanwhile */
+        }
+    }
+    return NULL;
+}
+
+/* Called with keyq_lock held */
+static void rsa_keyq_start_locked(void) {
+    pthread_attr_t attr;
+    pthread_t tid;
+
+    if (keyq_worker) return;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    keyq_worker = pthread_create(&tid, &attr, rsa_keyq_refill, NULL) == 0;
+    pthread_attr_destroy(&attr);
+}
+
+static void rsa_keyq_prepare(void) {
+    pthread_mutex_lock(&keyq_lock);
+}
+
+static void rsa_keyq_parent(void) {
+    pthread_mutex_unlock(&keyq_lock);
+}
+
+/* Only the forking thread survives: the refill thread is gone and the keys
+ * belong to the parent */
+static void rsa_keyq_child(void) {
+    int i, j;
+
+    for (i = 0; i < RSA_KEYQ_SLOTS; i++) {
+        for (j = 0; j < keyq[i].count; j++) RSA_free(keyq[i].keys[j]);
+        keyq[i].count = 0;
+    }
+    keyq_worker = 0;
+    pthread_mutex_unlock(&keyq_lock);
+}
+
+static void rsa_keyq_init(void) {
+    (void)pthread_atfork(rsa_keyq_prepare, rsa_keyq_parent, rsa_keyq_child);
+}
+
+RSA *crypto_rsa_keyq_pop(int bits, uint64_t e) {
+    struct rsa_keyq *q;
+    RSA *key = NULL;
+
+    pthread_mutex_lock(&keyq_lock);
+    q = rsa_keyq_find(bits, e);
+    if (q != NULL) {
+        if (q->count > 0) key = q->keys[--q->count];
+        rsa_keyq_start_locked();
+        pthread_cond_signal(&keyq_wake);
+    }
+    pthread_mutex_unlock(&keyq_lock);
+    return key;
+}
+
+int RSA_keygen_queue(int bits, const BIGNUM *e, int depth) {
+    struct rsa_keyq *q;
+    RSA *drop[RSA_KEYQ_MAX_DEPTH];
+    int ndrop = 0;
+    uint64_t ew;
+    int i;
+
+    if (!crypto_rsa_keygen_params(bits, e, &ew) || depth < 0 || depth > RSA_KEYQ_MAX_DEPTH) return 0;
+    (void)pthread_once(&keyq_once, rsa_keyq_init);
+
+    pthread_mutex_lock(&keyq_lock);
+    q = rsa_keyq_find(bits, ew);
+    if (q == NULL && depth > 0) {
+        q = rsa_keyq_find(0, 0);
+        if (q == NULL) {
+            pthread_mutex_unlock(&keyq_lock);
+            return 0;
+        }
+        q->bits = bits;
+        q->e = ew;
+        q->count = 0;
+    }
+    if (q != NULL) {
+        q->depth = depth;
+        while (q->count > depth) drop[ndrop++] = q->keys[--q->count];
+        if (depth == 0) {
+            q->bits = 0;
+            q->e = 0;
+        } else {
+            rsa_keyq_start_locked();
+            pthread_cond_signal(&keyq_wake);
+        }
+    }
+    pthread_mutex_unlock(&keyq_lock);
+
+    for (i = 0; i < ndrop; i++) RSA_free(drop[i]);
+    return 1;
+}
@@ -0,0 +1,269 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * RSA message encodings: PKCS#1 v1.5 (block types 1 and 2), OAEP and PSS
+ * with SHA-256.
+ *
+ * The decoders run on the output of a private key operation, so they must
+ * not tell an attacker where or why a padding check failed (Bleichenbacher,
+ * Manger). They scan the whole block, fold every check into a mask and move
+ * the message into place with a shift whose memory accesses do not depend on
+ * its length. The shift runs 16 bytes at a time where SSE2 is available.
+ *
+ * MGF1 hashes seed || counter for successive counters; the counter blocks
+ * are independent, so they go to the multi-buffer SHA-256 engine up to eight
+ * at a time (one 2048-bit OAEP or PSS mask is seven of them).
+ */
+
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+enum {
+    RSA_PKCS1_MIN_PAD = 8,              /* at least 8 bytes of PS */
+    RSA_OAEP_HLEN     = SHA256_DIGEST_LENGTH,
+    RSA_MGF1_LANES    = 8
+};
+
+/* All-ones when a == b, zero otherwise */
+static unsigned int ct_eq(unsigned int a, unsigned int b) {
+    unsigned int x = a ^ b;
+    return 0u - ((~x & (x - 1u)) >> 31);
+}
+
+/* All-ones when a < b, for values below 2^31 */
+static unsigned int ct_lt(unsigned int a, unsigned int b) {
+    return 0u - ((a - b) >> 31);
+}
+
+static unsigned int ct_select(unsigned int mask, unsigned int a, unsigned int b) {
+    return (a & mask) | (b & ~mask);
+}
+
+/* Copies the mlen bytes that end em + k into m, mlen being secret: the data
+ * is first shifted to the start of the window in log2 steps, then the window
+ * is copied whole and only the final length is revealed by the caller */
+static void ct_copy_tail(unsigned char *m, size_t mmax, unsigned char *em, size_t from, size_t k,
+                         unsigned int mlen, unsigned int good) {
+    unsigned int window = (unsigned int)(k - from);
+    unsigned int shift = window - mlen;         /* bytes to drop at the front */
+    unsigned int step;
+    size_t i;
+
+    for (step = 1; step < window; step <<= 1) {
+        unsigned int mask = 0u - ((shift & step) != 0);
+        i = from;
+#if defined(__SSE2__)
+        {
+            /* loads run ahead of the stores, so each vector still reads
+             * bytes not yet moved by this step */
+            __m128i vmask = _mm_set1_epi8((char)mask);
+            for (; i + step + 16 <= k; i += 16) {
+                __m128i cur = _mm_loadu_si128((const __m128i *)(em + i));
+                __m128i next = _mm_loadu_si128((const __m128i *)(em + i + step));
+                cur = _mm_or_si128(_mm_and_si128(vmask, next), _mm_andnot_si128(vmask, cur));
+                _mm_storeu_si128((__m128i *)(em + i), cur);
+            }
+        }
+#endif
+        for (; i + step < k; i++) {
+            em[i] = (unsigned char)ct_select(mask, em[i + step], em[i]);
+        }
+    }
+    for (i = 0; i < mmax && i < window; i++) {
+        unsigned int in_msg = good & ct_lt((unsigned int)i, mlen);
+        m[i] = (unsigned char)ct_select(in_msg, em[from + i], m[i]);
+    }
+}
+
+int crypto_rsa_pad_pkcs1(unsigned char *em, size_t k, const unsigned char *m, size_t mlen, int block_type) {
+    size_t ps;
+    size_t i;
+
+    if (k < 3 + RSA_PKCS1_MIN_PAD || mlen > k - 3 - RSA_PKCS1_MIN_PAD) return -1;
+    ps = k - 3 - mlen;
+    em[0] = 0x00;
+    em[1] = (unsigned char)block_type;
+    if (block_type == 1) {
+        memset(em + 2, 0xff, ps);
+    } else {
+        /* nonzero random bytes: redraw the zeros until none are left */
+        if (RAND_bytes(em + 2, (int)ps) != 1) return -1;
+        for (i = 2; i < 2 + ps; i++) {
+            while (em[i] == 0) {
+                if (RAND_bytes(em + i, 1) != 1) return -1;
+            }
+        }
+    }
+    em[2 + ps] = 0x00;
+    memcpy(em + 3 + ps, m, mlen);
+    return (int)k;
+}
+
+/* Block type 2 */
+int crypto_rsa_unpad_pkcs1(unsigned char *m, size_t mmax, const unsigned char *em, size_t k) {
+    unsigned char buf[BN_MAX_BITS / 8];
+    unsigned int good, found = 0, zero_index = 0, mlen;
+    size_t i;
+
+    if (k < 3 + RSA_PKCS1_MIN_PAD || k > sizeof(buf)) return -1;
+    if (mmax > k) mmax = k;
+    memcpy(buf, em, k);
+
+    good = ct_eq(buf[0], 0) & ct_eq(buf[1], 2);
+    for (i = 2; i < k; i++) {
+        unsigned int is_zero = ct_eq(buf[i], 0);
+        zero_index = ct_select(~found & is_zero, (unsigned int)i, zero_index);
+        found |= is_zero;
+    }
+    good &= found;
+    good &= ~ct_lt(zero_index, 2 + RSA_PKCS1_MIN_PAD);
+    mlen = (unsigned int)k - zero_index - 1;
+    good &= ~ct_lt((unsigned int)mmax, mlen);
+    mlen = ct_select(good, mlen, 0);
+
+    ct_copy_tail(m, mmax, buf, 3 + RSA_PKCS1_MIN_PAD, k, mlen, good);
+    crypto_cleanse(buf, k);
+    return (int)ct_select(good, mlen, (unsigned int)-1);
+}
+
+/* MGF1 with SHA-256: out ^= mask of len bytes derived from seed */
+static void mgf1_xor(unsigned char *out, size_t len, const unsigned char *seed, size_t seed_len) {
+    unsigned char msg[RSA_MGF1_LANES][BN_MAX_BITS / 8 + 4];
+    unsigned char md[RSA_MGF1_LANES * SHA256_DIGEST_LENGTH];
+    const unsigned char *data[RSA_MGF1_LANES];
+    size_t lens[RSA_MGF1_LANES];
+    uint32_t counter = 0;
+    size_t lanes, n, i;
+
+    if (seed_len > BN_MAX_BITS / 8) return;
+    while (len > 0) {
+        lanes = (len + SHA256_DIGEST_LENGTH - 1) / SHA256_DIGEST_LENGTH;
+        if (lanes > RSA_MGF1_LANES) lanes = RSA_MGF1_LANES;
+        for (i = 0; i < lanes; i++, counter++) {
+            memcpy(msg[i], seed, seed_len);
+            msg[i][seed_len] = (unsigned char)(counter >> 24);
+            msg[i][seed_len + 1] = (unsigned char)(counter >> 16);
+            msg[i][seed_len + 2] = (unsigned char)(counter >> 8);
+            msg[i][seed_len + 3] = (unsigned char)counter;
+            data[i] = msg[i];
+            lens[i] = seed_len + 4;
+        }
+        crypto_sha256_multi(lanes, data, lens, md);
+
+        n = len < lanes * SHA256_DIGEST_LENGTH ? len : lanes * SHA256_DIGEST_LENGTH;
+        for (i = 0; i < n; i++) out[i] ^= md[i];
+        out += n;
+        len -= n;
+    }
+    crypto_cleanse(md, sizeof(md));
+    crypto_cleanse(msg, sizeof(msg));
+}
+
+int crypto_rsa_pad_oaep(unsigned char *em, size_t k, const unsigned char *m, size_t mlen) {
+    unsigned char *seed = em + 1;
+    unsigned char *db = em + 1 + RSA_OAEP_HLEN;
+    size_t dblen;
+
+    if (k < 2 * RSA_OAEP_HLEN + 2 || mlen > k - 2 * RSA_OAEP_HLEN - 2) return -1;
+    dblen = k - RSA_OAEP_HLEN - 1;
+
+    em[0] = 0x00;
+    crypto_sha256(NULL, 0, db);                 /* hash of the empty label */
+    memset(db + RSA_OAEP_HLEN, 0, dblen - RSA_OAEP_HLEN - mlen - 1);
+    db[dblen - mlen - 1] = 0x01;
+    memcpy(db + dblen - mlen, m, mlen);
+    if (RAND_bytes(seed, RSA_OAEP_HLEN) != 1) return -1;
+
+    mgf1_xor(db, dblen, seed, RSA_OAEP_HLEN);
+    mgf1_xor(seed, RSA_OAEP_HLEN, db, dblen);
+    return (int)k;
+}
+
+int crypto_rsa_unpad_oaep(unsigned char *m, size_t mmax, const unsigned char *em, size_t k) {
+    unsigned char buf[BN_MAX_BITS / 8];
+    unsigned char lhash[RSA_OAEP_HLEN];
+    unsigned char *seed = buf + 1;
+    unsigned char *db = buf + 1 + RSA_OAEP_HLEN;
+    unsigned int good, found = 0, one_index = 0, mlen;
+    size_t dblen, i;
+
+    if (k < 2 * RSA_OAEP_HLEN + 2 || k > sizeof(buf)) return -1;
+    if (mmax > k) mmax = k;
+    memcpy(buf, em, k);
+    dblen = k - RSA_OAEP_HLEN - 1;
+
+    mgf1_xor(seed, RSA_OAEP_HLEN, db, dblen);
+    mgf1_xor(db, dblen, seed, RSA_OAEP_HLEN);
+
+    good = ct_eq(buf[0], 0);
+    crypto_sha256(NULL, 0, lhash);
+    for (i = 0; i < RSA_OAEP_HLEN; i++) good &= ct_eq(db[i], lhash[i]);
+
+    /* PS is zeros up to the 0x01 separator; anything else before it fails */
+    for (i = RSA_OAEP_HLEN; i < dblen; i++) {
+        unsigned int is_one = ct_eq(db[i], 1);
+        unsigned int is_zero = ct_eq(db[i], 0);
+        one_index = ct_select(~found & is_one, (unsigned int)i, one_index);
+        good &= found | is_zero | is_one;
+        found |= is_one;
+    }
+    good &= found;
+    mlen = (unsigned int)dblen - one_index - 1;
+    good &= ~ct_lt((unsigned int)mmax, mlen);
+    mlen = ct_select(good, mlen, 0);
+
+    ct_copy_tail(m, mmax, buf, 1 + 2 * RSA_OAEP_HLEN + 1, k, mlen, good);
+    crypto_cleanse(buf, k);
+    return (int)ct_select(good, mlen, (unsigned int)-1);
+}
+
+/* EMSA-PSS (RFC 8017, 9.1.1) with SHA-256 and MGF1-SHA-256. salt_len -1 is
+ * the hash length, -2 and -3 the largest salt that fits, as in OpenSSL.
+ * When the encoded message is a byte shorter than the modulus, em[0] is
+ * left zero and the encoding starts at em + 1. */
+int crypto_rsa_pad_pss(unsigned char *em, size_t mod_bits, const unsigned char *mhash, int salt_len) {
+    unsigned char mprime[8 + SHA256_DIGEST_LENGTH + BN_MAX_BITS / 8];
+    size_t em_bits, em_len, k, db_len, slen;
+    unsigned char *h;
+
+    if (mod_bits < 2 || mod_bits > BN_MAX_BITS) return -1;
+    em_bits = mod_bits - 1;
+    em_len = (em_bits + 7) / 8;
+    k = (mod_bits + 7) / 8;
+    if (em_len < SHA256_DIGEST_LENGTH + 2) return -1;
+
+    if (salt_len == -1) {
+        slen = SHA256_DIGEST_LENGTH;
+    } else if (salt_len == -2 || salt_len == -3) {
+        slen = em_len - SHA256_DIGEST_LENGTH - 2;
+    } else if (salt_len >= 0) {
+        slen = (size_t)salt_len;
+    } else {
+        return -1;
+    }
+    if (slen > em_len - SHA256_DIGEST_LENGTH - 2) return -1;
+
+    if (em_len < k) *em++ = 0x00;
+    db_len = em_len - SHA256_DIGEST_LENGTH - 1;
+    h = em + db_len;
+
+    /* H = Hash(0x00 * 8 || mHash || salt) */
+    memset(mprime, 0, 8);
+    memcpy(mprime + 8, mhash, SHA256_DIGEST_LENGTH);
+    if (slen > 0 && RAND_bytes(mprime + 8 + SHA256_DIGEST_LENGTH, (int)slen) != 1) return -1;
+    crypto_sha256(mprime, 8 + SHA256_DIGEST_LENGTH + slen, h);
+
+    /* DB = PS || 0x01 || salt, masked with MGF1(H) */
+    memset(em, 0, db_len - slen - 1);
+    em[db_len - slen - 1] = 0x01;
+    memcpy(em + db_len - slen, mprime + 8 + SHA256_DIGEST_LENGTH, slen);
+    mgf1_xor(em, db_len, h, SHA256_DIGEST_LENGTH);
+    em[0] &= (unsigned char)(0xffu >> (8 * em_len - em_bits));
+    em[em_len - 1] = 0xbc;
+
+    crypto_cleanse(mprime, sizeof(mprime));
+    return (int)k;
+}
@@ -0,0 +1,870 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * SSL_CTX / SSL objects, a process-wide cache of context state and the
+ * loopback handshake behind SSL_connect and SSL_accept.
+ *
+ * An SSL_CTX is a light handle. The expensive part of a context (the parsed
+ * certificate, the trust store, the server's ticket keys and the client's
+ * session cache) lives in a shared entry keyed by (method, options,
+ * certificate path, CA file, CA path), resolved when the first SSL is made
+ * from the context. A process that creates and frees a context per
+ * connection, as the examples do, therefore finds the certificates already
+ * parsed and the sessions of earlier connections still cached.
+ *
+ * The handshake is a stand-in for TLS: it follows the message flow of a
+ * TLS 1.2 handshake with session tickets (hello, certificate, new session
+ * ticket, finished, and the abbreviated hello / finished exchange on
+ * resumption) so that version negotiation, certificate checks and session
+ * reuse can be exercised against a local peer, e.g. over a socketpair().
+ * It has no key exchange and no record layer and protects no data.
+ */
+
+#define _GNU_SOURCE  /* For MSG_NOSIGNAL, inet_ntop */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "lib_crypto_internal.h"
+
+enum {
+    SSL_VERSION_SSL2   = 1 << 0,
+    SSL_VERSION_SSL3   = 1 << 1,
+    SSL_VERSION_TLS1   = 1 << 2,
+    SSL_VERSION_TLS1_1 = 1 << 3,
+    SSL_VERSION_TLS1_2 = 1 << 4,
+    SSL_VERSION_ALL    = (1 << 5) - 1
+};
+
+enum {
+    SSL_SHARED_MAX       = 32,          /* cached context states */
+    SSL_SESSION_SLOTS    = 64,          /* client sessions per context state */
+    SSL_SESSION_KEY_MAX  = 128,
+    SSL_TICKET_LIFETIME  = 7200,        /* seconds, OpenSSL's default */
+    SSL_MSG_MAX          = 1 << 20,
+    SSL_MAX_CHAIN        = 16
+};
+
+/* Handshake message types, numbered as in TLS */
+enum {
+    SSL_MT_CLIENT_HELLO       = 1,
+    SSL_MT_SERVER_HELLO       = 2,
+    SSL_MT_NEW_SESSION_TICKET = 4,
+    SSL_MT_CERTIFICATE        = 11,
+    SSL_MT_FINISHED           = 20
+};
+
+typedef struct ssl_session {
+    char key[SSL_SESSION_KEY_MAX];      /* host name or peer address; "" when free */
+    int version;
+    int64_t expires;
+    uint64_t last_used;
+    unsigned char master[SSL_MASTER_SIZE];
+    unsigned char ticket[SSL_TICKET_SIZE];
+} ssl_session;
+
+struct crypto_ssl_shared {
+    int references;
+    uint64_t last_used;                 /* shared_lock */
+    /* key */
+    const SSL_METHOD *method;
+    long options;
+    char *cert_file;
+    int cert_type;
+    char *ca_file, *ca_path;
+    /* contents; immutable once published */
+    crypto_cert_file *cert;
+    crypto_cert_store *store;
+    crypto_aes_key ticket_enc;
+    unsigned char ticket_mac[32];
+    /* client sessions */
+    pthread_mutex_t lock;
+    uint64_t clock;
+    ssl_session sessions[SSL_SESSION_SLOTS];
+};
+
+static const SSL_METHOD method_sslv23 = { 1, 1, SSL_VERSION_ALL };
+static const SSL_METHOD method_sslv23_client = { 1, 0, SSL_VERSION_ALL };
+static const SSL_METHOD method_sslv23_server = { 0, 1, SSL_VERSION_ALL };
+static const SSL_METHOD method_sslv2 = { 1, 1, SSL_VERSION_SSL2 };
+static const SSL_METHOD method_sslv2_client = { 1, 0, SSL_VERSION_SSL2 };
+static const SSL_METHOD method_sslv2_server = { 0, 1, SSL_VERSION_SSL2 };
+static const SSL_METHOD method_sslv3 = { 1, 1, SSL_VERSION_SSL3 };
+static const SSL_METHOD method_sslv3_client = { 1, 0, SSL_VERSION_SSL3 };
+static const SSL_METHOD method_sslv3_server = { 0, 1, SSL_VERSION_SSL3 };
+static const SSL_METHOD method_tlsv1 = { 1, 1, SSL_VERSION_TLS1 };
+static const SSL_METHOD method_tlsv1_client = { 1, 0, SSL_VERSION_TLS1 };
+static const SSL_METHOD method_tlsv1_server = { 0, 1, SSL_VERSION_TLS1 };
+static const SSL_METHOD method_tlsv1_1 = { 1, 1, SSL_VERSION_TLS1_1 };
+static const SSL_METHOD method_tlsv1_1_client = { 1, 0, SSL_VERSION_TLS1_1 };
+static const SSL_METHOD method_tlsv1_1_server = { 0, 1, SSL_VERSION_TLS1_1 };
+static const SSL_METHOD method_tlsv1_2 = { 1, 1, SSL_VERSION_TLS1_2 };
+static const SSL_METHOD method_tlsv1_2_client = { 1, 0, SSL_VERSION_TLS1_2 };
+static const SSL_METHOD method_tlsv1_2_server = { 0, 1, SSL_VERSION_TLS1_2 };
+
+static pthread_mutex_t shared_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct crypto_ssl_shared *shared_cache[SSL_SHARED_MAX];
+static uint64_t shared_clock;
+
+const SSL_METHOD *SSLv23_client_method(void) { return &method_sslv23_client; }
+const SSL_METHOD *SSLv23_server_method(void) { return &method_sslv23_server; }
+const SSL_METHOD *SSLv23_method(void) { return &method_sslv23; }
+const SSL_METHOD *SSLv2_client_method(void) { return &method_sslv2_client; }
+const SSL_METHOD *SSLv2_server_method(void) { return &method_sslv2_server; }
+const SSL_METHOD *SSLv2_method(void) { return &method_sslv2; }
+const SSL_METHOD *SSLv3_client_method(void) { return &method_sslv3_client; }
+const SSL_METHOD *SSLv3_server_method(void) { return &method_sslv3_server; }
+const SSL_METHOD *SSLv3_method(void) { return &method_sslv3; }
+const SSL_METHOD *TLSv1_client_method(void) { return &method_tlsv1_client; }
+const SSL_METHOD *TLSv1_server_method(void) { return &method_tlsv1_server; }
+const SSL_METHOD *TLSv1_method(void) { return &method_tlsv1; }
+const SSL_METHOD *TLSv1_1_client_method(void) { return &method_tlsv1_1_client; }
+const SSL_METHOD *TLSv1_1_server_method(void) { return &method_tlsv1_1_server; }
+const SSL_METHOD *TLSv1_1_method(void) { return &method_tlsv1_1; }
+const SSL_METHOD *TLSv1_2_client_method(void) { return &method_tlsv1_2_client; }
+const SSL_METHOD *TLSv1_2_server_method(void) { return &method_tlsv1_2_server; }
+const SSL_METHOD *TLSv1_2_method(void) { return &method_tlsv1_2; }
+
+int SSL_library_init(void) {
+    return 1;                           /* everything is set up on first use */
+}
+
+static char *ssl_strdup(const char *s) {
+    return s != NULL ? strdup(s) : NULL;
+}
+
+static int ssl_strcmp_null(const char *a, const char *b) {
+    if (a == NULL || b == NULL) return a != b;
+    return strcmp(a, b);
+}
+
+/* Versions left by the method once the SSL_OP_NO_* options are applied */
+static unsigned int ssl_versions(const SSL_METHOD *method, long options) {
+    unsigned int v = method->versions;
+
+    if (options & SSL_OP_NO_SSLv2) v &= ~(unsigned int)SSL_VERSION_SSL2;
+    if (options & SSL_OP_NO_SSLv3) v &= ~(unsigned int)SSL_VERSION_SSL3;
+    if (options & SSL_OP_NO_TLSv1) v &= ~(unsigned int)SSL_VERSION_TLS1;
+    if (options & SSL_OP_NO_TLSv1_1) v &= ~(unsigned int)SSL_VERSION_TLS1_1;
+    if (options & SSL_OP_NO_TLSv1_2) v &= ~(unsigned int)SSL_VERSION_TLS1_2;
+    return v;
+}
+
+
+/*============================================================================
+ * SHARED CONTEXT STATE
+ *==========================================================================*/
+static void ssl_shared_put(struct crypto_ssl_shared *sh) {
+    if (sh == NULL) return;
+    if (__atomic_sub_fetch(&sh->references, 1, __ATOMIC_ACQ_REL) > 0) return;
+    crypto_cert_file_put(sh->cert);
+    crypto_cert_store_put(sh->store);
+    free(sh->cert_file);
+    free(sh->ca_file);
+    free(sh->ca_path);
+    pthread_mutex_destroy(&sh->lock);
+    crypto_cleanse(sh, sizeof(*sh));
+    free(sh);
+}
+
+/* Whether sh was made for the context's current settings and files; called
+ * with ctx->lock held */
+static int ssl_shared_matches(const struct crypto_ssl_shared *sh, const SSL_CTX *ctx,
+                              const crypto_cert_file *cert, const crypto_cert_store *store) {
+    return sh->method == ctx->method && sh->options == ctx->options && sh->cert_type == ctx->cert_type &&
+           ssl_strcmp_null(sh->cert_file, ctx->cert_file) == 0 && ssl_strcmp_null(sh->ca_file, ctx->ca_file) == 0 &&
+           ssl_strcmp_null(sh->ca_path, ctx->ca_path) == 0 && sh->cert == cert && sh->store == store;
+}
+
+static struct crypto_ssl_shared *ssl_shared_new(const SSL_CTX *ctx, crypto_cert_file *cert, crypto_cert_store *store) {
+    struct crypto_ssl_shared *sh = (struct crypto_ssl_shared *)calloc(1, sizeof(*sh));
+    unsigned char key[AES128_KEY_SIZE];
+
+    if (sh == NULL) return NULL;
+    sh->references = 1;
+    sh->method = ctx->method;
+    sh->options = ctx->options;
+    sh->cert_type = ctx->cert_type;
+    sh->cert_file = ssl_strdup(ctx->cert_file);
+    sh->ca_file = ssl_strdup(ctx->ca_file);
+    sh->ca_path = ssl_strdup(ctx->ca_path);
+    sh->cert = cert;
+    sh->store = store;
+    if (pthread_mutex_init(&sh->lock, NULL) != 0 || RAND_bytes(key, sizeof(key)) != 1 ||
+        RAND_bytes(sh->ticket_mac, sizeof(sh->ticket_mac)) != 1) {
+        sh->cert = NULL;
+        sh->store = NULL;
+        free(sh->cert_file);
+        free(sh->ca_file);
+        free(sh->ca_path);
+        free(sh);
+        return NULL;
+    }
+    crypto_aes128_set_key(&sh->ticket_enc, key);
+    crypto_cleanse(key, sizeof(key));
+    return sh;
+}
+
+/* The cached state for ctx's settings, made on a miss. The file and store
+ * lookups are a stat() each while the files are unchanged; a changed file
+ * yields a new entry, and with it new ticket keys and an empty session cache */
+static struct crypto_ssl_shared *ssl_shared_get(SSL_CTX *ctx) {
+    struct crypto_ssl_shared *sh = NULL;
+    crypto_cert_file *cert = NULL;
+    crypto_cert_store *store = NULL;
+    int i, slot = -1, idle = -1;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->cert_file != NULL) cert = crypto_cert_file_get(ctx->cert_file, ctx->cert_type);
+    if (ctx->ca_file != NULL || ctx->ca_path != NULL) store = crypto_cert_store_get(ctx->ca_file, ctx->ca_path);
+
+    if (ctx->shared != NULL && ssl_shared_matches(ctx->shared, ctx, cert, store)) {
+        sh = ctx->shared;
+        __atomic_add_fetch(&sh->references, 1, __ATOMIC_RELAXED);
+        goto out;
+    }
+
+    pthread_mutex_lock(&shared_lock);
+    for (i = 0; i < SSL_SHARED_MAX; i++) {
+        struct crypto_ssl_shared *c = shared_cache[i];
+        if (c == NULL) {
+            if (slot < 0) slot = i;
+        } else if (ssl_shared_matches(c, ctx, cert, store)) {
+            sh = c;
+            break;
+        } else if (__atomic_load_n(&c->references, __ATOMIC_ACQUIRE) == 1 &&
+                   (idle < 0 || c->last_used < shared_cache[idle]->last_used)) {
+            idle = i;                   /* only the cache holds it: evictable */
+        }
+    }
+    if (slot < 0) slot = idle;
+    if (sh == NULL) {
+        sh = ssl_shared_new(ctx, cert, store);
+        if (sh != NULL) {
+            cert = NULL;                /* ownership moved into sh */
+            store = NULL;
+            if (slot >= 0) {
+                ssl_shared_put(shared_cache[slot]);
+                shared_cache[slot] = sh;
+                __atomic_add_fetch(&sh->references, 1, __ATOMIC_RELAXED);
+            }
+        }
+    } else {
+        __atomic_add_fetch(&sh->references, 1, __ATOMIC_RELAXED);
+    }
+    if (sh != NULL) sh->last_used = ++shared_clock;
+    pthread_mutex_unlock(&shared_lock);
+
+    if (sh != NULL) {
+        ssl_shared_put(ctx->shared);
+        ctx->shared = sh;
+        __atomic_add_fetch(&sh->references, 1, __ATOMIC_RELAXED);
+    }
+out:
+    pthread_mutex_unlock(&ctx->lock);
+    crypto_cert_file_put(cert);
+    crypto_cert_store_put(store);
+    return sh;
+}
+
+/* Settings changed: the next SSL_new resolves the shared state again */
+static void ssl_ctx_changed_locked(SSL_CTX *ctx) {
+    ssl_shared_put(ctx->shared);
+    ctx->shared = NULL;
+}
+
+
+/*============================================================================
+ * CLIENT SESSIONS
+ *==========================================================================*/
+static int64_t ssl_now(void) {
+    return (int64_t)time(NULL);
+}
+
+static int ssl_session_find(struct crypto_ssl_shared *sh, const char *key, ssl_session *out) {
+    int64_t now = ssl_now();
+    int found = 0;
+    int i;
+
+    pthread_mutex_lock(&sh->lock);
+    for (i = 0; i < SSL_SESSION_SLOTS; i++) {
+        ssl_session *s = &sh->sessions[i];
+        if (s->key[0] == '\0' || strcmp(s->key, key) != 0) continue;
+        if (s->expires <= now) {
+            crypto_cleanse(s, sizeof(*s));
+        } else {
+            s->last_used = ++sh->clock;
+            *out = *s;
+            found = 1;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&sh->lock);
+    return found;
+}
+
+/* Stores s under its key, replacing the least recently used slot */
+static void ssl_session_store(struct crypto_ssl_shared *sh, const ssl_session *s) {
+    ssl_session *slot = NULL;
+    int i;
+
+    pthread_mutex_lock(&sh->lock);
+    for (i = 0; i < SSL_SESSION_SLOTS; i++) {
+        ssl_session *c = &sh->sessions[i];
+        if (c->key[0] != '\0' && strcmp(c->key, s->key) == 0) {
+            slot = c;
+            break;
+        }
+        if (slot == NULL || c->last_used < slot->last_used) slot = c;
+    }
+    *slot = *s;
+    slot->last_used = ++sh->clock;
+    pthread_mutex_unlock(&sh->lock);
+}
+
+static void ssl_session_drop(struct crypto_ssl_shared *sh, const char *key) {
+    int i;
+
+    pthread_mutex_lock(&sh->lock);
+    for (i = 0; i < SSL_SESSION_SLOTS; i++) {
+        if (strcmp(sh->sessions[i].key, key) == 0) crypto_cleanse(&sh->sessions[i], sizeof(ssl_session));
+    }
+    pthread_mutex_unlock(&sh->lock);
+}
+
+/* Sessions are per server: the host name when set, else the peer address */
+static void ssl_session_key(const SSL *s, char *key, size_t len) {
+    struct sockaddr_storage ss;
+    socklen_t sl = sizeof(ss);
+    char addr[INET6_ADDRSTRLEN];
+
+    if (s->hostname != NULL) {
+        snprintf(key, len, "host:%s", s->hostname);
+        return;
+    }
+    memset(&ss, 0, sizeof(ss));
+    if (getpeername(s->fd, (struct sockaddr *)&ss, &sl) != 0) {
+        snprintf(key, len, "fd");
+    } else if (ss.ss_family == AF_INET) {
+        const struct sockaddr_in *in = (const struct sockaddr_in *)&ss;
+        inet_ntop(AF_INET, &in->sin_addr, addr, sizeof(addr));
+        snprintf(key, len, "inet:%s:%u", addr, (unsigned int)ntohs(in->sin_port));
+    } else if (ss.ss_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)&ss;
+        inet_ntop(AF_INET6, &in6->sin6_addr, addr, sizeof(addr));
+        snprintf(key, len, "inet6:[%s]:%u", addr, (unsigned int)ntohs(in6->sin6_port));
+    } else if (ss.ss_family == AF_UNIX) {
+        const struct sockaddr_un *un = (const struct sockaddr_un *)&ss;
+        snprintf(key, len, "unix:%.*s", (int)(sl > offsetof(struct sockaddr_un, sun_path) ?
+                 sl - offsetof(struct sockaddr_un, sun_path) : 0), un->sun_path);
+    } else {
+        snprintf(key, len, "family:%d", (int)ss.ss_family);
+    }
+}
+
+
+/*============================================================================
+ * TICKETS
+ *==========================================================================*/
+static void ssl_store_be(unsigned char *p, uint64_t v, int n) {
+    while (n-- > 0) {
+        p[n] = (unsigned char)v;
+        v >>= 8;
+    }
+}
+
+static uint64_t ssl_load_be(const unsigned char *p, int n) {
+    uint64_t v = 0;
+    int i;
+
+    for (i = 0; i < n; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+/* nonce | AES-128-CTR(version, expiry, master) | HMAC-SHA256 truncated */
+static int ssl_ticket_seal(const struct crypto_ssl_shared *sh, unsigned char *ticket, int version,
+                           int64_t expires, const unsigned char *master) {
+    unsigned char state[48];
+    unsigned char ctr[AES_BLOCK_SIZE];
+    unsigned char tag[SHA256_DIGEST_LENGTH];
+
+    if (RAND_bytes(ticket, 16) != 1) return 0;
+    memset(state, 0, sizeof(state));
+    ssl_store_be(state, (uint64_t)version, 2);
+    ssl_store_be(state + 2, (uint64_t)expires, 8);
+    memcpy(state + 10, master, SSL_MASTER_SIZE);
+    memcpy(ctr, ticket, sizeof(ctr));
+    crypto_aes_ctr_blocks(&sh->ticket_enc, ctr, state, ticket + 16, sizeof(state) / AES_BLOCK_SIZE);
+    crypto_hmac_sha256(sh->ticket_mac, sizeof(sh->ticket_mac), ticket, 16 + sizeof(state), tag);
+    memcpy(ticket + 16 + sizeof(state), tag, 16);
+    crypto_cleanse(state, sizeof(state));
+    return 1;
+}
+
+static int ssl_ticket_open(const struct crypto_ssl_shared *sh, const unsigned char *ticket, int *version,
+                           unsigned char *master) {
+    unsigned char state[48];
+    unsigned char ctr[AES_BLOCK_SIZE];
+    unsigned char tag[SHA256_DIGEST_LENGTH];
+    unsigned int diff = 0;
+    int ok;
+    int i;
+
+    crypto_hmac_sha256(sh->ticket_mac, sizeof(sh->ticket_mac), ticket, 16 + sizeof(state), tag);
+    for (i = 0; i < 16; i++) diff |= tag[i] ^ ticket[16 + sizeof(state) + i];
+    if (diff != 0) return 0;
+
+    memcpy(ctr, ticket, sizeof(ctr));
+    crypto_aes_ctr_blocks(&sh->ticket_enc, ctr, ticket + 16, state, sizeof(state) / AES_BLOCK_SIZE);
+    ok = (int64_t)ssl_load_be(state + 2, 8) > ssl_now();
+    if (ok) {
+        *version = (int)ssl_load_be(state, 2);
+        memcpy(master, state + 10, SSL_MASTER_SIZE);
+    }
+    crypto_cleanse(state, sizeof(state));
+    return ok;
+}
+
+
+/*============================================================================
+ * HANDSHAKE
+ *==========================================================================*/
+static int ssl_write_all(int fd, const unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static int ssl_read_all(int fd, unsigned char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return 0;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 1;
+}
+
+static int ssl_send(const SSL *s, int type, const unsigned char *body, size_t len) {
+    unsigned char hdr[4];
+
+    hdr[0] = (unsigned char)type;
+    ssl_store_be(hdr + 1, len, 3);
+    return ssl_write_all(s->fd, hdr, sizeof(hdr)) && ssl_write_all(s->fd, body, len);
+}
+
+/* Receives a message of the expected type; *body is malloc'ed */
+static int ssl_recv(const SSL *s, int type, unsigned char **body, size_t *len) {
+    unsigned char hdr[4];
+
+    *body = NULL;
+    if (!ssl_read_all(s->fd, hdr, sizeof(hdr)) || hdr[0] != type) return 0;
+    *len = (size_t)ssl_load_be(hdr + 1, 3);
+    if (*len > SSL_MSG_MAX) return 0;
+    *body = (unsigned char *)malloc(*len + 1);
+    if (*body == NULL) return 0;
+    if (!ssl_read_all(s->fd, *body, *len)) {
+        free(*body);
+        *body = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/* Stand-in for the key schedule: both sides derive the master secret from
+ * the two randoms, which an eavesdropper sees as well */
+static void ssl_master(unsigned char *master, const unsigned char *crand, const unsigned char *srand) {
+    unsigned char seed[2 * SSL_RANDOM_SIZE];
+
+    memcpy(seed, crand, SSL_RANDOM_SIZE);
+    memcpy(seed + SSL_RANDOM_SIZE, srand, SSL_RANDOM_SIZE);
+    crypto_hmac_sha256("master secret", 13, seed, sizeof(seed), master);
+}
+
+static void ssl_finished(unsigned char *out, const unsigned char *master, const char *label,
+                         const unsigned char *crand, const unsigned char *srand) {
+    unsigned char seed[16 + 2 * SSL_RANDOM_SIZE];
+    size_t n = strlen(label);
+
+    memcpy(seed, label, n);
+    memcpy(seed + n, crand, SSL_RANDOM_SIZE);
+    memcpy(seed + n + SSL_RANDOM_SIZE, srand, SSL_RANDOM_SIZE);
+    crypto_hmac_sha256(master, SSL_MASTER_SIZE, seed, n + 2 * SSL_RANDOM_SIZE, out);
+}
+
+/* Sends our Finished, or checks the peer's */
+static int ssl_finished_send(SSL *s, const char *label, const unsigned char *crand, const unsigned char *srand) {
+    unsigned char fin[SHA256_DIGEST_LENGTH];
+
+    ssl_finished(fin, s->master, label, crand, srand);
+    return ssl_send(s, SSL_MT_FINISHED, fin, sizeof(fin));
+}
+
+static int ssl_finished_check(SSL *s, const char *label, const unsigned char *crand, const unsigned char *srand) {
+    unsigned char fin[SHA256_DIGEST_LENGTH];
+    unsigned char *body;
+    size_t len, i;
+    unsigned int diff = 0;
+
+    if (!ssl_recv(s, SSL_MT_FINISHED, &body, &len)) return 0;
+    ssl_finished(fin, s->master, label, crand, srand);
+    if (len != sizeof(fin)) diff = 1;
+    for (i = 0; i < len && i < sizeof(fin); i++) diff |= fin[i] ^ body[i];
+    free(body);
+    return diff == 0;
+}
+
+static int ssl_highest_version(unsigned int mask) {
+    int v;
+
+    for (v = 4; v >= 0; v--) {
+        if (mask & (1u << v)) return v;
+    }
+    return -1;
+}
+
+/* Trust: with SSL_VERIFY_PEER one certificate of the chain must be in the
+ * store. Signatures are not checked by the stand-in. */
+static int ssl_verify_chain(SSL *s, const unsigned char *body, size_t len) {
+    size_t pos = 1, i;
+    int count, trusted = 0, ok;
+
+    if (len < 1) return 0;
+    count = body[0];
+    if (count == 0 || count > SSL_MAX_CHAIN) return 0;
+    for (i = 0; i < (size_t)count; i++) {
+        size_t n;
+        if (pos + 3 > len) return 0;
+        n = (size_t)ssl_load_be(body + pos, 3);
+        pos += 3;
+        if (pos + n > len) return 0;
+        if (s->shared->store != NULL && crypto_cert_store_contains(s->shared->store, body + pos, n)) trusted = 1;
+        pos += n;
+    }
+    if (!(s->verify_mode & SSL_VERIFY_PEER)) return 1;
+    ok = trusted;
+    if (s->verify_cb.fn != NULL) ok = s->verify_cb.fn(ok, NULL);
+    return ok;
+}
+
+static int ssl_client_handshake(SSL *s) {
+    unsigned int offer = ssl_versions(s->ctx->method, s->options);
+    unsigned char hello[1 + SSL_RANDOM_SIZE + 2 + SSL_TICKET_SIZE];
+    unsigned char crand[SSL_RANDOM_SIZE], srand[SSL_RANDOM_SIZE];
+    unsigned char *body = NULL;
+    size_t len, hlen;
+    ssl_session sess;
+    int have_session;
+    int ok = 0;
+
+    if (!s->ctx->method->client || offer == 0) return 0;
+    memset(&sess, 0, sizeof(sess));
+    ssl_session_key(s, sess.key, sizeof(sess.key));
+    have_session = ssl_session_find(s->shared, sess.key, &sess) && (offer & (1u << sess.version));
+
+    /* ClientHello: versions, random, ticket */
+    if (RAND_bytes(crand, sizeof(crand)) != 1) return 0;
+    hello[0] = (unsigned char)offer;
+    memcpy(hello + 1, crand, sizeof(crand));
+    hlen = 1 + SSL_RANDOM_SIZE + 2;
+    ssl_store_be(hello + 1 + SSL_RANDOM_SIZE, have_session ? SSL_TICKET_SIZE : 0, 2);
+    if (have_session) {
+        memcpy(hello + hlen, sess.ticket, SSL_TICKET_SIZE);
+        hlen += SSL_TICKET_SIZE;
+    }
+    if (!ssl_send(s, SSL_MT_CLIENT_HELLO, hello, hlen)) goto out;
+
+    /* ServerHello: version, random, resumed */
+    if (!ssl_recv(s, SSL_MT_SERVER_HELLO, &body, &len) || len != 1 + SSL_RANDOM_SIZE + 1) goto out;
+    s->version = body[0];
+    memcpy(srand, body + 1, sizeof(srand));
+    s->resumed = body[1 + SSL_RANDOM_SIZE];
+    free(body);
+    body = NULL;
+    if (s->version > 4 || !(offer & (1u << s->version))) goto out;
+
+    if (s->resumed) {
+        if (!have_session || s->version != sess.version) goto out;
+        memcpy(s->master, sess.master, SSL_MASTER_SIZE);
+    } else {
+        if (have_session) ssl_session_drop(s->shared, sess.key);
+        if (!ssl_recv(s, SSL_MT_CERTIFICATE, &body, &len) || !ssl_verify_chain(s, body, len)) goto out;
+        free(body);
+        body = NULL;
+        ssl_master(s->master, crand, srand);
+
+        if (!ssl_recv(s, SSL_MT_NEW_SESSION_TICKET, &body, &len)) goto out;
+        if (len == SSL_TICKET_SIZE) {
+            memcpy(sess.ticket, body, SSL_TICKET_SIZE);
+            memcpy(sess.master, s->master, SSL_MASTER_SIZE);
+            sess.version = s->version;
+            sess.expires = ssl_now() + SSL_TICKET_LIFETIME;
+            sess.last_used = 0;
+        } else {
+            sess.key[0] = '\0';
+        }
+    }
+
+    if (!ssl_finished_send(s, "client finished", crand, srand)) goto out;
+    if (!ssl_finished_check(s, "server finished", crand, srand)) goto out;
+    if (!s->resumed && sess.key[0] != '\0') ssl_session_store(s->shared, &sess);
+    ok = 1;
+
+out:
+    free(body);
+    crypto_cleanse(&sess, sizeof(sess));
+    return ok;
+}
+
+static int ssl_server_handshake(SSL *s) {
+    unsigned int mine = ssl_versions(s->ctx->method, s->options);
+    const crypto_cert_file *cert = s->shared->cert;
+    unsigned char crand[SSL_RANDOM_SIZE], srand[SSL_RANDOM_SIZE];
+    unsigned char reply[1 + SSL_RANDOM_SIZE + 1];
+    unsigned char ticket[SSL_TICKET_SIZE];
+    unsigned char *body = NULL, *chain = NULL;
+    size_t len, tlen, clen, i;
+    int version;
+    int ok = 0;
+
+    if (!s->ctx->method->server || mine == 0 || cert == NULL) return 0;
+
+    if (!ssl_recv(s, SSL_MT_CLIENT_HELLO, &body, &len) || len < 1 + SSL_RANDOM_SIZE + 2) goto out;
+    memcpy(crand, body + 1, sizeof(crand));
+    s->version = ssl_highest_version(mine & body[0]);
+    if (s->version < 0) goto out;
+    tlen = (size_t)ssl_load_be(body + 1 + SSL_RANDOM_SIZE, 2);
+    if (len != 1 + SSL_RANDOM_SIZE + 2 + tlen) goto out;
+    s->resumed = tlen == SSL_TICKET_SIZE &&
+                 ssl_ticket_open(s->shared, body + 1 + SSL_RANDOM_SIZE + 2, &version, s->master) &&
+                 version == s->version;
+
+    if (RAND_bytes(srand, sizeof(srand)) != 1) goto out;
+    reply[0] = (unsigned char)s->version;
+    memcpy(reply + 1, srand, sizeof(srand));
+    reply[1 + SSL_RANDOM_SIZE] = (unsigned char)s->resumed;
+    if (!ssl_send(s, SSL_MT_SERVER_HELLO, reply, sizeof(reply))) goto out;
+
+    if (!s->resumed) {
+        size_t pos = 1;
+        size_t n = cert->count < SSL_MAX_CHAIN ? cert->count : SSL_MAX_CHAIN;
+
+        for (clen = 1, i = 0; i < n; i++) clen += 3 + cert->der_len[i];
+        chain = (unsigned char *)malloc(clen);
+        if (chain == NULL) goto out;
+        chain[0] = (unsigned char)n;
+        for (i = 0; i < n; i++) {
+            ssl_store_be(chain + pos, cert->der_len[i], 3);
+            memcpy(chain + pos + 3, cert->der[i], cert->der_len[i]);
+            pos += 3 + cert->der_len[i];
+        }
+        if (!ssl_send(s, SSL_MT_CERTIFICATE, chain, clen)) goto out;
+
+        ssl_master(s->master, crand, srand);
+        if (!ssl_ticket_seal(s->shared, ticket, s->version, ssl_now() + SSL_TICKET_LIFETIME, s->master)) goto out;
+        if (!ssl_send(s, SSL_MT_NEW_SESSION_TICKET, ticket, sizeof(ticket))) goto out;
+    }
+
+    if (!ssl_finished_check(s, "client finished", crand, srand)) goto out;
+    if (!ssl_finished_send(s, "server finished", crand, srand)) goto out;
+    ok = 1;
+
+out:
+    free(body);
+    free(chain);
+    return ok;
+}
+
+
+/*============================================================================
+ * SSL_CTX
+ *==========================================================================*/
+SSL_CTX *SSL_CTX_new(const SSL_METHOD *meth) {
+    SSL_CTX *ctx;
+
+    if (meth == NULL) return NULL;
+    ctx = (SSL_CTX *)calloc(1, sizeof(SSL_CTX));
+    if (ctx == NULL) return NULL;
+    if (pthread_mutex_init(&ctx->lock, NULL) != 0) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->references = 1;
+    ctx->method = meth;
+    ctx->verify_mode = SSL_VERIFY_NONE;
+    return ctx;
+}
+
+int SSL_CTX_up_ref(SSL_CTX *ctx) {
+    __atomic_add_fetch(&ctx->references, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void SSL_CTX_free(SSL_CTX *ctx) {
+    if (ctx == NULL) return;
+    if (__atomic_sub_fetch(&ctx->references, 1, __ATOMIC_ACQ_REL) > 0) return;
+    ssl_shared_put(ctx->shared);
+    free(ctx->cert_file);
+    free(ctx->ca_file);
+    free(ctx->ca_path);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+}
+
+long SSL_CTX_ctrl(SSL_CTX *ctx, int cmd, long larg, void *parg) {
+    long r = 0;
+
+    (void)parg;
+    if (ctx == NULL) return 0;
+    pthread_mutex_lock(&ctx->lock);
+    if (cmd == SSL_CTRL_OPTIONS) {
+        if ((ctx->options | larg) != ctx->options) ssl_ctx_changed_locked(ctx);
+        r = ctx->options |= larg;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return r;
+}
+
+/* Parsed now, through the certificate cache, so that errors surface here */
+int SSL_CTX_use_certificate_file(SSL_CTX *ctx, const char *file, int type) {
+    crypto_cert_file *f;
+    char *copy;
+
+    if (ctx == NULL || file == NULL || (type != SSL_FILETYPE_PEM && type != SSL_FILETYPE_ASN1)) return 0;
+    f = crypto_cert_file_get(file, type);
+    if (f == NULL) return 0;
+    crypto_cert_file_put(f);
+    copy = strdup(file);
+    if (copy == NULL) return 0;
+
+    pthread_mutex_lock(&ctx->lock);
+    free(ctx->cert_file);
+    ctx->cert_file = copy;
+    ctx->cert_type = type;
+    ssl_ctx_changed_locked(ctx);
+    pthread_mutex_unlock(&ctx->lock);
+    return 1;
+}
+
+int SSL_CTX_load_verify_locations(SSL_CTX *ctx, const char *CAfile, const char *CApath) {
+    crypto_cert_store *store;
+    char *file_copy, *path_copy;
+
+    if (ctx == NULL || (CAfile == NULL && CApath == NULL)) return 0;
+    store = crypto_cert_store_get(CAfile, CApath);
+    if (store == NULL) return 0;
+    crypto_cert_store_put(store);
+    file_copy = ssl_strdup(CAfile);
+    path_copy = ssl_strdup(CApath);
+    if ((CAfile != NULL && file_copy == NULL) || (CApath != NULL && path_copy == NULL)) {
+        free(file_copy);
+        free(path_copy);
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    free(ctx->ca_file);
+    free(ctx->ca_path);
+    ctx->ca_file = file_copy;
+    ctx->ca_path = path_copy;
+    ssl_ctx_changed_locked(ctx);
+    pthread_mutex_unlock(&ctx->lock);
+    return 1;
+}
+
+void SSL_CTX_set_verify(SSL_CTX *ctx, int mode, SSL_verify_cb verify_callback) {
+    if (ctx == NULL) return;
+    pthread_mutex_lock(&ctx->lock);
+    ctx->verify_mode = mode;
+    ctx->verify_cb = verify_callback;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+
+/*============================================================================
+ * SSL
+ *==========================================================================*/
+SSL *SSL_new(SSL_CTX *ctx) {
+    SSL *s;
+
+    if (ctx == NULL) return NULL;
+    s = (SSL *)calloc(1, sizeof(SSL));
+    if (s == NULL) return NULL;
+    s->shared = ssl_shared_get(ctx);
+    if (s->shared == NULL) {
+        free(s);
+        return NULL;
+    }
+    SSL_CTX_up_ref(ctx);
+    s->ctx = ctx;
+    s->fd = -1;
+    s->version = -1;
+    pthread_mutex_lock(&ctx->lock);
+    s->options = ctx->options;
+    s->verify_mode = ctx->verify_mode;
+    s->verify_cb = ctx->verify_cb;
+    pthread_mutex_unlock(&ctx->lock);
+    return s;
+}
+
+void SSL_free(SSL *s) {
+    if (s == NULL) return;
+    ssl_shared_put(s->shared);
+    SSL_CTX_free(s->ctx);
+    free(s->hostname);
+    crypto_cleanse(s, sizeof(*s));
+    free(s);
+}
+
+long SSL_ctrl(SSL *s, int cmd, long larg, void *parg) {
+    if (s == NULL) return 0;
+    switch (cmd) {
+    case SSL_CTRL_OPTIONS:
+        return s->options |= larg;
+    case SSL_CTRL_SET_TLSEXT_HOSTNAME:
+        free(s->hostname);
+        s->hostname = ssl_strdup((const char *)parg);
+        return parg == NULL || s->hostname != NULL;
+    default:
+        return 0;
+    }
+}
+
+void SSL_set_verify(SSL *s, int mode, SSL_verify_cb verify_callback) {
+    if (s == NULL) return;
+    s->verify_mode = mode;
+    s->verify_cb = verify_callback;
+}
+
+int SSL_set_fd(SSL *ssl, int fd) {
+    if (ssl == NULL || fd < 0) return 0;
+    ssl->fd = fd;
+    return 1;
+}
+
+int SSL_connect(SSL *ssl) {
+    if (ssl == NULL || ssl->fd < 0) return -1;
+    return ssl_client_handshake(ssl) ? 1 : -1;
+}
+
+int SSL_accept(SSL *ssl) {
+    if (ssl == NULL || ssl->fd < 0) return -1;
+    return ssl_server_handshake(ssl) ? 1 : -1;
+}
+
+int SSL_session_reused(const SSL *s) {
+    return s != NULL && s->resumed;
+}
@@ -0,0 +1,87 @@
+/**
+ * Native backend behind lib_crypto_checkers.h.
+ * Runtime CPU feature detection and small helpers shared by the backend.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib_crypto_internal.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+
+static unsigned long long crypto_xgetbv(unsigned int index) {
+    unsigned int eax, edx;
+    __asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(index));
+    return ((unsigned long long)edx << 32) | eax;
+}
+
+static unsigned int crypto_cpu_detect(void) {
+    unsigned int eax, ebx, ecx, edx;
+    unsigned int max_leaf;
+    unsigned int f = 0;
+    int ymm_ok = 0;
+    int zmm_ok = 0;
+
+    if (__get_cpuid(0, &max_leaf, &ebx, &ecx, &edx) == 0) return 0;
+
+    __cpuid(1, eax, ebx, ecx, edx);
+    if (ecx & bit_SSSE3)  f |= CRYPTO_CPU_SSSE3;
+    if (ecx & bit_SSE4_1) f |= CRYPTO_CPU_SSE41;
+    if (ecx & bit_AES)    f |= CRYPTO_CPU_AESNI;
+    if (ecx & bit_PCLMUL) f |= CRYPTO_CPU_PCLMUL;
+    if (ecx & bit_OSXSAVE) {
+        unsigned long long xcr0 = crypto_xgetbv(0);
+        ymm_ok = (xcr0 & 0x06) == 0x06;         /* XMM and YMM state */
+        zmm_ok = (xcr0 & 0xe6) == 0xe6;         /* plus opmask and ZMM state */
+    }
+
+    if (max_leaf >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        if ((ebx & bit_AVX2) && ymm_ok)            f |= CRYPTO_CPU_AVX2;
+        if (ebx & bit_BMI2)                        f |= CRYPTO_CPU_BMI2;
+        if (ebx & bit_ADX)                         f |= CRYPTO_CPU_ADX;
+        if (ebx & bit_SHA)                         f |= CRYPTO_CPU_SHANI;
+        if ((ebx & bit_AVX512F) && zmm_ok)         f |= CRYPTO_CPU_AVX512F;
+        if ((ebx & bit_AVX512IFMA) && zmm_ok)      f |= CRYPTO_CPU_AVX512IFMA;
+    }
+    return f;
+}
+#else
+static unsigned int crypto_cpu_detect(void) {
+    return 0;
+}
+#endif
+
+unsigned int crypto_cpu_features(void) {
+    /* 0 means "not detected yet": bit 31 is always set once detection ran,
+     * so racing threads at worst detect twice and store the same value */
+    static volatile unsigned int features = 0;
+    unsigned int f = features;
+
+    if (f == 0) {
+        const char *mask = getenv("CRYPTO_CPU_MASK");
+        f = crypto_cpu_detect();
+        if (mask != NULL) {
+            f &= ~(unsigned int)strtoul(mask, NULL, 16);
+        }
+        f |= 1u << 31;
+        features = f;
+    }
+    return f;
+}
+
+void crypto_cleanse(void *p, size_t len) {
+    memset(p, 0, len);
+    __asm__ __volatile__ ("" : : "r"(p) : "memory");
+}
+
+int CRYPTO_memcmp(const void *in_a, const void *in_b, size_t len) {
+    const volatile unsigned char *a = (const volatile unsigned char *)in_a;
+    const volatile unsigned char *b = (const volatile unsigned char *)in_b;
+    unsigned char x = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) x |= a[i] ^ b[i];
+    return x;
+}
@@ -0,0 +1,372 @@
+/*
+ * Allocators used by the dynamic memory examples as alternatives to
+ * malloc/free for code with a known allocation shape.
+ *
+ * Arenas: bump-pointer allocation out of large blocks, freed in bulk by
+ * mem_arena_reset / mem_arena_destroy or rewound to a saved mark. Suited to
+ * request handlers and other code that allocates many small blocks and
+ * drops them all before returning. Individual blocks are never freed.
+ *
+ * Aligned blocks: posix_memalign-style allocation with a realloc that keeps
+ * the alignment, growing large blocks with mremap instead of copying them,
+ * and optionally backing the largest ones with 2 MiB pages.
+ *
+ * Pools: size-class slabs with per-thread magazines for fixed-size records
+ * allocated and freed at high rates, e.g.
+ *
+ *     bigstruct *s = POOL_NEW(bigstruct);
+ *     ...
+ *     POOL_DELETE(s);
+ *
+ * Heap profile: a sampling malloc interposer (built with
+ * MEM_PROFILE_INTERPOSE, linked in or preloaded) that records the stacks of
+ * live allocations for pprof at a cost low enough for production.
+ *
+ * Guarded heap: a malloc that reports frees of pointers it does not own,
+ * double frees and writes to freed blocks, for canary builds (built with
+ * MEM_GUARD_INTERPOSE it replaces malloc for the whole program).
+ *
+ * Spans: pointer and length pairs with bounds-checked access, for the
+ * fixed-size arrays of the static memory examples, cheap enough to leave
+ * checked in release builds.
+ */
+
+#ifndef LIB_MEMORY_H
+#define LIB_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*============================================================================
+ * ARENAS
+ *==========================================================================*/
+enum {
+    MEM_ARENA_ALIGN = 16            /* alignment of mem_arena_alloc results */
+};
+
+struct mem_arena_block;
+
+/* Fields are private; they are visible only so that the allocation fast
+ * path below can be inlined */
+typedef struct mem_arena {
+    char *cur;                      /* next free byte of the current block */
+    char *end;                      /* end of the current block */
+    struct mem_arena_block *block;  /* current block, chained to older ones */
+    struct mem_arena_block *spare;  /* emptied block kept for reuse */
+    size_t block_size;              /* size of the next block to allocate */
+    size_t used;                    /* bytes in blocks older than the current one */
+} mem_arena;
+
+/* Position to rewind to; nested marks are restored in reverse order */
+typedef struct mem_arena_mark {
+    struct mem_arena_block *block;
+    char *cur;
+    size_t used;
+} mem_arena_mark;
+
+/* block_size is the size of the first block (0 picks a default); later
+ * blocks grow geometrically. NULL when out of memory */
+mem_arena *mem_arena_create(size_t block_size);
+
+/* Frees every block and the arena itself */
+void mem_arena_destroy(mem_arena *a);
+
+/* Frees every allocation at once. The arena keeps a single block as large
+ * as everything it held, so a workload of stable size stops calling malloc
+ * after its first round */
+void mem_arena_reset(mem_arena *a);
+
+void *mem_arena_alloc_slow(mem_arena *a, size_t size, size_t align);
+
+/* size bytes aligned to align (a power of two); NULL when out of memory */
+static inline void *mem_arena_alloc_aligned(mem_arena *a, size_t size, size_t align) {
+    uintptr_t p = ((uintptr_t)a->cur + (align - 1)) & ~(uintptr_t)(align - 1);
+
+    if (p <= (uintptr_t)a->end && size <= (size_t)((uintptr_t)a->end - p)) {
+        a->cur = (char *)(p + size);
+        return (void *)p;
+    }
+    return mem_arena_alloc_slow(a, size, align);
+}
+
+static inline void *mem_arena_alloc(mem_arena *a, size_t size) {
+    return mem_arena_alloc_aligned(a, size, MEM_ARENA_ALIGN);
+}
+
+void *mem_arena_calloc(mem_arena *a, size_t nmemb, size_t size);
+
+/* Copies of a string / of len bytes of memory */
+char *mem_arena_strdup(mem_arena *a, const char *s);
+void *mem_arena_memdup(mem_arena *a, const void *p, size_t len);
+
+static inline mem_arena_mark mem_arena_save(const mem_arena *a) {
+    mem_arena_mark m;
+    m.block = a->block;
+    m.cur = a->cur;
+    m.used = a->used;
+    return m;
+}
+
+/* Frees everything allocated since m was saved */
+void mem_arena_restore(mem_arena *a, mem_arena_mark m);
+
+/* Bytes handed out since creation or the last reset */
+size_t mem_arena_used(const mem_arena *a);
+
+/* The calling thread's scratch arena, created on first use and freed when
+ * the thread exits; NULL when out of memory. Callers bracket their use with
+ * mem_arena_save / mem_arena_restore so that nested users share it:
+ *
+ *     mem_arena *s = mem_scratch();
+ *     mem_arena_mark m = mem_arena_save(s);
+ *     ... mem_arena_alloc(s, n) ...
+ *     mem_arena_restore(s, m);
+ */
+mem_arena *mem_scratch(void);
+
+/*============================================================================
+ * ALIGNED BLOCKS
+ *==========================================================================*/
+/* size bytes at a multiple of alignment (a power of two); NULL with errno
+ * set on failure. Large blocks are page mappings, so release with
+ * mem_aligned_free, not free */
+void *mem_aligned_alloc(size_t alignment, size_t size);
+
+/* realloc that keeps ptr aligned to alignment, which ptr must already
+ * satisfy. ptr may come from mem_aligned_alloc or posix_memalign. Large
+ * blocks grow by remapping their pages rather than copying them. NULL with
+ * ptr untouched on failure; a new_size of 0 frees ptr */
+void *mem_aligned_realloc(void *ptr, size_t alignment, size_t new_size);
+
+/* Frees blocks from the two functions above and from posix_memalign */
+void mem_aligned_free(void *ptr);
+
+enum mem_huge_mode {
+    MEM_HUGE_OFF,                   /* base pages */
+    MEM_HUGE_THP,                   /* transparent huge pages, madvise(MADV_HUGEPAGE) */
+    MEM_HUGE_HUGETLB                /* the hugetlbfs pool, THP when it is short */
+};
+
+/* Backs mem_aligned_alloc blocks of 2 MiB and more allocated from now on
+ * with 2 MiB pages, for large tables read at random, where base pages make
+ * most loads miss the dTLB; the MEM_HUGE_PAGES environment variable (thp or
+ * hugetlb) sets the initial mode. Returns the previous mode */
+enum mem_huge_mode mem_aligned_huge_pages(enum mem_huge_mode mode);
+
+/*============================================================================
+ * POOLS
+ *==========================================================================*/
+enum {
+    MEM_POOL_ALIGN      = 64,       /* cache line; object sizes are rounded to it */
+    MEM_POOL_MAX        = 1024,     /* largest object size */
+    MEM_POOL_CLASSES    = MEM_POOL_MAX / MEM_POOL_ALIGN,
+    MEM_POOL_MAG_ROUNDS = 64,       /* objects per magazine */
+    MEM_POOL_SLAB_SIZE  = 64 * 1024 /* slabs are aligned to their size and start with their class */
+};
+
+/* An uninitialised object of size bytes at most MEM_POOL_MAX, aligned to
+ * MEM_POOL_ALIGN; NULL when out of memory or size is too large */
+void *mem_pool_alloc(size_t size);
+
+/* Returns an object from the pool, from any thread; its class is read from
+ * its slab */
+void mem_pool_free(void *p);
+
+/* Fields are private; they are visible only so that the typed fast paths
+ * below can be inlined */
+struct mem_pool_mag {
+    struct mem_pool_mag *next;
+    unsigned int rounds;            /* objects held */
+    void *obj[MEM_POOL_MAG_ROUNDS];
+};
+
+struct mem_pool_cache {
+    struct mem_pool_mag *loaded[MEM_POOL_CLASSES];
+    struct mem_pool_mag *prev[MEM_POOL_CLASSES];
+    int registered;
+};
+
+extern __thread struct mem_pool_cache mem_pool_tls;
+
+/* mem_pool_alloc for a size known at compile time, which folds to a pop
+ * from the thread's magazine */
+static inline void *mem_pool_new(size_t size) {
+    struct mem_pool_mag *m = mem_pool_tls.loaded[(size - 1) / MEM_POOL_ALIGN];
+
+    if (m != NULL && m->rounds > 0) return m->obj[--m->rounds];
+    return mem_pool_alloc(size);
+}
+
+/* mem_pool_free inline for an object expected to be of size bytes, which
+ * folds to a push to the thread's magazine. The class read from p's slab
+ * must match, so that a void * or a pointer to a base struct goes to
+ * mem_pool_free instead; only a branch depends on that load, which keeps
+ * the push off the chain from the slab to the magazine */
+static inline void mem_pool_delete(void *p, size_t size) {
+    unsigned int cls = (unsigned int)((size - 1) / MEM_POOL_ALIGN);
+    struct mem_pool_mag *m = cls < MEM_POOL_CLASSES ? mem_pool_tls.loaded[cls] : NULL;
+
+    if (p == NULL) return;
+    if (m != NULL && m->rounds < MEM_POOL_MAG_ROUNDS
+        && *(const unsigned int *)((uintptr_t)p & ~(uintptr_t)(MEM_POOL_SLAB_SIZE - 1)) == cls) {
+        m->obj[m->rounds++] = p;
+        return;
+    }
+    mem_pool_free(p);
+}
+
+/* Typed front end; types larger than MEM_POOL_MAX do not compile */
+#define POOL_NEW(type) \
+    ((type *)mem_pool_new(sizeof(type) + 0 * sizeof(char[sizeof(type) <= MEM_POOL_MAX ? 1 : -1])))
+#define POOL_DELETE(p) mem_pool_delete((p), sizeof(*(p)))
+
+/*============================================================================
+ * HEAP PROFILE
+ *==========================================================================*/
+/* Samples one allocation every period bytes on average (1 records them
+ * all). The MEM_PROFILE environment variable starts the profiler when the
+ * program loads; MEM_PROFILE_SIGNAL then names a signal that writes a
+ * profile to MEM_PROFILE_PREFIX.<pid>.<n>.heap. 0 when the profiler is not
+ * built in */
+int mem_profile_start(size_t period);
+
+/* Stops sampling; blocks already sampled stay in the profile until freed */
+void mem_profile_stop(void);
+
+/* Writes the live-allocation profile in pprof's heap format to fd; 0 on
+ * failure or when the profiler is not running */
+int mem_profile_dump(int fd);
+
+/*============================================================================
+ * GUARDED HEAP
+ *==========================================================================*/
+enum mem_guard_error {
+    MEM_GUARD_BAD_FREE,             /* not the start of a live block of the guarded heap */
+    MEM_GUARD_DOUBLE_FREE,
+    MEM_GUARD_USE_AFTER_FREE        /* a freed block was written to */
+};
+
+/* Called with the offending pointer; when it returns, the operation is
+ * dropped */
+typedef void (*mem_guard_handler)(enum mem_guard_error err, const void *ptr);
+
+/* malloc, calloc, realloc, memalign and free on the guarded heap. Freed
+ * blocks are quarantined before reuse, so that writes to them and double
+ * frees are caught */
+void *mem_guard_malloc(size_t size);
+void *mem_guard_calloc(size_t nmemb, size_t size);
+void *mem_guard_realloc(void *ptr, size_t size);
+void *mem_guard_memalign(size_t alignment, size_t size);
+void mem_guard_free(void *ptr);
+
+size_t mem_guard_usable_size(const void *ptr);
+
+/* Whether ptr is a live block of the guarded heap, in constant time */
+int mem_guard_owns(const void *ptr);
+
+/* Releases the calling thread's quarantine now, checking every block in it
+ * for writes after free */
+void mem_guard_flush(void);
+
+/* Installs handler (NULL restores the default, which prints the error and
+ * aborts) and returns the previous one */
+mem_guard_handler mem_guard_set_handler(mem_guard_handler handler);
+
+/*============================================================================
+ * SPANS
+ *==========================================================================*/
+/* What an index out of range does, per translation unit:
+ *   2  prints the file, line, index and length and aborts (the default);
+ *   1  traps with a single instruction, for hardened release builds (the
+ *      default with NDEBUG);
+ *   0  nothing: the access is unchecked, as on a raw array.
+ * A check is one unsigned comparison and a branch to cold code that does
+ * not return. The compiler drops it wherever the index is known to be in
+ * range, which is the case in a loop bounded by the span's length or by the
+ * length of a fixed-size array: such loops compile as they would without
+ * checks and stay vectorisable. For a loop bounded by anything else, narrow
+ * the spans to that bound first with MEM_SPAN_NARROW, one check each */
+#ifndef MEM_SPAN_CHECKS
+#ifdef NDEBUG
+#define MEM_SPAN_CHECKS 1
+#else
+#define MEM_SPAN_CHECKS 2
+#endif
+#endif
+
+/* Reports an index (or range end) outside a span of len elements, aborts */
+void mem_span_fail(const char *file, int line, size_t index, size_t len) __attribute__((noreturn, cold));
+
+static inline int mem_span_out(int out, const char *file, int line, size_t index, size_t len) {
+#if MEM_SPAN_CHECKS >= 2
+    if (__builtin_expect(out, 0)) mem_span_fail(file, line, index, len);
+#elif MEM_SPAN_CHECKS == 1
+    if (__builtin_expect(out, 0)) __builtin_trap();
+#endif
+    (void)out;
+    (void)file;
+    (void)line;
+    (void)index;
+    (void)len;
+    return 0;
+}
+
+/* index, once checked to be below len */
+static inline size_t mem_span_index(size_t index, size_t len, const char *file, int line) {
+    return index + (size_t)mem_span_out(index >= len, file, line, index, len);
+}
+
+/* off, once checked that [off, off + n) lies within len elements */
+static inline size_t mem_span_range(size_t off, size_t n, size_t len, const char *file, int line) {
+    return off + (size_t)mem_span_out(off > len || n > len - off, file, line, off + n, len);
+}
+
+/* n, once checked to be at most len */
+static inline size_t mem_span_count(size_t n, size_t len, const char *file, int line) {
+    return n + (size_t)mem_span_out(n > len, file, line, n, len);
+}
+
+/* The number of elements of an array; does not compile for a pointer */
+#define MEM_COUNTOF(a) \
+    (sizeof(a) / sizeof((a)[0]) + \
+     0 * sizeof(char[1 - 2 * __builtin_types_compatible_p(__typeof__(a), __typeof__(&(a)[0]))]))
+
+/* Declares name, a view of len elements of type from data:
+ *
+ *     MEM_SPAN_TYPE(span_ulong, unsigned long);
+ *     unsigned long fib[SIZE10];
+ *     span_ulong s = MEM_SPAN_OF(fib);
+ */
+#define MEM_SPAN_TYPE(name, type) typedef struct name { type *data; size_t len; } name
+
+/* Initialiser of a span over a whole array */
+#define MEM_SPAN_OF(a) { (a), MEM_COUNTOF(a) }
+
+/* Element i of span s, and of array a; i may be of any integer type, a
+ * negative one being out of range */
+#define MEM_SPAN_AT(s, i) ((s).data[mem_span_index((size_t)(i), (s).len, __FILE__, __LINE__)])
+#define MEM_ARRAY_AT(a, i) ((a)[mem_span_index((size_t)(i), MEM_COUNTOF(a), __FILE__, __LINE__)])
+
+/* Whether i indexes s, for callers that handle a bad index themselves; an
+ * access under this test costs no second comparison */
+#define MEM_SPAN_HAS(s, i) ((size_t)(i) < (s).len)
+#define MEM_ARRAY_HAS(a, i) ((size_t)(i) < MEM_COUNTOF(a))
+
+/* The address of the n elements of s from off, for memcpy and the like */
+#define MEM_SPAN_PTR(s, off, n) ((s).data + mem_span_range((size_t)(off), (size_t)(n), (s).len, __FILE__, __LINE__))
+
+/* Shortens s in place to its first n elements, which it must have */
+#define MEM_SPAN_NARROW(s, n) ((void)((s).len = mem_span_count((size_t)(n), (s).len, __FILE__, __LINE__)))
+
+/* The span of type of the n elements of s from off */
+#define MEM_SPAN_SUB(type, s, off, n) ((type){ MEM_SPAN_PTR(s, off, n), (size_t)(n) })
+
+/*============================================================================
+ * BENCHMARKS
+ *==========================================================================*/
+/* Allocation patterns of the corrected dynamic memory examples with glibc
+ * malloc and with the allocators above; the number of failed benchmarks */
+int mem_bench_suite(FILE *report);
+
+#endif /* LIB_MEMORY_H */
@@ -0,0 +1,294 @@
+/**
+ * Backend behind lib_memory.h.
+ * Aligned allocation with a realloc that keeps the alignment.
+ *
+ * Blocks below ALIGNED_MAP_THRESHOLD come from posix_memalign. Growing one
+ * stays in place while malloc_usable_size allows it and otherwise is an
+ * aligned allocation, a copy and a free. Larger blocks are page-rounded
+ * anonymous mappings: mremap grows them in place when the address space
+ * after them is free and otherwise moves their pages to a new address
+ * without copying a byte, so growing a buffer to N bytes costs O(N) page
+ * faults instead of O(N) copies per step. When the alignment is larger than
+ * a page the move goes to a reserved, suitably aligned range
+ * (MREMAP_FIXED), since mremap on its own only guarantees page alignment.
+ *
+ * Mappings are recorded in a small hash table keyed by address so that
+ * mem_aligned_realloc and mem_aligned_free can tell them from heap blocks;
+ * only page-aligned pointers are looked up, and none while no mapping is
+ * live.
+ *
+ * In a huge-page mode (mem_aligned_huge_pages, or MEM_HUGE_PAGES=thp or
+ * hugetlb in the environment) mappings of ALIGNED_HUGE_PAGE bytes and more
+ * are rounded to and aligned on 2 MiB, so that every page of them can be a
+ * huge page. hugetlb mode maps them from the hugetlbfs pool, whose pages are
+ * reserved at mmap time, so that an empty pool is a failed call rather than
+ * a SIGBUS on first touch; on failure, and in thp mode, the mapping is made
+ * of normal pages with madvise(MADV_HUGEPAGE), which khugepaged and the
+ * fault handler back with transparent huge pages when they can. mremap
+ * keeps both the alignment and the advice when a THP block grows; a
+ * hugetlbfs block is regrown by copying.
+ */
+
+#define _GNU_SOURCE  /* For mremap, malloc_usable_size, MAP_HUGETLB */
+
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "lib_memory.h"
+
+enum {
+    ALIGNED_BUCKETS = 256
+};
+
+#define ALIGNED_MAP_THRESHOLD ((size_t)256 << 10)
+#define ALIGNED_HUGE_PAGE ((size_t)2 << 20)
+
+struct aligned_map {
+    void *addr;
+    size_t len;                     /* mapped length, a multiple of the page size */
+    enum mem_huge_mode huge;        /* MEM_HUGE_OFF, _THP or _HUGETLB, as mapped */
+    struct aligned_map *next;
+};
+
+static pthread_mutex_t aligned_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct aligned_map *aligned_table[ALIGNED_BUCKETS];
+static size_t aligned_live;         /* mappings in the table; read unlocked as a filter */
+static size_t aligned_page;
+static enum mem_huge_mode aligned_huge;
+
+static size_t page_size(void) {
+    size_t ps = __atomic_load_n(&aligned_page, __ATOMIC_RELAXED);
+
+    if (ps == 0) {
+        long v = sysconf(_SC_PAGESIZE);
+        ps = v > 0 ? (size_t)v : 4096;
+        __atomic_store_n(&aligned_page, ps, __ATOMIC_RELAXED);
+    }
+    return ps;
+}
+
+static struct aligned_map **aligned_bucket(const void *addr) {
+    uintptr_t h = ((uintptr_t)addr >> 12) * (uintptr_t)0x9e3779b97f4a7c15ull;
+    return &aligned_table[(h >> 24) % ALIGNED_BUCKETS];
+}
+
+static int aligned_insert(void *addr, size_t len, enum mem_huge_mode huge) {
+    struct aligned_map *m = (struct aligned_map *)malloc(sizeof(*m));
+    struct aligned_map **b;
+
+    if (m == NULL) return 0;
+    m->addr = addr;
+    m->len = len;
+    m->huge = huge;
+    pthread_mutex_lock(&aligned_lock);
+    b = aligned_bucket(addr);
+    m->next = *b;
+    *b = m;
+    __atomic_store_n(&aligned_live, aligned_live + 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&aligned_lock);
+    return 1;
+}
+
+/* Length of the mapping at addr, 0 for a heap block, and its page kind in
+ * *huge when huge is not NULL. With remove set the record is dropped;
+ * otherwise, with new_addr set, it is moved to new_addr / new_len */
+static size_t aligned_lookup(void *addr, int remove, void *new_addr, size_t new_len, enum mem_huge_mode *huge) {
+    struct aligned_map **p, *m = NULL;
+    size_t len = 0;
+
+    if (((uintptr_t)addr & (page_size() - 1)) != 0) return 0;
+    if (__atomic_load_n(&aligned_live, __ATOMIC_RELAXED) == 0) return 0;
+
+    pthread_mutex_lock(&aligned_lock);
+    for (p = aligned_bucket(addr); *p != NULL; p = &(*p)->next) {
+        if ((*p)->addr == addr) {
+            m = *p;
+            len = m->len;
+            if (huge != NULL) *huge = m->huge;
+            if (remove || new_addr != NULL) *p = m->next;
+            break;
+        }
+    }
+    if (m != NULL && new_addr != NULL) {
+        struct aligned_map **b = aligned_bucket(new_addr);
+        m->addr = new_addr;
+        m->len = new_len;
+        m->next = *b;
+        *b = m;
+    } else if (m != NULL && remove) {
+        __atomic_store_n(&aligned_live, aligned_live - 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&aligned_lock);
+    if (remove && m != NULL) free(m);
+    return len;
+}
+
+static size_t round_to_pages(size_t size) {
+    size_t ps = page_size();
+    return size > SIZE_MAX - ps ? 0 : (size + ps - 1) & ~(ps - 1);
+}
+
+/* len bytes of address space at a multiple of alignment, trimmed from a
+ * larger mapping; MAP_FAILED on failure */
+static void *map_aligned(size_t len, size_t alignment, int prot) {
+    size_t ps = page_size(), extra = alignment > ps ? alignment - ps : 0;
+    uintptr_t base, start;
+    void *p;
+
+    if (len > SIZE_MAX - extra) return MAP_FAILED;
+    p = mmap(NULL, len + extra, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED || extra == 0) return p;
+
+    base = (uintptr_t)p;
+    start = (base + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if (start > base) (void)munmap(p, start - base);
+    if (start + len < base + len + extra) (void)munmap((void *)(start + len), base + len + extra - (start + len));
+    return (void *)start;
+}
+
+static int valid_alignment(size_t alignment) {
+    return alignment != 0 && (alignment & (alignment - 1)) == 0;
+}
+
+static size_t round_to_huge(size_t size) {
+    return size > SIZE_MAX - ALIGNED_HUGE_PAGE ? 0 : (size + ALIGNED_HUGE_PAGE - 1) & ~(ALIGNED_HUGE_PAGE - 1);
+}
+
+enum mem_huge_mode mem_aligned_huge_pages(enum mem_huge_mode mode) {
+    return __atomic_exchange_n(&aligned_huge, mode, __ATOMIC_RELAXED);
+}
+
+static void __attribute__((constructor)) aligned_init(void) {
+    const char *env = getenv("MEM_HUGE_PAGES");
+
+    if (env == NULL) return;
+    if (strcmp(env, "thp") == 0) aligned_huge = MEM_HUGE_THP;
+    else if (strcmp(env, "hugetlb") == 0) aligned_huge = MEM_HUGE_HUGETLB;
+}
+
+/* A huge-page mapping of len bytes (a multiple of ALIGNED_HUGE_PAGE) for
+ * mode, with the kind it got in *huge; MAP_FAILED on failure */
+static void *map_huge(size_t len, size_t alignment, enum mem_huge_mode mode, enum mem_huge_mode *huge) {
+    void *p;
+
+    if (mode == MEM_HUGE_HUGETLB && alignment <= ALIGNED_HUGE_PAGE) {
+        p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            *huge = MEM_HUGE_HUGETLB;
+            return p;
+        }
+    }
+    p = map_aligned(len, alignment > ALIGNED_HUGE_PAGE ? alignment : ALIGNED_HUGE_PAGE, PROT_READ | PROT_WRITE);
+    if (p == MAP_FAILED) return p;
+    (void)madvise(p, len, MADV_HUGEPAGE);
+    *huge = MEM_HUGE_THP;
+    return p;
+}
+
+void *mem_aligned_alloc(size_t alignment, size_t size) {
+    enum mem_huge_mode mode = __atomic_load_n(&aligned_huge, __ATOMIC_RELAXED), huge = MEM_HUGE_OFF;
+    void *p = NULL;
+    size_t len;
+
+    if (!valid_alignment(alignment)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment < sizeof(void *)) alignment = sizeof(void *);
+
+    if (size < ALIGNED_MAP_THRESHOLD) {
+        int err = posix_memalign(&p, alignment, size);
+        if (err != 0) {
+            errno = err;
+            return NULL;
+        }
+        return p;
+    }
+
+    if (size < ALIGNED_HUGE_PAGE) mode = MEM_HUGE_OFF;
+    len = mode == MEM_HUGE_OFF ? round_to_pages(size) : round_to_huge(size);
+    if (len == 0) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (mode == MEM_HUGE_OFF) p = map_aligned(len, alignment, PROT_READ | PROT_WRITE);
+    else p = map_huge(len, alignment, mode, &huge);
+    if (p == MAP_FAILED) return NULL;
+    if (!aligned_insert(p, len, huge)) {
+        (void)munmap(p, len);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return p;
+}
+
+void mem_aligned_free(void *ptr) {
+    size_t len;
+
+    if (ptr == NULL) return;
+    len = aligned_lookup(ptr, 1, NULL, 0, NULL);
+    if (len != 0) (void)munmap(ptr, len);
+    else free(ptr);
+}
+
+/* Resizes the mapping at ptr to new_len bytes, moving its pages when it
+ * cannot grow in place; MAP_FAILED with ptr unchanged on failure */
+static void *remap_aligned(void *ptr, size_t old_len, size_t new_len, size_t alignment) {
+    void *q, *target;
+
+    q = mremap(ptr, old_len, new_len, 0);
+    if (q != MAP_FAILED || new_len < old_len) return q;
+    if (alignment <= page_size()) return mremap(ptr, old_len, new_len, MREMAP_MAYMOVE);
+
+    target = map_aligned(new_len, alignment, PROT_NONE);
+    if (target == MAP_FAILED) return MAP_FAILED;
+    q = mremap(ptr, old_len, new_len, MREMAP_MAYMOVE | MREMAP_FIXED, target);
+    if (q == MAP_FAILED) (void)munmap(target, new_len);
+    return q;
+}
+
+void *mem_aligned_realloc(void *ptr, size_t alignment, size_t new_size) {
+    enum mem_huge_mode huge = MEM_HUGE_OFF;
+    size_t old_len, new_len, old_size;
+    void *q;
+
+    if (ptr == NULL) return mem_aligned_alloc(alignment, new_size);
+    if (new_size == 0) {
+        mem_aligned_free(ptr);
+        return NULL;
+    }
+    if (!valid_alignment(alignment) || ((uintptr_t)ptr & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    old_len = aligned_lookup(ptr, 0, NULL, 0, &huge);
+    if (old_len != 0 && new_size >= ALIGNED_MAP_THRESHOLD && huge != MEM_HUGE_HUGETLB) {
+        new_len = huge == MEM_HUGE_THP ? round_to_huge(new_size) : round_to_pages(new_size);
+        if (new_len == 0) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        if (new_len == old_len) return ptr;
+        if (huge == MEM_HUGE_THP && alignment < ALIGNED_HUGE_PAGE) alignment = ALIGNED_HUGE_PAGE;
+        q = remap_aligned(ptr, old_len, new_len, alignment);
+        if (q == MAP_FAILED) return NULL;
+        (void)aligned_lookup(ptr, 0, q, new_len, NULL);
+        return q;
+    }
+
+    /* A heap block, or a mapping shrinking below the threshold. A heap
+     * block is kept when it still fits and is not mostly empty */
+    old_size = old_len != 0 ? old_len : malloc_usable_size(ptr);
+    if (old_len == 0 && new_size <= old_size && new_size >= old_size / 2) return ptr;
+
+    q = mem_aligned_alloc(alignment, new_size);
+    if (q == NULL) return NULL;
+    memcpy(q, ptr, old_size < new_size ? old_size : new_size);
+    mem_aligned_free(ptr);
+    return q;
+}
@@ -0,0 +1,202 @@
+/**
+ * Backend behind lib_memory.h.
+ * Region allocator: bump-pointer allocation out of a chain of blocks.
+ *
+ * The allocation fast path is inline in lib_memory.h; this file handles a
+ * full block, resets and marks. A block that a restore empties is kept as a
+ * spare for the next overflow, so code that repeatedly saves, allocates past
+ * a block boundary and restores does not call malloc every time. A reset
+ * folds the whole chain into one block of the combined size.
+ *
+ * Each thread's scratch arena is created lazily and destroyed by a
+ * pthread_key destructor when the thread exits.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib_memory.h"
+
+enum {
+    ARENA_DEFAULT_BLOCK = 64 * 1024,
+    ARENA_MIN_BLOCK     = 256
+};
+
+#define ARENA_MAX_GROWTH ((size_t)64 << 20)  /* blocks stop doubling here */
+
+struct mem_arena_block {
+    struct mem_arena_block *prev;
+    size_t size;                    /* usable bytes after the header */
+    _Alignas(MEM_ARENA_ALIGN) char data[];
+};
+
+static __thread mem_arena *scratch_tls;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+static pthread_key_t scratch_key;
+static int scratch_key_ok;
+
+static struct mem_arena_block *arena_block_new(size_t size) {
+    struct mem_arena_block *b;
+
+    if (size > SIZE_MAX - sizeof(*b)) return NULL;
+    b = (struct mem_arena_block *)malloc(sizeof(*b) + size);
+    if (b == NULL) return NULL;
+    b->prev = NULL;
+    b->size = size;
+    return b;
+}
+
+/* Makes b the current block */
+static void arena_push(mem_arena *a, struct mem_arena_block *b) {
+    if (a->block != NULL) a->used += (size_t)(a->cur - a->block->data);
+    b->prev = a->block;
+    a->block = b;
+    a->cur = b->data;
+    a->end = b->data + b->size;
+}
+
+/* Keeps the larger of b and the current spare, frees the other */
+static void arena_keep_spare(mem_arena *a, struct mem_arena_block *b) {
+    if (a->spare == NULL || a->spare->size < b->size) {
+        free(a->spare);
+        a->spare = b;
+    } else {
+        free(b);
+    }
+}
+
+mem_arena *mem_arena_create(size_t block_size) {
+    mem_arena *a;
+    struct mem_arena_block *b;
+
+    if (block_size == 0) block_size = ARENA_DEFAULT_BLOCK;
+    if (block_size < ARENA_MIN_BLOCK) block_size = ARENA_MIN_BLOCK;
+
+    a = (mem_arena *)calloc(1, sizeof(*a));
+    if (a == NULL) return NULL;
+    b = arena_block_new(block_size);
+    if (b == NULL) {
+        free(a);
+        return NULL;
+    }
+    a->block_size = block_size;
+    arena_push(a, b);
+    return a;
+}
+
+void mem_arena_destroy(mem_arena *a) {
+    struct mem_arena_block *b;
+
+    if (a == NULL) return;
+    while ((b = a->block) != NULL) {
+        a->block = b->prev;
+        free(b);
+    }
+    free(a->spare);
+    free(a);
+}
+
+void *mem_arena_alloc_slow(mem_arena *a, size_t size, size_t align) {
+    struct mem_arena_block *b;
+    size_t need;
+    uintptr_t p;
+
+    if (align < MEM_ARENA_ALIGN) align = MEM_ARENA_ALIGN;
+    if ((align & (align - 1)) != 0 || size > SIZE_MAX - align) return NULL;
+    need = size + align - MEM_ARENA_ALIGN;  /* block data is MEM_ARENA_ALIGN aligned */
+
+    if (a->spare != NULL && a->spare->size >= need) {
+        b = a->spare;
+        a->spare = NULL;
+    } else {
+        size_t bs = a->block_size;
+        if (bs < need) bs = need;
+        b = arena_block_new(bs);
+        if (b == NULL) return NULL;
+        if (a->block_size < ARENA_MAX_GROWTH) a->block_size *= 2;
+    }
+    arena_push(a, b);
+
+    p = ((uintptr_t)a->cur + (align - 1)) & ~(uintptr_t)(align - 1);
+    a->cur = (char *)(p + size);
+    return (void *)p;
+}
+
+void *mem_arena_calloc(mem_arena *a, size_t nmemb, size_t size) {
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) return NULL;
+    p = mem_arena_alloc(a, nmemb * size);
+    if (p != NULL) memset(p, 0, nmemb * size);
+    return p;
+}
+
+void *mem_arena_memdup(mem_arena *a, const void *p, size_t len) {
+    void *q = mem_arena_alloc_aligned(a, len, 1);
+    if (q != NULL && len > 0) memcpy(q, p, len);
+    return q;
+}
+
+char *mem_arena_strdup(mem_arena *a, const char *s) {
+    return (char *)mem_arena_memdup(a, s, strlen(s) + 1);
+}
+
+void mem_arena_reset(mem_arena *a) {
+    struct mem_arena_block *b, *largest = NULL, *merged = NULL;
+    size_t total = 0;
+
+    for (b = a->block; b != NULL; b = b->prev) {
+        if (largest == NULL || b->size > largest->size) largest = b;
+        total += b->size;
+    }
+    if (a->block->prev != NULL) merged = arena_block_new(total);
+    if (merged == NULL) merged = largest;   /* a single block, or no memory for the merge */
+
+    while ((b = a->block) != NULL) {
+        a->block = b->prev;
+        if (b != merged) free(b);
+    }
+    free(a->spare);
+    a->spare = NULL;
+    a->used = 0;
+    arena_push(a, merged);
+}
+
+void mem_arena_restore(mem_arena *a, mem_arena_mark m) {
+    while (a->block != m.block) {
+        struct mem_arena_block *b = a->block;
+        a->block = b->prev;
+        arena_keep_spare(a, b);
+    }
+    a->cur = m.cur;
+    a->end = a->block->data + a->block->size;
+    a->used = m.used;
+}
+
+size_t mem_arena_used(const mem_arena *a) {
+    return a->used + (size_t)(a->cur - a->block->data);
+}
+
+/*============================================================================
+ * SCRATCH ARENAS
+ *==========================================================================*/
+static void scratch_thread_exit(void *p) {
+    scratch_tls = NULL;
+    mem_arena_destroy((mem_arena *)p);
+}
+
+static void scratch_init_once(void) {
+    scratch_key_ok = pthread_key_create(&scratch_key, scratch_thread_exit) == 0;
+}
+
+mem_arena *mem_scratch(void) {
+    mem_arena *a = scratch_tls;
+
+    if (a != NULL) return a;
+    (void)pthread_once(&scratch_once, scratch_init_once);
+    a = mem_arena_create(0);
+    if (a == NULL) return NULL;
+    if (scratch_key_ok) (void)pthread_setspecific(scratch_key, a);
+    scratch_tls = a;
+    return a;
+}
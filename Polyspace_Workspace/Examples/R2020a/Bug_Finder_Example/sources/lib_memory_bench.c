@@ -0,0 +1,512 @@
+/**
+ * Backend behind lib_memory.h.
+ * Benchmarks of the allocators against glibc malloc, timed with the
+ * CRYPTO_bench harness.
+ *
+ * Each benchmark call runs BENCH_ROUNDS rounds of one allocation shape, so
+ * that the clock reads of the harness stay small next to the work:
+ *   - the corrected_unprotectedmemoryallocation shape: one int, used, freed;
+ *   - the corrected_memleak_array shape: an array of ten ints, filled,
+ *     searched, freed;
+ *   - a request handler: BENCH_HANDLER_ALLOCS blocks of 16 to 512 bytes,
+ *     all live until the end of the round.
+ *
+ * The pool benchmarks allocate goodpractice.c's bigstruct, one at a time and
+ * BENCH_POOL_LIVE at a time.
+ *
+ * The single int and handler shapes also run on the guarded heap, whose
+ * cost against malloc is what a canary build pays.
+ *
+ * The growth benchmark doubles a 4 KiB-aligned buffer from 4 KiB to 1 GiB,
+ * faulting in each new page, once with posix_memalign + memcpy + free per
+ * step (what corrected_alignmentchange would need to keep its data) and
+ * once with mem_aligned_realloc.
+ *
+ * The table benchmarks read BENCH_TABLE_LOADS random bytes of a 256 MiB
+ * table from mem_aligned_alloc, with base pages and in THP mode. With base
+ * pages nearly every load misses the dTLB, whose reach is a few MiB; the
+ * harness reports the misses per call where the PMU is readable.
+ *
+ * The span benchmarks run the corrected_outboundarray loop and an axpy over
+ * BENCH_SPAN_LEN doubles on raw arrays and on spans, with the checks that
+ * MEM_SPAN_CHECKS selects for this file: the axpy once with its spans
+ * narrowed to the loop bound and once checking every index.
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For posix_memalign */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lib_memory.h"
+#include "lib_crypto_checkers.h"
+
+enum {
+    BENCH_ROUNDS         = 1000,
+    BENCH_HANDLER_ALLOCS = 48,
+    BENCH_ARRAY_LEN      = 10,
+    BENCH_POOL_LIVE      = 256,
+    BENCH_TABLE_LOADS    = 65536,
+    BENCH_SPAN_LEN       = 4096
+};
+
+#define BENCH_SECONDS 0.5
+#define BENCH_GROW_ALIGN ((size_t)4096)
+#define BENCH_GROW_MAX ((size_t)1 << 30)
+#define BENCH_TABLE_SIZE ((size_t)256 << 20)
+
+typedef struct bench_bigstruct {
+    unsigned int count;
+    int values[20];
+} bench_bigstruct;
+
+typedef struct bench_state {
+    mem_arena *arena;
+    size_t sizes[BENCH_HANDLER_ALLOCS];
+    void *ptrs[BENCH_POOL_LIVE];
+    unsigned char *table;           /* BENCH_TABLE_SIZE bytes */
+    double x[BENCH_SPAN_LEN];
+    double y[BENCH_SPAN_LEN];
+    size_t span_n;                  /* the axpy bound, unknown to the compiler */
+    uint64_t seed;
+    volatile unsigned long sink;    /* keeps the compiler from dropping malloc/free pairs */
+} bench_state;
+
+/*============================================================================
+ * SINGLE INT
+ *==========================================================================*/
+static int bench_int_malloc(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        int *ptr = (int *)malloc(sizeof(int));
+        if (ptr == NULL) return 0;
+        *ptr = r;
+        st->sink += (unsigned long)*ptr;
+        free(ptr);
+    }
+    return 1;
+}
+
+static int bench_int_scratch(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    mem_arena *s = mem_scratch();
+    int r;
+
+    if (s == NULL) return 0;
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        mem_arena_mark m = mem_arena_save(s);
+        int *ptr = (int *)mem_arena_alloc(s, sizeof(int));
+        if (ptr == NULL) return 0;
+        *ptr = r;
+        st->sink += (unsigned long)*ptr;
+        mem_arena_restore(s, m);
+    }
+    return 1;
+}
+
+static int bench_int_guard(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        int *ptr = (int *)mem_guard_malloc(sizeof(int));
+        if (ptr == NULL) return 0;
+        *ptr = r;
+        st->sink += (unsigned long)*ptr;
+        mem_guard_free(ptr);
+    }
+    return 1;
+}
+
+/*============================================================================
+ * INT ARRAY
+ *==========================================================================*/
+static unsigned long bench_array_use(int *pi, int r) {
+    int i;
+
+    for (i = 0; i < BENCH_ARRAY_LEN; i++) pi[i] = 42 + i;
+    for (i = 0; i < BENCH_ARRAY_LEN; i++) {
+        if (pi[i] == r) break;
+    }
+    return (unsigned long)i;
+}
+
+static int bench_array_malloc(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        int *pi = (int *)malloc(BENCH_ARRAY_LEN * sizeof(int));
+        if (pi == NULL) return 0;
+        st->sink += bench_array_use(pi, r);
+        free(pi);
+    }
+    return 1;
+}
+
+static int bench_array_scratch(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    mem_arena *s = mem_scratch();
+    int r;
+
+    if (s == NULL) return 0;
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        mem_arena_mark m = mem_arena_save(s);
+        int *pi = (int *)mem_arena_alloc(s, BENCH_ARRAY_LEN * sizeof(int));
+        if (pi == NULL) return 0;
+        st->sink += bench_array_use(pi, r);
+        mem_arena_restore(s, m);
+    }
+    return 1;
+}
+
+/*============================================================================
+ * REQUEST HANDLER
+ *==========================================================================*/
+static int bench_handler_malloc(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r, i;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) {
+            st->ptrs[i] = malloc(st->sizes[i]);
+            if (st->ptrs[i] == NULL) return 0;
+            memset(st->ptrs[i], i, 16);
+        }
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) {
+            st->sink += *(unsigned char *)st->ptrs[i];
+            free(st->ptrs[i]);
+        }
+    }
+    return 1;
+}
+
+static int bench_handler_arena(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r, i;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) {
+            st->ptrs[i] = mem_arena_alloc(st->arena, st->sizes[i]);
+            if (st->ptrs[i] == NULL) return 0;
+            memset(st->ptrs[i], i, 16);
+        }
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) st->sink += *(unsigned char *)st->ptrs[i];
+        mem_arena_reset(st->arena);
+    }
+    return 1;
+}
+
+static int bench_handler_scratch(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    mem_arena *s = mem_scratch();
+    int r, i;
+
+    if (s == NULL) return 0;
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        mem_arena_mark m = mem_arena_save(s);
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) {
+            st->ptrs[i] = mem_arena_alloc(s, st->sizes[i]);
+            if (st->ptrs[i] == NULL) return 0;
+            memset(st->ptrs[i], i, 16);
+        }
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) st->sink += *(unsigned char *)st->ptrs[i];
+        mem_arena_restore(s, m);
+    }
+    return 1;
+}
+
+static int bench_handler_guard(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r, i;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) {
+            st->ptrs[i] = mem_guard_malloc(st->sizes[i]);
+            if (st->ptrs[i] == NULL) return 0;
+            memset(st->ptrs[i], i, 16);
+        }
+        for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) {
+            st->sink += *(unsigned char *)st->ptrs[i];
+            mem_guard_free(st->ptrs[i]);
+        }
+    }
+    return 1;
+}
+
+/*============================================================================
+ * POOLS
+ *==========================================================================*/
+static int bench_record_malloc(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        bench_bigstruct *s = (bench_bigstruct *)malloc(sizeof(bench_bigstruct));
+        if (s == NULL) return 0;
+        s->count = (unsigned int)r;
+        st->sink += s->count;
+        free(s);
+    }
+    return 1;
+}
+
+static int bench_record_pool(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        bench_bigstruct *s = POOL_NEW(bench_bigstruct);
+        if (s == NULL) return 0;
+        s->count = (unsigned int)r;
+        st->sink += s->count;
+        POOL_DELETE(s);
+    }
+    return 1;
+}
+
+static int bench_records_malloc(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_POOL_LIVE; i++) {
+        bench_bigstruct *s = (bench_bigstruct *)malloc(sizeof(bench_bigstruct));
+        if (s == NULL) return 0;
+        s->count = (unsigned int)i;
+        st->ptrs[i] = s;
+    }
+    for (i = 0; i < BENCH_POOL_LIVE; i++) {
+        st->sink += ((bench_bigstruct *)st->ptrs[i])->count;
+        free(st->ptrs[i]);
+    }
+    return 1;
+}
+
+static int bench_records_pool(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_POOL_LIVE; i++) {
+        bench_bigstruct *s = POOL_NEW(bench_bigstruct);
+        if (s == NULL) return 0;
+        s->count = (unsigned int)i;
+        st->ptrs[i] = s;
+    }
+    for (i = 0; i < BENCH_POOL_LIVE; i++) {
+        bench_bigstruct *s = (bench_bigstruct *)st->ptrs[i];
+        st->sink += s->count;
+        POOL_DELETE(s);
+    }
+    return 1;
+}
+
+/*============================================================================
+ * ALIGNED GROWTH
+ *==========================================================================*/
+/* Writes one byte per page of buf[from, to) */
+static void bench_touch(unsigned char *buf, size_t from, size_t to) {
+    for (; from < to; from += BENCH_GROW_ALIGN) buf[from] = (unsigned char)from;
+}
+
+static int bench_grow_copy(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    unsigned char *buf = NULL, *next = NULL;
+    size_t size = BENCH_GROW_ALIGN;
+
+    if (posix_memalign((void **)&buf, BENCH_GROW_ALIGN, size) != 0) return 0;
+    bench_touch(buf, 0, size);
+    while (size < BENCH_GROW_MAX) {
+        if (posix_memalign((void **)&next, BENCH_GROW_ALIGN, 2 * size) != 0) {
+            free(buf);
+            return 0;
+        }
+        memcpy(next, buf, size);
+        free(buf);
+        buf = next;
+        bench_touch(buf, size, 2 * size);
+        size *= 2;
+    }
+    st->sink += buf[size - BENCH_GROW_ALIGN];
+    free(buf);
+    return 1;
+}
+
+static int bench_grow_remap(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    unsigned char *buf, *next;
+    size_t size = BENCH_GROW_ALIGN;
+
+    buf = (unsigned char *)mem_aligned_alloc(BENCH_GROW_ALIGN, size);
+    if (buf == NULL) return 0;
+    bench_touch(buf, 0, size);
+    while (size < BENCH_GROW_MAX) {
+        next = (unsigned char *)mem_aligned_realloc(buf, BENCH_GROW_ALIGN, 2 * size);
+        if (next == NULL) {
+            mem_aligned_free(buf);
+            return 0;
+        }
+        buf = next;
+        bench_touch(buf, size, 2 * size);
+        size *= 2;
+    }
+    st->sink += buf[size - BENCH_GROW_ALIGN];
+    mem_aligned_free(buf);
+    return 1;
+}
+
+/*============================================================================
+ * HUGE PAGES
+ *==========================================================================*/
+static int bench_table_random(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    uint64_t x = st->seed;
+    unsigned long sum = 0;
+    int i;
+
+    if (st->table == NULL) return 0;
+    for (i = 0; i < BENCH_TABLE_LOADS; i++) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        sum += st->table[(x >> 20) & (BENCH_TABLE_SIZE - 1)];
+    }
+    st->seed = x;
+    st->sink += sum;
+    return 1;
+}
+
+/* Runs bench_table_random on a table allocated in huge-page mode mode */
+static int bench_table(FILE *report, const char *name, bench_state *st, enum mem_huge_mode mode) {
+    enum mem_huge_mode prev = mem_aligned_huge_pages(mode);
+    int ok;
+
+    st->table = (unsigned char *)mem_aligned_alloc(BENCH_GROW_ALIGN, BENCH_TABLE_SIZE);
+    (void)mem_aligned_huge_pages(prev);
+    if (st->table != NULL) memset(st->table, 1, BENCH_TABLE_SIZE);
+    ok = CRYPTO_bench(report, name, bench_table_random, st, 0, BENCH_SECONDS);
+    mem_aligned_free(st->table);
+    st->table = NULL;
+    return ok;
+}
+
+/*============================================================================
+ * SPANS
+ *==========================================================================*/
+MEM_SPAN_TYPE(bench_span_ulong, unsigned long);
+MEM_SPAN_TYPE(bench_span_double, double);
+
+static int bench_fib_raw(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r, i;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        unsigned long fib[BENCH_ARRAY_LEN];
+
+        for (i = 0; i < BENCH_ARRAY_LEN; i++) fib[i] = i < 2 ? (unsigned long)r : fib[i-1] + fib[i-2];
+        st->sink += fib[i-1];
+    }
+    return 1;
+}
+
+static int bench_fib_span(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int r, i;
+
+    for (r = 0; r < BENCH_ROUNDS; r++) {
+        unsigned long fib[BENCH_ARRAY_LEN];
+        bench_span_ulong s = MEM_SPAN_OF(fib);
+
+        for (i = 0; i < BENCH_ARRAY_LEN; i++)
+            MEM_SPAN_AT(s, i) = i < 2 ? (unsigned long)r : MEM_SPAN_AT(s, i-1) + MEM_SPAN_AT(s, i-2);
+        st->sink += MEM_SPAN_AT(s, i-1);
+    }
+    return 1;
+}
+
+static int bench_axpy_raw(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    size_t n = st->span_n, i;
+
+    for (i = 0; i < n; i++) st->y[i] += 0.5 * st->x[i];
+    st->sink += (unsigned long)st->y[n - 1];
+    return 1;
+}
+
+static int bench_axpy_span(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    bench_span_double x = MEM_SPAN_OF(st->x), y = MEM_SPAN_OF(st->y);
+    size_t n = st->span_n, i;
+
+    MEM_SPAN_NARROW(x, n);
+    MEM_SPAN_NARROW(y, n);
+    for (i = 0; i < y.len; i++) MEM_SPAN_AT(y, i) += 0.5 * MEM_SPAN_AT(x, i);
+    st->sink += (unsigned long)MEM_SPAN_AT(y, n - 1);
+    return 1;
+}
+
+static int bench_axpy_checked(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    bench_span_double x = MEM_SPAN_OF(st->x), y = MEM_SPAN_OF(st->y);
+    size_t n = st->span_n, i;
+
+    for (i = 0; i < n; i++) MEM_SPAN_AT(y, i) += 0.5 * MEM_SPAN_AT(x, i);
+    st->sink += (unsigned long)MEM_SPAN_AT(y, n - 1);
+    return 1;
+}
+
+/*============================================================================
+ * SUITE
+ *==========================================================================*/
+int mem_bench_suite(FILE *report) {
+    bench_state *st = (bench_state *)calloc(1, sizeof(bench_state));
+    unsigned int x = 12345;
+    int failed = 0, i;
+
+    if (st == NULL) return -1;
+    st->arena = mem_arena_create(0);
+    if (st->arena == NULL) {
+        free(st);
+        return -1;
+    }
+    for (i = 0; i < BENCH_HANDLER_ALLOCS; i++) {
+        x = x * 1103515245u + 12345u;
+        st->sizes[i] = 16 + (x >> 16) % 497;
+    }
+    for (i = 0; i < BENCH_SPAN_LEN; i++) st->x[i] = (double)(i & 255);
+    st->span_n = BENCH_SPAN_LEN;
+
+    if (report != NULL) fprintf(report, "# allocation, %d rounds per call\n", BENCH_ROUNDS);
+    failed += !CRYPTO_bench(report, "corrected_unprotectedmemoryallocation malloc", bench_int_malloc, st, 0,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_unprotectedmemoryallocation scratch", bench_int_scratch, st, 0,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_unprotectedmemoryallocation mem_guard", bench_int_guard, st, 0,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_memleak_array malloc", bench_array_malloc, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_memleak_array scratch", bench_array_scratch, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "handler 48 x 16..512B malloc", bench_handler_malloc, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "handler 48 x 16..512B arena", bench_handler_arena, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "handler 48 x 16..512B scratch", bench_handler_scratch, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "handler 48 x 16..512B mem_guard", bench_handler_guard, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "bigstruct new/delete malloc", bench_record_malloc, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "bigstruct new/delete POOL_NEW", bench_record_pool, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "bigstruct 256 live malloc", bench_records_malloc, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "bigstruct 256 live POOL_NEW", bench_records_pool, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "grow 4K-aligned to 1G, memalign + copy", bench_grow_copy, st, BENCH_GROW_MAX,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "grow 4K-aligned to 1G, mem_aligned_realloc", bench_grow_remap, st,
+                            BENCH_GROW_MAX, BENCH_SECONDS);
+    failed += !bench_table(report, "64K random reads, 256M table, 4K pages", st, MEM_HUGE_OFF);
+    failed += !bench_table(report, "64K random reads, 256M table, THP", st, MEM_HUGE_THP);
+    failed += !CRYPTO_bench(report, "corrected_outboundarray raw", bench_fib_raw, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "corrected_outboundarray span", bench_fib_span, st, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "axpy 4K doubles raw", bench_axpy_raw, st, BENCH_SPAN_LEN * sizeof(double),
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "axpy 4K doubles span, narrowed", bench_axpy_span, st,
+                            BENCH_SPAN_LEN * sizeof(double), BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "axpy 4K doubles span, checked per index", bench_axpy_checked, st,
+                            BENCH_SPAN_LEN * sizeof(double), BENCH_SECONDS);
+
+    mem_arena_destroy(st->arena);
+    free(st);
+    return failed;
+}
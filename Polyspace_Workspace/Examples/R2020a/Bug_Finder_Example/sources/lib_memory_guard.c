@@ -0,0 +1,680 @@
+/**
+ * Backend behind lib_memory.h.
+ * Guarded heap: a malloc that catches invalid, double and late frees at a
+ * cost low enough for canary builds.
+ *
+ * Blocks up to GUARD_SMALL_MAX come from size-class segments of
+ * GUARD_SEG_SIZE bytes, each holding chunks of one class. Larger blocks, and
+ * blocks aligned beyond 16 bytes, are page mappings of their own. Every
+ * block is preceded by a 16-byte header holding its size, its class and a
+ * state tag (live, quarantined or available).
+ *
+ * Ownership is a two-level radix tree over the address space in segment
+ * granules, so free looks up any pointer in two loads: a stack or static
+ * address, or a block from another allocator, finds no segment. A pointer
+ * inside a segment must also sit exactly at a chunk start, which is checked
+ * with a multiplication by the segment's reciprocal stride rather than a
+ * division, and its chunk must be live; otherwise the free is reported as
+ * invalid or, for a quarantined or available chunk, as a double free.
+ *
+ * Freed blocks do not become reusable at once. free fills the first 16
+ * bytes of the block (all that the smallest class holds, and where the
+ * links, counts and other leading fields of a record live) with a poison
+ * pattern and puts it at the tail of the thread's quarantine ring
+ * (GUARD_QUARANTINE blocks or GUARD_QUARANTINE_BYTES, whichever is reached
+ * first). When a block leaves the ring its poison is checked, catching
+ * writes through a dangling pointer, and it goes on the thread's free list
+ * for its class. A large
+ * block is made inaccessible in quarantine and unmapped when it leaves it,
+ * so any access to it faults. Reads of freed small blocks are not caught:
+ * that needs a page per block or shadow memory, the cost this allocator
+ * avoids.
+ *
+ * Threads allocate from and free to their own lists without locking; lists
+ * are refilled from and flushed to their class GUARD_BATCH chunks at a time
+ * under the class's mutex. State tags are plain stores, so two threads
+ * freeing the same block at the same instant can both succeed.
+ *
+ * Errors go to the handler set with mem_guard_set_handler; the default one
+ * prints the error and aborts. Built with MEM_GUARD_INTERPOSE this file also
+ * defines malloc, free and the rest of the family, so that a canary build
+ * runs the whole program on the guarded heap. It cannot be combined with
+ * MEM_PROFILE_INTERPOSE.
+ */
+
+#define _GNU_SOURCE  /* For MAP_ANONYMOUS, MADV_DONTNEED */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "lib_memory.h"
+
+enum {
+    GUARD_SEG_SHIFT     = 20,
+    GUARD_RADIX_BITS    = 14,           /* two levels cover 48-bit addresses */
+    GUARD_HDR           = 16,
+    GUARD_SEG_HDR       = 64,           /* segment record before the first chunk */
+    GUARD_CLASSES       = 88,
+    GUARD_LARGE         = GUARD_CLASSES,
+    GUARD_BATCH         = 32,
+    GUARD_CACHE_MAX     = 256,          /* free chunks a thread keeps per class */
+    GUARD_QUARANTINE    = 1024,         /* ring slots, a power of two */
+};
+
+/* Chunk states */
+enum {
+    GUARD_LIVE  = 0x4c495645,
+    GUARD_FREED = 0x46524545,           /* in quarantine */
+    GUARD_AVAIL = 0x4156424c            /* on a free list */
+};
+
+#define GUARD_SEG_SIZE ((size_t)1 << GUARD_SEG_SHIFT)
+#define GUARD_SMALL_MAX ((size_t)64 << 10)
+#define GUARD_QUARANTINE_BYTES ((size_t)8 << 20)
+#define GUARD_POISON_WORD 0xdfdfdfdfdfdfdfdfull
+
+struct guard_chunk {
+    size_t size;                        /* requested size */
+    uint32_t cls;
+    uint32_t state;
+};
+
+struct guard_seg {
+    char *first;                        /* header of the first chunk */
+    char *end;
+    size_t stride;                      /* chunk size, header included */
+    uint64_t recip;                     /* ceil(2^40 / stride); 0 for a large block */
+    size_t map_len;
+    uint32_t cls;
+};
+
+struct guard_class {
+    pthread_mutex_t lock;
+    struct guard_chunk *free;           /* chunks flushed by threads */
+    char *cur;                          /* uncarved part of the newest segment */
+    char *end;
+};
+
+struct guard_thread {
+    struct guard_chunk *free[GUARD_CLASSES];
+    unsigned int nfree[GUARD_CLASSES];
+    struct guard_chunk *ring[GUARD_QUARANTINE];
+    unsigned int head;                  /* oldest quarantined block */
+    unsigned int count;
+    size_t bytes;
+    struct guard_thread *next;          /* on the list of states of exited threads */
+};
+
+static struct guard_seg **guard_root[1 << GUARD_RADIX_BITS];
+static pthread_mutex_t guard_radix_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct guard_class guard_classes[GUARD_CLASSES];
+static pthread_once_t guard_once = PTHREAD_ONCE_INIT;
+static pthread_key_t guard_key;
+static int guard_key_ok;
+
+static pthread_mutex_t guard_threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct guard_thread *guard_spare_threads;
+static __thread struct guard_thread *guard_tls __attribute__((tls_model("initial-exec")));
+
+static mem_guard_handler guard_handler;
+static size_t guard_page;
+
+/*============================================================================
+ * ERRORS
+ *==========================================================================*/
+static __attribute__((noinline, cold)) void guard_report(enum mem_guard_error err, const void *ptr) {
+    static const char *const what[] = { "invalid free", "double free", "write after free" };
+    mem_guard_handler h = __atomic_load_n(&guard_handler, __ATOMIC_ACQUIRE);
+    char msg[96];
+    int n;
+
+    if (h != NULL) {
+        h(err, ptr);
+        return;
+    }
+    /* nothing here may allocate: the heap may be the thing that is broken */
+    n = snprintf(msg, sizeof(msg), "mem_guard: %s of %p\n", what[err], ptr);
+    if (n > 0) (void)write(2, msg, (size_t)n < sizeof(msg) ? (size_t)n : sizeof(msg) - 1);
+    abort();
+}
+
+mem_guard_handler mem_guard_set_handler(mem_guard_handler handler) {
+    return __atomic_exchange_n(&guard_handler, handler, __ATOMIC_ACQ_REL);
+}
+
+/*============================================================================
+ * SEGMENTS AND OWNERSHIP
+ *==========================================================================*/
+static size_t guard_page_size(void) {
+    size_t ps = __atomic_load_n(&guard_page, __ATOMIC_RELAXED);
+
+    if (ps == 0) {
+        long v = sysconf(_SC_PAGESIZE);
+        ps = v > 0 ? (size_t)v : 4096;
+        __atomic_store_n(&guard_page, ps, __ATOMIC_RELAXED);
+    }
+    return ps;
+}
+
+static inline struct guard_seg *guard_seg_of(const void *p) {
+    uintptr_t key = (uintptr_t)p >> GUARD_SEG_SHIFT;
+    struct guard_seg **leaf;
+
+    if ((key >> (2 * GUARD_RADIX_BITS)) != 0) return NULL;
+    leaf = __atomic_load_n(&guard_root[key >> GUARD_RADIX_BITS], __ATOMIC_ACQUIRE);
+    if (leaf == NULL) return NULL;
+    return __atomic_load_n(&leaf[key & ((1u << GUARD_RADIX_BITS) - 1)], __ATOMIC_ACQUIRE);
+}
+
+/* Points the granules of [base, base + len) at s (or at nothing); 0 when a
+ * leaf cannot be allocated */
+static int guard_radix_set(char *base, size_t len, struct guard_seg *s) {
+    uintptr_t key = (uintptr_t)base >> GUARD_SEG_SHIFT;
+    uintptr_t last = ((uintptr_t)base + len - 1) >> GUARD_SEG_SHIFT;
+    int ok = 1;
+
+    if ((last >> (2 * GUARD_RADIX_BITS)) != 0) return 0;
+    pthread_mutex_lock(&guard_radix_lock);
+    for (; key <= last && ok; key++) {
+        struct guard_seg ***slot = &guard_root[key >> GUARD_RADIX_BITS];
+        if (*slot == NULL && s != NULL) {
+            void *leaf = mmap(NULL, sizeof(struct guard_seg *) << GUARD_RADIX_BITS, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (leaf == MAP_FAILED) ok = 0;
+            else __atomic_store_n(slot, (struct guard_seg **)leaf, __ATOMIC_RELEASE);
+        }
+        if (*slot != NULL) __atomic_store_n(&(*slot)[key & ((1u << GUARD_RADIX_BITS) - 1)], s, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&guard_radix_lock);
+    return ok;
+}
+
+/* len bytes at a multiple of align (a power of two, at least a page) */
+static char *guard_map(size_t len, size_t align) {
+    size_t extra = align - guard_page_size();
+    uintptr_t base, start;
+    void *p;
+
+    if (len > SIZE_MAX - extra) return NULL;
+    p = mmap(NULL, len + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    base = (uintptr_t)p;
+    start = (base + align - 1) & ~(uintptr_t)(align - 1);
+    if (start > base) (void)munmap(p, start - base);
+    if (start + len < base + len + extra) (void)munmap((void *)(start + len), base + len + extra - (start + len));
+    return (char *)start;
+}
+
+/* Whether p is the user pointer of one of s's chunks */
+static inline int guard_is_chunk(const struct guard_seg *s, const void *p) {
+    uintptr_t off = (uintptr_t)p - GUARD_HDR - (uintptr_t)s->first;
+
+    if (off >= (uintptr_t)(s->end - s->first)) return 0;
+    return ((off * s->recip) >> 40) * s->stride == off;
+}
+
+/*============================================================================
+ * SIZE CLASSES
+ *==========================================================================*/
+/* 16-byte steps to 1 KiB, then four classes per power of two. The steps
+ * reach far enough that mixed small sizes never mispredict the branch */
+static inline unsigned int guard_class_of(size_t size) {
+    unsigned int lg;
+
+    if (size <= 1024) return (unsigned int)((size + (size == 0) - 1) >> 4);
+    lg = 63u - (unsigned int)__builtin_clzll((unsigned long long)(size - 1));
+    return 64 + (lg - 10) * 4 + (unsigned int)((size - 1) >> (lg - 2)) - 4;
+}
+
+static size_t guard_class_size(unsigned int cls) {
+    unsigned int k;
+
+    if (cls < 64) return (size_t)(cls + 1) * 16;
+    k = cls - 64;
+    return (size_t)(5 + k % 4) << (8 + k / 4);
+}
+
+/* Carves a fresh segment for cls; called with the class locked */
+static int guard_seg_new(struct guard_class *gc, unsigned int cls) {
+    size_t stride = guard_class_size(cls) + GUARD_HDR;
+    char *base = guard_map(GUARD_SEG_SIZE, GUARD_SEG_SIZE);
+    struct guard_seg *s = (struct guard_seg *)base;
+
+    if (base == NULL) return 0;
+    s->first = base + GUARD_SEG_HDR;
+    s->stride = stride;
+    s->end = s->first + (GUARD_SEG_SIZE - GUARD_SEG_HDR) / stride * stride;
+    s->recip = (((uint64_t)1 << 40) + stride - 1) / stride;
+    s->map_len = GUARD_SEG_SIZE;
+    s->cls = cls;
+    if (!guard_radix_set(base, GUARD_SEG_SIZE, s)) {
+        (void)munmap(base, GUARD_SEG_SIZE);
+        return 0;
+    }
+    gc->cur = s->first;
+    gc->end = s->end;
+    return 1;
+}
+
+/*============================================================================
+ * THREAD STATE
+ *==========================================================================*/
+static inline void guard_release(struct guard_thread *t, struct guard_chunk *c);
+
+static void guard_evict(struct guard_thread *t) {
+    struct guard_chunk *c = t->ring[t->head];
+
+    t->head = (t->head + 1) & (GUARD_QUARANTINE - 1);
+    t->count--;
+    t->bytes -= c->size;
+    guard_release(t, c);
+}
+
+/* Hands the n first chunks of the thread's list for cls to the class */
+static void guard_flush_class(struct guard_thread *t, unsigned int cls, unsigned int n) {
+    struct guard_class *gc = &guard_classes[cls];
+    struct guard_chunk *head = t->free[cls], *tail = head;
+    unsigned int i;
+
+    if (n == 0 || head == NULL) return;
+    for (i = 1; i < n && *(struct guard_chunk **)(tail + 1) != NULL; i++) tail = *(struct guard_chunk **)(tail + 1);
+    t->free[cls] = *(struct guard_chunk **)(tail + 1);
+    t->nfree[cls] -= i;
+    pthread_mutex_lock(&gc->lock);
+    *(struct guard_chunk **)(tail + 1) = gc->free;
+    gc->free = head;
+    pthread_mutex_unlock(&gc->lock);
+}
+
+static void guard_thread_exit(void *p) {
+    struct guard_thread *t = (struct guard_thread *)p;
+    unsigned int cls;
+
+    while (t->count > 0) guard_evict(t);
+    for (cls = 0; cls < GUARD_CLASSES; cls++) guard_flush_class(t, cls, t->nfree[cls]);
+    guard_tls = NULL;
+    pthread_mutex_lock(&guard_threads_lock);
+    t->next = guard_spare_threads;
+    guard_spare_threads = t;
+    pthread_mutex_unlock(&guard_threads_lock);
+}
+
+static void guard_init_once(void) {
+    unsigned int cls;
+
+    for (cls = 0; cls < GUARD_CLASSES; cls++) pthread_mutex_init(&guard_classes[cls].lock, NULL);
+    guard_key_ok = pthread_key_create(&guard_key, guard_thread_exit) == 0;
+}
+
+static struct guard_thread *guard_thread(void) {
+    struct guard_thread *t = guard_tls;
+
+    if (t != NULL) return t;
+    (void)pthread_once(&guard_once, guard_init_once);
+    pthread_mutex_lock(&guard_threads_lock);
+    t = guard_spare_threads;
+    if (t != NULL) guard_spare_threads = t->next;
+    pthread_mutex_unlock(&guard_threads_lock);
+    if (t == NULL) {
+        void *m = mmap(NULL, sizeof(*t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m == MAP_FAILED) return NULL;
+        t = (struct guard_thread *)m;
+    }
+    /* set before pthread_setspecific, which may itself allocate */
+    guard_tls = t;
+    if (guard_key_ok) (void)pthread_setspecific(guard_key, t);
+    return t;
+}
+
+/*============================================================================
+ * LARGE BLOCKS
+ *==========================================================================*/
+static void *guard_large_alloc(size_t size, size_t alignment) {
+    size_t ps = guard_page_size(), off = alignment > ps ? alignment : ps, len;
+    struct guard_seg *s;
+    struct guard_chunk *c;
+    char *base;
+
+    if (size > SIZE_MAX - off - ps) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    len = (off + size + ps - 1) & ~(ps - 1);
+    base = guard_map(len, alignment > GUARD_SEG_SIZE ? alignment : GUARD_SEG_SIZE);
+    if (base == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    s = (struct guard_seg *)base;
+    s->first = base + off - GUARD_HDR;
+    s->end = base + len;
+    s->stride = (size_t)(s->end - s->first);
+    s->recip = 0;                       /* only the first chunk start matches */
+    s->map_len = len;
+    s->cls = GUARD_LARGE;
+    c = (struct guard_chunk *)s->first;
+    c->size = size;
+    c->cls = GUARD_LARGE;
+    c->state = GUARD_LIVE;
+    if (!guard_radix_set(base, len, s)) {
+        (void)munmap(base, len);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return c + 1;
+}
+
+/* Takes the pages of a freed large block away until it leaves quarantine */
+static void guard_large_retire(struct guard_chunk *c) {
+    char *user = (char *)(c + 1);
+    struct guard_seg *s = guard_seg_of(user);
+
+    (void)mprotect(user, (size_t)(s->end - user), PROT_NONE);
+    (void)madvise(user, (size_t)(s->end - user), MADV_DONTNEED);
+}
+
+static void guard_large_unmap(struct guard_chunk *c) {
+    struct guard_seg *s = guard_seg_of(c + 1);
+    char *base = (char *)s;
+    size_t len = s->map_len;
+
+    (void)guard_radix_set(base, len, NULL);
+    (void)munmap(base, len);
+}
+
+/*============================================================================
+ * QUARANTINE
+ *==========================================================================*/
+/* Two fixed stores and loads: poisoning to a length that depends on the
+ * block costs a memset call per free and as much again to check */
+static inline void guard_poison(void *p) {
+    uint64_t w = GUARD_POISON_WORD;
+
+    memcpy(p, &w, 8);
+    memcpy((char *)p + 8, &w, 8);
+}
+
+static inline int guard_poison_intact(const struct guard_chunk *c) {
+    uint64_t a, b;
+
+    memcpy(&a, c + 1, 8);
+    memcpy(&b, (const char *)(c + 1) + 8, 8);
+    return ((a ^ GUARD_POISON_WORD) | (b ^ GUARD_POISON_WORD)) == 0;
+}
+
+/* A block leaving quarantine becomes available to the thread */
+static inline void guard_release(struct guard_thread *t, struct guard_chunk *c) {
+    unsigned int cls = c->cls;
+
+    if (cls == GUARD_LARGE) {
+        guard_large_unmap(c);
+        return;
+    }
+    if (c->state != GUARD_FREED || cls >= GUARD_CLASSES) return;    /* header overwritten: leak the chunk */
+    if (!guard_poison_intact(c)) guard_report(MEM_GUARD_USE_AFTER_FREE, c + 1);
+    c->state = GUARD_AVAIL;
+    *(struct guard_chunk **)(c + 1) = t->free[cls];
+    t->free[cls] = c;
+    if (++t->nfree[cls] > GUARD_CACHE_MAX) guard_flush_class(t, cls, GUARD_BATCH);
+}
+
+static __attribute__((noinline)) void guard_quarantine_slow(struct guard_thread *t, struct guard_chunk *c) {
+    while (t->count == GUARD_QUARANTINE || (t->count > 0 && t->bytes + c->size > GUARD_QUARANTINE_BYTES)) {
+        guard_evict(t);
+    }
+    t->ring[(t->head + t->count) & (GUARD_QUARANTINE - 1)] = c;
+    t->count++;
+    t->bytes += c->size;
+}
+
+static inline void guard_quarantine(struct guard_thread *t, struct guard_chunk *c) {
+    struct guard_chunk *old;
+
+    if (t->count != GUARD_QUARANTINE) {
+        guard_quarantine_slow(t, c);
+        return;
+    }
+    old = t->ring[t->head];
+    if (t->bytes - old->size + c->size > GUARD_QUARANTINE_BYTES) {
+        guard_quarantine_slow(t, c);
+        return;
+    }
+    /* a full ring: the new block takes the oldest one's slot */
+    t->ring[t->head] = c;
+    t->head = (t->head + 1) & (GUARD_QUARANTINE - 1);
+    t->bytes = t->bytes - old->size + c->size;
+    guard_release(t, old);
+}
+
+void mem_guard_flush(void) {
+    struct guard_thread *t = guard_tls;
+
+    if (t == NULL) return;
+    while (t->count > 0) guard_evict(t);
+}
+
+/*============================================================================
+ * ALLOCATION
+ *==========================================================================*/
+/* Refills the thread's list for cls from the class and takes a chunk */
+static __attribute__((noinline)) void *guard_malloc_slow(size_t size, unsigned int cls) {
+    struct guard_thread *t = guard_thread();
+    struct guard_class *gc = &guard_classes[cls];
+    struct guard_chunk *c;
+    unsigned int n = 0;
+
+    if (t == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if (t->free[cls] == NULL) {
+        size_t stride = guard_class_size(cls) + GUARD_HDR;
+        pthread_mutex_lock(&gc->lock);
+        while (n < GUARD_BATCH && gc->free != NULL) {
+            c = gc->free;
+            gc->free = *(struct guard_chunk **)(c + 1);
+            *(struct guard_chunk **)(c + 1) = t->free[cls];
+            t->free[cls] = c;
+            n++;
+        }
+        while (n < GUARD_BATCH) {
+            if (gc->cur == gc->end && !guard_seg_new(gc, cls)) break;
+            c = (struct guard_chunk *)gc->cur;
+            gc->cur += stride;
+            c->cls = cls;
+            c->state = GUARD_AVAIL;
+            *(struct guard_chunk **)(c + 1) = t->free[cls];
+            t->free[cls] = c;
+            n++;
+        }
+        pthread_mutex_unlock(&gc->lock);
+        t->nfree[cls] += n;
+    }
+
+    c = t->free[cls];
+    if (c == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    t->free[cls] = *(struct guard_chunk **)(c + 1);
+    t->nfree[cls]--;
+    c->size = size;
+    c->state = GUARD_LIVE;
+    return c + 1;
+}
+
+void *mem_guard_malloc(size_t size) {
+    struct guard_thread *t = guard_tls;
+    struct guard_chunk *c;
+    unsigned int cls;
+
+    if (size > GUARD_SMALL_MAX) return guard_large_alloc(size, GUARD_HDR);
+    cls = guard_class_of(size);
+    if (t == NULL || (c = t->free[cls]) == NULL) return guard_malloc_slow(size, cls);
+    t->free[cls] = *(struct guard_chunk **)(c + 1);
+    t->nfree[cls]--;
+    c->size = size;
+    c->state = GUARD_LIVE;
+    return c + 1;
+}
+
+/* The live chunk of ptr, or NULL after reporting why there is none */
+static inline struct guard_chunk *guard_check(const void *ptr) {
+    const struct guard_seg *s = guard_seg_of(ptr);
+    struct guard_chunk *c;
+
+    if (s == NULL || !guard_is_chunk(s, ptr)) {
+        guard_report(MEM_GUARD_BAD_FREE, ptr);
+        return NULL;
+    }
+    c = (struct guard_chunk *)ptr - 1;
+    if (c->state != GUARD_LIVE) {
+        guard_report(c->state == GUARD_FREED || c->state == GUARD_AVAIL ? MEM_GUARD_DOUBLE_FREE : MEM_GUARD_BAD_FREE,
+                     ptr);
+        return NULL;
+    }
+    return c;
+}
+
+static __attribute__((noinline)) void guard_free_slow(struct guard_chunk *c) {
+    struct guard_thread *t = guard_thread();
+
+    if (c->cls == GUARD_LARGE) guard_large_retire(c);
+    else guard_poison(c + 1);
+    if (t == NULL) return;              /* no thread state: the block stays quarantined for good */
+    guard_quarantine(t, c);
+}
+
+void mem_guard_free(void *ptr) {
+    struct guard_thread *t = guard_tls;
+    struct guard_chunk *c;
+
+    if (ptr == NULL) return;
+    c = guard_check(ptr);
+    if (c == NULL) return;
+    c->state = GUARD_FREED;
+    if (t == NULL || c->cls == GUARD_LARGE) {
+        guard_free_slow(c);
+        return;
+    }
+    guard_poison(ptr);
+    guard_quarantine(t, c);
+}
+
+void *mem_guard_calloc(size_t nmemb, size_t size) {
+    void *p;
+
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    p = mem_guard_malloc(nmemb * size);
+    if (p != NULL) memset(p, 0, nmemb * size);
+    return p;
+}
+
+static size_t guard_capacity(const struct guard_chunk *c) {
+    if (c->cls == GUARD_LARGE) return (size_t)(guard_seg_of(c + 1)->end - (const char *)(c + 1));
+    return guard_class_size(c->cls);
+}
+
+void *mem_guard_realloc(void *ptr, size_t size) {
+    struct guard_chunk *c;
+    size_t cap;
+    void *q;
+
+    if (ptr == NULL) return mem_guard_malloc(size);
+    if (size == 0) {
+        mem_guard_free(ptr);
+        return NULL;
+    }
+    c = guard_check(ptr);
+    if (c == NULL) return NULL;
+
+    cap = guard_capacity(c);
+    if (c->cls == GUARD_LARGE ? size <= cap && size > GUARD_SMALL_MAX && size >= cap / 2
+                              : size <= GUARD_SMALL_MAX && guard_class_of(size) == c->cls) {
+        c->size = size;
+        return ptr;
+    }
+    q = mem_guard_malloc(size);
+    if (q == NULL) return NULL;
+    memcpy(q, ptr, c->size < size ? c->size : size);
+    mem_guard_free(ptr);
+    return q;
+}
+
+void *mem_guard_memalign(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment <= GUARD_HDR) return mem_guard_malloc(size);
+    return guard_large_alloc(size, alignment);
+}
+
+size_t mem_guard_usable_size(const void *ptr) {
+    const struct guard_chunk *c;
+
+    if (ptr == NULL) return 0;
+    c = guard_check(ptr);
+    return c != NULL ? guard_capacity(c) : 0;
+}
+
+int mem_guard_owns(const void *ptr) {
+    const struct guard_seg *s = guard_seg_of(ptr);
+
+    return s != NULL && guard_is_chunk(s, ptr) && ((const struct guard_chunk *)ptr - 1)->state == GUARD_LIVE;
+}
+
+#if defined(MEM_GUARD_INTERPOSE)
+/*============================================================================
+ * INTERPOSED ALLOCATOR
+ *==========================================================================*/
+void *malloc(size_t size) {
+    return mem_guard_malloc(size);
+}
+
+void free(void *ptr) {
+    mem_guard_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    return mem_guard_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    return mem_guard_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    return mem_guard_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return mem_guard_memalign(alignment, size);
+}
+
+void *valloc(size_t size) {
+    return mem_guard_memalign(guard_page_size(), size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    p = mem_guard_memalign(alignment, size);
+    if (p == NULL) return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+size_t malloc_usable_size(void *ptr) {
+    return mem_guard_usable_size(ptr);
+}
+#endif /* MEM_GUARD_INTERPOSE */
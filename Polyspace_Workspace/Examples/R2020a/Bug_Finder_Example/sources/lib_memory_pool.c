@@ -0,0 +1,265 @@
+/**
+ * Backend behind lib_memory.h.
+ * Slab pool for fixed-size records, after Bonwick's magazine allocator.
+ *
+ * Sizes are rounded up to a multiple of the cache line, one size class per
+ * multiple up to MEM_POOL_MAX, so every object starts on its own cache line
+ * and objects of one class are packed together in 64 KiB slabs. The first
+ * cache line of a slab records its class, which mem_pool_free finds by
+ * masking the object address.
+ *
+ * Each thread holds two magazines (arrays of free objects) per class: alloc
+ * pops from the loaded one and free pushes to it, swapping with the previous
+ * one when it runs empty or full, with no lock. For POOL_NEW, whose size is
+ * a constant, and POOL_DELETE, which reads the class from the slab as
+ * mem_pool_free does, this fast path is inline in lib_memory.h. Only
+ * when both magazines are exhausted does the thread exchange one with the
+ * class's depot under its mutex, at most once per MEM_POOL_MAG_ROUNDS
+ * operations. The depot refills from fresh slab space. A thread's magazines
+ * go back to the depot when it exits, so objects freed by one thread are
+ * reused by others.
+ *
+ * Slabs are never returned to the system: memory freed into a class stays
+ * available to that class.
+ */
+
+#define _GNU_SOURCE  /* For MAP_ANONYMOUS */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "lib_memory.h"
+
+enum {
+    POOL_SLAB_SIZE     = MEM_POOL_SLAB_SIZE,
+    POOL_SLABS_PER_MAP = 16
+};
+
+struct pool_slab {
+    unsigned int cls;               /* first, as mem_pool_delete reads it */
+};
+
+struct pool_depot {
+    _Alignas(MEM_POOL_ALIGN) pthread_mutex_t lock;
+    struct mem_pool_mag *full;      /* magazines holding objects */
+    struct mem_pool_mag *empty;
+    void *loose;                    /* objects chained through their first word */
+    char *cur;                      /* unused part of the class's newest slab */
+    char *end;
+};
+
+static struct pool_depot pool_depots[MEM_POOL_CLASSES];
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t pool_key;
+static int pool_key_ok;
+__thread struct mem_pool_cache mem_pool_tls;
+
+static pthread_mutex_t pool_slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static char *pool_slab_cur;         /* unused slabs of the newest mapping */
+static char *pool_slab_end;
+
+/*============================================================================
+ * SLABS AND DEPOTS
+ *==========================================================================*/
+static char *pool_slab_new(unsigned int cls) {
+    char *s = NULL;
+
+    pthread_mutex_lock(&pool_slab_lock);
+    if (pool_slab_cur == pool_slab_end) {
+        size_t len = (size_t)POOL_SLAB_SIZE * (POOL_SLABS_PER_MAP + 1);
+        char *p = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            /* keep the POOL_SLAB_SIZE-aligned part, unmap the rest */
+            uintptr_t start = ((uintptr_t)p + POOL_SLAB_SIZE - 1) & ~(uintptr_t)(POOL_SLAB_SIZE - 1);
+            size_t head = (size_t)(start - (uintptr_t)p);
+            if (head > 0) (void)munmap(p, head);
+            (void)munmap((char *)start + (size_t)POOL_SLAB_SIZE * POOL_SLABS_PER_MAP, POOL_SLAB_SIZE - head);
+            pool_slab_cur = (char *)start;
+            pool_slab_end = pool_slab_cur + (size_t)POOL_SLAB_SIZE * POOL_SLABS_PER_MAP;
+        }
+    }
+    if (pool_slab_cur != pool_slab_end) {
+        s = pool_slab_cur;
+        pool_slab_cur += POOL_SLAB_SIZE;
+    }
+    pthread_mutex_unlock(&pool_slab_lock);
+
+    if (s != NULL) ((struct pool_slab *)s)->cls = cls;
+    return s;
+}
+
+/* Fills m with free objects of class cls, loose objects first and then
+ * slab space. Called with the depot locked */
+static void pool_depot_fill(struct pool_depot *d, unsigned int cls, struct mem_pool_mag *m) {
+    size_t size = (size_t)(cls + 1) * MEM_POOL_ALIGN;
+
+    while (m->rounds < MEM_POOL_MAG_ROUNDS && d->loose != NULL) {
+        void *p = d->loose;
+        d->loose = *(void **)p;
+        m->obj[m->rounds++] = p;
+    }
+    while (m->rounds < MEM_POOL_MAG_ROUNDS) {
+        if ((size_t)(d->end - d->cur) < size) {
+            char *s = pool_slab_new(cls);
+            if (s == NULL) break;
+            d->cur = s + MEM_POOL_ALIGN;
+            d->end = s + POOL_SLAB_SIZE;
+        }
+        m->obj[m->rounds++] = d->cur;
+        d->cur += size;
+    }
+}
+
+static struct mem_pool_mag *pool_mag_new(void) {
+    struct mem_pool_mag *m = (struct mem_pool_mag *)malloc(sizeof(*m));
+    if (m != NULL) {
+        m->next = NULL;
+        m->rounds = 0;
+    }
+    return m;
+}
+
+/* Hands m to the depot, on the full or the empty list. Called locked */
+static void pool_depot_put(struct pool_depot *d, struct mem_pool_mag *m) {
+    if (m->rounds > 0) {
+        m->next = d->full;
+        d->full = m;
+    } else {
+        m->next = d->empty;
+        d->empty = m;
+    }
+}
+
+/*============================================================================
+ * THREAD CACHES
+ *==========================================================================*/
+static void pool_thread_exit(void *p) {
+    struct mem_pool_cache *t = (struct mem_pool_cache *)p;
+    unsigned int cls;
+
+    for (cls = 0; cls < MEM_POOL_CLASSES; cls++) {
+        struct pool_depot *d = &pool_depots[cls];
+        if (t->loaded[cls] == NULL && t->prev[cls] == NULL) continue;
+        pthread_mutex_lock(&d->lock);
+        if (t->loaded[cls] != NULL) pool_depot_put(d, t->loaded[cls]);
+        if (t->prev[cls] != NULL) pool_depot_put(d, t->prev[cls]);
+        pthread_mutex_unlock(&d->lock);
+        t->loaded[cls] = t->prev[cls] = NULL;
+    }
+    t->registered = 0;
+}
+
+static void pool_init_once(void) {
+    unsigned int cls;
+
+    for (cls = 0; cls < MEM_POOL_CLASSES; cls++) pthread_mutex_init(&pool_depots[cls].lock, NULL);
+    pool_key_ok = pthread_key_create(&pool_key, pool_thread_exit) == 0;
+}
+
+static struct mem_pool_cache *pool_cache(void) {
+    struct mem_pool_cache *t = &mem_pool_tls;
+
+    if (!t->registered) {
+        (void)pthread_once(&pool_once, pool_init_once);
+        if (pool_key_ok) (void)pthread_setspecific(pool_key, t);
+        t->registered = 1;
+    }
+    return t;
+}
+
+static __attribute__((noinline)) void *pool_alloc_slow(unsigned int cls) {
+    struct mem_pool_cache *t = pool_cache();
+    struct pool_depot *d;
+    struct mem_pool_mag *m = t->prev[cls];
+
+    if (m != NULL && m->rounds > 0) {
+        t->prev[cls] = t->loaded[cls];
+        t->loaded[cls] = m;
+        return m->obj[--m->rounds];
+    }
+
+    d = &pool_depots[cls];
+    pthread_mutex_lock(&d->lock);
+    if (d->full != NULL) {
+        /* previous (empty) to the depot, loaded (empty) becomes previous */
+        m = d->full;
+        d->full = m->next;
+        if (t->prev[cls] != NULL) pool_depot_put(d, t->prev[cls]);
+        t->prev[cls] = t->loaded[cls];
+        t->loaded[cls] = m;
+    } else {
+        m = t->loaded[cls];
+        if (m == NULL && d->empty != NULL) {
+            m = d->empty;
+            d->empty = m->next;
+        }
+        if (m == NULL) m = pool_mag_new();
+        if (m != NULL) {
+            pool_depot_fill(d, cls, m);
+            t->loaded[cls] = m;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    if (m == NULL || m->rounds == 0) return NULL;
+    return m->obj[--m->rounds];
+}
+
+static __attribute__((noinline)) void pool_free_slow(void *p, unsigned int cls) {
+    struct mem_pool_cache *t = pool_cache();
+    struct pool_depot *d = &pool_depots[cls];
+    struct mem_pool_mag *m = t->prev[cls];
+
+    if (m != NULL && m->rounds < MEM_POOL_MAG_ROUNDS) {
+        t->prev[cls] = t->loaded[cls];
+        t->loaded[cls] = m;
+        m->obj[m->rounds++] = p;
+        return;
+    }
+
+    pthread_mutex_lock(&d->lock);
+    m = d->empty;
+    if (m != NULL) d->empty = m->next;
+    else m = pool_mag_new();
+    if (m == NULL) {
+        /* no magazine to be had: the object waits in the depot */
+        *(void **)p = d->loose;
+        d->loose = p;
+    } else {
+        /* previous (full) to the depot, loaded (full) becomes previous */
+        if (t->prev[cls] != NULL) pool_depot_put(d, t->prev[cls]);
+        t->prev[cls] = t->loaded[cls];
+        t->loaded[cls] = m;
+        m->obj[m->rounds++] = p;
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+/*============================================================================
+ * ALLOCATION
+ *==========================================================================*/
+void *mem_pool_alloc(size_t size) {
+    unsigned int cls;
+    struct mem_pool_mag *m;
+
+    if (size == 0) size = 1;
+    if (size > MEM_POOL_MAX) return NULL;
+    cls = (unsigned int)((size - 1) / MEM_POOL_ALIGN);
+    m = mem_pool_tls.loaded[cls];
+    if (m != NULL && m->rounds > 0) return m->obj[--m->rounds];
+    return pool_alloc_slow(cls);
+}
+
+void mem_pool_free(void *p) {
+    const struct pool_slab *s;
+    struct mem_pool_mag *m;
+
+    if (p == NULL) return;
+    s = (const struct pool_slab *)((uintptr_t)p & ~(uintptr_t)(POOL_SLAB_SIZE - 1));
+    m = mem_pool_tls.loaded[s->cls];
+    if (m != NULL && m->rounds < MEM_POOL_MAG_ROUNDS) {
+        m->obj[m->rounds++] = p;
+        return;
+    }
+    pool_free_slow(p, s->cls);
+}
@@ -0,0 +1,577 @@
+/**
+ * Backend behind lib_memory.h.
+ * Sampling heap profiler, cheap enough to leave on in production.
+ *
+ * Built with MEM_PROFILE_INTERPOSE, this file defines malloc, free and the
+ * rest of the family on top of glibc's __libc_* entry points, either linked
+ * into a program or preloaded into an unmodified one:
+ *
+ *     gcc -shared -fPIC -O2 -DMEM_PROFILE_INTERPOSE lib_memory_profile.c \
+ *         -o libmemprofile.so -lpthread -lm
+ *     MEM_PROFILE=524288 MEM_PROFILE_SIGNAL=12 LD_PRELOAD=./libmemprofile.so app
+ *     kill -USR2 <pid>        # writes /tmp/memprofile.<pid>.<n>.heap
+ *
+ * Sampling follows tcmalloc: every thread counts down the bytes it
+ * allocates from a distance drawn from an exponential distribution with
+ * mean MEM_PROFILE bytes, so that sampling is a Poisson process over
+ * allocated bytes and an allocation of s bytes is sampled with probability
+ * 1 - exp(-s / mean). The allocation that crosses zero has its stack
+ * recorded, interned so that each distinct stack is stored once. Unsampled
+ * allocations cost a thread-local subtraction and a branch.
+ *
+ * free must drop the record of a sampled block without a lock or a table
+ * lookup on every call. A table of counters indexed by a hash of the
+ * address says whether any sampled block can have that address; only when
+ * its counter is non-zero is the sample table locked and searched.
+ *
+ * Profiles are written in the text heap format of gperftools ("heap_v2"),
+ * which pprof reads: sampled in-use and cumulative counts and bytes per
+ * stack, followed by the process's mappings. pprof scales each stack's
+ * figures by the inverse of the sampling probability at its average size,
+ * which makes them unbiased estimates of the true totals.
+ *
+ * On MEM_PROFILE_SIGNAL the signal handler only posts a semaphore; a dumper
+ * thread writes the file. The profiler's own memory comes from mmap, never
+ * from malloc.
+ *
+ * Without MEM_PROFILE_INTERPOSE the mem_profile_* functions are stubs that
+ * report the profiler as unavailable.
+ */
+
+#define _GNU_SOURCE  /* For backtrace, the __libc_* allocator entry points */
+
+#include <errno.h>
+#include <stdlib.h>
+#include "lib_memory.h"
+
+#if defined(MEM_PROFILE_INTERPOSE)
+
+#include <execinfo.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+enum {
+    PROF_MAX_DEPTH      = 32,
+    PROF_SKIP           = 2,        /* prof_record and the wrapper */
+    PROF_FILTER_BITS    = 18,
+    PROF_SAMPLE_BUCKETS = 1 << 16,
+    PROF_STACK_BUCKETS  = 1 << 14,
+    PROF_CHUNK          = 1 << 20,  /* internal mmap chunk */
+    PROF_OUT_BUF        = 4096
+};
+
+#define PROF_DEFAULT_PREFIX "/tmp/memprofile"
+
+struct prof_stack {
+    struct prof_stack *next;
+    uint64_t hash;
+    uint64_t live_count, live_bytes;    /* sampled blocks */
+    uint64_t alloc_count, alloc_bytes;
+    int depth;
+    void *pc[];
+};
+
+struct prof_sample {
+    struct prof_sample *next;
+    void *ptr;
+    struct prof_stack *stack;
+    size_t size;
+};
+
+struct prof_thread {
+    int64_t until;                      /* bytes left before the next sample */
+    uint64_t rng;                       /* 0 until the thread's first sample */
+    int busy;                           /* inside the profiler: do not sample */
+};
+
+static size_t prof_period;              /* mean sampling distance, 0 = off */
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct prof_sample *prof_samples[PROF_SAMPLE_BUCKETS];
+static struct prof_stack *prof_stacks[PROF_STACK_BUCKETS];
+static struct prof_sample *prof_sample_free;
+static unsigned char *prof_filter;      /* 1 << PROF_FILTER_BITS counters */
+static char *prof_chunk_cur, *prof_chunk_end;
+
+static sem_t prof_dump_sem;
+static int prof_dump_started;
+static unsigned int prof_dump_seq;
+static const char *prof_prefix = PROF_DEFAULT_PREFIX;
+
+static __thread struct prof_thread prof_tls __attribute__((tls_model("initial-exec")));
+
+/*============================================================================
+ * SAMPLING
+ *==========================================================================*/
+/* Exponentially distributed distance with mean period */
+static int64_t prof_next_distance(struct prof_thread *t, size_t period) {
+    double u, d;
+
+    t->rng ^= t->rng >> 12;
+    t->rng ^= t->rng << 25;
+    t->rng ^= t->rng >> 27;
+    u = (double)(((t->rng * 0x2545f4914f6cdd1dull) >> 11) + 1) * (1.0 / 9007199254740992.0);
+    d = -log(u) * (double)period;
+    if (d < 1.0) d = 1.0;
+    if (d > 4e18) d = 4e18;
+    return (int64_t)d;
+}
+
+static size_t prof_filter_index(const void *p) {
+    return (size_t)(((uintptr_t)p >> 4) & ((1u << PROF_FILTER_BITS) - 1));
+}
+
+/* Bump allocation from mmap chunks; called with prof_lock held */
+static void *prof_internal_alloc(size_t size) {
+    void *p;
+
+    size = (size + 15) & ~(size_t)15;
+    if ((size_t)(prof_chunk_end - prof_chunk_cur) < size) {
+        size_t len = size > PROF_CHUNK ? size : PROF_CHUNK;
+        char *c = (char *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (c == MAP_FAILED) return NULL;
+        prof_chunk_cur = c;
+        prof_chunk_end = c + len;
+    }
+    p = prof_chunk_cur;
+    prof_chunk_cur += size;
+    return p;
+}
+
+/* The record for this stack, created on first sight; called locked */
+static struct prof_stack *prof_intern(void *const *pc, int depth) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    struct prof_stack *s, **b;
+    int i;
+
+    for (i = 0; i < depth; i++) h = (h ^ (uint64_t)(uintptr_t)pc[i]) * 0x100000001b3ull;
+    b = &prof_stacks[h % PROF_STACK_BUCKETS];
+    for (s = *b; s != NULL; s = s->next) {
+        if (s->hash == h && s->depth == depth && memcmp(s->pc, pc, (size_t)depth * sizeof(void *)) == 0) return s;
+    }
+    s = (struct prof_stack *)prof_internal_alloc(sizeof(*s) + (size_t)depth * sizeof(void *));
+    if (s == NULL) return NULL;
+    memset(s, 0, sizeof(*s));
+    s->hash = h;
+    s->depth = depth;
+    memcpy(s->pc, pc, (size_t)depth * sizeof(void *));
+    s->next = *b;
+    *b = s;
+    return s;
+}
+
+static __attribute__((noinline)) void prof_record(void *ptr, size_t size, size_t period) {
+    struct prof_thread *t = &prof_tls;
+    void *pc[PROF_MAX_DEPTH + PROF_SKIP];
+    struct prof_sample *smp;
+    struct prof_stack *stk;
+    int depth;
+
+    if (t->busy) return;
+    t->busy = 1;
+    if (t->rng == 0) {
+        /* first allocation of the thread: start its countdown instead */
+        t->rng = ((uint64_t)(uintptr_t)t ^ (uint64_t)time(NULL) * 0x9e3779b97f4a7c15ull) | 1;
+        t->until = prof_next_distance(t, period) - (int64_t)size;
+        if (t->until > 0) {
+            t->busy = 0;
+            return;
+        }
+    }
+    t->until = prof_next_distance(t, period);
+
+    depth = backtrace(pc, PROF_MAX_DEPTH + PROF_SKIP) - PROF_SKIP;
+    if (depth < 0) depth = 0;
+
+    pthread_mutex_lock(&prof_lock);
+    stk = prof_intern(pc + PROF_SKIP, depth);
+    smp = prof_sample_free;
+    if (smp != NULL) prof_sample_free = smp->next;
+    else smp = (struct prof_sample *)prof_internal_alloc(sizeof(*smp));
+    if (stk != NULL && smp != NULL && prof_filter != NULL) {
+        struct prof_sample **b = &prof_samples[((uintptr_t)ptr >> 4) % PROF_SAMPLE_BUCKETS];
+        size_t fi = prof_filter_index(ptr);
+        smp->ptr = ptr;
+        smp->stack = stk;
+        smp->size = size;
+        smp->next = *b;
+        *b = smp;
+        stk->live_count++;
+        stk->live_bytes += size;
+        stk->alloc_count++;
+        stk->alloc_bytes += size;
+        if (prof_filter[fi] < 255) __atomic_store_n(&prof_filter[fi], prof_filter[fi] + 1, __ATOMIC_RELAXED);
+    } else if (smp != NULL) {
+        smp->next = prof_sample_free;
+        prof_sample_free = smp;
+    }
+    pthread_mutex_unlock(&prof_lock);
+    t->busy = 0;
+}
+
+/* The sampling period when this allocation is to be sampled, else 0. The
+ * countdown runs before the allocation so that the common case can
+ * tail-call glibc */
+static inline size_t prof_due(size_t size) {
+    size_t period = __atomic_load_n(&prof_period, __ATOMIC_RELAXED);
+
+    if (period == 0) return 0;
+    /* clamped so that a huge request, bound to fail, cannot wrap the count */
+    prof_tls.until -= size < ((size_t)1 << 62) ? (int64_t)size : (int64_t)1 << 62;
+    return prof_tls.until <= 0 ? period : 0;
+}
+
+/* A failed allocation passes the sample on to the next one */
+static void *prof_sampled(void *ptr, size_t size, size_t period) {
+    if (ptr != NULL) prof_record(ptr, size, period);
+    else prof_tls.until = 0;
+    return ptr;
+}
+
+/* Out of line so that malloc's common path needs no stack frame */
+static __attribute__((noinline)) void *prof_malloc_sampled(size_t size, size_t period) {
+    return prof_sampled(__libc_malloc(size), size, period);
+}
+
+/* Takes the record of ptr out of the sample table, its block still counted
+ * as live; NULL when ptr was not sampled. Called with prof_lock held */
+static struct prof_sample *prof_unlink(void *ptr) {
+    struct prof_sample **p;
+
+    for (p = &prof_samples[((uintptr_t)ptr >> 4) % PROF_SAMPLE_BUCKETS]; *p != NULL; p = &(*p)->next) {
+        struct prof_sample *smp = *p;
+        if (smp->ptr != ptr) continue;
+        *p = smp->next;
+        return smp;
+    }
+    return NULL;
+}
+
+/* Drops an unlinked record, its block no longer live. Called with
+ * prof_lock held */
+static void prof_drop(struct prof_sample *smp) {
+    size_t fi = prof_filter_index(smp->ptr);
+
+    smp->stack->live_count--;
+    smp->stack->live_bytes -= smp->size;
+    smp->next = prof_sample_free;
+    prof_sample_free = smp;
+    /* a saturated counter stays set: its addresses are always looked up */
+    if (prof_filter[fi] < 255) __atomic_store_n(&prof_filter[fi], prof_filter[fi] - 1, __ATOMIC_RELAXED);
+}
+
+static __attribute__((noinline)) void prof_forget(void *ptr) {
+    struct prof_sample *smp;
+
+    pthread_mutex_lock(&prof_lock);
+    smp = prof_unlink(ptr);
+    if (smp != NULL) prof_drop(smp);
+    pthread_mutex_unlock(&prof_lock);
+}
+
+/* Whether ptr can be a sampled block */
+static inline int prof_maybe_sampled(const void *ptr) {
+    const unsigned char *filter = __atomic_load_n(&prof_filter, __ATOMIC_ACQUIRE);
+
+    if (filter == NULL || ptr == NULL) return 0;
+    return __atomic_load_n(&filter[prof_filter_index(ptr)], __ATOMIC_RELAXED) != 0;
+}
+
+static inline void prof_free(void *ptr) {
+    if (prof_maybe_sampled(ptr)) prof_forget(ptr);
+}
+
+/* realloc of a block that may be sampled. Its record leaves the table
+ * before the block can move and its address be handed out again, and goes
+ * back if realloc fails, leaving the block live where it was; realloc(ptr,
+ * 0) returns NULL having freed it */
+static __attribute__((noinline)) void *prof_realloc_tracked(void *ptr, size_t size) {
+    struct prof_sample *smp;
+    void *q;
+
+    pthread_mutex_lock(&prof_lock);
+    smp = prof_unlink(ptr);
+    pthread_mutex_unlock(&prof_lock);
+    q = __libc_realloc(ptr, size);
+    if (smp == NULL) return q;
+
+    pthread_mutex_lock(&prof_lock);
+    if (q == NULL && size != 0) {
+        struct prof_sample **b = &prof_samples[((uintptr_t)ptr >> 4) % PROF_SAMPLE_BUCKETS];
+        smp->next = *b;
+        *b = smp;
+    } else {
+        prof_drop(smp);
+    }
+    pthread_mutex_unlock(&prof_lock);
+    return q;
+}
+
+/*============================================================================
+ * INTERPOSED ALLOCATOR
+ *==========================================================================*/
+void *malloc(size_t size) {
+    size_t period = prof_due(size);
+
+    if (period != 0) return prof_malloc_sampled(size, period);
+    return __libc_malloc(size);
+}
+
+void free(void *ptr) {
+    prof_free(ptr);                     /* before the address can be reused */
+    __libc_free(ptr);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    size_t bytes, period;
+
+    /* glibc refuses a size that overflows; it is not counted */
+    if (__builtin_mul_overflow(nmemb, size, &bytes)) return __libc_calloc(nmemb, size);
+    period = prof_due(bytes);
+    if (period != 0) return prof_sampled(__libc_calloc(nmemb, size), bytes, period);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    size_t period = prof_due(size);
+    void *q;
+
+    if (!prof_maybe_sampled(ptr)) {
+        if (period != 0) return prof_sampled(__libc_realloc(ptr, size), size, period);
+        return __libc_realloc(ptr, size);
+    }
+    q = prof_realloc_tracked(ptr, size);
+    return period != 0 ? prof_sampled(q, size, period) : q;
+}
+
+void *memalign(size_t alignment, size_t size) {
+    size_t period = prof_due(size);
+
+    if (period != 0) return prof_sampled(__libc_memalign(alignment, size), size, period);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+void *valloc(size_t size) {
+    return memalign((size_t)sysconf(_SC_PAGESIZE), size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    void *p;
+
+    if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0) return EINVAL;
+    p = memalign(alignment, size);
+    if (p == NULL) return ENOMEM;
+    *memptr = p;
+    return 0;
+}
+
+/*============================================================================
+ * PROFILES
+ *==========================================================================*/
+typedef struct prof_out {
+    int fd;
+    size_t len;
+    int failed;
+    char buf[PROF_OUT_BUF];
+} prof_out;
+
+static void prof_flush(prof_out *o) {
+    size_t off = 0;
+
+    while (off < o->len && !o->failed) {
+        ssize_t n = write(o->fd, o->buf + off, o->len - off);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) o->failed = 1;
+        else off += (size_t)n;
+    }
+    o->len = 0;
+}
+
+/* Appends up to 256 formatted bytes */
+static void __attribute__((format(printf, 2, 3))) prof_printf(prof_out *o, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    if (PROF_OUT_BUF - o->len < 256) prof_flush(o);
+    va_start(ap, fmt);
+    n = vsnprintf(o->buf + o->len, 256, fmt, ap);
+    va_end(ap);
+    if (n > 0) o->len += (size_t)n < 256 ? (size_t)n : 255;
+}
+
+int mem_profile_dump(int fd) {
+    prof_out o;
+    uint64_t lc = 0, lb = 0, ac = 0, ab = 0;
+    size_t i;
+    int maps;
+
+    if (fd < 0 || __atomic_load_n(&prof_filter, __ATOMIC_ACQUIRE) == NULL) return 0;
+    o.fd = fd;
+    o.len = 0;
+    o.failed = 0;
+
+    /* only write(2) and vsnprintf under the lock: nothing here allocates */
+    pthread_mutex_lock(&prof_lock);
+    for (i = 0; i < PROF_STACK_BUCKETS; i++) {
+        const struct prof_stack *s;
+        for (s = prof_stacks[i]; s != NULL; s = s->next) {
+            lc += s->live_count;
+            lb += s->live_bytes;
+            ac += s->alloc_count;
+            ab += s->alloc_bytes;
+        }
+    }
+    prof_printf(&o, "heap profile: %6llu: %8llu [%6llu: %8llu] @ heap_v2/%zu\n", (unsigned long long)lc,
+                (unsigned long long)lb, (unsigned long long)ac, (unsigned long long)ab, prof_period);
+    for (i = 0; i < PROF_STACK_BUCKETS; i++) {
+        const struct prof_stack *s;
+        for (s = prof_stacks[i]; s != NULL; s = s->next) {
+            int d;
+            prof_printf(&o, "%6llu: %8llu [%6llu: %8llu] @", (unsigned long long)s->live_count,
+                        (unsigned long long)s->live_bytes, (unsigned long long)s->alloc_count,
+                        (unsigned long long)s->alloc_bytes);
+            for (d = 0; d < s->depth; d++) prof_printf(&o, " %p", s->pc[d]);
+            prof_printf(&o, "\n");
+        }
+    }
+    pthread_mutex_unlock(&prof_lock);
+
+    prof_printf(&o, "\nMAPPED_LIBRARIES:\n");
+    prof_flush(&o);
+    maps = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (maps >= 0) {
+        ssize_t n;
+        while ((n = read(maps, o.buf, sizeof(o.buf))) > 0) {
+            o.len = (size_t)n;
+            prof_flush(&o);
+        }
+        close(maps);
+    }
+    return !o.failed;
+}
+
+static void *prof_dump_thread(void *unused) {
+    char path[256];
+    (void)unused;
+
+    prof_tls.busy = 1;                  /* the dumper's own allocations are not sampled */
+    for (;;) {
+        int fd;
+        if (sem_wait(&prof_dump_sem) != 0) continue;
+        snprintf(path, sizeof(path), "%s.%d.%u.heap", prof_prefix, (int)getpid(), prof_dump_seq++);
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd < 0) continue;
+        (void)mem_profile_dump(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void prof_signal_handler(int sig) {
+    (void)sig;
+    (void)sem_post(&prof_dump_sem);     /* async-signal-safe */
+}
+
+/* Installs the handler for sig and starts the dumper thread */
+static int prof_dump_on_signal(int sig) {
+    struct sigaction sa;
+    pthread_attr_t attr;
+    pthread_t th;
+    int ok;
+
+    if (prof_dump_started) return 1;
+    if (sem_init(&prof_dump_sem, 0, 0) != 0) return 0;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    ok = pthread_create(&th, &attr, prof_dump_thread, NULL) == 0;
+    pthread_attr_destroy(&attr);
+    if (!ok) return 0;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = prof_signal_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    prof_dump_started = sigaction(sig, &sa, NULL) == 0;
+    return prof_dump_started;
+}
+
+/* A fork() while another thread holds prof_lock would leave it locked for
+ * good in the child, whose first sampled malloc or free of a sampled block
+ * would then hang: the forking thread holds it across the fork instead */
+static void prof_fork_prepare(void) {
+    pthread_mutex_lock(&prof_lock);
+}
+
+static void prof_fork_release(void) {
+    pthread_mutex_unlock(&prof_lock);
+}
+
+int mem_profile_start(size_t period) {
+    void *pc[4];
+
+    if (period == 0) return 0;
+    if (__atomic_load_n(&prof_filter, __ATOMIC_ACQUIRE) == NULL) {
+        void *f = mmap(NULL, (size_t)1 << PROF_FILTER_BITS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+        if (f == MAP_FAILED) return 0;
+        if (pthread_atfork(prof_fork_prepare, prof_fork_release, prof_fork_release) != 0) {
+            munmap(f, (size_t)1 << PROF_FILTER_BITS);
+            return 0;
+        }
+        (void)backtrace(pc, 4);         /* loads the unwinder now, not inside a sampled malloc */
+        __atomic_store_n(&prof_filter, (unsigned char *)f, __ATOMIC_RELEASE);
+    }
+    __atomic_store_n(&prof_period, period, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void mem_profile_stop(void) {
+    /* records stay, so that blocks sampled so far are still released */
+    __atomic_store_n(&prof_period, 0, __ATOMIC_RELAXED);
+}
+
+/* MEM_PROFILE=<mean bytes between samples>, MEM_PROFILE_SIGNAL=<signal
+ * number>, MEM_PROFILE_PREFIX=<path prefix of the dumps> */
+static void __attribute__((constructor)) prof_init(void) {
+    const char *period = getenv("MEM_PROFILE");
+    const char *sig = getenv("MEM_PROFILE_SIGNAL");
+    const char *prefix = getenv("MEM_PROFILE_PREFIX");
+
+    if (period == NULL || !mem_profile_start((size_t)strtoull(period, NULL, 0))) return;
+    if (prefix != NULL && *prefix != '\0') prof_prefix = prefix;
+    if (sig != NULL) (void)prof_dump_on_signal(atoi(sig));
+}
+
+#else /* MEM_PROFILE_INTERPOSE */
+
+int mem_profile_start(size_t period) {
+    (void)period;
+    return 0;
+}
+
+void mem_profile_stop(void) {
+}
+
+int mem_profile_dump(int fd) {
+    (void)fd;
+    return 0;
+}
+
+#endif /* MEM_PROFILE_INTERPOSE */
@@ -0,0 +1,25 @@
+/**
+ * Backend behind lib_memory.h.
+ * The failure path of span checks; the checks themselves are inline in the
+ * header, so that the compiler sees them next to the loops they guard.
+ *
+ * Kept out of line and marked cold and noreturn: a check then costs its
+ * call site a compare and a never-taken branch, and the code behind the
+ * branch is moved out of the hot text. Nothing here allocates, since a bad
+ * index may already have corrupted the heap.
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For write */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "lib_memory.h"
+
+void mem_span_fail(const char *file, int line, size_t index, size_t len) {
+    char msg[256];
+    int n = snprintf(msg, sizeof(msg), "%s:%d: index %zu out of a span of %zu\n", file, line, index, len);
+
+    if (n > 0) (void)write(2, msg, (size_t)n < sizeof(msg) ? (size_t)n : sizeof(msg) - 1);
+    abort();
+}
@@ -0,0 +1,333 @@
+/*
+ * Numeric routines used by the examples in place of the scalar idioms they
+ * fix: widening to long before an addition that may overflow, masking
+ * before a narrowing conversion.
+ *
+ * Checked arithmetic: element-wise addition, subtraction and multiplication
+ * of arrays that report every element that overflows, or clamp it, at the
+ * speed of the unchecked loop.
+ *
+ * Narrowing conversions: arrays of one integer type converted to a
+ * narrower one, or to the other signedness, truncating, saturating or
+ * stopping at the first value that does not fit, with every such value
+ * counted and located.
+ *
+ * Summation: sums and dot products of double and float arrays that do not
+ * let small elements be absorbed by large ones, compensated or exact,
+ * at close to the speed of the vectorised naive sum.
+ *
+ * Invariant divisors: a divisor checked and prepared once, after which
+ * dividing by it is a multiplication and shifts, in scalar code or over
+ * arrays.
+ *
+ * All use AVX-512 or AVX2 code chosen at run time, with a portable scalar
+ * fallback.
+ */
+
+#ifndef LIB_NUMERIC_H
+#define LIB_NUMERIC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*============================================================================
+ * CHECKED ARITHMETIC
+ *==========================================================================*/
+/* Each of these computes r[i] = a[i] op b[i] for the n elements, r being
+ * allowed to be a or b but not to overlap them otherwise. Where mask is not
+ * NULL it receives (n + 63) / 64 words, bit i % 64 of word i / 64 being set
+ * when element i overflowed.
+ *
+ * The checked ones store the result modulo 2^32 or 2^64, as unsigned
+ * arithmetic would, and return the index of the first element that
+ * overflowed, n when none did */
+size_t num_add_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask);
+size_t num_sub_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask);
+size_t num_mul_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask);
+size_t num_add_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask);
+size_t num_sub_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask);
+size_t num_mul_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask);
+size_t num_add_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask);
+size_t num_sub_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask);
+size_t num_mul_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask);
+
+/* The saturating ones store the nearest representable value instead and
+ * return the number of elements clamped */
+size_t num_add_sat_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask);
+size_t num_sub_sat_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask);
+size_t num_mul_sat_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask);
+size_t num_add_sat_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask);
+size_t num_sub_sat_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask);
+size_t num_mul_sat_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask);
+size_t num_add_sat_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask);
+size_t num_sub_sat_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask);
+size_t num_mul_sat_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask);
+
+/*============================================================================
+ * NARROWING CONVERSIONS
+ *==========================================================================*/
+enum num_type {
+    NUM_INT8,
+    NUM_UINT8,
+    NUM_INT16,
+    NUM_UINT16,
+    NUM_INT32,
+    NUM_UINT32,
+    NUM_INT64,
+    NUM_UINT64
+};
+
+enum num_narrow_mode {
+    NUM_TRUNCATE,                   /* the low-order bits, as (short)(value & 0xFFFF) keeps them */
+    NUM_SATURATE,                   /* the representable value nearest */
+    NUM_CHECK                       /* stop before the first value that does not fit */
+};
+
+typedef struct num_narrow_result {
+    size_t lossy;                   /* values that did not fit */
+    size_t first;                   /* index of the first of them, n when none */
+} num_narrow_result;
+
+/* Converts the n elements of src, of type src_type, to dst_type into dst,
+ * which must not overlap src. Where mask is not NULL it receives
+ * (n + 63) / 64 words, bit i % 64 of word i / 64 being set when element i
+ * did not fit. With NUM_CHECK nothing is stored from the first such
+ * element on and it is the only one reported. Any pair of types works;
+ * those narrowing from 32 and 64 bits (and 16 with AVX-512) and those
+ * changing signedness at the same width are vectorised */
+num_narrow_result num_narrow(void *dst, enum num_type dst_type, const void *src, enum num_type src_type, size_t n,
+                             enum num_narrow_mode mode, uint64_t *mask);
+
+/*============================================================================
+ * SUMMATION
+ *==========================================================================*/
+enum num_sum_method {
+    NUM_SUM_PLAIN,                  /* the additions reordered across vector lanes: error growing with n */
+    NUM_SUM_PAIRWISE,               /* halves summed recursively: error growing with log n, as fast */
+    NUM_SUM_KAHAN,                  /* Neumaier's compensation: as if in twice the precision; 3-4x slower, below */
+    NUM_SUM_EXACT                   /* Shewchuk's partials: the exact sum, correctly rounded; slower */
+};
+
+/* The sum of the n elements of x, and the sum of the n products
+ * x[i] * y[i], by the method given. The float ones accumulate in float,
+ * but for NUM_SUM_EXACT. The order of the additions, and so the plain and
+ * pairwise results, depend on the instruction set. NUM_SUM_EXACT rounds the
+ * double products exactly unless they underflow. An element or product
+ * that is not finite, or a sum that overflows, makes the result infinite
+ * or NaN as with the plain sum.
+ *
+ * NUM_SUM_KAHAN misses the target of 1.5x the time of NUM_SUM_PLAIN on data
+ * in cache. Its vectors take seven additions each against one, and the
+ * kernels are bound by the adders, not by the latency of the accumulators:
+ * over 4096 elements it takes about 3x the plain sum's time with AVX-512
+ * (2.7x for floats) and 4.3x with AVX2 (4x for floats). Dot products take
+ * 1.1 to 1.8x, and sums of arrays larger than the caches 1.2 to 1.3x, where
+ * both wait on memory. Kahan's original four additions would take 1.7x less
+ * but lose the small elements of large + small - large */
+double num_sum_f64(const double *x, size_t n, enum num_sum_method method);
+float num_sum_f32(const float *x, size_t n, enum num_sum_method method);
+double num_dot_f64(const double *x, const double *y, size_t n, enum num_sum_method method);
+float num_dot_f32(const float *x, const float *y, size_t n, enum num_sum_method method);
+
+/*============================================================================
+ * INVARIANT DIVISORS
+ *==========================================================================*/
+/* A divisor checked once and turned into a multiplier and a shift, so that
+ * dividing by it costs a multiplication, a shift and an addition or two
+ * instead of a division instruction, as a compiler does for a constant
+ * divisor. The quotients truncate toward zero and the remainders take the
+ * sign of the numerator, as / and % do.
+ *
+ * The init functions return 0, or -1 for a zero divisor, leaving d
+ * unchanged. Dividing INT32_MIN (INT64_MIN) by -1, the one quotient that
+ * does not fit, yields INT32_MIN (INT64_MIN) and a remainder of 0 rather
+ * than the trap of the division instruction */
+typedef struct num_divisor_u32 {
+    uint32_t divisor;
+    uint32_t magic;                 /* 0 for powers of two, which only shift */
+    uint8_t shift;
+    uint8_t add;                    /* the multiplier is 2^32 + magic: add the numerator back */
+    uint64_t fastmod;               /* 2^64 / divisor rounded up, for the scalar code */
+} num_divisor_u32;
+
+typedef struct num_divisor_s32 {
+    int32_t divisor;
+    int32_t magic;                  /* 0 for powers of two, negative for negative divisors */
+    uint8_t shift;
+    uint8_t add;
+    uint8_t negative;
+} num_divisor_s32;
+
+typedef struct num_divisor_u64 {
+    uint64_t divisor;
+    uint64_t magic;
+    uint8_t shift;
+    uint8_t add;
+} num_divisor_u64;
+
+typedef struct num_divisor_s64 {
+    int64_t divisor;
+    int64_t magic;
+    uint8_t shift;
+    uint8_t add;
+    uint8_t negative;
+} num_divisor_s64;
+
+int num_divisor_u32_init(num_divisor_u32 *d, uint32_t divisor);
+int num_divisor_s32_init(num_divisor_s32 *d, int32_t divisor);
+int num_divisor_u64_init(num_divisor_u64 *d, uint64_t divisor);
+int num_divisor_s64_init(num_divisor_s64 *d, int64_t divisor);
+
+/* The high halves of the double-width products */
+static inline int32_t num_mulhi_s32(int32_t a, int32_t b) {
+    return (int32_t)(((int64_t)a * b) >> 32);
+}
+
+static inline uint64_t num_mulhi_u64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    return (uint64_t)(((unsigned __int128)a * b) >> 64);
+#else
+    uint64_t lo = (a & 0xFFFFFFFFu) * (b & 0xFFFFFFFFu);
+    uint64_t mid1 = (a >> 32) * (b & 0xFFFFFFFFu) + (lo >> 32);
+    uint64_t mid2 = (a & 0xFFFFFFFFu) * (b >> 32) + (mid1 & 0xFFFFFFFFu);
+
+    return (a >> 32) * (b >> 32) + (mid1 >> 32) + (mid2 >> 32);
+#endif
+}
+
+static inline int64_t num_mulhi_s64(int64_t a, int64_t b) {
+    /* The unsigned product, corrected for the operands' signs */
+    uint64_t hi = num_mulhi_u64((uint64_t)a, (uint64_t)b);
+
+    hi -= a < 0 ? (uint64_t)b : 0;
+    hi -= b < 0 ? (uint64_t)a : 0;
+    return (int64_t)hi;
+}
+
+/* The unsigned 32-bit ones use a 64-bit multiplier instead (Lemire, Kaser
+ * and Kurz), with which neither the quotient nor the remainder needs a
+ * shift or an addition */
+static inline uint32_t num_div_u32(uint32_t n, const num_divisor_u32 *d) {
+    if (d->magic == 0) return n >> d->shift;
+    return (uint32_t)num_mulhi_u64(d->fastmod, n);
+}
+
+static inline int32_t num_div_s32(int32_t n, const num_divisor_s32 *d) {
+    uint32_t sign = d->negative ? UINT32_MAX : 0;
+    uint32_t uq;
+    int32_t q;
+
+    if (d->magic == 0) {
+        /* Round toward zero: bias negative numerators by the divisor less one */
+        uq = (uint32_t)n + ((uint32_t)(n >> 31) & ((UINT32_C(1) << d->shift) - 1));
+        q = (int32_t)uq >> d->shift;
+        return (int32_t)(((uint32_t)q ^ sign) - sign);
+    }
+    uq = (uint32_t)num_mulhi_s32(d->magic, n);
+    if (d->add) uq += ((uint32_t)n ^ sign) - sign;
+    q = (int32_t)uq >> d->shift;
+    return (int32_t)((uint32_t)q + ((uint32_t)q >> 31));
+}
+
+static inline uint64_t num_div_u64(uint64_t n, const num_divisor_u64 *d) {
+    uint64_t q;
+
+    if (d->magic == 0) return n >> d->shift;
+    q = num_mulhi_u64(d->magic, n);
+    if (d->add) q += (n - q) >> 1;
+    return q >> d->shift;
+}
+
+static inline int64_t num_div_s64(int64_t n, const num_divisor_s64 *d) {
+    uint64_t sign = d->negative ? UINT64_MAX : 0;
+    uint64_t uq;
+    int64_t q;
+
+    if (d->magic == 0) {
+        uq = (uint64_t)n + ((uint64_t)(n >> 63) & ((UINT64_C(1) << d->shift) - 1));
+        q = (int64_t)uq >> d->shift;
+        return (int64_t)(((uint64_t)q ^ sign) - sign);
+    }
+    uq = (uint64_t)num_mulhi_s64(d->magic, n);
+    if (d->add) uq += ((uint64_t)n ^ sign) - sign;
+    q = (int64_t)uq >> d->shift;
+    return (int64_t)((uint64_t)q + ((uint64_t)q >> 63));
+}
+
+/* The remainders, computed in unsigned arithmetic so that INT32_MIN % -1
+ * wraps to 0 */
+static inline uint32_t num_mod_u32(uint32_t n, const num_divisor_u32 *d) {
+    if (d->magic == 0) return n & (d->divisor - 1);
+    return (uint32_t)num_mulhi_u64(d->fastmod * n, d->divisor);
+}
+
+static inline int32_t num_mod_s32(int32_t n, const num_divisor_s32 *d) {
+    return (int32_t)((uint32_t)n - (uint32_t)num_div_s32(n, d) * (uint32_t)d->divisor);
+}
+
+static inline uint64_t num_mod_u64(uint64_t n, const num_divisor_u64 *d) {
+    return n - num_div_u64(n, d) * d->divisor;
+}
+
+static inline int64_t num_mod_s64(int64_t n, const num_divisor_s64 *d) {
+    return (int64_t)((uint64_t)n - (uint64_t)num_div_s64(n, d) * (uint64_t)d->divisor);
+}
+
+/* Quotient and remainder, as div() and lldiv() return them */
+static inline div_t num_divmod_s32(int32_t n, const num_divisor_s32 *d) {
+    div_t r;
+
+    r.quot = num_div_s32(n, d);
+    r.rem = (int32_t)((uint32_t)n - (uint32_t)r.quot * (uint32_t)d->divisor);
+    return r;
+}
+
+static inline lldiv_t num_divmod_s64(int64_t n, const num_divisor_s64 *d) {
+    lldiv_t r;
+
+    r.quot = num_div_s64(n, d);
+    r.rem = (int64_t)((uint64_t)n - (uint64_t)r.quot * (uint64_t)d->divisor);
+    return r;
+}
+
+/* The quotients into q and the remainders into r of the count numerators
+ * n, either of q and r being allowed to be NULL or to be n. The 32-bit
+ * ones are vectorised; neither instruction set has the high half of a
+ * 64 x 64-bit product, so the 64-bit ones are the loops over the above */
+void num_divmod_u32_array(uint32_t *q, uint32_t *r, const uint32_t *n, size_t count, const num_divisor_u32 *d);
+void num_divmod_s32_array(int32_t *q, int32_t *r, const int32_t *n, size_t count, const num_divisor_s32 *d);
+void num_divmod_u64_array(uint64_t *q, uint64_t *r, const uint64_t *n, size_t count, const num_divisor_u64 *d);
+void num_divmod_s64_array(int64_t *q, int64_t *r, const int64_t *n, size_t count, const num_divisor_s64 *d);
+
+/*============================================================================
+ * INTEGER TO FLOATING-POINT CONVERSIONS
+ *==========================================================================*/
+/* Converts the n elements of src to float or double into dst, rounded to
+ * nearest as a cast rounds them. Where mask is not NULL it receives
+ * (n + 63) / 64 words, bit i % 64 of word i / 64 being set when element i
+ * was not exactly representable: beyond 2^24 in magnitude for float, 2^53
+ * for double, unless its low-order bits are zero. The result counts and
+ * locates those elements. Where wide is not NULL, num_i64_to_f32 also
+ * stores them converted to double at the same index of wide, leaving the
+ * other elements of wide as they were; beyond 2^53 these are rounded too,
+ * as num_i64_to_f64 would report */
+num_narrow_result num_i64_to_f32(float *dst, const int64_t *src, size_t n, uint64_t *mask, double *wide);
+num_narrow_result num_i64_to_f64(double *dst, const int64_t *src, size_t n, uint64_t *mask);
+
+/*============================================================================
+ * INSTRUCTION SETS
+ *==========================================================================*/
+/* The instruction set in use: "avx512", "avx2" or "scalar". NUMERIC_ISA in
+ * the environment ("avx2" or "scalar") caps it */
+const char *num_isa(void);
+
+/*============================================================================
+ * BENCHMARKS
+ *==========================================================================*/
+/* The kernels against the scalar loops they replace; the number of failed
+ * benchmarks */
+int num_bench_suite(FILE *report);
+
+#endif /* LIB_NUMERIC_H */
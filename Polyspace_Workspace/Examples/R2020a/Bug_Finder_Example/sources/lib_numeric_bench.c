@@ -0,0 +1,730 @@
+/**
+ * Backend behind lib_numeric.h.
+ * Benchmarks of the numeric kernels against the scalar loops they replace,
+ * timed with the CRYPTO_bench harness.
+ *
+ * The checked arithmetic benchmarks go once over BENCH_VALUES pairs of
+ * operands per call, amounts as a billing aggregation adds them up, one in
+ * BENCH_OVERFLOW_EVERY of them overflowing:
+ *   - the unchecked loop, the speed to match;
+ *   - the corrected_intovfl fix applied to each element, widening to
+ *     int64_t and comparing against the int32_t range;
+ *   - a loop over __builtin_*_overflow building the same mask as the
+ *     kernels;
+ *   - the kernels, checked and saturating.
+ *
+ * The narrowing benchmarks convert BENCH_VALUES values per call, imported
+ * int64_t columns whose values mostly fit the narrower type, again one in
+ * BENCH_OVERFLOW_EVERY not fitting: the loop that compares each value
+ * against the limits of the narrower type, counting and locating the ones
+ * that do not fit, against num_narrow in its three modes.
+ *
+ * The summation benchmarks add up BENCH_VALUES metric values per call,
+ * from 1 to 10^6 with a pair of opposite 10^16 spikes every
+ * BENCH_OVERFLOW_EVERY values, which the naive sum absorbs the small values
+ * into: the s += x[i] loop against the four num_sum methods, and the same
+ * for dot products. The plain and compensated sums are also timed over
+ * BENCH_BIG_VALUES values, far more than the caches hold, and the relative
+ * error of each method is reported.
+ *
+ * The division benchmarks divide BENCH_VALUES numerators per call by a
+ * divisor only known at run time, as hash bucketing takes hashes modulo a
+ * table size and rate limiting divides timestamps by an interval: the / or
+ * % loop, which divides with the division instruction, against the
+ * num_divisor inline functions in the same loop and the array forms.
+ *
+ * The floating-point conversion benchmarks convert BENCH_VALUES int64_t
+ * features per call, counts below 2^20 but for one in BENCH_OVERFLOW_EVERY
+ * that is a 64-bit identifier: the cast alone, the speed to match, and the
+ * cast followed by the round-trip comparison that locates the values float
+ * rounds, against num_i64_to_f32 with the mask, and with the widening. The
+ * checked conversion is also timed over BENCH_BIG_VALUES features, where
+ * memory bandwidth bounds it.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "lib_numeric.h"
+#include "lib_crypto_checkers.h"
+
+enum {
+    BENCH_VALUES         = 4096,
+    BENCH_OVERFLOW_EVERY = 1000,
+    BENCH_BIG_VALUES     = 1 << 22
+};
+
+#define BENCH_SECONDS 0.5
+
+typedef struct bench_state {
+    int32_t a32[BENCH_VALUES], b32[BENCH_VALUES], r32[BENCH_VALUES];
+    int64_t a64[BENCH_VALUES], b64[BENCH_VALUES], r64[BENCH_VALUES];
+    int64_t column[BENCH_VALUES];   /* int16_t values but one in BENCH_OVERFLOW_EVERY */
+    uint32_t ucolumn[BENCH_VALUES]; /* int32_t values but one in BENCH_OVERFLOW_EVERY */
+    int16_t r16[BENCH_VALUES];
+    double metric[BENCH_VALUES];    /* 1 to 10^6 but for pairs of opposite 10^16 spikes */
+    double weight[BENCH_VALUES];
+    float fmetric[BENCH_VALUES];
+    double *big;                    /* BENCH_BIG_VALUES values, far more than the caches hold */
+    uint32_t hash[BENCH_VALUES];
+    uint64_t hash64[BENCH_VALUES];
+    uint32_t ur32[BENCH_VALUES];
+    uint64_t ur64[BENCH_VALUES];
+    uint32_t buckets;               /* the divisors, read from memory at each call */
+    int32_t interval;
+    num_divisor_u32 buckets_d;
+    num_divisor_s32 interval_d;
+    num_divisor_u64 buckets64_d;
+    int64_t feature[BENCH_VALUES];  /* counts below 2^20 but for one in BENCH_OVERFLOW_EVERY */
+    float rf[BENCH_VALUES];
+    double rd[BENCH_VALUES];
+    int64_t *big_feature;           /* BENCH_BIG_VALUES features */
+    float *big_rf;
+    uint64_t mask[BENCH_VALUES / 64];
+    volatile unsigned long sink;    /* keeps the compiler from dropping the loops */
+} bench_state;
+
+static void bench_state_init(bench_state *st) {
+    uint64_t x = 0x9E3779B97F4A7C15u;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        st->a32[i] = (int32_t)(x & 0xFFFFF) - 0x80000;
+        st->b32[i] = (int32_t)(x >> 44) - 0x80000;
+        st->a64[i] = (int64_t)(x >> 24) - ((int64_t)1 << 39);
+        st->b64[i] = (int64_t)(x & 0xFFFFFFFFFFu) - ((int64_t)1 << 39);
+        st->column[i] = (int16_t)(x >> 48);
+        st->ucolumn[i] = (uint32_t)(x >> 33);
+        st->metric[i] = (double)(x >> 11) * 0x1.0p-53 * pow(10.0, (double)(x % 7));
+        st->weight[i] = (double)(x >> 40) * 0x1.0p-24;
+        st->fmetric[i] = (float)st->metric[i];
+        st->hash[i] = (uint32_t)(x * 0x9E3779B97F4A7C15u >> 32);
+        st->hash64[i] = x * 0xD6E8FEB86659FD93u;
+        st->feature[i] = (int64_t)(x >> 44);
+        if (i % BENCH_OVERFLOW_EVERY == BENCH_OVERFLOW_EVERY - 1) {
+            st->a32[i] = INT32_MAX - 1;
+            st->b32[i] = 2 + (int32_t)(x & 0xFF);
+            st->a64[i] = INT64_MAX - 1;
+            st->b64[i] = 2;
+            st->column[i] = (int64_t)(x >> 1);
+            st->ucolumn[i] = (uint32_t)x | 0x80000000u;
+            st->metric[i] = i % (2 * BENCH_OVERFLOW_EVERY) < BENCH_OVERFLOW_EVERY ? 1.0e16 : -1.0e16;
+            st->feature[i] = (int64_t)st->hash64[i];
+        }
+    }
+    st->buckets = 1009;
+    st->interval = 60;
+    (void)num_divisor_u32_init(&st->buckets_d, st->buckets);
+    (void)num_divisor_s32_init(&st->interval_d, st->interval);
+    (void)num_divisor_u64_init(&st->buckets64_d, st->buckets);
+}
+
+/*============================================================================
+ * CHECKED ARITHMETIC
+ *==========================================================================*/
+static int bench_add_i32_plain(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->r32[i] = (int32_t)((uint32_t)st->a32[i] + (uint32_t)st->b32[i]);
+    st->sink += (unsigned long)st->r32[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_add_i32_widen(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        int64_t wide = (int64_t)st->a32[i] + (int64_t)st->b32[i];
+
+        st->r32[i] = (int32_t)wide;
+        m |= (uint64_t)(wide < INT32_MIN || wide > INT32_MAX) << (i % 64);
+        if (i % 64 == 63) {
+            st->mask[i / 64] = m;
+            m = 0;
+        }
+    }
+    st->sink += (unsigned long)st->mask[0];
+    return 1;
+}
+
+static int bench_add_i32_builtin(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        m |= (uint64_t)__builtin_add_overflow(st->a32[i], st->b32[i], &st->r32[i]) << (i % 64);
+        if (i % 64 == 63) {
+            st->mask[i / 64] = m;
+            m = 0;
+        }
+    }
+    st->sink += (unsigned long)st->mask[0];
+    return 1;
+}
+
+static int bench_add_i32_num(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    st->sink += num_add_i32(st->r32, st->a32, st->b32, BENCH_VALUES, st->mask);
+    return 1;
+}
+
+static int bench_add_sat_i32_num(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    st->sink += num_add_sat_i32(st->r32, st->a32, st->b32, BENCH_VALUES, st->mask);
+    return 1;
+}
+
+static int bench_mul_i32_builtin(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        m |= (uint64_t)__builtin_mul_overflow(st->a32[i], st->b32[i], &st->r32[i]) << (i % 64);
+        if (i % 64 == 63) {
+            st->mask[i / 64] = m;
+            m = 0;
+        }
+    }
+    st->sink += (unsigned long)st->mask[0];
+    return 1;
+}
+
+static int bench_mul_i32_num(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    st->sink += num_mul_i32(st->r32, st->a32, st->b32, BENCH_VALUES, st->mask);
+    return 1;
+}
+
+static int bench_add_i64_builtin(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        m |= (uint64_t)__builtin_add_overflow(st->a64[i], st->b64[i], &st->r64[i]) << (i % 64);
+        if (i % 64 == 63) {
+            st->mask[i / 64] = m;
+            m = 0;
+        }
+    }
+    st->sink += (unsigned long)st->mask[0];
+    return 1;
+}
+
+static int bench_add_i64_num(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    st->sink += num_add_i64(st->r64, st->a64, st->b64, BENCH_VALUES, st->mask);
+    return 1;
+}
+
+static int bench_add_sat_i64_num(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    st->sink += num_add_sat_i64(st->r64, st->a64, st->b64, BENCH_VALUES, st->mask);
+    return 1;
+}
+
+static int bench_checked_run(FILE *report, bench_state *st) {
+    static const struct {
+        const char *name;
+        int (*fn)(void *arg);
+        size_t width;
+    } benches[] = {
+        { "add i32 unchecked", bench_add_i32_plain, sizeof(int32_t) },
+        { "add i32 widened to int64_t", bench_add_i32_widen, sizeof(int32_t) },
+        { "add i32 __builtin_add_overflow", bench_add_i32_builtin, sizeof(int32_t) },
+        { "add i32 num_add_i32", bench_add_i32_num, sizeof(int32_t) },
+        { "add i32 num_add_sat_i32", bench_add_sat_i32_num, sizeof(int32_t) },
+        { "mul i32 __builtin_mul_overflow", bench_mul_i32_builtin, sizeof(int32_t) },
+        { "mul i32 num_mul_i32", bench_mul_i32_num, sizeof(int32_t) },
+        { "add i64 __builtin_add_overflow", bench_add_i64_builtin, sizeof(int64_t) },
+        { "add i64 num_add_i64", bench_add_i64_num, sizeof(int64_t) },
+        { "add i64 num_add_sat_i64", bench_add_sat_i64_num, sizeof(int64_t) }
+    };
+    int failed = 0;
+    size_t i;
+
+    if (report != NULL) fprintf(report, "# checked arithmetic, %d pairs per call\n", BENCH_VALUES);
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        failed += !CRYPTO_bench(report, benches[i].name, benches[i].fn, st, 2 * BENCH_VALUES * benches[i].width,
+                                BENCH_SECONDS);
+    }
+    return failed;
+}
+
+/*============================================================================
+ * NARROWING CONVERSIONS
+ *==========================================================================*/
+static int bench_i64_i16_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    size_t lossy = 0, first = BENCH_VALUES;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        int64_t v = st->column[i];
+
+        if (v < INT16_MIN || v > INT16_MAX) {
+            if (lossy++ == 0) first = (size_t)i;
+        }
+        st->r16[i] = (int16_t)(v & 0xFFFF);
+    }
+    st->sink += lossy + first;
+    return 1;
+}
+
+static int bench_i64_i16_truncate(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_narrow(st->r16, NUM_INT16, st->column, NUM_INT64, BENCH_VALUES, NUM_TRUNCATE, NULL);
+
+    st->sink += res.lossy + res.first;
+    return 1;
+}
+
+static int bench_i64_i16_saturate(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_narrow(st->r16, NUM_INT16, st->column, NUM_INT64, BENCH_VALUES, NUM_SATURATE,
+                                       st->mask);
+
+    st->sink += res.lossy + res.first;
+    return 1;
+}
+
+static int bench_i64_i32_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    size_t lossy = 0, first = BENCH_VALUES;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        int64_t v = st->column[i];
+
+        if (v < INT32_MIN || v > INT32_MAX) {
+            if (lossy++ == 0) first = (size_t)i;
+            v = v < 0 ? INT32_MIN : INT32_MAX;
+        }
+        st->r32[i] = (int32_t)v;
+    }
+    st->sink += lossy + first;
+    return 1;
+}
+
+static int bench_i64_i32_saturate(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_narrow(st->r32, NUM_INT32, st->column, NUM_INT64, BENCH_VALUES, NUM_SATURATE,
+                                       st->mask);
+
+    st->sink += res.lossy + res.first;
+    return 1;
+}
+
+static int bench_u32_i32_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        if (st->ucolumn[i] > INT32_MAX) break;
+        st->r32[i] = (int32_t)st->ucolumn[i];
+    }
+    st->sink += (unsigned long)i;
+    return 1;
+}
+
+static int bench_u32_i32_check(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_narrow(st->r32, NUM_INT32, st->ucolumn, NUM_UINT32, BENCH_VALUES, NUM_CHECK, NULL);
+
+    st->sink += res.first;
+    return 1;
+}
+
+static int bench_narrow_run(FILE *report, bench_state *st) {
+    static const struct {
+        const char *name;
+        int (*fn)(void *arg);
+        size_t width;
+    } benches[] = {
+        { "int64_t -> int16_t, compare and mask each value", bench_i64_i16_loop, sizeof(int64_t) },
+        { "int64_t -> int16_t, num_narrow NUM_TRUNCATE", bench_i64_i16_truncate, sizeof(int64_t) },
+        { "int64_t -> int16_t, num_narrow NUM_SATURATE", bench_i64_i16_saturate, sizeof(int64_t) },
+        { "int64_t -> int32_t, compare and clamp each value", bench_i64_i32_loop, sizeof(int64_t) },
+        { "int64_t -> int32_t, num_narrow NUM_SATURATE", bench_i64_i32_saturate, sizeof(int64_t) },
+        { "uint32_t -> int32_t, stop at the first overflow", bench_u32_i32_loop, sizeof(uint32_t) },
+        { "uint32_t -> int32_t, num_narrow NUM_CHECK", bench_u32_i32_check, sizeof(uint32_t) }
+    };
+    int failed = 0;
+    size_t i;
+
+    if (report != NULL) fprintf(report, "# narrowing conversions, %d values per call\n", BENCH_VALUES);
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        failed += !CRYPTO_bench(report, benches[i].name, benches[i].fn, st, BENCH_VALUES * benches[i].width,
+                                BENCH_SECONDS);
+    }
+    return failed;
+}
+
+/*============================================================================
+ * SUMMATION
+ *==========================================================================*/
+static int bench_sum_f64_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    double s = 0.0;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) s += st->metric[i];
+    st->sink += (unsigned long)s;
+    return 1;
+}
+
+#define BENCH_SUM(name, call) \
+    static int name(void *arg) { \
+        bench_state *st = (bench_state *)arg; \
+        \
+        st->sink += (unsigned long)(call); \
+        return 1; \
+    }
+
+BENCH_SUM(bench_sum_f64_plain, num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_PLAIN))
+BENCH_SUM(bench_sum_f64_pairwise, num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_PAIRWISE))
+BENCH_SUM(bench_sum_f64_kahan, num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_KAHAN))
+BENCH_SUM(bench_sum_f64_exact, num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_EXACT))
+BENCH_SUM(bench_sum_f32_plain, num_sum_f32(st->fmetric, BENCH_VALUES, NUM_SUM_PLAIN))
+BENCH_SUM(bench_sum_f32_kahan, num_sum_f32(st->fmetric, BENCH_VALUES, NUM_SUM_KAHAN))
+BENCH_SUM(bench_dot_f64_plain, num_dot_f64(st->metric, st->weight, BENCH_VALUES, NUM_SUM_PLAIN))
+BENCH_SUM(bench_dot_f64_kahan, num_dot_f64(st->metric, st->weight, BENCH_VALUES, NUM_SUM_KAHAN))
+BENCH_SUM(bench_big_plain, num_sum_f64(st->big, BENCH_BIG_VALUES, NUM_SUM_PLAIN))
+BENCH_SUM(bench_big_kahan, num_sum_f64(st->big, BENCH_BIG_VALUES, NUM_SUM_KAHAN))
+
+static int bench_sum_f32_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    float s = 0.0f;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) s += st->fmetric[i];
+    st->sink += (unsigned long)s;
+    return 1;
+}
+
+static int bench_dot_f64_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    double s = 0.0;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) s += st->metric[i] * st->weight[i];
+    st->sink += (unsigned long)s;
+    return 1;
+}
+
+static int bench_big_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    double s = 0.0;
+    int i;
+
+    for (i = 0; i < BENCH_BIG_VALUES; i++) s += st->big[i];
+    st->sink += (unsigned long)s;
+    return 1;
+}
+
+static int bench_sum_run(FILE *report, bench_state *st) {
+    static const struct {
+        const char *name;
+        int (*fn)(void *arg);
+        size_t bytes;
+    } benches[] = {
+        { "sum double, s += x[i]", bench_sum_f64_loop, BENCH_VALUES * sizeof(double) },
+        { "sum double, num_sum_f64 NUM_SUM_PLAIN", bench_sum_f64_plain, BENCH_VALUES * sizeof(double) },
+        { "sum double, num_sum_f64 NUM_SUM_PAIRWISE", bench_sum_f64_pairwise, BENCH_VALUES * sizeof(double) },
+        { "sum double, num_sum_f64 NUM_SUM_KAHAN", bench_sum_f64_kahan, BENCH_VALUES * sizeof(double) },
+        { "sum double, num_sum_f64 NUM_SUM_EXACT", bench_sum_f64_exact, BENCH_VALUES * sizeof(double) },
+        { "sum float, s += x[i]", bench_sum_f32_loop, BENCH_VALUES * sizeof(float) },
+        { "sum float, num_sum_f32 NUM_SUM_PLAIN", bench_sum_f32_plain, BENCH_VALUES * sizeof(float) },
+        { "sum float, num_sum_f32 NUM_SUM_KAHAN", bench_sum_f32_kahan, BENCH_VALUES * sizeof(float) },
+        { "dot double, s += x[i] * y[i]", bench_dot_f64_loop, 2 * BENCH_VALUES * sizeof(double) },
+        { "dot double, num_dot_f64 NUM_SUM_PLAIN", bench_dot_f64_plain, 2 * BENCH_VALUES * sizeof(double) },
+        { "dot double, num_dot_f64 NUM_SUM_KAHAN", bench_dot_f64_kahan, 2 * BENCH_VALUES * sizeof(double) },
+        { "big sum double, s += x[i]", bench_big_loop, BENCH_BIG_VALUES * sizeof(double) },
+        { "big sum double, num_sum_f64 NUM_SUM_PLAIN", bench_big_plain, BENCH_BIG_VALUES * sizeof(double) },
+        { "big sum double, num_sum_f64 NUM_SUM_KAHAN", bench_big_kahan, BENCH_BIG_VALUES * sizeof(double) }
+    };
+    double exact, loop = 0.0;
+    int failed = 0;
+    size_t i;
+
+    st->big = (double *)malloc(BENCH_BIG_VALUES * sizeof(double));
+    if (st->big == NULL) return 1;
+    for (i = 0; i < BENCH_BIG_VALUES; i++) st->big[i] = st->metric[i % BENCH_VALUES];
+
+    if (report != NULL) {
+        fprintf(report, "# summation, %d values per call, %d for big\n", BENCH_VALUES, BENCH_BIG_VALUES);
+    }
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        failed += !CRYPTO_bench(report, benches[i].name, benches[i].fn, st, benches[i].bytes, BENCH_SECONDS);
+    }
+
+    exact = num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_EXACT);
+    for (i = 0; i < BENCH_VALUES; i++) loop += st->metric[i];
+    if (report != NULL) {
+        fprintf(report, "# relative error of the double sum: loop %.2g, plain %.2g, pairwise %.2g, kahan %.2g\n",
+                fabs(loop - exact) / exact,
+                fabs(num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_PLAIN) - exact) / exact,
+                fabs(num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_PAIRWISE) - exact) / exact,
+                fabs(num_sum_f64(st->metric, BENCH_VALUES, NUM_SUM_KAHAN) - exact) / exact);
+    }
+
+    free(st->big);
+    st->big = NULL;
+    return failed;
+}
+
+/*============================================================================
+ * INVARIANT DIVISORS
+ *==========================================================================*/
+static int bench_mod_u32_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->ur32[i] = st->hash[i] % st->buckets;
+    st->sink += st->ur32[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_mod_u32_inline(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_divisor_u32 d = st->buckets_d;   /* copied, as the stores to ur32 could alias it */
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->ur32[i] = num_mod_u32(st->hash[i], &d);
+    st->sink += st->ur32[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_mod_u32_array(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    num_divmod_u32_array(NULL, st->ur32, st->hash, BENCH_VALUES, &st->buckets_d);
+    st->sink += st->ur32[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_div_s32_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->r32[i] = st->a32[i] / st->interval;
+    st->sink += (unsigned long)st->r32[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_div_s32_inline(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_divisor_s32 d = st->interval_d;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->r32[i] = num_div_s32(st->a32[i], &d);
+    st->sink += (unsigned long)st->r32[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_div_s32_array(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    num_divmod_s32_array(st->r32, NULL, st->a32, BENCH_VALUES, &st->interval_d);
+    st->sink += (unsigned long)st->r32[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_mod_u64_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->ur64[i] = st->hash64[i] % st->buckets;
+    st->sink += st->ur64[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_mod_u64_inline(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_divisor_u64 d = st->buckets64_d;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->ur64[i] = num_mod_u64(st->hash64[i], &d);
+    st->sink += st->ur64[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_divide_run(FILE *report, bench_state *st) {
+    static const struct {
+        const char *name;
+        int (*fn)(void *arg);
+        size_t width;
+    } benches[] = {
+        { "uint32_t hash % buckets", bench_mod_u32_loop, sizeof(uint32_t) },
+        { "uint32_t hash, num_mod_u32", bench_mod_u32_inline, sizeof(uint32_t) },
+        { "uint32_t hash, num_divmod_u32_array", bench_mod_u32_array, sizeof(uint32_t) },
+        { "int32_t value / interval", bench_div_s32_loop, sizeof(int32_t) },
+        { "int32_t value, num_div_s32", bench_div_s32_inline, sizeof(int32_t) },
+        { "int32_t value, num_divmod_s32_array", bench_div_s32_array, sizeof(int32_t) },
+        { "uint64_t hash % buckets", bench_mod_u64_loop, sizeof(uint64_t) },
+        { "uint64_t hash, num_mod_u64", bench_mod_u64_inline, sizeof(uint64_t) }
+    };
+    int failed = 0;
+    size_t i;
+
+    if (report != NULL) fprintf(report, "# invariant divisors, %d numerators per call\n", BENCH_VALUES);
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        failed += !CRYPTO_bench(report, benches[i].name, benches[i].fn, st, BENCH_VALUES * benches[i].width,
+                                BENCH_SECONDS);
+    }
+    return failed;
+}
+
+/*============================================================================
+ * FLOATING-POINT CONVERSIONS
+ *==========================================================================*/
+static int bench_i64_f32_cast(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->rf[i] = (float)st->feature[i];
+    st->sink += (unsigned long)st->rf[BENCH_VALUES - 1];
+    return 1;
+}
+
+/* The cast and the round trip over n features; 2^63 does not convert back */
+static void i64_f32_loop(bench_state *st, float *r, const int64_t *v, size_t n) {
+    size_t lossy = 0, first = n, i;
+
+    for (i = 0; i < n; i++) {
+        r[i] = (float)v[i];
+        if (r[i] >= 0x1p63f || (int64_t)r[i] != v[i]) {
+            if (lossy++ == 0) first = i;
+        }
+    }
+    st->sink += lossy + first;
+}
+
+static int bench_i64_f32_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    i64_f32_loop(st, st->rf, st->feature, BENCH_VALUES);
+    return 1;
+}
+
+static int bench_i64_f32_mask(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_i64_to_f32(st->rf, st->feature, BENCH_VALUES, st->mask, NULL);
+
+    st->sink += res.lossy + res.first;
+    return 1;
+}
+
+static int bench_i64_f32_widen(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_i64_to_f32(st->rf, st->feature, BENCH_VALUES, st->mask, st->rd);
+
+    st->sink += res.lossy + res.first;
+    return 1;
+}
+
+static int bench_i64_f64_cast(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) st->rd[i] = (double)st->feature[i];
+    st->sink += (unsigned long)st->rd[BENCH_VALUES - 1];
+    return 1;
+}
+
+static int bench_i64_f64_mask(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_i64_to_f64(st->rd, st->feature, BENCH_VALUES, st->mask);
+
+    st->sink += res.lossy + res.first;
+    return 1;
+}
+
+static int bench_big_i64_f32_loop(void *arg) {
+    bench_state *st = (bench_state *)arg;
+
+    i64_f32_loop(st, st->big_rf, st->big_feature, BENCH_BIG_VALUES);
+    return 1;
+}
+
+static int bench_big_i64_f32(void *arg) {
+    bench_state *st = (bench_state *)arg;
+    num_narrow_result res = num_i64_to_f32(st->big_rf, st->big_feature, BENCH_BIG_VALUES, NULL, NULL);
+
+    st->sink += res.lossy + res.first;
+    return 1;
+}
+
+static int bench_float_run(FILE *report, bench_state *st) {
+    static const struct {
+        const char *name;
+        int (*fn)(void *arg);
+        size_t bytes;
+    } benches[] = {
+        { "int64_t -> float, cast", bench_i64_f32_cast, BENCH_VALUES * sizeof(int64_t) },
+        { "int64_t -> float, cast and round trip", bench_i64_f32_loop, BENCH_VALUES * sizeof(int64_t) },
+        { "int64_t -> float, num_i64_to_f32", bench_i64_f32_mask, BENCH_VALUES * sizeof(int64_t) },
+        { "int64_t -> float, num_i64_to_f32 widening", bench_i64_f32_widen, BENCH_VALUES * sizeof(int64_t) },
+        { "int64_t -> double, cast", bench_i64_f64_cast, BENCH_VALUES * sizeof(int64_t) },
+        { "int64_t -> double, num_i64_to_f64", bench_i64_f64_mask, BENCH_VALUES * sizeof(int64_t) },
+        { "big int64_t -> float, cast and round trip", bench_big_i64_f32_loop, BENCH_BIG_VALUES * sizeof(int64_t) },
+        { "big int64_t -> float, num_i64_to_f32", bench_big_i64_f32, BENCH_BIG_VALUES * sizeof(int64_t) }
+    };
+    int failed = 0;
+    size_t i;
+
+    st->big_feature = (int64_t *)malloc(BENCH_BIG_VALUES * sizeof(int64_t));
+    st->big_rf = (float *)malloc(BENCH_BIG_VALUES * sizeof(float));
+    if (st->big_feature != NULL && st->big_rf != NULL) {
+        for (i = 0; i < BENCH_BIG_VALUES; i++) st->big_feature[i] = st->feature[i % BENCH_VALUES];
+        if (report != NULL) {
+            fprintf(report, "# floating-point conversions, %d features per call, %d for big\n", BENCH_VALUES,
+                    BENCH_BIG_VALUES);
+        }
+        for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+            failed += !CRYPTO_bench(report, benches[i].name, benches[i].fn, st, benches[i].bytes, BENCH_SECONDS);
+        }
+    } else {
+        failed = 1;
+    }
+
+    free(st->big_feature);
+    free(st->big_rf);
+    st->big_feature = NULL;
+    st->big_rf = NULL;
+    return failed;
+}
+
+/*============================================================================
+ * SUITE
+ *==========================================================================*/
+int num_bench_suite(FILE *report) {
+    bench_state *st = (bench_state *)calloc(1, sizeof(bench_state));
+    int failed = 0;
+
+    if (st == NULL) return -1;
+    bench_state_init(st);
+
+    if (report != NULL) fprintf(report, "# numeric kernels: %s\n", num_isa());
+    failed += bench_checked_run(report, st);
+    failed += bench_narrow_run(report, st);
+    failed += bench_sum_run(report, st);
+    failed += bench_divide_run(report, st);
+    failed += bench_float_run(report, st);
+
+    free(st);
+    return failed;
+}
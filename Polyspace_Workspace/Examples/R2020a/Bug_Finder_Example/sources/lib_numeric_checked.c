@@ -0,0 +1,533 @@
+/**
+ * Backend behind lib_numeric.h.
+ * Checked and saturating array arithmetic with AVX-512, AVX2 and scalar
+ * implementations.
+ *
+ * The arrays are processed in blocks of 64 elements, each block yielding
+ * one word of the overflow mask. A vector step computes the wrapped result
+ * of all its lanes, as the unchecked loop would, and finds the overflowing
+ * lanes with a few more instructions:
+ *   - signed addition and subtraction overflow where the result's sign
+ *     differs from the sign both operands share (for a - b: from a's, when
+ *     b's differs), i.e. the sign bit of (a ^ r) & (b ^ r), resp.
+ *     (a ^ b) & (a ^ r);
+ *   - unsigned addition carries where r < a, and subtraction borrows where
+ *     a < b, compared through an unsigned maximum on AVX2;
+ *   - 32-bit multiplication overflows where the high half of the 64-bit
+ *     product is not the sign extension (zero for unsigned) of the low
+ *     half. The even and odd lanes are multiplied to 64 bits separately
+ *     and their high halves blended back into one vector.
+ * The lanes' sign bits become mask bits through a movemask on AVX2 and a
+ * compare into a mask register on AVX-512. Saturation then blends the bound
+ * into the overflowing lanes: the maximum or minimum by the sign of a for
+ * signed addition and subtraction and of a ^ b for multiplication, all ones
+ * or zero for unsigned.
+ *
+ * Neither instruction set has the high half of a 64 x 64-bit product, so
+ * int64 multiplication is the scalar loop everywhere, as are the last
+ * n % 64 elements of every array.
+ *
+ * The scalar loop over __builtin_add_overflow is what this replaces: the
+ * compiler does not vectorise the branch on the overflow flag.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib_numeric_internal.h"
+
+enum {
+    NUM_ADD_I32,
+    NUM_SUB_I32,
+    NUM_MUL_I32,
+    NUM_ADD_U32,
+    NUM_SUB_U32,
+    NUM_MUL_U32,
+    NUM_ADD_I64,
+    NUM_SUB_I64,
+    NUM_MUL_I64,
+    NUM_OPS
+};
+
+#define NUM_BLOCK 64    /* elements per mask word */
+
+/* The 64 elements from r, a and b of one operation; the overflow mask */
+typedef uint64_t (*num_block_fn)(void *r, const void *a, const void *b, int sat);
+
+static int numeric_level = -1;
+
+static int numeric_detect(void) {
+    const char *cap = getenv("NUMERIC_ISA");
+    int level = NUMERIC_SCALAR;
+
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) level = NUMERIC_AVX2;
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+        __builtin_cpu_supports("avx512dq")) {
+        level = NUMERIC_AVX512;
+    }
+#endif
+    if (cap != NULL && strcmp(cap, "scalar") == 0) level = NUMERIC_SCALAR;
+    else if (cap != NULL && strcmp(cap, "avx2") == 0 && level > NUMERIC_AVX2) level = NUMERIC_AVX2;
+    return level;
+}
+
+int numeric_isa(void) {
+    int level = __atomic_load_n(&numeric_level, __ATOMIC_RELAXED);
+
+    if (level < 0) {
+        level = numeric_detect();
+        __atomic_store_n(&numeric_level, level, __ATOMIC_RELAXED);
+    }
+    return level;
+}
+
+const char *num_isa(void) {
+    static const char *const names[] = { "scalar", "avx2", "avx512" };
+    return names[numeric_isa()];
+}
+
+/*============================================================================
+ * SCALAR
+ *==========================================================================*/
+/* Each returns whether a op b overflows and stores the wrapped or, with
+ * sat, the saturated result */
+static inline uint64_t add_i32(int32_t *r, int32_t a, int32_t b, int sat) {
+    int o = __builtin_add_overflow(a, b, r);
+    if (o && sat) *r = a < 0 ? INT32_MIN : INT32_MAX;
+    return (uint64_t)o;
+}
+
+static inline uint64_t sub_i32(int32_t *r, int32_t a, int32_t b, int sat) {
+    int o = __builtin_sub_overflow(a, b, r);
+    if (o && sat) *r = a < 0 ? INT32_MIN : INT32_MAX;
+    return (uint64_t)o;
+}
+
+static inline uint64_t mul_i32(int32_t *r, int32_t a, int32_t b, int sat) {
+    int o = __builtin_mul_overflow(a, b, r);
+    if (o && sat) *r = (a ^ b) < 0 ? INT32_MIN : INT32_MAX;
+    return (uint64_t)o;
+}
+
+static inline uint64_t add_u32(uint32_t *r, uint32_t a, uint32_t b, int sat) {
+    int o = __builtin_add_overflow(a, b, r);
+    if (o && sat) *r = UINT32_MAX;
+    return (uint64_t)o;
+}
+
+static inline uint64_t sub_u32(uint32_t *r, uint32_t a, uint32_t b, int sat) {
+    int o = __builtin_sub_overflow(a, b, r);
+    if (o && sat) *r = 0;
+    return (uint64_t)o;
+}
+
+static inline uint64_t mul_u32(uint32_t *r, uint32_t a, uint32_t b, int sat) {
+    int o = __builtin_mul_overflow(a, b, r);
+    if (o && sat) *r = UINT32_MAX;
+    return (uint64_t)o;
+}
+
+static inline uint64_t add_i64(int64_t *r, int64_t a, int64_t b, int sat) {
+    int o = __builtin_add_overflow(a, b, r);
+    if (o && sat) *r = a < 0 ? INT64_MIN : INT64_MAX;
+    return (uint64_t)o;
+}
+
+static inline uint64_t sub_i64(int64_t *r, int64_t a, int64_t b, int sat) {
+    int o = __builtin_sub_overflow(a, b, r);
+    if (o && sat) *r = a < 0 ? INT64_MIN : INT64_MAX;
+    return (uint64_t)o;
+}
+
+static inline uint64_t mul_i64(int64_t *r, int64_t a, int64_t b, int sat) {
+    int o = __builtin_mul_overflow(a, b, r);
+    if (o && sat) *r = (a ^ b) < 0 ? INT64_MIN : INT64_MAX;
+    return (uint64_t)o;
+}
+
+#define SCALAR_LOOP(type, fn) \
+    do { \
+        type *pr = (type *)r; \
+        const type *pa = (const type *)a, *pb = (const type *)b; \
+        for (i = 0; i < len; i++) m |= fn(pr + i, pa[i], pb[i], sat) << i; \
+    } while (0)
+
+/* Up to 64 elements of op; the overflow mask */
+static uint64_t block_scalar(int op, void *r, const void *a, const void *b, size_t len, int sat) {
+    uint64_t m = 0;
+    size_t i;
+
+    switch (op) {
+    case NUM_ADD_I32: SCALAR_LOOP(int32_t, add_i32); break;
+    case NUM_SUB_I32: SCALAR_LOOP(int32_t, sub_i32); break;
+    case NUM_MUL_I32: SCALAR_LOOP(int32_t, mul_i32); break;
+    case NUM_ADD_U32: SCALAR_LOOP(uint32_t, add_u32); break;
+    case NUM_SUB_U32: SCALAR_LOOP(uint32_t, sub_u32); break;
+    case NUM_MUL_U32: SCALAR_LOOP(uint32_t, mul_u32); break;
+    case NUM_ADD_I64: SCALAR_LOOP(int64_t, add_i64); break;
+    case NUM_SUB_I64: SCALAR_LOOP(int64_t, sub_i64); break;
+    default: SCALAR_LOOP(int64_t, mul_i64); break;
+    }
+    return m;
+}
+
+/* A 64-element block function over step, which handles lanes elements of
+ * type and returns their overflow bits */
+#define VECTOR_BLOCK(name, target, type, lanes, step) \
+    static target uint64_t name(void *r, const void *a, const void *b, int sat) { \
+        type *pr = (type *)r; \
+        const type *pa = (const type *)a, *pb = (const type *)b; \
+        uint64_t m = 0; \
+        int i; \
+        for (i = 0; i < NUM_BLOCK; i += (lanes)) m |= (uint64_t)step(pr + i, pa + i, pb + i, sat) << i; \
+        return m; \
+    }
+
+#if defined(NUMERIC_HAVE_X86_SIMD)
+/*============================================================================
+ * AVX2
+ *==========================================================================*/
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+/* The sign bits of the 32-bit lanes of v, resp. the 64-bit lanes */
+#define SIGNS32(v) (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(v))
+#define SIGNS64(v) (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(v))
+
+/* The signed bound on the side of x's sign: INT32_MIN when x < 0 */
+static inline AVX2_TARGET __m256i bound_i32_avx2(__m256i x) {
+    return _mm256_xor_si256(_mm256_srai_epi32(x, 31), _mm256_set1_epi32(INT32_MAX));
+}
+
+static inline AVX2_TARGET __m256i bound_i64_avx2(__m256i x) {
+    return _mm256_xor_si256(_mm256_cmpgt_epi64(_mm256_setzero_si256(), x), _mm256_set1_epi64x(INT64_MAX));
+}
+
+/* The high halves of the 64-bit products of the lanes of a and b, each in
+ * the lane it comes from */
+static inline AVX2_TARGET __m256i mul_high_i32_avx2(__m256i a, __m256i b) {
+    __m256i even = _mm256_mul_epi32(a, b);
+    __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+static inline AVX2_TARGET __m256i mul_high_u32_avx2(__m256i a, __m256i b) {
+    __m256i even = _mm256_mul_epu32(a, b);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+
+static inline AVX2_TARGET unsigned int add_i32_avx2(int32_t *pr, const int32_t *pa, const int32_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_add_epi32(a, b);
+    __m256i o = _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r));
+
+    if (sat) r = _mm256_blendv_epi8(r, bound_i32_avx2(a), _mm256_srai_epi32(o, 31));
+    STORE256(pr, r);
+    return SIGNS32(o);
+}
+
+static inline AVX2_TARGET unsigned int sub_i32_avx2(int32_t *pr, const int32_t *pa, const int32_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_sub_epi32(a, b);
+    __m256i o = _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r));
+
+    if (sat) r = _mm256_blendv_epi8(r, bound_i32_avx2(a), _mm256_srai_epi32(o, 31));
+    STORE256(pr, r);
+    return SIGNS32(o);
+}
+
+static inline AVX2_TARGET unsigned int mul_i32_avx2(int32_t *pr, const int32_t *pa, const int32_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_mullo_epi32(a, b);
+    __m256i ok = _mm256_cmpeq_epi32(mul_high_i32_avx2(a, b), _mm256_srai_epi32(r, 31));
+
+    if (sat) r = _mm256_blendv_epi8(bound_i32_avx2(_mm256_xor_si256(a, b)), r, ok);
+    STORE256(pr, r);
+    return SIGNS32(ok) ^ 0xFFu;
+}
+
+static inline AVX2_TARGET unsigned int add_u32_avx2(uint32_t *pr, const uint32_t *pa, const uint32_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_add_epi32(a, b);
+    __m256i ok = _mm256_cmpeq_epi32(_mm256_max_epu32(r, a), r);    /* r >= a */
+
+    if (sat) r = _mm256_or_si256(r, _mm256_xor_si256(ok, _mm256_set1_epi32(-1)));
+    STORE256(pr, r);
+    return SIGNS32(ok) ^ 0xFFu;
+}
+
+static inline AVX2_TARGET unsigned int sub_u32_avx2(uint32_t *pr, const uint32_t *pa, const uint32_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_sub_epi32(a, b);
+    __m256i ok = _mm256_cmpeq_epi32(_mm256_max_epu32(a, b), a);    /* a >= b */
+
+    if (sat) r = _mm256_and_si256(r, ok);
+    STORE256(pr, r);
+    return SIGNS32(ok) ^ 0xFFu;
+}
+
+static inline AVX2_TARGET unsigned int mul_u32_avx2(uint32_t *pr, const uint32_t *pa, const uint32_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_mullo_epi32(a, b);
+    __m256i ok = _mm256_cmpeq_epi32(mul_high_u32_avx2(a, b), _mm256_setzero_si256());
+
+    if (sat) r = _mm256_or_si256(r, _mm256_xor_si256(ok, _mm256_set1_epi32(-1)));
+    STORE256(pr, r);
+    return SIGNS32(ok) ^ 0xFFu;
+}
+
+static inline AVX2_TARGET unsigned int add_i64_avx2(int64_t *pr, const int64_t *pa, const int64_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_add_epi64(a, b);
+    __m256i o = _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r));
+
+    if (sat) {
+        r = _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(r), _mm256_castsi256_pd(bound_i64_avx2(a)),
+                                                 _mm256_castsi256_pd(o)));
+    }
+    STORE256(pr, r);
+    return SIGNS64(o);
+}
+
+static inline AVX2_TARGET unsigned int sub_i64_avx2(int64_t *pr, const int64_t *pa, const int64_t *pb, int sat) {
+    __m256i a = LOAD256(pa), b = LOAD256(pb), r = _mm256_sub_epi64(a, b);
+    __m256i o = _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r));
+
+    if (sat) {
+        r = _mm256_castpd_si256(_mm256_blendv_pd(_mm256_castsi256_pd(r), _mm256_castsi256_pd(bound_i64_avx2(a)),
+                                                 _mm256_castsi256_pd(o)));
+    }
+    STORE256(pr, r);
+    return SIGNS64(o);
+}
+
+VECTOR_BLOCK(add_i32_block_avx2, AVX2_TARGET, int32_t, 8, add_i32_avx2)
+VECTOR_BLOCK(sub_i32_block_avx2, AVX2_TARGET, int32_t, 8, sub_i32_avx2)
+VECTOR_BLOCK(mul_i32_block_avx2, AVX2_TARGET, int32_t, 8, mul_i32_avx2)
+VECTOR_BLOCK(add_u32_block_avx2, AVX2_TARGET, uint32_t, 8, add_u32_avx2)
+VECTOR_BLOCK(sub_u32_block_avx2, AVX2_TARGET, uint32_t, 8, sub_u32_avx2)
+VECTOR_BLOCK(mul_u32_block_avx2, AVX2_TARGET, uint32_t, 8, mul_u32_avx2)
+VECTOR_BLOCK(add_i64_block_avx2, AVX2_TARGET, int64_t, 4, add_i64_avx2)
+VECTOR_BLOCK(sub_i64_block_avx2, AVX2_TARGET, int64_t, 4, sub_i64_avx2)
+
+/*============================================================================
+ * AVX-512
+ *==========================================================================*/
+#define LOAD512(p) _mm512_loadu_si512((const void *)(p))
+#define STORE512(p, v) _mm512_storeu_si512((void *)(p), v)
+
+static inline AVX512_TARGET __m512i bound_i32_avx512(__m512i x) {
+    return _mm512_xor_si512(_mm512_srai_epi32(x, 31), _mm512_set1_epi32(INT32_MAX));
+}
+
+static inline AVX512_TARGET __m512i bound_i64_avx512(__m512i x) {
+    return _mm512_xor_si512(_mm512_srai_epi64(x, 63), _mm512_set1_epi64(INT64_MAX));
+}
+
+static inline AVX512_TARGET __m512i mul_high_i32_avx512(__m512i a, __m512i b) {
+    __m512i even = _mm512_mul_epi32(a, b);
+    __m512i odd = _mm512_mul_epi32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+    return _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+}
+
+static inline AVX512_TARGET __m512i mul_high_u32_avx512(__m512i a, __m512i b) {
+    __m512i even = _mm512_mul_epu32(a, b);
+    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64(a, 32), _mm512_srli_epi64(b, 32));
+    return _mm512_mask_blend_epi32(0xAAAA, _mm512_srli_epi64(even, 32), odd);
+}
+
+static inline AVX512_TARGET unsigned int add_i32_avx512(int32_t *pr, const int32_t *pa, const int32_t *pb, int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_add_epi32(a, b);
+    __m512i o = _mm512_and_si512(_mm512_xor_si512(a, r), _mm512_xor_si512(b, r));
+    __mmask16 k = _mm512_cmplt_epi32_mask(o, _mm512_setzero_si512());
+
+    if (sat) r = _mm512_mask_mov_epi32(r, k, bound_i32_avx512(a));
+    STORE512(pr, r);
+    return k;
+}
+
+static inline AVX512_TARGET unsigned int sub_i32_avx512(int32_t *pr, const int32_t *pa, const int32_t *pb, int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_sub_epi32(a, b);
+    __m512i o = _mm512_and_si512(_mm512_xor_si512(a, b), _mm512_xor_si512(a, r));
+    __mmask16 k = _mm512_cmplt_epi32_mask(o, _mm512_setzero_si512());
+
+    if (sat) r = _mm512_mask_mov_epi32(r, k, bound_i32_avx512(a));
+    STORE512(pr, r);
+    return k;
+}
+
+static inline AVX512_TARGET unsigned int mul_i32_avx512(int32_t *pr, const int32_t *pa, const int32_t *pb, int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_mullo_epi32(a, b);
+    __mmask16 k = _mm512_cmpneq_epi32_mask(mul_high_i32_avx512(a, b), _mm512_srai_epi32(r, 31));
+
+    if (sat) r = _mm512_mask_mov_epi32(r, k, bound_i32_avx512(_mm512_xor_si512(a, b)));
+    STORE512(pr, r);
+    return k;
+}
+
+static inline AVX512_TARGET unsigned int add_u32_avx512(uint32_t *pr, const uint32_t *pa, const uint32_t *pb,
+                                                        int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_add_epi32(a, b);
+    __mmask16 k = _mm512_cmplt_epu32_mask(r, a);
+
+    if (sat) r = _mm512_mask_mov_epi32(r, k, _mm512_set1_epi32(-1));
+    STORE512(pr, r);
+    return k;
+}
+
+static inline AVX512_TARGET unsigned int sub_u32_avx512(uint32_t *pr, const uint32_t *pa, const uint32_t *pb,
+                                                        int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_sub_epi32(a, b);
+    __mmask16 k = _mm512_cmplt_epu32_mask(a, b);
+
+    if (sat) r = _mm512_maskz_mov_epi32((__mmask16)~k, r);
+    STORE512(pr, r);
+    return k;
+}
+
+static inline AVX512_TARGET unsigned int mul_u32_avx512(uint32_t *pr, const uint32_t *pa, const uint32_t *pb,
+                                                        int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_mullo_epi32(a, b);
+    __mmask16 k = _mm512_cmpneq_epi32_mask(mul_high_u32_avx512(a, b), _mm512_setzero_si512());
+
+    if (sat) r = _mm512_mask_mov_epi32(r, k, _mm512_set1_epi32(-1));
+    STORE512(pr, r);
+    return k;
+}
+
+static inline AVX512_TARGET unsigned int add_i64_avx512(int64_t *pr, const int64_t *pa, const int64_t *pb, int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_add_epi64(a, b);
+    __m512i o = _mm512_and_si512(_mm512_xor_si512(a, r), _mm512_xor_si512(b, r));
+    __mmask8 k = _mm512_cmplt_epi64_mask(o, _mm512_setzero_si512());
+
+    if (sat) r = _mm512_mask_mov_epi64(r, k, bound_i64_avx512(a));
+    STORE512(pr, r);
+    return k;
+}
+
+static inline AVX512_TARGET unsigned int sub_i64_avx512(int64_t *pr, const int64_t *pa, const int64_t *pb, int sat) {
+    __m512i a = LOAD512(pa), b = LOAD512(pb), r = _mm512_sub_epi64(a, b);
+    __m512i o = _mm512_and_si512(_mm512_xor_si512(a, b), _mm512_xor_si512(a, r));
+    __mmask8 k = _mm512_cmplt_epi64_mask(o, _mm512_setzero_si512());
+
+    if (sat) r = _mm512_mask_mov_epi64(r, k, bound_i64_avx512(a));
+    STORE512(pr, r);
+    return k;
+}
+
+VECTOR_BLOCK(add_i32_block_avx512, AVX512_TARGET, int32_t, 16, add_i32_avx512)
+VECTOR_BLOCK(sub_i32_block_avx512, AVX512_TARGET, int32_t, 16, sub_i32_avx512)
+VECTOR_BLOCK(mul_i32_block_avx512, AVX512_TARGET, int32_t, 16, mul_i32_avx512)
+VECTOR_BLOCK(add_u32_block_avx512, AVX512_TARGET, uint32_t, 16, add_u32_avx512)
+VECTOR_BLOCK(sub_u32_block_avx512, AVX512_TARGET, uint32_t, 16, sub_u32_avx512)
+VECTOR_BLOCK(mul_u32_block_avx512, AVX512_TARGET, uint32_t, 16, mul_u32_avx512)
+VECTOR_BLOCK(add_i64_block_avx512, AVX512_TARGET, int64_t, 8, add_i64_avx512)
+VECTOR_BLOCK(sub_i64_block_avx512, AVX512_TARGET, int64_t, 8, sub_i64_avx512)
+#endif /* NUMERIC_HAVE_X86_SIMD */
+
+/*============================================================================
+ * DISPATCH
+ *==========================================================================*/
+/* One row per instruction set, indexed by numeric_isa(); NULL where the
+ * scalar loop is all there is */
+static const num_block_fn block_table[][NUM_OPS] = {
+    { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    { add_i32_block_avx2, sub_i32_block_avx2, mul_i32_block_avx2, add_u32_block_avx2, sub_u32_block_avx2,
+      mul_u32_block_avx2, add_i64_block_avx2, sub_i64_block_avx2, NULL },
+    { add_i32_block_avx512, sub_i32_block_avx512, mul_i32_block_avx512, add_u32_block_avx512, sub_u32_block_avx512,
+      mul_u32_block_avx512, add_i64_block_avx512, sub_i64_block_avx512, NULL }
+#endif
+};
+
+/* op over n elements of width bytes; with sat the number of overflows,
+ * otherwise the index of the first */
+static size_t run(int op, size_t width, void *r, const void *a, const void *b, size_t n, uint64_t *mask, int sat) {
+    num_block_fn block = block_table[numeric_isa()][op];
+    size_t first = n, count = 0, i;
+    uint64_t m;
+
+    for (i = 0; i < n; i += NUM_BLOCK) {
+        size_t off = i * width, len = n - i < NUM_BLOCK ? n - i : NUM_BLOCK;
+
+        if (block != NULL && len == NUM_BLOCK) {
+            m = block((char *)r + off, (const char *)a + off, (const char *)b + off, sat);
+        } else {
+            m = block_scalar(op, (char *)r + off, (const char *)a + off, (const char *)b + off, len, sat);
+        }
+        if (mask != NULL) mask[i / NUM_BLOCK] = m;
+        if (m != 0) {
+            if (first == n) first = i + (size_t)__builtin_ctzll(m);
+            count += (size_t)__builtin_popcountll(m);
+        }
+    }
+    return sat ? count : first;
+}
+
+size_t num_add_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_ADD_I32, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_sub_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_SUB_I32, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_mul_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_MUL_I32, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_add_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_ADD_U32, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_sub_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_SUB_U32, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_mul_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_MUL_U32, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_add_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_ADD_I64, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_sub_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_SUB_I64, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_mul_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_MUL_I64, sizeof(*r), r, a, b, n, mask, 0);
+}
+
+size_t num_add_sat_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_ADD_I32, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_sub_sat_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_SUB_I32, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_mul_sat_i32(int32_t *r, const int32_t *a, const int32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_MUL_I32, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_add_sat_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_ADD_U32, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_sub_sat_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_SUB_U32, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_mul_sat_u32(uint32_t *r, const uint32_t *a, const uint32_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_MUL_U32, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_add_sat_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_ADD_I64, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_sub_sat_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_SUB_I64, sizeof(*r), r, a, b, n, mask, 1);
+}
+
+size_t num_mul_sat_i64(int64_t *r, const int64_t *a, const int64_t *b, size_t n, uint64_t *mask) {
+    return run(NUM_MUL_I64, sizeof(*r), r, a, b, n, mask, 1);
+}
@@ -0,0 +1,442 @@
+/**
+ * Backend behind lib_numeric.h.
+ * Narrowing integer conversions with AVX-512, AVX2 and scalar
+ * implementations.
+ *
+ * A conversion is reduced to a range in the source type, [lo, hi]: the
+ * destination's range intersected with the source's, so that both bounds
+ * fit in a source lane. A value fits when it lies in the range, compared
+ * signed or unsigned as the source is; saturation clamps it to the range
+ * with a minimum and a maximum. What is left is a truncation, which is
+ * exact for the values in range:
+ *   - AVX-512 has it as an instruction for every narrowing (VPMOVQD,
+ *     VPMOVQW, VPMOVQB, VPMOVDW, VPMOVDB, VPMOVWB);
+ *   - AVX2 only has saturating packs, which truncate exactly once the
+ *     values are in range. Truncation mode brings them there first by
+ *     sign or zero extending their low-order bits within the lane. 64-bit
+ *     lanes are first reduced to their low halves with a shuffle, and the
+ *     packs, which work within 128-bit halves, are followed by a permute
+ *     that restores the element order.
+ * The comparisons yield one mask bit per element, 64 elements making one
+ * word of the caller's mask, as for the checked arithmetic.
+ *
+ * Each kernel is compiled once per signedness of the source and mode, so
+ * that its loop tests neither: with the tests the loops ran at about half
+ * the speed.
+ *
+ * NUM_CHECK must not store anything from the first value that does not
+ * fit. The kernels compare a step's elements before storing them and
+ * return without storing when one does not fit; the scalar code then
+ * converts the values of that block before it, storing some of them a
+ * second time, which is why dst and src must not overlap.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "lib_numeric_internal.h"
+
+#define NUM_BLOCK 64    /* elements per mask word */
+
+/* A conversion as the kernels see it */
+typedef struct num_conv {
+    unsigned int src_width;         /* bytes */
+    unsigned int dst_width;
+    int src_signed;
+    int dst_signed;
+    int64_t lo;                     /* the range that fits, in the source type */
+    uint64_t hi;
+    enum num_narrow_mode mode;
+} num_conv;
+
+/* The 64 elements from dst and src; the mask of those that do not fit.
+ * With NUM_CHECK it returns at the first step holding one, having stored
+ * the steps before it only */
+typedef uint64_t (*num_conv_fn)(const num_conv *c, void *dst, const void *src);
+
+static unsigned int type_width(enum num_type t) {
+    return 1u << ((unsigned int)t >> 1);
+}
+
+static int type_signed(enum num_type t) {
+    return ((unsigned int)t & 1) == 0;
+}
+
+static int64_t type_min(enum num_type t) {
+    return type_signed(t) ? (int64_t)(UINT64_MAX << (8 * type_width(t) - 1)) : 0;
+}
+
+static uint64_t type_max(enum num_type t) {
+    return UINT64_MAX >> (64 - 8 * type_width(t) + type_signed(t));
+}
+
+/*============================================================================
+ * SCALAR
+ *==========================================================================*/
+/* Element i of src, sign or zero extended */
+static inline uint64_t load_elem(const num_conv *c, const void *src, size_t i) {
+    switch (c->src_width) {
+    case 1: return c->src_signed ? (uint64_t)((const int8_t *)src)[i] : ((const uint8_t *)src)[i];
+    case 2: return c->src_signed ? (uint64_t)((const int16_t *)src)[i] : ((const uint16_t *)src)[i];
+    case 4: return c->src_signed ? (uint64_t)((const int32_t *)src)[i] : ((const uint32_t *)src)[i];
+    default: return ((const uint64_t *)src)[i];
+    }
+}
+
+/* The low-order bytes of v as element i of dst */
+static inline void store_elem(const num_conv *c, void *dst, size_t i, uint64_t v) {
+    switch (c->dst_width) {
+    case 1: ((uint8_t *)dst)[i] = (uint8_t)v; break;
+    case 2: ((uint16_t *)dst)[i] = (uint16_t)v; break;
+    case 4: ((uint32_t *)dst)[i] = (uint32_t)v; break;
+    default: ((uint64_t *)dst)[i] = v; break;
+    }
+}
+
+/* Up to 64 elements; the mask of those that do not fit, with NUM_CHECK
+ * stopping at the first */
+static uint64_t conv_scalar(const num_conv *c, void *dst, const void *src, size_t len) {
+    uint64_t m = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        uint64_t v = load_elem(c, src, i);
+        int below = c->src_signed && (int64_t)v < c->lo;
+        int above = c->src_signed ? (int64_t)v > (int64_t)c->hi : v > c->hi;
+
+        if (below || above) {
+            if (c->mode == NUM_CHECK) return m | (uint64_t)1 << i;
+            if (c->mode == NUM_SATURATE) v = below ? (uint64_t)c->lo : c->hi;
+            m |= (uint64_t)1 << i;
+        }
+        store_elem(c, dst, i, v);
+    }
+    return m;
+}
+
+#if defined(NUMERIC_HAVE_X86_SIMD)
+#define BODY static inline __attribute__((always_inline))
+
+/* A num_conv_fn over block, which converts the block with the signedness
+ * and mode it is given as constants: every combination gets its own copy
+ * of the loop, without tests on them */
+#define KERNEL(name, target, block) \
+    static target uint64_t name(const num_conv *c, void *dst, const void *src) { \
+        if (c->src_signed) { \
+            if (c->mode == NUM_TRUNCATE) return block(c, dst, src, 1, NUM_TRUNCATE); \
+            if (c->mode == NUM_SATURATE) return block(c, dst, src, 1, NUM_SATURATE); \
+            return block(c, dst, src, 1, NUM_CHECK); \
+        } \
+        if (c->mode == NUM_TRUNCATE) return block(c, dst, src, 0, NUM_TRUNCATE); \
+        if (c->mode == NUM_SATURATE) return block(c, dst, src, 0, NUM_SATURATE); \
+        return block(c, dst, src, 0, NUM_CHECK); \
+    }
+/*============================================================================
+ * AVX2
+ *==========================================================================*/
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define STORE256(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+
+/* Stores the 16 elements of the 32-bit lanes of a and b, in range unless
+ * truncating, at d */
+BODY AVX2_TARGET void store16_avx2(unsigned char *d, __m256i a, __m256i b, unsigned int dw, int dst_signed,
+                                   enum num_narrow_mode mode) {
+    __m256i x;
+
+    if (dw == 4) {
+        STORE256(d, a);
+        STORE256(d + 32, b);
+        return;
+    }
+    if (mode == NUM_TRUNCATE) {
+        int shift = 32 - 8 * (int)dw;
+
+        if (dst_signed) {
+            a = _mm256_srai_epi32(_mm256_slli_epi32(a, shift), shift);
+            b = _mm256_srai_epi32(_mm256_slli_epi32(b, shift), shift);
+        } else {
+            a = _mm256_and_si256(a, _mm256_set1_epi32((int)(0xFFFFFFFFu >> shift)));
+            b = _mm256_and_si256(b, _mm256_set1_epi32((int)(0xFFFFFFFFu >> shift)));
+        }
+    }
+    /* a0-3 b0-3 | a4-7 b4-7, then a0-7 | b0-7 */
+    x = dw == 2 && !dst_signed ? _mm256_packus_epi32(a, b) : _mm256_packs_epi32(a, b);
+    x = _mm256_permute4x64_epi64(x, 0xD8);
+    if (dw == 2) {
+        STORE256(d, x);
+        return;
+    }
+    /* a0-7 a0-7 | b0-7 b0-7, then a0-7 b0-7 in the low half */
+    x = dst_signed ? _mm256_packs_epi16(x, x) : _mm256_packus_epi16(x, x);
+    x = _mm256_permute4x64_epi64(x, 0x08);
+    _mm_storeu_si128((__m128i *)d, _mm256_castsi256_si128(x));
+}
+
+/* Whether each 32-bit lane of v lies outside [lo, hi]; clamps it there
+ * when saturating */
+BODY AVX2_TARGET __m256i range32_avx2(__m256i *v, __m256i lo, __m256i hi, int sgn, enum num_narrow_mode mode) {
+    __m256i out;
+
+    if (sgn) {
+        out = _mm256_or_si256(_mm256_cmpgt_epi32(lo, *v), _mm256_cmpgt_epi32(*v, hi));
+        if (mode == NUM_SATURATE) *v = _mm256_min_epi32(_mm256_max_epi32(*v, lo), hi);
+    } else {
+        out = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_min_epu32(*v, hi), *v), _mm256_set1_epi32(-1));
+        if (mode == NUM_SATURATE) *v = _mm256_min_epu32(*v, hi);
+    }
+    return out;
+}
+
+BODY AVX2_TARGET uint64_t conv32_block_avx2(const num_conv *c, void *dst, const void *src, int sgn,
+                                           enum num_narrow_mode mode) {
+    const int32_t *s = (const int32_t *)src;
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned int dw = c->dst_width;
+    const int dst_signed = c->dst_signed;
+    __m256i lo = _mm256_set1_epi32((int32_t)c->lo), hi = _mm256_set1_epi32((int32_t)(uint32_t)c->hi);
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < NUM_BLOCK; i += 16) {
+        __m256i a = LOAD256(s + i), b = LOAD256(s + i + 8);
+        __m256i oa = range32_avx2(&a, lo, hi, sgn, mode), ob = range32_avx2(&b, lo, hi, sgn, mode);
+        uint64_t k = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(oa)) |
+                     (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(ob)) << 8;
+
+        if (k != 0 && mode == NUM_CHECK) return m | k << i;
+        store16_avx2(d + (size_t)i * dw, a, b, dw, dst_signed, mode);
+        m |= k << i;
+    }
+    return m;
+}
+
+KERNEL(conv32_avx2, AVX2_TARGET, conv32_block_avx2)
+
+/* As range32_avx2, for 64-bit lanes */
+BODY AVX2_TARGET __m256i range64_avx2(__m256i *v, __m256i lo, __m256i hi, int sgn, enum num_narrow_mode mode) {
+    __m256i below, above;
+
+    if (sgn) {
+        below = _mm256_cmpgt_epi64(lo, *v);
+        above = _mm256_cmpgt_epi64(*v, hi);
+        if (mode == NUM_SATURATE) {
+            *v = _mm256_blendv_epi8(*v, lo, below);
+            *v = _mm256_blendv_epi8(*v, hi, above);
+        }
+        return _mm256_or_si256(below, above);
+    }
+    above = _mm256_cmpgt_epi64(_mm256_xor_si256(*v, _mm256_set1_epi64x(INT64_MIN)),
+                               _mm256_xor_si256(hi, _mm256_set1_epi64x(INT64_MIN)));
+    if (mode == NUM_SATURATE) *v = _mm256_blendv_epi8(*v, hi, above);
+    return above;
+}
+
+/* The low halves of the 64-bit lanes of a, then of b */
+static inline AVX2_TARGET __m256i low_halves_avx2(__m256i a, __m256i b) {
+    __m256 x = _mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _MM_SHUFFLE(2, 0, 2, 0));
+    return _mm256_permute4x64_epi64(_mm256_castps_si256(x), 0xD8);
+}
+
+BODY AVX2_TARGET uint64_t conv64_block_avx2(const num_conv *c, void *dst, const void *src, int sgn,
+                                           enum num_narrow_mode mode) {
+    const int64_t *s = (const int64_t *)src;
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned int dw = c->dst_width;
+    const int dst_signed = c->dst_signed;
+    __m256i lo = _mm256_set1_epi64x(c->lo), hi = _mm256_set1_epi64x((int64_t)c->hi);
+    uint64_t m = 0;
+    int i, j;
+
+    for (i = 0; i < NUM_BLOCK; i += 16) {
+        __m256i v[4];
+        uint64_t k = 0;
+
+        for (j = 0; j < 4; j++) {
+            v[j] = LOAD256(s + i + 4 * j);
+            k |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(range64_avx2(&v[j], lo, hi, sgn, mode))) << (4 * j);
+        }
+        if (k != 0 && mode == NUM_CHECK) return m | k << i;
+        if (dw == 8) {
+            for (j = 0; j < 4; j++) STORE256(d + (size_t)(i + 4 * j) * 8, v[j]);
+        } else {
+            store16_avx2(d + (size_t)i * dw, low_halves_avx2(v[0], v[1]), low_halves_avx2(v[2], v[3]), dw,
+                         dst_signed, mode);
+        }
+        m |= k << i;
+    }
+    return m;
+}
+
+KERNEL(conv64_avx2, AVX2_TARGET, conv64_block_avx2)
+
+/*============================================================================
+ * AVX-512
+ *==========================================================================*/
+BODY AVX512_TARGET uint64_t conv16_block_avx512(const num_conv *c, void *dst, const void *src, int sgn,
+                                               enum num_narrow_mode mode) {
+    const int16_t *s = (const int16_t *)src;
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned int dw = c->dst_width;
+    __m512i lo = _mm512_set1_epi16((int16_t)c->lo), hi = _mm512_set1_epi16((int16_t)(uint16_t)c->hi);
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < NUM_BLOCK; i += 32) {
+        __m512i v = _mm512_loadu_si512((const void *)(s + i));
+        uint64_t k;
+
+        if (sgn) {
+            k = _mm512_cmplt_epi16_mask(v, lo) | _mm512_cmpgt_epi16_mask(v, hi);
+            if (mode == NUM_SATURATE) v = _mm512_min_epi16(_mm512_max_epi16(v, lo), hi);
+        } else {
+            k = _mm512_cmpgt_epu16_mask(v, hi);
+            if (mode == NUM_SATURATE) v = _mm512_min_epu16(v, hi);
+        }
+        if (k != 0 && mode == NUM_CHECK) return m | k << i;
+        if (dw == 2) _mm512_storeu_si512((void *)(d + 2 * i), v);
+        else _mm256_storeu_si256((__m256i *)(d + i), _mm512_cvtepi16_epi8(v));
+        m |= k << i;
+    }
+    return m;
+}
+
+KERNEL(conv16_avx512, AVX512_TARGET, conv16_block_avx512)
+
+BODY AVX512_TARGET uint64_t conv32_block_avx512(const num_conv *c, void *dst, const void *src, int sgn,
+                                               enum num_narrow_mode mode) {
+    const int32_t *s = (const int32_t *)src;
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned int dw = c->dst_width;
+    __m512i lo = _mm512_set1_epi32((int32_t)c->lo), hi = _mm512_set1_epi32((int32_t)(uint32_t)c->hi);
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < NUM_BLOCK; i += 16) {
+        __m512i v = _mm512_loadu_si512((const void *)(s + i));
+        uint64_t k;
+
+        if (sgn) {
+            k = (unsigned int)(_mm512_cmplt_epi32_mask(v, lo) | _mm512_cmpgt_epi32_mask(v, hi));
+            if (mode == NUM_SATURATE) v = _mm512_min_epi32(_mm512_max_epi32(v, lo), hi);
+        } else {
+            k = _mm512_cmpgt_epu32_mask(v, hi);
+            if (mode == NUM_SATURATE) v = _mm512_min_epu32(v, hi);
+        }
+        if (k != 0 && mode == NUM_CHECK) return m | k << i;
+        switch (dw) {
+        case 4: _mm512_storeu_si512((void *)(d + 4 * i), v); break;
+        case 2: _mm256_storeu_si256((__m256i *)(d + 2 * i), _mm512_cvtepi32_epi16(v)); break;
+        default: _mm_storeu_si128((__m128i *)(d + i), _mm512_cvtepi32_epi8(v)); break;
+        }
+        m |= k << i;
+    }
+    return m;
+}
+
+KERNEL(conv32_avx512, AVX512_TARGET, conv32_block_avx512)
+
+BODY AVX512_TARGET uint64_t conv64_block_avx512(const num_conv *c, void *dst, const void *src, int sgn,
+                                               enum num_narrow_mode mode) {
+    const int64_t *s = (const int64_t *)src;
+    unsigned char *d = (unsigned char *)dst;
+    const unsigned int dw = c->dst_width;
+    __m512i lo = _mm512_set1_epi64(c->lo), hi = _mm512_set1_epi64((int64_t)c->hi);
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < NUM_BLOCK; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void *)(s + i));
+        uint64_t k;
+
+        if (sgn) {
+            k = (unsigned int)(_mm512_cmplt_epi64_mask(v, lo) | _mm512_cmpgt_epi64_mask(v, hi));
+            if (mode == NUM_SATURATE) v = _mm512_min_epi64(_mm512_max_epi64(v, lo), hi);
+        } else {
+            k = _mm512_cmpgt_epu64_mask(v, hi);
+            if (mode == NUM_SATURATE) v = _mm512_min_epu64(v, hi);
+        }
+        if (k != 0 && mode == NUM_CHECK) return m | k << i;
+        switch (dw) {
+        case 8: _mm512_storeu_si512((void *)(d + 8 * i), v); break;
+        case 4: _mm256_storeu_si256((__m256i *)(d + 4 * i), _mm512_cvtepi64_epi32(v)); break;
+        case 2: _mm_storeu_si128((__m128i *)(d + 2 * i), _mm512_cvtepi64_epi16(v)); break;
+        default: _mm_storel_epi64((__m128i *)(d + i), _mm512_cvtepi64_epi8(v)); break;
+        }
+        m |= k << i;
+    }
+    return m;
+}
+
+KERNEL(conv64_avx512, AVX512_TARGET, conv64_block_avx512)
+#endif /* NUMERIC_HAVE_X86_SIMD */
+
+/*============================================================================
+ * DISPATCH
+ *==========================================================================*/
+/* The kernel for c at the instruction set in use; NULL where the scalar
+ * loop is all there is */
+static num_conv_fn conv_kernel(const num_conv *c) {
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    int level = numeric_isa();
+
+    if (c->dst_width > c->src_width) return NULL;
+    if (level == NUMERIC_AVX512) {
+        switch (c->src_width) {
+        case 2: return conv16_avx512;
+        case 4: return conv32_avx512;
+        case 8: return conv64_avx512;
+        default: return NULL;
+        }
+    }
+    if (level == NUMERIC_AVX2) {
+        switch (c->src_width) {
+        case 4: return conv32_avx2;
+        case 8: return conv64_avx2;
+        default: return NULL;
+        }
+    }
+#endif
+    (void)c;
+    return NULL;
+}
+
+num_narrow_result num_narrow(void *dst, enum num_type dst_type, const void *src, enum num_type src_type, size_t n,
+                             enum num_narrow_mode mode, uint64_t *mask) {
+    num_narrow_result res = { 0, n };
+    num_conv c;
+    num_conv_fn kernel;
+    size_t i;
+
+    c.src_width = type_width(src_type);
+    c.dst_width = type_width(dst_type);
+    c.src_signed = type_signed(src_type);
+    c.dst_signed = type_signed(dst_type);
+    c.lo = type_min(dst_type) > type_min(src_type) ? type_min(dst_type) : type_min(src_type);
+    c.hi = type_max(dst_type) < type_max(src_type) ? type_max(dst_type) : type_max(src_type);
+    c.mode = mode;
+    kernel = conv_kernel(&c);
+
+    for (i = 0; i < n; i += NUM_BLOCK) {
+        size_t len = n - i < NUM_BLOCK ? n - i : NUM_BLOCK;
+        unsigned char *d = (unsigned char *)dst + i * c.dst_width;
+        const unsigned char *s = (const unsigned char *)src + i * c.src_width;
+        uint64_t m;
+
+        m = kernel != NULL && len == NUM_BLOCK ? kernel(&c, d, s) : conv_scalar(&c, d, s, len);
+        if (m != 0 && mode == NUM_CHECK) {
+            res.lossy = 1;
+            res.first = i + (size_t)__builtin_ctzll(m);
+            (void)conv_scalar(&c, d, s, res.first - i);
+            if (mask != NULL) {
+                mask[i / NUM_BLOCK] = m & -m;
+                memset(mask + i / NUM_BLOCK + 1, 0, ((n + NUM_BLOCK - 1) / NUM_BLOCK - i / NUM_BLOCK - 1) * 8);
+            }
+            return res;
+        }
+        if (mask != NULL) mask[i / NUM_BLOCK] = m;
+        if (m != 0) {
+            if (res.lossy == 0) res.first = i + (size_t)__builtin_ctzll(m);
+            res.lossy += (size_t)__builtin_popcountll(m);
+        }
+    }
+    return res;
+}
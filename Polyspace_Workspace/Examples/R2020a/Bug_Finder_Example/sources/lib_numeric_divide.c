@@ -0,0 +1,337 @@
+/**
+ * Backend behind lib_numeric.h.
+ * Division by invariant divisors: the multiplier and shift computed once
+ * per divisor, and the array forms with AVX-512, AVX2 and scalar
+ * implementations.
+ *
+ * This is Granlund and Montgomery's method as libdivide arranges it. For a
+ * divisor d that is not a power of two, with l = floor(log2 |d|), the
+ * multiplier is m = floor(2^(N + l) / |d|) + 1 (N = 32 or 64): the high
+ * half of n * m, shifted right by l, is then n / d for every N-bit n when
+ * the rounding error of m is small enough, i.e. when |d| - 2^(N + l) % |d|
+ * is below 2^l. Otherwise m needs N + 1 bits: its top bit becomes the
+ * numerator added back to the high half (halved first, for unsigned
+ * divisors, so that the sum cannot carry out). Signed divisors take one
+ * bit less, the sign of the quotient correcting it toward zero, and the
+ * negative ones a negated multiplier. Powers of two only shift, with a
+ * bias that rounds negative numerators toward zero.
+ *
+ * The scalar code for unsigned 32-bit divisors uses Lemire, Kaser and
+ * Kurz's variant instead: with c = ceil(2^64 / d), the quotient is the
+ * high half of c * n, and the remainder the high half of the low half of
+ * that product times d, exact for all 32-bit n and d. Two multiplications
+ * without shift or branch made the remainder, which hash bucketing takes,
+ * three times as fast as the division instruction where Granlund and
+ * Montgomery's sequence was only a third faster.
+ *
+ * The 32-bit array forms take the high halves of the products of the even
+ * and odd lanes with two 32 x 32-bit multiplications to 64 bits, as the
+ * checked multiplication does, and are otherwise the scalar code on vector
+ * types: their arithmetic operators let one body serve AVX2 and AVX-512.
+ * The remainders are n - q * d, with a 32-bit multiplication.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "lib_numeric_internal.h"
+
+/* (hi * 2^64) / d and its remainder, for hi < d, by long division */
+static uint64_t div_128_64(uint64_t hi, uint64_t d, uint64_t *rem) {
+    uint64_t q = 0;
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        uint64_t carry = hi >> 63;
+
+        hi <<= 1;
+        q <<= 1;
+        if (carry || hi >= d) {
+            hi -= d;
+            q |= 1;
+        }
+    }
+    *rem = hi;
+    return q;
+}
+
+/*============================================================================
+ * DIVISORS
+ *==========================================================================*/
+int num_divisor_u32_init(num_divisor_u32 *d, uint32_t divisor) {
+    unsigned int l;
+    uint64_t m, rem;
+
+    if (divisor == 0) return -1;
+    l = 31 - (unsigned int)__builtin_clz(divisor);
+    d->divisor = divisor;
+    d->shift = (uint8_t)l;
+    d->add = 0;
+    d->fastmod = 0;
+    if ((divisor & (divisor - 1)) == 0) {
+        d->magic = 0;
+        return 0;
+    }
+    d->fastmod = UINT64_MAX / divisor + 1;
+    m = ((uint64_t)1 << (32 + l)) / divisor;
+    rem = ((uint64_t)1 << (32 + l)) % divisor;
+    if (divisor - rem >= (uint64_t)1 << l) {
+        m += m;
+        if (2 * rem >= divisor) m++;
+        d->add = 1;
+    }
+    d->magic = (uint32_t)(m + 1);
+    return 0;
+}
+
+int num_divisor_s32_init(num_divisor_s32 *d, int32_t divisor) {
+    uint32_t abs_d = divisor < 0 ? -(uint32_t)divisor : (uint32_t)divisor;
+    unsigned int l;
+    uint64_t m, rem;
+
+    if (divisor == 0) return -1;
+    l = 31 - (unsigned int)__builtin_clz(abs_d);
+    d->divisor = divisor;
+    d->negative = divisor < 0;
+    d->shift = (uint8_t)l;
+    d->add = 0;
+    if ((abs_d & (abs_d - 1)) == 0) {
+        d->magic = 0;
+        return 0;
+    }
+    m = ((uint64_t)1 << (31 + l)) / abs_d;
+    rem = ((uint64_t)1 << (31 + l)) % abs_d;
+    if (abs_d - rem < (uint64_t)1 << l) {
+        d->shift = (uint8_t)(l - 1);
+    } else {
+        m += m;
+        if (2 * rem >= abs_d) m++;
+        d->add = 1;
+    }
+    m = (uint32_t)(m + 1);
+    d->magic = (int32_t)(d->negative ? -(uint32_t)m : (uint32_t)m);
+    return 0;
+}
+
+int num_divisor_u64_init(num_divisor_u64 *d, uint64_t divisor) {
+    unsigned int l;
+    uint64_t m, rem;
+
+    if (divisor == 0) return -1;
+    l = 63 - (unsigned int)__builtin_clzll(divisor);
+    d->divisor = divisor;
+    d->shift = (uint8_t)l;
+    d->add = 0;
+    if ((divisor & (divisor - 1)) == 0) {
+        d->magic = 0;
+        return 0;
+    }
+    m = div_128_64((uint64_t)1 << l, divisor, &rem);
+    if (divisor - rem >= (uint64_t)1 << l) {
+        m += m;
+        if (rem + rem >= divisor || rem + rem < rem) m++;
+        d->add = 1;
+    }
+    d->magic = m + 1;
+    return 0;
+}
+
+int num_divisor_s64_init(num_divisor_s64 *d, int64_t divisor) {
+    uint64_t abs_d = divisor < 0 ? -(uint64_t)divisor : (uint64_t)divisor;
+    unsigned int l;
+    uint64_t m, rem;
+
+    if (divisor == 0) return -1;
+    l = 63 - (unsigned int)__builtin_clzll(abs_d);
+    d->divisor = divisor;
+    d->negative = divisor < 0;
+    d->shift = (uint8_t)l;
+    d->add = 0;
+    if ((abs_d & (abs_d - 1)) == 0) {
+        d->magic = 0;
+        return 0;
+    }
+    m = div_128_64((uint64_t)1 << (l - 1), abs_d, &rem);
+    if (abs_d - rem < (uint64_t)1 << l) {
+        d->shift = (uint8_t)(l - 1);
+    } else {
+        m += m;
+        if (rem + rem >= abs_d || rem + rem < rem) m++;
+        d->add = 1;
+    }
+    m++;
+    d->magic = (int64_t)(d->negative ? -m : m);
+    return 0;
+}
+
+/*============================================================================
+ * VECTOR KERNELS
+ *==========================================================================*/
+#if defined(NUMERIC_HAVE_X86_SIMD)
+#define BODY static inline __attribute__((always_inline))
+
+typedef uint32_t u32x8 __attribute__((vector_size(32)));
+typedef int32_t i32x8 __attribute__((vector_size(32)));
+typedef uint32_t u32x16 __attribute__((vector_size(64)));
+typedef int32_t i32x16 __attribute__((vector_size(64)));
+
+/* The high halves of the 32 x 32-bit products of the lanes of a and m */
+BODY AVX2_TARGET u32x8 mulhi_u32_avx2(u32x8 a, u32x8 m) {
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epu32((__m256i)a, (__m256i)m), 32);
+    __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64((__m256i)a, 32), (__m256i)m);
+
+    return (u32x8)_mm256_blend_epi32(even, odd, 0xAA);
+}
+
+BODY AVX2_TARGET i32x8 mulhi_s32_avx2(i32x8 a, i32x8 m) {
+    __m256i even = _mm256_srli_epi64(_mm256_mul_epi32((__m256i)a, (__m256i)m), 32);
+    __m256i odd = _mm256_mul_epi32(_mm256_srli_epi64((__m256i)a, 32), (__m256i)m);
+
+    return (i32x8)_mm256_blend_epi32(even, odd, 0xAA);
+}
+
+BODY AVX512_TARGET u32x16 mulhi_u32_avx512(u32x16 a, u32x16 m) {
+    __m512i even = _mm512_srli_epi64(_mm512_mul_epu32((__m512i)a, (__m512i)m), 32);
+    __m512i odd = _mm512_mul_epu32(_mm512_srli_epi64((__m512i)a, 32), (__m512i)m);
+
+    return (u32x16)_mm512_mask_blend_epi32(0xAAAA, even, odd);
+}
+
+BODY AVX512_TARGET i32x16 mulhi_s32_avx512(i32x16 a, i32x16 m) {
+    __m512i even = _mm512_srli_epi64(_mm512_mul_epi32((__m512i)a, (__m512i)m), 32);
+    __m512i odd = _mm512_mul_epi32(_mm512_srli_epi64((__m512i)a, 32), (__m512i)m);
+
+    return (i32x16)_mm512_mask_blend_epi32(0xAAAA, even, odd);
+}
+
+/* divmod_u32_<isa> and divmod_s32_<isa> over the vector types U and I of W
+ * lanes: the quotients and remainders of the first count - count % W
+ * numerators, the number done. Each body is compiled once per kind of
+ * divisor, given as constants, so that its loop tests none */
+#define DIV_KERNELS(isa, target, U, I, W) \
+    BODY target size_t divmod_u32_##isa##_body(uint32_t *q, uint32_t *r, const uint32_t *n, size_t count, \
+                                               const num_divisor_u32 *d, int pow2, int add) { \
+        U zero = { 0 }, magic = zero + d->magic, divisor = zero + d->divisor; \
+        unsigned int shift = d->shift; \
+        size_t i; \
+        \
+        for (i = 0; i + W <= count; i += W) { \
+            U v, quot; \
+            \
+            memcpy(&v, n + i, sizeof(v)); \
+            if (pow2) { \
+                quot = v >> shift; \
+            } else { \
+                quot = mulhi_u32_##isa(v, magic); \
+                if (add) quot += (v - quot) >> 1; \
+                quot >>= shift; \
+            } \
+            if (q != NULL) memcpy(q + i, &quot, sizeof(quot)); \
+            if (r != NULL) { \
+                v -= quot * divisor; \
+                memcpy(r + i, &v, sizeof(v)); \
+            } \
+        } \
+        return i; \
+    } \
+    \
+    static target size_t divmod_u32_##isa(uint32_t *q, uint32_t *r, const uint32_t *n, size_t count, \
+                                          const num_divisor_u32 *d) { \
+        if (d->magic == 0) return divmod_u32_##isa##_body(q, r, n, count, d, 1, 0); \
+        if (d->add) return divmod_u32_##isa##_body(q, r, n, count, d, 0, 1); \
+        return divmod_u32_##isa##_body(q, r, n, count, d, 0, 0); \
+    } \
+    \
+    BODY target size_t divmod_s32_##isa##_body(int32_t *q, int32_t *r, const int32_t *n, size_t count, \
+                                               const num_divisor_s32 *d, int pow2, int add) { \
+        I zero = { 0 }, magic = zero + d->magic, divisor = zero + d->divisor; \
+        I sign = zero - d->negative, bias = zero + (int32_t)((UINT32_C(1) << d->shift) - 1); \
+        unsigned int shift = d->shift; \
+        size_t i; \
+        \
+        for (i = 0; i + W <= count; i += W) { \
+            I v, quot; \
+            \
+            memcpy(&v, n + i, sizeof(v)); \
+            if (pow2) { \
+                quot = (I)((U)v + (U)((v >> 31) & bias)) >> shift; \
+                quot = (I)(((U)quot ^ (U)sign) - (U)sign); \
+            } else { \
+                quot = mulhi_s32_##isa(v, magic); \
+                if (add) quot = (I)((U)quot + (((U)v ^ (U)sign) - (U)sign)); \
+                quot >>= shift; \
+                quot = (I)((U)quot + ((U)quot >> 31)); \
+            } \
+            if (q != NULL) memcpy(q + i, &quot, sizeof(quot)); \
+            if (r != NULL) { \
+                v = (I)((U)v - (U)quot * (U)divisor); \
+                memcpy(r + i, &v, sizeof(v)); \
+            } \
+        } \
+        return i; \
+    } \
+    \
+    static target size_t divmod_s32_##isa(int32_t *q, int32_t *r, const int32_t *n, size_t count, \
+                                          const num_divisor_s32 *d) { \
+        if (d->magic == 0) return divmod_s32_##isa##_body(q, r, n, count, d, 1, 0); \
+        if (d->add) return divmod_s32_##isa##_body(q, r, n, count, d, 0, 1); \
+        return divmod_s32_##isa##_body(q, r, n, count, d, 0, 0); \
+    }
+
+DIV_KERNELS(avx2, AVX2_TARGET, u32x8, i32x8, 8)
+DIV_KERNELS(avx512, AVX512_TARGET, u32x16, i32x16, 16)
+#endif /* NUMERIC_HAVE_X86_SIMD */
+
+/*============================================================================
+ * ARRAYS
+ *==========================================================================*/
+void num_divmod_u32_array(uint32_t *q, uint32_t *r, const uint32_t *n, size_t count, const num_divisor_u32 *d) {
+    size_t i = 0;
+
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    if (numeric_isa() == NUMERIC_AVX512) i = divmod_u32_avx512(q, r, n, count, d);
+    else if (numeric_isa() == NUMERIC_AVX2) i = divmod_u32_avx2(q, r, n, count, d);
+#endif
+    for (; i < count; i++) {
+        uint32_t v = n[i], quot = num_div_u32(v, d);
+
+        if (q != NULL) q[i] = quot;
+        if (r != NULL) r[i] = v - quot * d->divisor;
+    }
+}
+
+void num_divmod_s32_array(int32_t *q, int32_t *r, const int32_t *n, size_t count, const num_divisor_s32 *d) {
+    size_t i = 0;
+
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    if (numeric_isa() == NUMERIC_AVX512) i = divmod_s32_avx512(q, r, n, count, d);
+    else if (numeric_isa() == NUMERIC_AVX2) i = divmod_s32_avx2(q, r, n, count, d);
+#endif
+    for (; i < count; i++) {
+        int32_t v = n[i], quot = num_div_s32(v, d);
+
+        if (q != NULL) q[i] = quot;
+        if (r != NULL) r[i] = (int32_t)((uint32_t)v - (uint32_t)quot * (uint32_t)d->divisor);
+    }
+}
+
+void num_divmod_u64_array(uint64_t *q, uint64_t *r, const uint64_t *n, size_t count, const num_divisor_u64 *d) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        uint64_t v = n[i], quot = num_div_u64(v, d);
+
+        if (q != NULL) q[i] = quot;
+        if (r != NULL) r[i] = v - quot * d->divisor;
+    }
+}
+
+void num_divmod_s64_array(int64_t *q, int64_t *r, const int64_t *n, size_t count, const num_divisor_s64 *d) {
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        int64_t v = n[i], quot = num_div_s64(v, d);
+
+        if (q != NULL) q[i] = quot;
+        if (r != NULL) r[i] = (int64_t)((uint64_t)v - (uint64_t)quot * (uint64_t)d->divisor);
+    }
+}
@@ -0,0 +1,237 @@
+/**
+ * Backend behind lib_numeric.h.
+ * Conversions of int64_t to float and double that report the elements
+ * they round, with AVX-512, AVX2 and scalar implementations.
+ *
+ * An integer is exactly representable with p significant bits (24 for
+ * float, 53 for double) when its significant bits, from the highest set
+ * to the lowest set bit of its magnitude u, span p bits at most: when
+ * u < lowbit(u) * 2^p, or u >> p < lowbit(u), lowbit(u) being u & -u.
+ * Comparing u >> p with lowbit(u) - 1 instead, unsigned, lets 0 through,
+ * and INT64_MIN's magnitude is 2^63 as an unsigned value.
+ *
+ * AVX-512DQ converts 64-bit lanes to and from float and double in both
+ * directions: the kernels convert each value, truncate the result back to
+ * int64_t and compare it with the value, which yields the mask directly.
+ * The values rounded to 2^63 come back as INT64_MIN, which only INT64_MIN
+ * itself converts to exactly.
+ *
+ * AVX2 converts neither way. A value is split into its high 48 bits,
+ * shifted in as the mantissa of 3 * 2^67, and its low 16 bits, as that of
+ * 2^52; subtracting 3 * 2^67 + 2^52 from the first leaves the high part
+ * exactly, and adding the low part rounds once, as a cast does. The round
+ * trip would take the same again backwards, so the kernels test the
+ * integer instead, as above. The floats are the doubles rounded, which
+ * rounds twice: the second rounding is wrong where the first made a tie
+ * of a value that was not one, so the steps holding an inexact double
+ * whose bits below the float's mantissa are exactly half of its last
+ * place are converted again by the scalar code, one in 2^28 values.
+ *
+ * The masks have one bit per element, 64 elements making one word, as
+ * for the checked arithmetic. The values are widened to double only in
+ * the steps holding one that float rounds, with a masked store.
+ */
+
+#include <stdint.h>
+#include "lib_numeric_internal.h"
+
+#define NUM_BLOCK 64    /* elements per mask word */
+
+/* The 64 elements from src into dst; the mask of those rounded */
+typedef uint64_t (*num_float_fn)(void *dst, const int64_t *src, double *wide);
+
+/*============================================================================
+ * SCALAR
+ *==========================================================================*/
+/* Whether v needs more than digits significant bits */
+static inline int inexact(int64_t v, unsigned int digits) {
+    uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+
+    return (u >> digits) > (u & (0 - u)) - 1;
+}
+
+static uint64_t f32_scalar(float *dst, const int64_t *src, size_t len, double *wide) {
+    uint64_t m = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        dst[i] = (float)src[i];
+        if (inexact(src[i], 24)) {
+            m |= (uint64_t)1 << i;
+            if (wide != NULL) wide[i] = (double)src[i];
+        }
+    }
+    return m;
+}
+
+static uint64_t f64_scalar(double *dst, const int64_t *src, size_t len) {
+    uint64_t m = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        dst[i] = (double)src[i];
+        if (inexact(src[i], 53)) m |= (uint64_t)1 << i;
+    }
+    return m;
+}
+
+#if defined(NUMERIC_HAVE_X86_SIMD)
+#define BODY static inline __attribute__((always_inline))
+
+/*============================================================================
+ * AVX2
+ *==========================================================================*/
+#define LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+
+/* The lanes of v as double, rounded to nearest */
+BODY AVX2_TARGET __m256d i64_to_f64_avx2(__m256i v) {
+    __m256i hi = _mm256_blend_epi16(_mm256_srai_epi32(v, 16), _mm256_setzero_si256(), 0x33);
+    __m256i lo = _mm256_blend_epi16(v, _mm256_castpd_si256(_mm256_set1_pd(0x1p52)), 0x88);
+    __m256d h;
+
+    hi = _mm256_add_epi64(hi, _mm256_castpd_si256(_mm256_set1_pd(0x3p67)));
+    h = _mm256_sub_pd(_mm256_castsi256_pd(hi), _mm256_set1_pd(0x3p67 + 0x1p52));
+    return _mm256_add_pd(h, _mm256_castsi256_pd(lo));
+}
+
+/* All ones in the lanes of v that need more than digits significant bits */
+BODY AVX2_TARGET __m256i inexact_avx2(__m256i v, int digits) {
+    const __m256i bias = _mm256_set1_epi64x(INT64_MIN);
+    __m256i sign = _mm256_cmpgt_epi64(_mm256_setzero_si256(), v);
+    __m256i u = _mm256_sub_epi64(_mm256_xor_si256(v, sign), sign);
+    __m256i low = _mm256_and_si256(u, _mm256_sub_epi64(_mm256_setzero_si256(), u));
+
+    return _mm256_cmpgt_epi64(_mm256_xor_si256(_mm256_srli_epi64(u, digits), bias),
+                              _mm256_xor_si256(_mm256_sub_epi64(low, _mm256_set1_epi64x(1)), bias));
+}
+
+static AVX2_TARGET uint64_t f32_avx2(void *dst, const int64_t *src, double *wide) {
+    float *d = (float *)dst;
+    const __m256i half = _mm256_set1_epi64x(0x10000000), below = _mm256_set1_epi64x(0x1FFFFFFF);
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < NUM_BLOCK; i += 4) {
+        __m256i v = LOAD256(src + i);
+        __m256d w = i64_to_f64_avx2(v);
+        __m256i tie = _mm256_cmpeq_epi64(_mm256_and_si256(_mm256_castpd_si256(w), below), half);
+        __m256i x = inexact_avx2(v, 24);
+        uint64_t k = (unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(x));
+
+        _mm_storeu_ps(d + i, _mm256_cvtpd_ps(w));
+        if (k != 0) {
+            if (!_mm256_testz_si256(tie, inexact_avx2(v, 53))) (void)f32_scalar(d + i, src + i, 4, NULL);
+            if (wide != NULL) _mm256_maskstore_pd(wide + i, x, w);
+            m |= k << i;
+        }
+    }
+    return m;
+}
+
+static AVX2_TARGET uint64_t f64_avx2(void *dst, const int64_t *src, double *wide) {
+    double *d = (double *)dst;
+    uint64_t m = 0;
+    int i;
+
+    (void)wide;
+    for (i = 0; i < NUM_BLOCK; i += 4) {
+        __m256i v = LOAD256(src + i);
+
+        _mm256_storeu_pd(d + i, i64_to_f64_avx2(v));
+        m |= (uint64_t)(unsigned int)_mm256_movemask_pd(_mm256_castsi256_pd(inexact_avx2(v, 53))) << i;
+    }
+    return m;
+}
+
+/*============================================================================
+ * AVX-512
+ *==========================================================================*/
+static AVX512_TARGET uint64_t f32_avx512(void *dst, const int64_t *src, double *wide) {
+    float *d = (float *)dst;
+    uint64_t m = 0;
+    int i;
+
+    for (i = 0; i < NUM_BLOCK; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void *)(src + i));
+        __m256 f = _mm512_cvtepi64_ps(v);
+        __mmask8 k = _mm512_cmpneq_epi64_mask(_mm512_cvttps_epi64(f), v);
+
+        _mm256_storeu_ps(d + i, f);
+        if (k != 0) {
+            if (wide != NULL) _mm512_mask_storeu_pd(wide + i, k, _mm512_cvtepi64_pd(v));
+            m |= (uint64_t)k << i;
+        }
+    }
+    return m;
+}
+
+static AVX512_TARGET uint64_t f64_avx512(void *dst, const int64_t *src, double *wide) {
+    double *d = (double *)dst;
+    uint64_t m = 0;
+    int i;
+
+    (void)wide;
+    for (i = 0; i < NUM_BLOCK; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void *)(src + i));
+        __m512d f = _mm512_cvtepi64_pd(v);
+
+        _mm512_storeu_pd(d + i, f);
+        m |= (uint64_t)_mm512_cmpneq_epi64_mask(_mm512_cvttpd_epi64(f), v) << i;
+    }
+    return m;
+}
+#endif /* NUMERIC_HAVE_X86_SIMD */
+
+/*============================================================================
+ * DISPATCH
+ *==========================================================================*/
+/* The kernel converting to double, or to float, at the instruction set in
+ * use; NULL where the scalar loop is all there is */
+static num_float_fn float_kernel(int to_double) {
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    int level = numeric_isa();
+
+    if (level == NUMERIC_AVX512) return to_double ? f64_avx512 : f32_avx512;
+    if (level == NUMERIC_AVX2) return to_double ? f64_avx2 : f32_avx2;
+#endif
+    (void)to_double;
+    return NULL;
+}
+
+/* Adds the mask word of block i to res and mask */
+static void add_block(num_narrow_result *res, uint64_t *mask, size_t i, uint64_t m) {
+    if (mask != NULL) mask[i / NUM_BLOCK] = m;
+    if (m != 0) {
+        if (res->lossy == 0) res->first = i + (size_t)__builtin_ctzll(m);
+        res->lossy += (size_t)__builtin_popcountll(m);
+    }
+}
+
+num_narrow_result num_i64_to_f32(float *dst, const int64_t *src, size_t n, uint64_t *mask, double *wide) {
+    num_narrow_result res = { 0, n };
+    num_float_fn kernel = float_kernel(0);
+    size_t i;
+
+    for (i = 0; i < n; i += NUM_BLOCK) {
+        size_t len = n - i < NUM_BLOCK ? n - i : NUM_BLOCK;
+        double *w = wide != NULL ? wide + i : NULL;
+
+        add_block(&res, mask, i, kernel != NULL && len == NUM_BLOCK ? kernel(dst + i, src + i, w)
+                                                                    : f32_scalar(dst + i, src + i, len, w));
+    }
+    return res;
+}
+
+num_narrow_result num_i64_to_f64(double *dst, const int64_t *src, size_t n, uint64_t *mask) {
+    num_narrow_result res = { 0, n };
+    num_float_fn kernel = float_kernel(1);
+    size_t i;
+
+    for (i = 0; i < n; i += NUM_BLOCK) {
+        size_t len = n - i < NUM_BLOCK ? n - i : NUM_BLOCK;
+
+        add_block(&res, mask, i, kernel != NULL && len == NUM_BLOCK ? kernel(dst + i, src + i, NULL)
+                                                                    : f64_scalar(dst + i, src + i, len));
+    }
+    return res;
+}
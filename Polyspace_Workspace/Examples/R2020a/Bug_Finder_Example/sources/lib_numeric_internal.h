@@ -0,0 +1,31 @@
+/**
+ * Backend behind lib_numeric.h.
+ * Definitions shared between the lib_numeric_*.c translation units; the
+ * example sources only see lib_numeric.h.
+ */
+
+#ifndef LIB_NUMERIC_INTERNAL_H
+#define LIB_NUMERIC_INTERNAL_H
+
+#include "lib_numeric.h"
+
+#if defined(__x86_64__) && defined(__SSE2__)
+#define NUMERIC_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#define AVX512_TARGET __attribute__((target("avx512f,avx512bw,avx512dq")))
+#endif
+
+/*============================================================================
+ * INSTRUCTION SETS
+ *==========================================================================*/
+enum {
+    NUMERIC_SCALAR,
+    NUMERIC_AVX2,
+    NUMERIC_AVX512
+};
+
+/* The level in use, detected on the first call and capped by NUMERIC_ISA */
+int numeric_isa(void);
+
+#endif /* LIB_NUMERIC_INTERNAL_H */
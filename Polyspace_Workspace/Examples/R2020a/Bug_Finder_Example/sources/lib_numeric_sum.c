@@ -0,0 +1,400 @@
+/**
+ * Backend behind lib_numeric.h.
+ * Summation and dot products of double and float arrays, plain, pairwise,
+ * compensated and exact, with AVX-512, AVX2 and scalar implementations.
+ *
+ * The vector kernels keep four accumulators of one vector each, eight for
+ * the compensated ones, and add the array to them in steps of as many
+ * vectors, so that the additions of a step do not wait on each other:
+ *   - the plain kernel adds each vector to its accumulator (multiplies and
+ *     adds for a dot product);
+ *   - the compensated kernel adds it with Knuth's TwoSum, six additions
+ *     and subtractions that yield the rounded sum and, exactly, the error
+ *     of that rounding. The errors go into a second accumulator, which is
+ *     Neumaier's improvement on Kahan's algorithm: unlike Kahan's, it
+ *     holds when an element is larger than the running sum, as in
+ *     large + small - large. Dot products split each product into its
+ *     rounded value and its error the same way, with a fused multiply-
+ *     subtract (Ogita, Rump and Oishi's Dot2).
+ * The accumulators are combined in the same way, then the lanes, in
+ * scalar code that also handles the last elements. The compensated result
+ * is as accurate as if it had been accumulated in twice the precision and
+ * rounded once.
+ *
+ * Pairwise summation splits the array in halves until they are a few
+ * hundred elements long, sums those with the plain kernel and adds the
+ * sums up the tree: the error grows with log n rather than with n, for
+ * the cost of the plain sum.
+ *
+ * The exact sum is Shewchuk's: it keeps the sum as a list of nonoverlapping
+ * partials, to which each element is added with TwoSum, and rounds it once
+ * at the end, correctly. It is scalar and several times slower than the
+ * others; the float one keeps double partials, which hold the float
+ * elements and their products exactly, and rounds to odd before rounding
+ * to float so that the result is rounded only once.
+ *
+ * The kernels use the vector types' arithmetic operators rather than
+ * intrinsics so that one body serves the four of them. Contraction into
+ * fused multiply-adds cannot break the error terms: the products whose
+ * errors are taken are also operands of the fused multiply-subtract, which
+ * keeps the compiler from fusing them into the additions.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include "lib_numeric_internal.h"
+
+#define MAX_LANES 16                /* floats in an AVX-512 vector */
+#define PAIRWISE_STEPS 16           /* kernel steps in a pairwise leaf */
+#define PAIRWISE_SCALAR_LEAF 128    /* elements in a pairwise leaf without kernels */
+#define PAIRWISE_ALIGN 64           /* split points, in elements */
+#define KAHAN_STEP 8                /* vectors per compensated kernel step */
+#define EXACT_PARTIALS 2100         /* one per bit of the double range, the most there can be */
+
+/* The plain kernel sums the n elements of x, or the n products x[i] * y[i]
+ * when y is not NULL, into lanes; n is a multiple of 4 * lanes. The
+ * compensated one sums them into the rounded sums s and their errors c; n
+ * is a multiple of KAHAN_STEP * lanes */
+typedef struct sum_kernels_f64 {
+    size_t lanes;
+    void (*plain)(const double *x, const double *y, size_t n, double *s);
+    void (*kahan)(const double *x, const double *y, size_t n, double *s, double *c);
+} sum_kernels_f64;
+
+typedef struct sum_kernels_f32 {
+    size_t lanes;
+    void (*plain)(const float *x, const float *y, size_t n, float *s);
+    void (*kahan)(const float *x, const float *y, size_t n, float *s, float *c);
+} sum_kernels_f32;
+
+/*============================================================================
+ * ERROR-FREE TRANSFORMATIONS
+ *==========================================================================*/
+/* Adds v to the sum s, adding the rounding error to c (TwoSum) */
+#define TWO_SUM(s, c, v) \
+    do { \
+        __typeof__(s) t_ = (s) + (v), b_ = t_ - (s); \
+        (c) += ((s) - (t_ - b_)) + ((v) - b_); \
+        (s) = t_; \
+    } while (0)
+
+/* Adds a * b to the sum s, adding the rounding errors of the product and
+ * of the sum to c (Dot2); fmsub(a, b, p) is a * b - p rounded once */
+#define TWO_PROD_SUM(s, c, a, b, fmsub) \
+    do { \
+        __typeof__(s) a_ = (a), b2_ = (b), p_ = a_ * b2_, e_ = fmsub(a_, b2_, p_); \
+        TWO_SUM(s, c, p_); \
+        (c) += e_; \
+    } while (0)
+
+#define FMSUB_F64(a, b, p) fma(a, b, -(p))
+#define FMSUB_F32(a, b, p) fmaf(a, b, -(p))
+
+/*============================================================================
+ * VECTOR KERNELS
+ *==========================================================================*/
+#if defined(NUMERIC_HAVE_X86_SIMD)
+/* The plain and compensated kernels for the vector type V of W elements of
+ * type T, loaded with load */
+#define SUM_KERNELS(sfx, target, T, V, W, load, fmadd, fmsub) \
+    static target void plain_##sfx(const T *x, const T *y, size_t n, T *s) { \
+        V a0 = { 0 }, a1 = a0, a2 = a0, a3 = a0; \
+        size_t i; \
+        \
+        if (y == NULL) { \
+            for (i = 0; i < n; i += 4 * W) { \
+                a0 += load(x + i); \
+                a1 += load(x + i + W); \
+                a2 += load(x + i + 2 * W); \
+                a3 += load(x + i + 3 * W); \
+            } \
+        } else { \
+            for (i = 0; i < n; i += 4 * W) { \
+                a0 = fmadd(load(x + i), load(y + i), a0); \
+                a1 = fmadd(load(x + i + W), load(y + i + W), a1); \
+                a2 = fmadd(load(x + i + 2 * W), load(y + i + 2 * W), a2); \
+                a3 = fmadd(load(x + i + 3 * W), load(y + i + 3 * W), a3); \
+            } \
+        } \
+        a0 = (a0 + a1) + (a2 + a3); \
+        memcpy(s, &a0, sizeof(a0)); \
+    } \
+    \
+    static target void kahan_##sfx(const T *x, const T *y, size_t n, T *s, T *c) { \
+        V s0 = { 0 }, s1 = s0, s2 = s0, s3 = s0, s4 = s0, s5 = s0, s6 = s0, s7 = s0; \
+        V c0 = s0, c1 = s0, c2 = s0, c3 = s0, c4 = s0, c5 = s0, c6 = s0, c7 = s0; \
+        size_t i; \
+        \
+        if (y == NULL) { \
+            for (i = 0; i < n; i += KAHAN_STEP * W) { \
+                TWO_SUM(s0, c0, load(x + i)); \
+                TWO_SUM(s1, c1, load(x + i + W)); \
+                TWO_SUM(s2, c2, load(x + i + 2 * W)); \
+                TWO_SUM(s3, c3, load(x + i + 3 * W)); \
+                TWO_SUM(s4, c4, load(x + i + 4 * W)); \
+                TWO_SUM(s5, c5, load(x + i + 5 * W)); \
+                TWO_SUM(s6, c6, load(x + i + 6 * W)); \
+                TWO_SUM(s7, c7, load(x + i + 7 * W)); \
+            } \
+        } else { \
+            for (i = 0; i < n; i += KAHAN_STEP * W) { \
+                TWO_PROD_SUM(s0, c0, load(x + i), load(y + i), fmsub); \
+                TWO_PROD_SUM(s1, c1, load(x + i + W), load(y + i + W), fmsub); \
+                TWO_PROD_SUM(s2, c2, load(x + i + 2 * W), load(y + i + 2 * W), fmsub); \
+                TWO_PROD_SUM(s3, c3, load(x + i + 3 * W), load(y + i + 3 * W), fmsub); \
+                TWO_PROD_SUM(s4, c4, load(x + i + 4 * W), load(y + i + 4 * W), fmsub); \
+                TWO_PROD_SUM(s5, c5, load(x + i + 5 * W), load(y + i + 5 * W), fmsub); \
+                TWO_PROD_SUM(s6, c6, load(x + i + 6 * W), load(y + i + 6 * W), fmsub); \
+                TWO_PROD_SUM(s7, c7, load(x + i + 7 * W), load(y + i + 7 * W), fmsub); \
+            } \
+        } \
+        c0 += c1 + c2 + c3 + c4 + c5 + c6 + c7; \
+        TWO_SUM(s0, c0, s1); \
+        TWO_SUM(s0, c0, s2); \
+        TWO_SUM(s0, c0, s3); \
+        TWO_SUM(s0, c0, s4); \
+        TWO_SUM(s0, c0, s5); \
+        TWO_SUM(s0, c0, s6); \
+        TWO_SUM(s0, c0, s7); \
+        memcpy(s, &s0, sizeof(s0)); \
+        memcpy(c, &c0, sizeof(c0)); \
+    }
+
+SUM_KERNELS(f64_avx2, AVX2_TARGET, double, __m256d, 4, _mm256_loadu_pd, _mm256_fmadd_pd, _mm256_fmsub_pd)
+SUM_KERNELS(f32_avx2, AVX2_TARGET, float, __m256, 8, _mm256_loadu_ps, _mm256_fmadd_ps, _mm256_fmsub_ps)
+SUM_KERNELS(f64_avx512, AVX512_TARGET, double, __m512d, 8, _mm512_loadu_pd, _mm512_fmadd_pd, _mm512_fmsub_pd)
+SUM_KERNELS(f32_avx512, AVX512_TARGET, float, __m512, 16, _mm512_loadu_ps, _mm512_fmadd_ps, _mm512_fmsub_ps)
+#endif /* NUMERIC_HAVE_X86_SIMD */
+
+/* The kernels for the instruction set in use, NULL for the scalar code */
+static const sum_kernels_f64 *kernels_f64(void) {
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    static const sum_kernels_f64 avx2 = { 4, plain_f64_avx2, kahan_f64_avx2 };
+    static const sum_kernels_f64 avx512 = { 8, plain_f64_avx512, kahan_f64_avx512 };
+
+    if (numeric_isa() == NUMERIC_AVX512) return &avx512;
+    if (numeric_isa() == NUMERIC_AVX2) return &avx2;
+#endif
+    return NULL;
+}
+
+static const sum_kernels_f32 *kernels_f32(void) {
+#if defined(NUMERIC_HAVE_X86_SIMD)
+    static const sum_kernels_f32 avx2 = { 8, plain_f32_avx2, kahan_f32_avx2 };
+    static const sum_kernels_f32 avx512 = { 16, plain_f32_avx512, kahan_f32_avx512 };
+
+    if (numeric_isa() == NUMERIC_AVX512) return &avx512;
+    if (numeric_isa() == NUMERIC_AVX2) return &avx2;
+#endif
+    return NULL;
+}
+
+/*============================================================================
+ * EXACT SUM
+ *==========================================================================*/
+/* The sum of the elements added so far is exactly that of the n partials,
+ * which are nonoverlapping and by increasing magnitude, unless an element
+ * was not finite or a partial sum overflowed: special then sums those and
+ * is the result */
+typedef struct exact_sum {
+    size_t n;
+    int have_special;
+    double special;
+    double p[EXACT_PARTIALS];
+} exact_sum;
+
+static void exact_add(exact_sum *a, double x) {
+    size_t i, j = 0;
+
+    if (!isfinite(x)) {
+        a->special += x;
+        a->have_special = 1;
+        return;
+    }
+    for (i = 0; i < a->n; i++) {
+        double y = a->p[i], hi, lo;
+
+        if (fabs(x) < fabs(y)) {
+            double t = x;
+            x = y;
+            y = t;
+        }
+        hi = x + y;
+        if (!isfinite(hi)) {
+            a->special += hi;
+            a->have_special = 1;
+            return;
+        }
+        lo = y - (hi - x);
+        if (lo != 0.0) a->p[j++] = lo;
+        x = hi;
+    }
+    a->p[j++] = x;
+    a->n = j;
+}
+
+/* The sum rounded to nearest, even on ties; rest receives a value of the
+ * sign of what was rounded off, 0.0 when the sum is exact */
+static double exact_round(const exact_sum *a, double *rest) {
+    size_t n = a->n;
+    double hi = 0.0, lo = 0.0;
+
+    *rest = 0.0;
+    if (a->have_special) return a->special;
+    if (n == 0) return hi;
+    hi = a->p[--n];
+    while (n > 0) {
+        double x = hi, y = a->p[--n];
+
+        hi = x + y;
+        lo = y - (hi - x);
+        if (lo != 0.0) break;
+    }
+    *rest = lo;
+    /* lo is half an ulp of hi and the partials below it push the sum past
+     * the tie: round the other way */
+    if (n > 0 && ((lo < 0.0 && a->p[n - 1] < 0.0) || (lo > 0.0 && a->p[n - 1] > 0.0))) {
+        double y = lo * 2.0, x = hi + y;
+
+        if (y == x - hi) {
+            hi = x;
+            *rest = -lo;
+        }
+    }
+    return hi;
+}
+
+static double exact_f64_run(const double *x, const double *y, size_t n) {
+    exact_sum a;
+    double rest;
+    size_t i;
+
+    a.n = 0;
+    a.have_special = 0;
+    a.special = 0.0;
+    for (i = 0; i < n; i++) {
+        if (y == NULL) {
+            exact_add(&a, x[i]);
+        } else {
+            double p = x[i] * y[i];
+
+            exact_add(&a, p);
+            if (isfinite(p)) exact_add(&a, fma(x[i], y[i], -p));
+        }
+    }
+    return exact_round(&a, &rest);
+}
+
+static float exact_f32_run(const float *x, const float *y, size_t n) {
+    exact_sum a;
+    double hi, rest;
+    uint64_t bits;
+    size_t i;
+
+    a.n = 0;
+    a.have_special = 0;
+    a.special = 0.0;
+    for (i = 0; i < n; i++) exact_add(&a, y == NULL ? (double)x[i] : (double)x[i] * (double)y[i]);
+    hi = exact_round(&a, &rest);
+    /* Round to odd: truncate to double, marking the inexact result in its
+     * last bit, which is far enough below float precision for the
+     * conversion to round as the exact sum would */
+    if (rest != 0.0 && isfinite(hi)) {
+        if ((rest < 0.0) != (hi < 0.0)) hi = nextafter(hi, 0.0);
+        memcpy(&bits, &hi, sizeof(bits));
+        bits |= 1;
+        memcpy(&hi, &bits, sizeof(hi));
+    }
+    return (float)hi;
+}
+
+/*============================================================================
+ * DRIVERS
+ *==========================================================================*/
+/* The plain, pairwise and compensated sums of the n elements of x, or of
+ * the n products x[i] * y[i] when y is not NULL, in type T, with the
+ * kernels and the scalar code for the elements they leave */
+#define SUM_DRIVERS(sfx, T, FMSUB) \
+    static T plain_##sfx##_run(const T *x, const T *y, size_t n) { \
+        const sum_kernels_##sfx *k = kernels_##sfx(); \
+        T lanes[MAX_LANES], s = 0; \
+        size_t i = 0, j; \
+        \
+        if (k != NULL && n >= 4 * k->lanes) { \
+            i = n - n % (4 * k->lanes); \
+            k->plain(x, y, i, lanes); \
+            for (j = 0; j < k->lanes; j++) s += lanes[j]; \
+        } \
+        if (y == NULL) { \
+            for (; i < n; i++) s += x[i]; \
+        } else { \
+            for (; i < n; i++) s += x[i] * y[i]; \
+        } \
+        return s; \
+    } \
+    \
+    static T pairwise_##sfx##_run(const T *x, const T *y, size_t n, size_t leaf) { \
+        size_t half = n / 2 - n / 2 % PAIRWISE_ALIGN; \
+        \
+        if (n <= leaf) return plain_##sfx##_run(x, y, n); \
+        return pairwise_##sfx##_run(x, y, half, leaf) \
+               + pairwise_##sfx##_run(x + half, y == NULL ? NULL : y + half, n - half, leaf); \
+    } \
+    \
+    static T kahan_##sfx##_run(const T *x, const T *y, size_t n) { \
+        const sum_kernels_##sfx *k = kernels_##sfx(); \
+        T s_lanes[MAX_LANES], c_lanes[MAX_LANES], s = 0, c = 0; \
+        size_t i = 0, j; \
+        \
+        if (k != NULL && n >= KAHAN_STEP * k->lanes) { \
+            i = n - n % (KAHAN_STEP * k->lanes); \
+            k->kahan(x, y, i, s_lanes, c_lanes); \
+            for (j = 0; j < k->lanes; j++) { \
+                c += c_lanes[j]; \
+                TWO_SUM(s, c, s_lanes[j]); \
+            } \
+        } \
+        if (y == NULL) { \
+            for (; i < n; i++) TWO_SUM(s, c, x[i]); \
+        } else { \
+            for (; i < n; i++) TWO_PROD_SUM(s, c, x[i], y[i], FMSUB); \
+        } \
+        /* An infinite or NaN sum leaves NaN errors */ \
+        return isfinite(s) ? s + c : s; \
+    } \
+    \
+    static T sum_##sfx(const T *x, const T *y, size_t n, enum num_sum_method method) { \
+        const sum_kernels_##sfx *k; \
+        \
+        switch (method) { \
+        case NUM_SUM_PAIRWISE: \
+            k = kernels_##sfx(); \
+            return pairwise_##sfx##_run(x, y, n, k != NULL ? PAIRWISE_STEPS * 4 * k->lanes : PAIRWISE_SCALAR_LEAF); \
+        case NUM_SUM_KAHAN: \
+            return kahan_##sfx##_run(x, y, n); \
+        case NUM_SUM_EXACT: \
+            return exact_##sfx##_run(x, y, n); \
+        default: \
+            return plain_##sfx##_run(x, y, n); \
+        } \
+    }
+
+SUM_DRIVERS(f64, double, FMSUB_F64)
+SUM_DRIVERS(f32, float, FMSUB_F32)
+
+double num_sum_f64(const double *x, size_t n, enum num_sum_method method) {
+    return sum_f64(x, NULL, n, method);
+}
+
+float num_sum_f32(const float *x, size_t n, enum num_sum_method method) {
+    return sum_f32(x, NULL, n, method);
+}
+
+double num_dot_f64(const double *x, const double *y, size_t n, enum num_sum_method method) {
+    return sum_f64(x, y, n, method);
+}
+
+float num_dot_f32(const float *x, const float *y, size_t n, enum num_sum_method method) {
+    return sum_f32(x, y, n, method);
+}
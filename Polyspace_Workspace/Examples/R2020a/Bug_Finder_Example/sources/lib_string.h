@@ -0,0 +1,175 @@
+/*
+ * String routines used by the examples in place of the byte-serial idioms
+ * they fix: strlen(s) > 0 as an emptiness test, memcmp(s1, s2, strlen(s1))
+ * as a prefix comparison, strrchr followed by strcmp.
+ *
+ * Kernels: AVX2 or SSE2 code chosen at run time, with a portable scalar
+ * fallback. Loads never cross into a page that the string does not touch,
+ * so a string ending just before an unmapped page is safe; they may read
+ * bytes before the start or after the end of a string within its page, as
+ * the C library's own routines do.
+ *
+ * Formatting: snprintf-compatible output for numbers that never writes past
+ * the given capacity and ignores the locale, for the sprintf calls of the
+ * examples and for metrics serialisation.
+ *
+ * Scanning: sscanf with a format compiled once and buffers passed with
+ * their capacity, and strtod without the locale, for the sscanf and atof
+ * calls of the examples and for parsing configuration and telemetry lines.
+ *
+ * Paths: realpath through a cache that inotify keeps current, returning
+ * interned strings instead of filling a PATH_MAX buffer.
+ */
+
+#ifndef LIB_STRING_H
+#define LIB_STRING_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*============================================================================
+ * KERNELS
+ *==========================================================================*/
+/* Whether s has at least one character; what strlen(s) > 0 computes,
+ * without scanning s */
+static inline int str_nonempty(const char *s) {
+    return s[0] != '\0';
+}
+
+/* strlen */
+size_t str_len(const char *s);
+
+/* strcmp, in one pass over both strings */
+int str_cmp(const char *s1, const char *s2);
+
+/* memcmp(prefix, s, strlen(prefix)) in one pass, without reading s beyond
+ * its terminator: 0 when s starts with prefix, otherwise the sign of the
+ * first differing byte */
+int str_cmp_prefix(const char *prefix, const char *s);
+
+/* strrchr */
+char *str_rchr(const char *s, int c);
+
+/* The instruction set in use: "avx2", "sse2" or "scalar". STRING_ISA in the
+ * environment ("sse2" or "scalar") caps it */
+const char *str_isa(void);
+
+/*============================================================================
+ * FORMATTING
+ *==========================================================================*/
+/* Each of these writes at most cap - 1 characters and a terminator (nothing
+ * when cap is 0) and returns the length of the whole output, as snprintf
+ * does; the output never depends on the locale */
+
+/* snprintf for the conversions the examples use: flags "-+ #0", width and
+ * precision, the length modifiers hh, h, l, ll, j, z and t, and d, i, u,
+ * o, x, X, c, s, p, e, E, f, F and %. Byte for byte what glibc prints; -1
+ * for any other conversion */
+int str_format(char *buf, size_t cap, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+int str_vformat(char *buf, size_t cap, const char *fmt, va_list ap);
+
+/* The shortest digits that read back as v, laid out as %.17g (%.9g for a
+ * float) lays out its digits: "0.1", "1e+100", "-nan" */
+int str_fmt_double(char *buf, size_t cap, double v);
+int str_fmt_float(char *buf, size_t cap, float v);
+
+/* %llu and %lld */
+int str_fmt_u64(char *buf, size_t cap, uint64_t v);
+int str_fmt_i64(char *buf, size_t cap, int64_t v);
+
+/*============================================================================
+ * SCANNING
+ *==========================================================================*/
+enum {
+    STR_SCAN_STEPS = 24,    /* directives in a compiled format */
+    STR_SCAN_SETS  = 4      /* %[ conversions in a compiled format */
+};
+
+/* One directive of a compiled format; the fields are private */
+typedef struct str_scan_step {
+    unsigned char op;
+    unsigned char size;
+    unsigned char suppress;
+    unsigned char set;
+    unsigned int width;
+    const char *lit;
+    size_t lit_len;
+} str_scan_step;
+
+/* A format compiled by str_scan_compile. Its literal text is not copied:
+ * the format string must outlive it */
+typedef struct str_scan_format {
+    str_scan_step step[STR_SCAN_STEPS];
+    uint32_t set[STR_SCAN_SETS][8];
+    int steps;
+} str_scan_format;
+
+/* Compiles a sscanf format once for any number of str_scan calls: 0, or -1
+ * for a conversion other than d, i, u, o, x, X, e, E, f, F, g, G, a, A, s,
+ * c, [, n and %, a length modifier other than hh, h, l, ll, j, z and t, or
+ * more than STR_SCAN_STEPS directives */
+int str_scan_compile(str_scan_format *f, const char *fmt);
+
+/* sscanf with a compiled format; returns what sscanf returns. Where sscanf
+ * is unbounded or undefined it differs:
+ *   - s, c and [ take the buffer and its capacity (char *, size_t), and a
+ *     token that does not fit fails the conversion, leaving the buffer
+ *     as it was;
+ *   - an integer outside the range of its destination fails, as does a
+ *     minus sign for u, o and x.
+ * Numbers are read in the C locale, floating ones in decimal or as inf and
+ * nan but not in hexadecimal */
+int str_scan(const str_scan_format *f, const char *input, ...);
+int str_vscan(const str_scan_format *f, const char *input, va_list ap);
+
+/* str_scan_compile and str_scan in one call, for a format used once */
+int str_scanf(const char *input, const char *fmt, ...);
+
+/* strtod and strtof in the C locale, correctly rounded, for decimal forms
+ * and inf and nan; errno is left alone */
+double str_to_double(const char *s, char **end);
+float str_to_float(const char *s, char **end);
+
+/*============================================================================
+ * PATHS
+ *==========================================================================*/
+typedef struct str_path_cache str_path_cache;
+
+/* A cache sized for about expected paths (more only lengthen its hash
+ * chains); NULL when out of memory. The cache is unbounded: it never
+ * evicts, and keeps every (dirfd, path) looked up, every canonical path
+ * returned and every directory watched until it is destroyed, forgotten
+ * entries included. A caller resolving an open-ended set of paths should
+ * destroy it and create another from time to time */
+str_path_cache *str_path_cache_create(size_t expected);
+
+/* Frees the cache and every path it returned */
+void str_path_cache_destroy(str_path_cache *c);
+
+/* realpath of path relative to the directory dirfd (AT_FDCWD: the working
+ * directory), as an interned string: equal paths are the same pointer, valid
+ * until the cache is destroyed. NULL with errno set as realpath sets it.
+ * Repeated lookups take no lock and make no system call until inotify
+ * reports a change along the path, except that a path relative to AT_FDCWD
+ * is joined to getcwd() at each call, so that a chdir needs no forgetting.
+ * Thread-safe */
+const char *str_path_resolve(str_path_cache *c, int dirfd, const char *path);
+
+/* Drops the entries relative to dirfd; to be called before dirfd is closed */
+void str_path_cache_forget(str_path_cache *c, int dirfd);
+
+/* str_path_resolve in a process-wide cache, relative to the working
+ * directory; the cache lives as long as the process, so this suits a
+ * bounded set of paths */
+const char *str_realpath(const char *path);
+
+/*============================================================================
+ * BENCHMARKS
+ *==========================================================================*/
+/* The kernels against the C library on the corpus's call-site patterns;
+ * the number of failed benchmarks */
+int str_bench_suite(FILE *report);
+
+#endif /* LIB_STRING_H */
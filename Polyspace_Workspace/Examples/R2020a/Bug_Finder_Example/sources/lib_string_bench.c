@@ -0,0 +1,653 @@
+/**
+ * Backend behind lib_string.h.
+ * Benchmarks of the string kernels against the C library, timed with the
+ * CRYPTO_bench harness.
+ *
+ * Each benchmark call goes once over BENCH_STRINGS heap strings at random
+ * alignments, in two sets: short ones of 8 to 64 bytes, the size of the
+ * user names and paths of the examples, and long ones of 256 to 2048 bytes.
+ * Every string has an equal copy elsewhere, so comparisons run to the end:
+ *   - the corrected_memcmpstrings prefix shape, memcmp(s1, s2, strlen(s1))
+ *     against str_cmp_prefix;
+ *   - strcmp against str_cmp;
+ *   - the corrected_nonreentrantstdreturn shape, strrchr(s, '/') against
+ *     str_rchr;
+ *   - strlen against str_len.
+ *
+ * There is no benchmark for str_nonempty: compilers already turn
+ * strlen(s) > 0 into the same single load.
+ *
+ * The formatting benchmarks write BENCH_VALUES numbers per call into a
+ * 64-byte buffer, with snprintf and with the bounded formatter: the
+ * corrected_strlibbufferoverflow format "Result=%12.2E" on floats, "%9.3f"
+ * on doubles, the demo_sprintf format "%u", and round-trip output of
+ * doubles, which is "%.17g" for snprintf and the shortest digits for
+ * str_fmt_double.
+ *
+ * The scanning benchmarks read BENCH_VALUES lines or numbers per call:
+ * telemetry lines "host=web-17 cpu=37.25 mem=812345 lat=0.004121" with
+ * sscanf and with a format compiled once for str_scan, and numbers printed
+ * with "%.2f" (the corrected_strstdlib "3.14") and "%.17g" with atof and
+ * str_to_double.
+ *
+ * The path benchmarks resolve BENCH_PATHS paths per call, six directories
+ * deep in a temporary tree, with the corrected_pathbufferoverflow
+ * realpath(path, buf) and with str_path_resolve, as absolute paths and
+ * relative to a directory descriptor. They then check that the cache follows
+ * a directory renamed and replaced along a path, a case where the directory
+ * watches it remembered had moved with the directory.
+ */
+
+#define _XOPEN_SOURCE 700  /* For realpath, mkdtemp */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lib_string.h"
+#include <unistd.h>
+#include <sys/stat.h>
+#include "lib_crypto_checkers.h"
+
+enum {
+    BENCH_STRINGS = 64,
+    BENCH_VALUES  = 64,
+    BENCH_PATHS   = 16
+};
+
+#define BENCH_SECONDS 0.5
+
+typedef struct bench_set {
+    char *blocks[2 * BENCH_STRINGS];
+    const char *s1[BENCH_STRINGS];
+    const char *s2[BENCH_STRINGS];  /* equal to s1 */
+    size_t bytes;                   /* sum of the lengths */
+    volatile unsigned long sink;    /* keeps the compiler from dropping the calls */
+} bench_set;
+
+static void bench_set_free(bench_set *set) {
+    int i;
+
+    for (i = 0; i < 2 * BENCH_STRINGS; i++) free(set->blocks[i]);
+}
+
+/* Strings of min_len to max_len bytes, path-like, starting at random
+ * offsets of their blocks; 0 when out of memory */
+static int bench_set_init(bench_set *set, size_t min_len, size_t max_len, unsigned int seed) {
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        size_t len, k;
+        unsigned int off1, off2;
+        char *a, *b;
+
+        seed = seed * 1103515245u + 12345u;
+        len = min_len + (seed >> 8) % (max_len - min_len + 1);
+        off1 = (seed >> 4) & 31;
+        off2 = (seed >> 12) & 31;
+        a = set->blocks[2 * i] = (char *)malloc(len + 1 + 32);
+        b = set->blocks[2 * i + 1] = (char *)malloc(len + 1 + 32);
+        if (a == NULL || b == NULL) return 0;
+        for (k = 0; k < len; k++) {
+            a[off1 + k] = (k % 9 == 0) ? '/' : (char)('a' + (k * 7 + (size_t)i) % 26);
+        }
+        a[off1 + len] = '\0';
+        memcpy(b + off2, a + off1, len + 1);
+        set->s1[i] = a + off1;
+        set->s2[i] = b + off2;
+        set->bytes += len;
+    }
+    return 1;
+}
+
+/*============================================================================
+ * KERNELS
+ *==========================================================================*/
+static int bench_prefix_libc(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += (unsigned long)memcmp(set->s1[i], set->s2[i], strlen(set->s1[i]));
+    }
+    return 1;
+}
+
+static int bench_prefix_str(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += (unsigned long)str_cmp_prefix(set->s1[i], set->s2[i]);
+    }
+    return 1;
+}
+
+static int bench_cmp_libc(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += (unsigned long)strcmp(set->s1[i], set->s2[i]);
+    }
+    return 1;
+}
+
+static int bench_cmp_str(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += (unsigned long)str_cmp(set->s1[i], set->s2[i]);
+    }
+    return 1;
+}
+
+static int bench_rchr_libc(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += (unsigned long)(strrchr(set->s1[i], '/') - set->s1[i]);
+    }
+    return 1;
+}
+
+static int bench_rchr_str(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += (unsigned long)(str_rchr(set->s1[i], '/') - set->s1[i]);
+    }
+    return 1;
+}
+
+static int bench_len_libc(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += strlen(set->s1[i]);
+    }
+    return 1;
+}
+
+static int bench_len_str(void *arg) {
+    bench_set *set = (bench_set *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_STRINGS; i++) {
+        set->sink += str_len(set->s1[i]);
+    }
+    return 1;
+}
+
+/*============================================================================
+ * FORMATTING
+ *==========================================================================*/
+typedef struct bench_values {
+    float floats[BENCH_VALUES];
+    double doubles[BENCH_VALUES];
+    unsigned int uints[BENCH_VALUES];
+    char out[64];
+    volatile unsigned long sink;
+} bench_values;
+
+static int bench_exp_snprintf(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)snprintf(bv->out, sizeof(bv->out), "Result=%12.2E", bv->floats[i]);
+    }
+    return 1;
+}
+
+static int bench_exp_format(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)str_format(bv->out, sizeof(bv->out), "Result=%12.2E", bv->floats[i]);
+    }
+    return 1;
+}
+
+static int bench_fixed_snprintf(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)snprintf(bv->out, sizeof(bv->out), "%9.3f", bv->doubles[i]);
+    }
+    return 1;
+}
+
+static int bench_fixed_format(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)str_format(bv->out, sizeof(bv->out), "%9.3f", bv->doubles[i]);
+    }
+    return 1;
+}
+
+static int bench_uint_snprintf(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)snprintf(bv->out, sizeof(bv->out), "%u", bv->uints[i]);
+    }
+    return 1;
+}
+
+static int bench_uint_format(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)str_format(bv->out, sizeof(bv->out), "%u", bv->uints[i]);
+    }
+    return 1;
+}
+
+static int bench_uint_fmt(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)str_fmt_u64(bv->out, sizeof(bv->out), bv->uints[i]);
+    }
+    return 1;
+}
+
+static int bench_roundtrip_snprintf(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)snprintf(bv->out, sizeof(bv->out), "%.17g", bv->doubles[i]);
+    }
+    return 1;
+}
+
+static int bench_roundtrip_fmt(void *arg) {
+    bench_values *bv = (bench_values *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        bv->sink += (unsigned long)str_fmt_double(bv->out, sizeof(bv->out), bv->doubles[i]);
+    }
+    return 1;
+}
+
+static int bench_format_run(FILE *report) {
+    bench_values *bv = (bench_values *)calloc(1, sizeof(bench_values));
+    unsigned int x = 2463534242u;
+    int failed = 0, i;
+
+    if (bv == NULL) return -1;
+    for (i = 0; i < BENCH_VALUES; i++) {
+        x = x * 1103515245u + 12345u;
+        bv->floats[i] = (float)(x >> 8) / 1000.0f - 4000.0f;
+        bv->doubles[i] = (double)x / 7.0 - 1e8;
+        bv->uints[i] = x >> (x % 24);
+    }
+
+    if (report != NULL) fprintf(report, "# formatting, %d values per call\n", BENCH_VALUES);
+    failed += !CRYPTO_bench(report, "Result=%12.2E snprintf", bench_exp_snprintf, bv, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "Result=%12.2E str_format", bench_exp_format, bv, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%9.3f snprintf", bench_fixed_snprintf, bv, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%9.3f str_format", bench_fixed_format, bv, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%u snprintf", bench_uint_snprintf, bv, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%u str_format", bench_uint_format, bv, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%u str_fmt_u64", bench_uint_fmt, bv, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "round-trip double snprintf %.17g", bench_roundtrip_snprintf, bv, 0,
+                            BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "round-trip double str_fmt_double", bench_roundtrip_fmt, bv, 0, BENCH_SECONDS);
+
+    free(bv);
+    return failed;
+}
+
+/*============================================================================
+ * SCANNING
+ *==========================================================================*/
+#define BENCH_SCAN_LINE "host=%31s cpu=%lf mem=%u lat=%lf"
+
+typedef struct bench_lines {
+    char lines[BENCH_VALUES][64];
+    char short_numbers[BENCH_VALUES][16];   /* "%.2f" */
+    char long_numbers[BENCH_VALUES][32];    /* "%.17g" */
+    str_scan_format line_format;
+    volatile double sink;
+} bench_lines;
+
+static int bench_line_sscanf(void *arg) {
+    bench_lines *bl = (bench_lines *)arg;
+    char host[32];
+    double cpu, lat;
+    unsigned int mem;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        if (sscanf(bl->lines[i], BENCH_SCAN_LINE, host, &cpu, &mem, &lat) != 4) return 0;
+        bl->sink += cpu + lat + mem + host[0];
+    }
+    return 1;
+}
+
+static int bench_line_scan(void *arg) {
+    bench_lines *bl = (bench_lines *)arg;
+    char host[32];
+    double cpu, lat;
+    unsigned int mem;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) {
+        if (str_scan(&bl->line_format, bl->lines[i], host, sizeof(host), &cpu, &mem, &lat) != 4) return 0;
+        bl->sink += cpu + lat + mem + host[0];
+    }
+    return 1;
+}
+
+static int bench_short_atof(void *arg) {
+    bench_lines *bl = (bench_lines *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) bl->sink += atof(bl->short_numbers[i]);
+    return 1;
+}
+
+static int bench_short_scan(void *arg) {
+    bench_lines *bl = (bench_lines *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) bl->sink += str_to_double(bl->short_numbers[i], NULL);
+    return 1;
+}
+
+static int bench_long_atof(void *arg) {
+    bench_lines *bl = (bench_lines *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) bl->sink += atof(bl->long_numbers[i]);
+    return 1;
+}
+
+static int bench_long_scan(void *arg) {
+    bench_lines *bl = (bench_lines *)arg;
+    int i;
+
+    for (i = 0; i < BENCH_VALUES; i++) bl->sink += str_to_double(bl->long_numbers[i], NULL);
+    return 1;
+}
+
+static int bench_scan_run(FILE *report) {
+    bench_lines *bl = (bench_lines *)calloc(1, sizeof(bench_lines));
+    unsigned int x = 362436069u;
+    int failed = 0, i;
+
+    if (bl == NULL) return -1;
+    if (str_scan_compile(&bl->line_format, BENCH_SCAN_LINE) != 0) {
+        free(bl);
+        return -1;
+    }
+    for (i = 0; i < BENCH_VALUES; i++) {
+        double v;
+
+        x = x * 1103515245u + 12345u;
+        v = (double)(x >> 4) / 3.0e5;
+        (void)snprintf(bl->lines[i], sizeof(bl->lines[i]), "host=web-%02u cpu=%.2f mem=%u lat=%.6f", x % 100,
+                       (double)(x % 10000) / 100.0, x >> 12, v / 1e5);
+        (void)snprintf(bl->short_numbers[i], sizeof(bl->short_numbers[i]), "%.2f", v);
+        (void)snprintf(bl->long_numbers[i], sizeof(bl->long_numbers[i]), "%.17g", v);
+    }
+
+    if (report != NULL) fprintf(report, "# scanning, %d values per call\n", BENCH_VALUES);
+    failed += !CRYPTO_bench(report, "telemetry line sscanf", bench_line_sscanf, bl, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "telemetry line str_scan", bench_line_scan, bl, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%.2f atof", bench_short_atof, bl, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%.2f str_to_double", bench_short_scan, bl, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%.17g atof", bench_long_atof, bl, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "%.17g str_to_double", bench_long_scan, bl, 0, BENCH_SECONDS);
+
+    free(bl);
+    return failed;
+}
+
+/*============================================================================
+ * PATHS
+ *==========================================================================*/
+typedef struct bench_paths {
+    char root[32];
+    char absolute[BENCH_PATHS][128];
+    char relative[BENCH_PATHS][128];    /* to root */
+    int root_fd;
+    str_path_cache *cache;
+    volatile unsigned long sink;
+} bench_paths;
+
+static int bench_path_realpath(void *arg) {
+    bench_paths *bp = (bench_paths *)arg;
+    char buf[PATH_MAX];
+    int i;
+
+    for (i = 0; i < BENCH_PATHS; i++) {
+        if (realpath(bp->absolute[i], buf) == NULL) return 0;
+        bp->sink += (unsigned char)buf[1];
+    }
+    return 1;
+}
+
+static int bench_path_absolute(void *arg) {
+    bench_paths *bp = (bench_paths *)arg;
+    const char *resolved;
+    int i;
+
+    for (i = 0; i < BENCH_PATHS; i++) {
+        if ((resolved = str_path_resolve(bp->cache, AT_FDCWD, bp->absolute[i])) == NULL) return 0;
+        bp->sink += (unsigned char)resolved[1];
+    }
+    return 1;
+}
+
+static int bench_path_relative(void *arg) {
+    bench_paths *bp = (bench_paths *)arg;
+    const char *resolved;
+    int i;
+
+    for (i = 0; i < BENCH_PATHS; i++) {
+        if ((resolved = str_path_resolve(bp->cache, bp->root_fd, bp->relative[i])) == NULL) return 0;
+        bp->sink += (unsigned char)resolved[1];
+    }
+    return 1;
+}
+
+/* Removes what bench_paths_init created */
+static void bench_paths_free(bench_paths *bp) {
+    char dir[128];
+    int i, depth;
+
+    for (i = 0; i < BENCH_PATHS; i++) (void)unlink(bp->absolute[i]);
+    for (depth = 6; depth > 0; depth--) {
+        for (i = 0; i < BENCH_PATHS; i++) {
+            size_t len = strlen(bp->absolute[i]);
+            int slashes = 0;
+
+            /* its directory depth levels below the root */
+            (void)snprintf(dir, sizeof(dir), "%s", bp->absolute[i]);
+            while (len > 0 && slashes < 7 - depth) slashes += dir[--len] == '/';
+            dir[len] = '\0';
+            (void)rmdir(dir);
+        }
+    }
+    (void)rmdir(bp->root);
+    if (bp->root_fd >= 0) (void)close(bp->root_fd);
+    str_path_cache_destroy(bp->cache);
+}
+
+/* A tree of BENCH_PATHS files six directories below a temporary root; 0
+ * when it cannot be made */
+static int bench_paths_init(bench_paths *bp) {
+    static const char *const names[] = { "srv", "data", "www", "static", "assets", "img" };
+    char dir[96];
+    int i, depth, fd;
+
+    bp->root_fd = -1;
+    (void)snprintf(bp->root, sizeof(bp->root), "/tmp/pathbenchXXXXXX");
+    if (mkdtemp(bp->root) == NULL) return 0;
+    bp->root_fd = open(bp->root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    bp->cache = str_path_cache_create(2 * BENCH_PATHS);
+    if (bp->root_fd < 0 || bp->cache == NULL) return 0;
+    for (i = 0; i < BENCH_PATHS; i++) {
+        size_t len = (size_t)snprintf(dir, sizeof(dir), "%s", bp->root);
+
+        for (depth = 0; depth < 6; depth++) {
+            len += (size_t)snprintf(dir + len, sizeof(dir) - len, "/%s%d", names[depth], i % (depth + 2));
+            if (mkdir(dir, 0700) != 0 && errno != EEXIST) return 0;
+        }
+        (void)snprintf(bp->absolute[i], sizeof(bp->absolute[i]), "%s/file%d", dir, i);
+        (void)snprintf(bp->relative[i], sizeof(bp->relative[i]), "%s", bp->absolute[i] + strlen(bp->root) + 1);
+        fd = open(bp->absolute[i], O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (fd < 0) return 0;
+        (void)close(fd);
+    }
+    return 1;
+}
+
+/* Whether str_path_resolve(path) comes to agree with realpath within a
+ * second of a change; the first lookup waits for the cache to have seen the
+ * change, so that it resolves the path again */
+static int bench_path_agrees(bench_paths *bp, const char *path) {
+    struct timespec tick = { 0, 10000000 };
+    char buf[PATH_MAX];
+    const char *resolved;
+    int i;
+
+    if (realpath(path, buf) == NULL) return 0;
+    for (i = 0; i < 100; i++) {
+        (void)nanosleep(&tick, NULL);
+        resolved = str_path_resolve(bp->cache, AT_FDCWD, path);
+        if (resolved != NULL && strcmp(resolved, buf) == 0) return 1;
+    }
+    return 0;
+}
+
+/* a/b renamed to z and a new a/b/f made, then replaced by a link to d/x:
+ * the resolution after the rename must watch the new a/b, not z */
+static int bench_path_renamed(bench_paths *bp) {
+    char a[64], b[64], f[64], z[64], zf[64], d[64], x[64];
+    int ok, fd;
+
+    (void)snprintf(a, sizeof(a), "%s/a", bp->root);
+    (void)snprintf(b, sizeof(b), "%s/a/b", bp->root);
+    (void)snprintf(f, sizeof(f), "%s/a/b/f", bp->root);
+    (void)snprintf(z, sizeof(z), "%s/z", bp->root);
+    (void)snprintf(zf, sizeof(zf), "%s/z/f", bp->root);
+    (void)snprintf(d, sizeof(d), "%s/d", bp->root);
+    (void)snprintf(x, sizeof(x), "%s/d/x", bp->root);
+
+    ok = mkdir(a, 0700) == 0 && mkdir(b, 0700) == 0 && mkdir(d, 0700) == 0 &&
+         (fd = open(f, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)) >= 0 && close(fd) == 0 &&
+         (fd = open(x, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)) >= 0 && close(fd) == 0;
+    ok = ok && bench_path_agrees(bp, f);
+    ok = ok && rename(b, z) == 0 && mkdir(b, 0700) == 0 &&
+         (fd = open(f, O_WRONLY | O_CREAT | O_CLOEXEC, 0600)) >= 0 && close(fd) == 0;
+    ok = ok && bench_path_agrees(bp, f);
+    ok = ok && unlink(f) == 0 && symlink(x, f) == 0;
+    ok = ok && bench_path_agrees(bp, f);
+
+    (void)unlink(f);
+    (void)unlink(zf);
+    (void)unlink(x);
+    (void)rmdir(b);
+    (void)rmdir(a);
+    (void)rmdir(z);
+    (void)rmdir(d);
+    return ok;
+}
+
+static int bench_path_run(FILE *report) {
+    bench_paths *bp = (bench_paths *)calloc(1, sizeof(bench_paths));
+    int failed = 0;
+
+    if (bp == NULL) return -1;
+    if (!bench_paths_init(bp)) {
+        bench_paths_free(bp);
+        free(bp);
+        return -1;
+    }
+
+    if (report != NULL) fprintf(report, "# paths, %d per call\n", BENCH_PATHS);
+    failed += !CRYPTO_bench(report, "realpath", bench_path_realpath, bp, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "str_path_resolve, absolute", bench_path_absolute, bp, 0, BENCH_SECONDS);
+    failed += !CRYPTO_bench(report, "str_path_resolve, relative to a dirfd", bench_path_relative, bp, 0,
+                            BENCH_SECONDS);
+    if (!bench_path_renamed(bp)) {
+        if (report != NULL) fprintf(report, "# str_path_resolve did not follow a renamed directory\n");
+        failed++;
+    }
+
+    bench_paths_free(bp);
+    free(bp);
+    return failed;
+}
+
+/*============================================================================
+ * SUITE
+ *==========================================================================*/
+static int bench_set_run(FILE *report, const char *label, bench_set *set) {
+    static const struct {
+        const char *name;
+        int (*fn)(void *arg);
+    } benches[] = {
+        { "memcmp(s1, s2, strlen(s1))", bench_prefix_libc },
+        { "str_cmp_prefix", bench_prefix_str },
+        { "strcmp", bench_cmp_libc },
+        { "str_cmp", bench_cmp_str },
+        { "strrchr", bench_rchr_libc },
+        { "str_rchr", bench_rchr_str },
+        { "strlen", bench_len_libc },
+        { "str_len", bench_len_str }
+    };
+    char name[96];
+    int failed = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        (void)snprintf(name, sizeof(name), "%s, %s", benches[i].name, label);
+        failed += !CRYPTO_bench(report, name, benches[i].fn, set, set->bytes, BENCH_SECONDS);
+    }
+    return failed;
+}
+
+int str_bench_suite(FILE *report) {
+    bench_set *sets = (bench_set *)calloc(2, sizeof(bench_set));
+    int failed = 0;
+
+    if (sets == NULL) return -1;
+    if (!bench_set_init(&sets[0], 8, 64, 12345u) || !bench_set_init(&sets[1], 256, 2048, 54321u)) {
+        bench_set_free(&sets[0]);
+        bench_set_free(&sets[1]);
+        free(sets);
+        return -1;
+    }
+
+    if (report != NULL) fprintf(report, "# strings, %d per call, kernels: %s\n", BENCH_STRINGS, str_isa());
+    failed += bench_set_run(report, "8..64B", &sets[0]);
+    failed += bench_set_run(report, "256..2048B", &sets[1]);
+    failed += bench_format_run(report);
+    failed += bench_scan_run(report);
+    failed += bench_path_run(report);
+
+    bench_set_free(&sets[0]);
+    bench_set_free(&sets[1]);
+    free(sets);
+    return failed;
+}
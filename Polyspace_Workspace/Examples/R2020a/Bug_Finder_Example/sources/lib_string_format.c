@@ -0,0 +1,927 @@
+/**
+ * Backend behind lib_string.h.
+ * Bounded, locale-independent number formatting.
+ *
+ * Every function writes through a sink that counts the whole output but
+ * stores at most cap - 1 characters and a terminator, so the return value
+ * is what snprintf returns and nothing is written past cap.
+ *
+ * Shortest output (str_fmt_double, str_fmt_float) is Ryu (Adams, PLDI
+ * 2018): the bounds of the interval of reals that round to the value are
+ * scaled by a power of ten with 125-bit approximations of 5^i and 2^j / 5^i,
+ * and digits are removed while the bounds still differ. The two tables are
+ * built on first use (a millisecond or two) from exact powers of five in a
+ * small bignum. Floats go through the same code with their own mantissa and
+ * exponent widths; the tables are more precise than they need.
+ *
+ * Fixed-precision conversions (%e, %f) need correctly rounded digits at any
+ * precision, which Ryu covers only with its printf tables of about 100 KB.
+ * They are produced here from the exact decimal expansion of the binary
+ * value instead: the integer part in decimal, then the fraction f / 2^k
+ * multiplied by ten per digit, in 128 bits while k <= 124 and in the bignum
+ * beyond. The digit after the last one kept, and whether anything non-zero
+ * follows it, round to nearest with ties to even, as glibc does in the
+ * default rounding mode.
+ *
+ * str_vformat handles the conversions of the corpus's formats: flags
+ * "-+ #0", width and precision (with *), the length modifiers hh, h, l, ll,
+ * j, z and t, and d, i, u, o, x, X, c, s, p, e, E, f, F and %. It returns
+ * -1 on anything else (%g, %a, %n, L).
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strnlen */
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include "lib_string.h"
+
+enum {
+    FMT_BIG_LIMBS       = 40,   /* 1280 bits: fractions of 2^-1074 times ten, 5^341 << 125 */
+    FMT_POW5_COUNT      = 326,
+    FMT_POW5_INV_COUNT  = 342,
+    FMT_POW5_BITS       = 125,
+    FMT_INT_DIGITS      = 320,  /* DBL_MAX has 309 */
+    FMT_DIGITS_MAX      = 800   /* the exact expansion of a double has at most 767 significant digits */
+};
+
+/*============================================================================
+ * SINK
+ *==========================================================================*/
+typedef struct fmt_sink {
+    char *buf;
+    size_t cap;
+    size_t len;     /* characters of the whole output */
+} fmt_sink;
+
+static inline void sink_putc(fmt_sink *s, char c) {
+    if (s->len + 1 < s->cap) s->buf[s->len] = c;
+    s->len++;
+}
+
+static void sink_write(fmt_sink *s, const char *p, size_t n) {
+    if (s->len + 1 < s->cap) {
+        size_t room = s->cap - 1 - s->len;
+        memcpy(s->buf + s->len, p, n < room ? n : room);
+    }
+    s->len += n;
+}
+
+static void sink_repeat(fmt_sink *s, char c, size_t n) {
+    if (s->len + 1 < s->cap) {
+        size_t room = s->cap - 1 - s->len;
+        memset(s->buf + s->len, c, n < room ? n : room);
+    }
+    s->len += n;
+}
+
+static int sink_end(fmt_sink *s) {
+    if (s->cap > 0) s->buf[s->len < s->cap ? s->len : s->cap - 1] = '\0';
+    return s->len > INT_MAX ? -1 : (int)s->len;
+}
+
+/*============================================================================
+ * BIGNUM
+ *==========================================================================*/
+/* Little-endian 32-bit limbs; d[n - 1] != 0 unless n == 0 */
+typedef struct fmt_big {
+    uint32_t d[FMT_BIG_LIMBS];
+    int n;
+} fmt_big;
+
+static void big_set_u64(fmt_big *b, uint64_t v) {
+    b->d[0] = (uint32_t)v;
+    b->d[1] = (uint32_t)(v >> 32);
+    b->n = (v >> 32) != 0 ? 2 : v != 0;
+}
+
+static void big_trim(fmt_big *b) {
+    while (b->n > 0 && b->d[b->n - 1] == 0) b->n--;
+}
+
+static void big_shl(fmt_big *b, int s) {
+    int w = s >> 5, r = s & 31, n = b->n, i;
+
+    if (n == 0) return;
+    if (r == 0) {
+        for (i = n - 1; i >= 0; i--) b->d[i + w] = b->d[i];
+    } else {
+        uint32_t top = b->d[n - 1] >> (32 - r);
+
+        for (i = n - 1; i > 0; i--) b->d[i + w] = b->d[i] << r | b->d[i - 1] >> (32 - r);
+        b->d[w] = b->d[0] << r;
+        if (top != 0) b->d[n++ + w] = top;
+    }
+    for (i = 0; i < w; i++) b->d[i] = 0;
+    b->n = n + w;
+}
+
+static void big_mul_small(fmt_big *b, uint32_t k) {
+    uint64_t carry = 0;
+    int i;
+
+    for (i = 0; i < b->n; i++) {
+        carry += (uint64_t)b->d[i] * k;
+        b->d[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry != 0) b->d[b->n++] = (uint32_t)carry;
+}
+
+/* b /= k; the remainder */
+static uint32_t big_div_small(fmt_big *b, uint32_t k) {
+    uint64_t r = 0;
+    int i;
+
+    for (i = b->n - 1; i >= 0; i--) {
+        r = r << 32 | b->d[i];
+        b->d[i] = (uint32_t)(r / k);
+        r %= k;
+    }
+    big_trim(b);
+    return (uint32_t)r;
+}
+
+static int big_cmp(const fmt_big *a, const fmt_big *b) {
+    int i;
+
+    if (a->n != b->n) return a->n < b->n ? -1 : 1;
+    for (i = a->n - 1; i >= 0; i--) {
+        if (a->d[i] != b->d[i]) return a->d[i] < b->d[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* a -= b, with a >= b */
+static void big_sub(fmt_big *a, const fmt_big *b) {
+    int64_t borrow = 0;
+    int i;
+
+    for (i = 0; i < a->n; i++) {
+        int64_t t = (int64_t)a->d[i] - (i < b->n ? b->d[i] : 0) - borrow;
+        borrow = t < 0;
+        a->d[i] = (uint32_t)t;
+    }
+    big_trim(a);
+}
+
+static int big_bitlen(const fmt_big *b) {
+    return b->n == 0 ? 0 : 32 * b->n - __builtin_clz(b->d[b->n - 1]);
+}
+
+/* Bits s to s + 127 of b */
+static unsigned __int128 big_bits(const fmt_big *b, int s) {
+    unsigned __int128 v = 0;
+    int i;
+
+    for (i = 0; i < b->n; i++) {
+        int at = 32 * i - s;
+
+        if (at <= -32 || at >= 128) continue;
+        v |= at >= 0 ? (unsigned __int128)b->d[i] << at : (unsigned __int128)(b->d[i] >> -at);
+    }
+    return v;
+}
+
+/* Keeps bits 0 to k - 1 of b */
+static void big_truncate(fmt_big *b, int k) {
+    int w = k >> 5;
+
+    if (w >= b->n) return;
+    b->d[w] &= ((uint32_t)1 << (k & 31)) - 1;
+    b->n = w + 1;
+    big_trim(b);
+}
+
+/*============================================================================
+ * RYU TABLES
+ *==========================================================================*/
+/* fmt_pow5[i]: 5^i scaled to FMT_POW5_BITS bits. fmt_pow5_inv[i]:
+ * 2^(bitlen(5^i) - 1 + FMT_POW5_BITS) / 5^i + 1. Low word first */
+static uint64_t fmt_pow5[FMT_POW5_COUNT][2];
+static uint64_t fmt_pow5_inv[FMT_POW5_INV_COUNT][2];
+static pthread_once_t fmt_tables_once = PTHREAD_ONCE_INIT;
+
+static void fmt_tables_init(void) {
+    fmt_big p, r, t;
+    int i;
+
+    big_set_u64(&p, 1);
+    for (i = 0; i < FMT_POW5_INV_COUNT; i++) {
+        int len = big_bitlen(&p), pos;
+        unsigned __int128 v, q = 0;
+
+        if (i < FMT_POW5_COUNT) {
+            if (len >= FMT_POW5_BITS) {
+                v = big_bits(&p, len - FMT_POW5_BITS);
+            } else {
+                t = p;
+                big_shl(&t, FMT_POW5_BITS - len);
+                v = big_bits(&t, 0);
+            }
+            fmt_pow5[i][0] = (uint64_t)v;
+            fmt_pow5[i][1] = (uint64_t)(v >> 64);
+        }
+        /* Long division of 2^(len - 1) * 2^FMT_POW5_BITS by p, one quotient
+         * bit at a time */
+        big_set_u64(&r, 1);
+        big_shl(&r, len - 1);
+        for (pos = FMT_POW5_BITS; pos >= 0; pos--) {
+            if (pos < FMT_POW5_BITS) big_shl(&r, 1);
+            if (big_cmp(&r, &p) >= 0) {
+                big_sub(&r, &p);
+                q |= (unsigned __int128)1 << pos;
+            }
+        }
+        q += 1;
+        fmt_pow5_inv[i][0] = (uint64_t)q;
+        fmt_pow5_inv[i][1] = (uint64_t)(q >> 64);
+        big_mul_small(&p, 5);
+    }
+}
+
+/*============================================================================
+ * SHORTEST (RYU)
+ *==========================================================================*/
+/* ceil(log2(5^e)) for e > 0, 1 for e == 0 */
+static inline int pow5bits(int e) {
+    return (int)(((uint32_t)e * 1217359) >> 19) + 1;
+}
+
+/* floor(log10(2^e)) and floor(log10(5^e)), for 0 <= e <= 1650 */
+static inline int log10_pow2(int e) {
+    return (int)(((uint32_t)e * 78913) >> 18);
+}
+
+static inline int log10_pow5(int e) {
+    return (int)(((uint32_t)e * 732923) >> 20);
+}
+
+static inline int pow5_factor(uint64_t v) {
+    int count = 0;
+
+    while (v % 5 == 0) {
+        v /= 5;
+        count++;
+    }
+    return count;
+}
+
+static inline uint64_t mul_shift64(uint64_t m, const uint64_t *mul, int j) {
+    unsigned __int128 b0 = (unsigned __int128)m * mul[0];
+    unsigned __int128 b2 = (unsigned __int128)m * mul[1];
+
+    return (uint64_t)(((b0 >> 64) + b2) >> (j - 64));
+}
+
+/* The shortest decimal d * 10^e10 that reads back as m2 * 2^e2, where e2 is
+ * already lowered by two for the interval bounds */
+static uint64_t ryu_shortest(uint64_t m2, int e2, int mm_shift, int *e10_out) {
+    int accept = (m2 & 1) == 0;
+    uint64_t mv = 4 * m2, vr, vp, vm, out;
+    int e10, removed = 0, vm_zeros = 0, vr_zeros = 0;
+    unsigned int last = 0;
+
+    (void)pthread_once(&fmt_tables_once, fmt_tables_init);
+    if (e2 >= 0) {
+        int q = log10_pow2(e2) - (e2 > 3);
+        int k = FMT_POW5_BITS + pow5bits(q) - 1;
+        int i = -e2 + q + k;
+
+        e10 = q;
+        vr = mul_shift64(mv, fmt_pow5_inv[q], i);
+        vp = mul_shift64(mv + 2, fmt_pow5_inv[q], i);
+        vm = mul_shift64(mv - 1 - (uint64_t)mm_shift, fmt_pow5_inv[q], i);
+        if (q <= 21) {
+            /* Only one of mp, mv and mm can be a multiple of 5, if any */
+            if (mv % 5 == 0) vr_zeros = pow5_factor(mv) >= q;
+            else if (accept) vm_zeros = pow5_factor(mv - 1 - (uint64_t)mm_shift) >= q;
+            else vp -= pow5_factor(mv + 2) >= q;
+        }
+    } else {
+        int q = log10_pow5(-e2) - (-e2 > 1);
+        int i = -e2 - q;
+        int k = pow5bits(i) - FMT_POW5_BITS;
+        int j = q - k;
+
+        e10 = q + e2;
+        vr = mul_shift64(mv, fmt_pow5[i], j);
+        vp = mul_shift64(mv + 2, fmt_pow5[i], j);
+        vm = mul_shift64(mv - 1 - (uint64_t)mm_shift, fmt_pow5[i], j);
+        if (q <= 1) {
+            /* mv has at least q trailing zero bits, being a multiple of 4 */
+            vr_zeros = 1;
+            if (accept) vm_zeros = mm_shift == 1;
+            else vp--;
+        } else if (q < 63) {
+            vr_zeros = (mv & (((uint64_t)1 << q) - 1)) == 0;
+        }
+    }
+
+    if (vm_zeros || vr_zeros) {
+        /* Rare: the general case, tracking trailing zeros exactly */
+        while (vp / 10 > vm / 10) {
+            vm_zeros &= vm % 10 == 0;
+            vr_zeros &= last == 0;
+            last = (unsigned int)(vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_zeros) {
+            while (vm % 10 == 0) {
+                vr_zeros &= last == 0;
+                last = (unsigned int)(vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vr_zeros && last == 5 && vr % 2 == 0) last = 4;   /* exact tie: round to even */
+        out = vr + ((vr == vm && (!accept || !vm_zeros)) || last >= 5);
+    } else {
+        int round_up = 0;
+
+        while (vp / 100 > vm / 100) {
+            round_up = vr % 100 >= 50;
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while (vp / 10 > vm / 10) {
+            round_up = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        out = vr + (vr == vm || round_up);
+    }
+    e10 += removed;
+    while (out % 10 == 0) {
+        out /= 10;
+        e10++;
+    }
+    *e10_out = e10;
+    return out;
+}
+
+/* d * 10^e10 laid out as %.{p}g lays out its digits: positional for
+ * decimal exponents from -4 to p - 1, otherwise d.ddde+XX */
+static int fmt_shortest(char *buf, size_t cap, int negative, uint64_t d, int e10, int p) {
+    fmt_sink s = { buf, cap, 0 };
+    char digits[20];
+    int n = 0, x;
+
+    do {
+        digits[19 - n++] = (char)('0' + d % 10);
+        d /= 10;
+    } while (d != 0);
+    memmove(digits, digits + 20 - n, (size_t)n);
+    x = e10 + n - 1;
+
+    if (negative) sink_putc(&s, '-');
+    if (x >= -4 && x < p) {
+        if (x < 0) {
+            sink_write(&s, "0.", 2);
+            sink_repeat(&s, '0', (size_t)(-x - 1));
+            sink_write(&s, digits, (size_t)n);
+        } else if (n <= x + 1) {
+            sink_write(&s, digits, (size_t)n);
+            sink_repeat(&s, '0', (size_t)(x + 1 - n));
+        } else {
+            sink_write(&s, digits, (size_t)(x + 1));
+            sink_putc(&s, '.');
+            sink_write(&s, digits + x + 1, (size_t)(n - x - 1));
+        }
+    } else {
+        sink_putc(&s, digits[0]);
+        if (n > 1) {
+            sink_putc(&s, '.');
+            sink_write(&s, digits + 1, (size_t)(n - 1));
+        }
+        sink_putc(&s, 'e');
+        sink_putc(&s, x < 0 ? '-' : '+');
+        if (x < 0) x = -x;
+        if (x >= 100) sink_putc(&s, (char)('0' + x / 100));
+        sink_putc(&s, (char)('0' + x / 10 % 10));
+        sink_putc(&s, (char)('0' + x % 10));
+    }
+    return sink_end(&s);
+}
+
+static int fmt_special(char *buf, size_t cap, int negative, int nan) {
+    fmt_sink s = { buf, cap, 0 };
+
+    if (negative) sink_putc(&s, '-');
+    sink_write(&s, nan ? "nan" : "inf", 3);
+    return sink_end(&s);
+}
+
+int str_fmt_double(char *buf, size_t cap, double v) {
+    uint64_t bits, mant;
+    int exp, negative, e10;
+    uint64_t d;
+
+    memcpy(&bits, &v, sizeof(bits));
+    mant = bits & (((uint64_t)1 << 52) - 1);
+    exp = (int)(bits >> 52 & 0x7ff);
+    negative = (int)(bits >> 63);
+    if (exp == 0x7ff) return fmt_special(buf, cap, negative, mant != 0);
+    if (exp == 0 && mant == 0) return fmt_shortest(buf, cap, negative, 0, 0, 17);
+    d = ryu_shortest(exp == 0 ? mant : mant | (uint64_t)1 << 52, (exp == 0 ? 1 : exp) - 1023 - 52 - 2,
+                     mant != 0 || exp <= 1, &e10);
+    return fmt_shortest(buf, cap, negative, d, e10, 17);
+}
+
+int str_fmt_float(char *buf, size_t cap, float v) {
+    uint32_t bits, mant;
+    int exp, negative, e10;
+    uint64_t d;
+
+    memcpy(&bits, &v, sizeof(bits));
+    mant = bits & ((1u << 23) - 1);
+    exp = (int)(bits >> 23 & 0xff);
+    negative = (int)(bits >> 31);
+    if (exp == 0xff) return fmt_special(buf, cap, negative, mant != 0);
+    if (exp == 0 && mant == 0) return fmt_shortest(buf, cap, negative, 0, 0, 9);
+    d = ryu_shortest(exp == 0 ? mant : mant | 1u << 23, (exp == 0 ? 1 : exp) - 127 - 23 - 2,
+                     mant != 0 || exp <= 1, &e10);
+    return fmt_shortest(buf, cap, negative, d, e10, 9);
+}
+
+/*============================================================================
+ * EXACT DIGITS
+ *==========================================================================*/
+/* The decimal expansion of m * 2^e, from its first significant digit */
+typedef struct fmt_exact {
+    char ip[FMT_INT_DIGITS];    /* integer part, or the first digit of the fraction */
+    int ip_len, ip_at;
+    int k;                      /* bits of the fraction, 0 when there is none */
+    unsigned __int128 f;        /* the fraction times 2^k, when k <= 124 */
+    fmt_big fb;                 /* the same, when k > 124 */
+} fmt_exact;
+
+static int exact_fraction_digit(fmt_exact *x) {
+    int d;
+
+    if (x->k <= 124) {
+        x->f *= 10;
+        d = (int)(x->f >> x->k);
+        x->f &= ((unsigned __int128)1 << x->k) - 1;
+    } else {
+        big_mul_small(&x->fb, 10);
+        d = (int)(big_bits(&x->fb, x->k) & 15);
+        big_truncate(&x->fb, x->k);
+    }
+    return d;
+}
+
+static int exact_fraction_zero(const fmt_exact *x) {
+    return x->k == 0 || (x->k <= 124 ? x->f == 0 : x->fb.n == 0);
+}
+
+static int exact_next(fmt_exact *x) {
+    if (x->ip_at < x->ip_len) return x->ip[x->ip_at++] - '0';
+    if (x->k == 0) return 0;
+    return exact_fraction_digit(x);
+}
+
+static int exact_rest_zero(const fmt_exact *x) {
+    int i;
+
+    for (i = x->ip_at; i < x->ip_len; i++) {
+        if (x->ip[i] != '0') return 0;
+    }
+    return exact_fraction_zero(x);
+}
+
+static int u64_digits(char *out, uint64_t v) {
+    char tmp[20];
+    int n = 0, i;
+
+    do {
+        tmp[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v != 0);
+    for (i = 0; i < n; i++) out[i] = tmp[n - 1 - i];
+    return n;
+}
+
+/* Sets x up for m * 2^e with m > 0; the decimal exponent of its first
+ * significant digit */
+static int exact_start(fmt_exact *x, uint64_t m, int e) {
+    int tz = __builtin_ctzll(m), exp10;
+
+    m >>= tz;
+    e += tz;
+    x->ip_at = 0;
+    x->ip_len = 0;
+    x->k = 0;
+    if (e >= 0) {
+        if (e + 64 - __builtin_clzll(m) <= 64) {
+            x->ip_len = u64_digits(x->ip, m << e);
+        } else {
+            /* Nine digits per division, least significant group first */
+            fmt_big b;
+            uint32_t groups[FMT_INT_DIGITS / 9 + 1];
+            int ng = 0, i;
+
+            big_set_u64(&b, m);
+            big_shl(&b, e);
+            while (b.n > 0) groups[ng++] = big_div_small(&b, 1000000000u);
+            x->ip_len = u64_digits(x->ip, groups[ng - 1]);
+            for (i = ng - 2; i >= 0; i--) {
+                uint32_t g = groups[i];
+                int j;
+
+                for (j = 8; j >= 0; j--) {
+                    x->ip[x->ip_len + j] = (char)('0' + g % 10);
+                    g /= 10;
+                }
+                x->ip_len += 9;
+            }
+        }
+        return x->ip_len - 1;
+    }
+
+    x->k = -e;
+    if (x->k < 64 && (m >> x->k) != 0) x->ip_len = u64_digits(x->ip, m >> x->k);
+    if (x->k <= 124) {
+        x->f = (unsigned __int128)m & (((unsigned __int128)1 << x->k) - 1);
+    } else {
+        big_set_u64(&x->fb, m);
+    }
+    if (x->ip_len > 0) return x->ip_len - 1;
+
+    /* Below one: skip the fraction's leading zeros */
+    exp10 = -1;
+    for (;;) {
+        int d = exact_fraction_digit(x);
+
+        if (d != 0) {
+            x->ip[0] = (char)('0' + d);
+            x->ip_len = 1;
+            return exp10;
+        }
+        exp10--;
+    }
+}
+
+/* Writes the first n significant digits of x, rounded to nearest-even on
+ * the rest; 1 when rounding carried out of the first digit, which leaves
+ * "100..." */
+static int exact_round(fmt_exact *x, char *digits, int n) {
+    int i, next, up;
+
+    for (i = 0; i < n; i++) digits[i] = (char)('0' + exact_next(x));
+    next = n < 0 ? 0 : exact_next(x);
+    if (next < 5) return 0;
+    up = next > 5 || !exact_rest_zero(x) || (n > 0 && (digits[n - 1] - '0') % 2 == 1);
+    if (!up) return 0;
+    for (i = n - 1; i >= 0 && digits[i] == '9'; i--) digits[i] = '0';
+    if (i >= 0) {
+        digits[i]++;
+        return 0;
+    }
+    if (n > 0) digits[0] = '1';
+    return 1;
+}
+
+/*============================================================================
+ * CONVERSIONS
+ *==========================================================================*/
+typedef struct fmt_spec {
+    int left, plus, space, alt, zero;
+    size_t width;
+    int prec;           /* -1 when not given */
+    char conv;
+} fmt_spec;
+
+static const char fmt_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+/* The digits of v in base, ending at end; their count */
+static int fmt_utoa(char *end, uint64_t v, unsigned int base, int upper) {
+    const char *hex = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+    char *p = end;
+
+    if (base == 10) {
+        while (v >= 100) {
+            unsigned int r = (unsigned int)(v % 100);
+            v /= 100;
+            p -= 2;
+            memcpy(p, fmt_pairs + 2 * r, 2);
+        }
+        if (v >= 10) {
+            p -= 2;
+            memcpy(p, fmt_pairs + 2 * v, 2);
+        } else {
+            *--p = (char)('0' + v);
+        }
+    } else {
+        do {
+            *--p = hex[v % base];
+            v /= base;
+        } while (v != 0);
+    }
+    return (int)(end - p);
+}
+
+/* prefix, zeros and body inside the field width: spaces before or after,
+ * or zeros after the prefix for the 0 flag */
+static void emit_padded(fmt_sink *s, const fmt_spec *sp, int zero_pad, const char *prefix, size_t prefix_len,
+                        size_t zeros, const char *body, size_t body_len) {
+    size_t len = prefix_len + zeros + body_len;
+    size_t fill = sp->width > len ? sp->width - len : 0;
+
+    if (!sp->left && !zero_pad) sink_repeat(s, ' ', fill);
+    sink_write(s, prefix, prefix_len);
+    sink_repeat(s, '0', zeros + (!sp->left && zero_pad ? fill : 0));
+    sink_write(s, body, body_len);
+    if (sp->left) sink_repeat(s, ' ', fill);
+}
+
+static void conv_int(fmt_sink *s, const fmt_spec *sp, uint64_t v, int negative) {
+    unsigned int base = sp->conv == 'o' ? 8 : (sp->conv == 'x' || sp->conv == 'X') ? 16 : 10;
+    char digits[24], prefix[2];
+    int n = 0, prefix_len = 0;
+    size_t zeros = 0;
+
+    if (v != 0 || sp->prec != 0) n = fmt_utoa(digits + sizeof(digits), v, base, sp->conv == 'X');
+    if (negative) prefix[prefix_len++] = '-';
+    else if (base == 10 && (sp->conv == 'd' || sp->conv == 'i') && sp->plus) prefix[prefix_len++] = '+';
+    else if (base == 10 && (sp->conv == 'd' || sp->conv == 'i') && sp->space) prefix[prefix_len++] = ' ';
+    if (sp->alt && base == 16 && v != 0) {
+        prefix[0] = '0';
+        prefix[1] = sp->conv;
+        prefix_len = 2;
+    }
+    if (sp->prec > n) zeros = (size_t)(sp->prec - n);
+    if (sp->alt && base == 8 && zeros == 0 && (n == 0 || digits[sizeof(digits) - n] != '0')) zeros = 1;
+    emit_padded(s, sp, sp->zero && sp->prec < 0, prefix, (size_t)prefix_len, zeros,
+                digits + sizeof(digits) - n, (size_t)n);
+}
+
+/* Digits from..from + count - 1 of a number with nd significant digits
+ * stored; those before the first or past the stored ones are zeros */
+static void emit_digits(fmt_sink *s, const char *digits, int nd, long long from, long long count) {
+    if (from < 0) {
+        long long z = -from < count ? -from : count;
+        sink_repeat(s, '0', (size_t)z);
+        from += z;
+        count -= z;
+    }
+    if (count > 0 && from < nd) {
+        long long c = nd - from < count ? nd - from : count;
+        sink_write(s, digits + from, (size_t)c);
+        from += c;
+        count -= c;
+    }
+    if (count > 0) sink_repeat(s, '0', (size_t)count);
+}
+
+static void conv_float(fmt_sink *s, const fmt_spec *sp, double v) {
+    int upper = sp->conv == 'E' || sp->conv == 'F';
+    int fixed = sp->conv == 'f' || sp->conv == 'F';
+    int prec = sp->prec < 0 ? 6 : sp->prec;
+    int point = prec > 0 || sp->alt;
+    char sign[1], digits[FMT_DIGITS_MAX], exp_buf[8];
+    int sign_len = 0, nd = 0, x = 0, exp_len = 0, negative, bexp;
+    uint64_t bits, mant;
+    size_t body;
+
+    memcpy(&bits, &v, sizeof(bits));
+    mant = bits & (((uint64_t)1 << 52) - 1);
+    bexp = (int)(bits >> 52 & 0x7ff);
+    negative = (int)(bits >> 63);
+    if (negative) sign[sign_len++] = '-';
+    else if (sp->plus) sign[sign_len++] = '+';
+    else if (sp->space) sign[sign_len++] = ' ';
+
+    if (bexp == 0x7ff) {
+        const char *word = mant != 0 ? (upper ? "NAN" : "nan") : (upper ? "INF" : "inf");
+        emit_padded(s, sp, 0, sign, (size_t)sign_len, 0, word, 3);
+        return;
+    }
+    if (bexp != 0 || mant != 0) {
+        fmt_exact ex;
+        long long n;
+
+        x = exact_start(&ex, bexp != 0 ? mant | (uint64_t)1 << 52 : mant, (bexp != 0 ? bexp : 1) - 1075);
+        n = fixed ? (long long)x + 1 + prec : (long long)prec + 1;
+        if (n < 0) {
+            x = 0;          /* below half a unit of the last place: zero */
+        } else {
+            nd = n < FMT_DIGITS_MAX ? (int)n : FMT_DIGITS_MAX;
+            if (exact_round(&ex, digits, nd)) {
+                x++;
+                if (nd == 0) nd = 1;
+                digits[0] = '1';
+            }
+        }
+    }
+
+    if (fixed) {
+        body = (size_t)(x >= 0 ? x + 1 : 1) + (point ? 1 + (size_t)prec : 0);
+    } else {
+        int ax = x < 0 ? -x : x;
+
+        exp_buf[exp_len++] = upper ? 'E' : 'e';
+        exp_buf[exp_len++] = x < 0 ? '-' : '+';
+        if (ax >= 100) exp_buf[exp_len++] = (char)('0' + ax / 100);
+        exp_buf[exp_len++] = (char)('0' + ax / 10 % 10);
+        exp_buf[exp_len++] = (char)('0' + ax % 10);
+        body = 1 + (point ? 1 + (size_t)prec : 0) + (size_t)exp_len;
+    }
+
+    {
+        size_t len = (size_t)sign_len + body;
+        size_t fill = sp->width > len ? sp->width - len : 0;
+
+        if (!sp->left && !sp->zero) sink_repeat(s, ' ', fill);
+        sink_write(s, sign, (size_t)sign_len);
+        if (!sp->left && sp->zero) sink_repeat(s, '0', fill);
+        if (fixed) {
+            if (x >= 0) emit_digits(s, digits, nd, 0, (long long)x + 1);
+            else sink_putc(s, '0');
+            if (point) sink_putc(s, '.');
+            emit_digits(s, digits, nd, (long long)x + 1, prec);
+        } else {
+            emit_digits(s, digits, nd, 0, 1);
+            if (point) sink_putc(s, '.');
+            emit_digits(s, digits, nd, 1, prec);
+            sink_write(s, exp_buf, (size_t)exp_len);
+        }
+        if (sp->left) sink_repeat(s, ' ', fill);
+    }
+}
+
+/*============================================================================
+ * FORMAT
+ *==========================================================================*/
+int str_vformat(char *buf, size_t cap, const char *fmt, va_list ap) {
+    fmt_sink s = { buf, cap, 0 };
+
+    for (;;) {
+        const char *lit = fmt;
+        fmt_spec sp = { 0, 0, 0, 0, 0, 0, -1, 0 };
+        int len_mod = 0;   /* 'H' hh, 'h', 'l', 'q' ll, 'j', 'z', 't' */
+
+        while (*fmt != '%' && *fmt != '\0') fmt++;
+        if (fmt != lit) sink_write(&s, lit, (size_t)(fmt - lit));
+        if (*fmt++ == '\0') break;
+
+        for (;; fmt++) {
+            if (*fmt == '-') sp.left = 1;
+            else if (*fmt == '+') sp.plus = 1;
+            else if (*fmt == ' ') sp.space = 1;
+            else if (*fmt == '#') sp.alt = 1;
+            else if (*fmt == '0') sp.zero = 1;
+            else break;
+        }
+        if (*fmt == '*') {
+            int w = va_arg(ap, int);
+            if (w < 0) {
+                sp.left = 1;
+                sp.width = (size_t)-(long long)w;
+            } else {
+                sp.width = (size_t)w;
+            }
+            fmt++;
+        } else {
+            while (*fmt >= '0' && *fmt <= '9') sp.width = sp.width * 10 + (size_t)(*fmt++ - '0');
+        }
+        if (*fmt == '.') {
+            fmt++;
+            if (*fmt == '*') {
+                int p = va_arg(ap, int);
+                sp.prec = p < 0 ? -1 : p;
+                fmt++;
+            } else {
+                sp.prec = 0;
+                while (*fmt >= '0' && *fmt <= '9') {
+                    if (sp.prec > (INT_MAX - 9) / 10) return -1;
+                    sp.prec = sp.prec * 10 + (*fmt++ - '0');
+                }
+            }
+        }
+        switch (*fmt) {
+        case 'h': len_mod = fmt[1] == 'h' ? 'H' : 'h'; fmt += len_mod == 'H' ? 2 : 1; break;
+        case 'l': len_mod = fmt[1] == 'l' ? 'q' : 'l'; fmt += len_mod == 'q' ? 2 : 1; break;
+        case 'j': case 'z': case 't': len_mod = *fmt++; break;
+        default: break;
+        }
+        sp.conv = *fmt++;
+        if (sp.left) sp.zero = 0;
+
+        switch (sp.conv) {
+        case 'd':
+        case 'i': {
+            long long v;
+            switch (len_mod) {
+            case 'H': v = (signed char)va_arg(ap, int); break;
+            case 'h': v = (short)va_arg(ap, int); break;
+            case 'l': v = va_arg(ap, long); break;
+            case 'q': v = va_arg(ap, long long); break;
+            case 'j': v = (long long)va_arg(ap, intmax_t); break;
+            case 'z': v = (long long)va_arg(ap, size_t); break;
+            case 't': v = (long long)va_arg(ap, ptrdiff_t); break;
+            default: v = va_arg(ap, int); break;
+            }
+            conv_int(&s, &sp, v < 0 ? 0 - (uint64_t)v : (uint64_t)v, v < 0);
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': {
+            uint64_t v;
+            switch (len_mod) {
+            case 'H': v = (unsigned char)va_arg(ap, unsigned int); break;
+            case 'h': v = (unsigned short)va_arg(ap, unsigned int); break;
+            case 'l': v = va_arg(ap, unsigned long); break;
+            case 'q': v = va_arg(ap, unsigned long long); break;
+            case 'j': v = (uint64_t)va_arg(ap, uintmax_t); break;
+            case 'z': v = va_arg(ap, size_t); break;
+            case 't': v = (uint64_t)va_arg(ap, ptrdiff_t); break;
+            default: v = va_arg(ap, unsigned int); break;
+            }
+            conv_int(&s, &sp, v, 0);
+            break;
+        }
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+            conv_float(&s, &sp, va_arg(ap, double));
+            break;
+        case 'c': {
+            char c = (char)va_arg(ap, int);
+            emit_padded(&s, &sp, 0, NULL, 0, 0, &c, 1);
+            break;
+        }
+        case 's': {
+            const char *str = va_arg(ap, const char *);
+            if (str == NULL) str = sp.prec < 0 || sp.prec >= 6 ? "(null)" : "";
+            emit_padded(&s, &sp, 0, NULL, 0, 0, str, sp.prec < 0 ? strlen(str) : strnlen(str, (size_t)sp.prec));
+            break;
+        }
+        case 'p': {
+            void *p = va_arg(ap, void *);
+            if (p == NULL) {
+                emit_padded(&s, &sp, 0, NULL, 0, 0, "(nil)", 5);
+            } else {
+                sp.conv = 'x';
+                sp.alt = 1;
+                sp.zero = 0;
+                conv_int(&s, &sp, (uint64_t)(uintptr_t)p, 0);
+            }
+            break;
+        }
+        case '%':
+            sink_putc(&s, '%');
+            break;
+        default:
+            (void)sink_end(&s);
+            return -1;
+        }
+    }
+    return sink_end(&s);
+}
+
+int str_format(char *buf, size_t cap, const char *fmt, ...) {
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = str_vformat(buf, cap, fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+int str_fmt_u64(char *buf, size_t cap, uint64_t v) {
+    fmt_sink s = { buf, cap, 0 };
+    char digits[20];
+    int n = fmt_utoa(digits + sizeof(digits), v, 10, 0);
+
+    sink_write(&s, digits + sizeof(digits) - n, (size_t)n);
+    return sink_end(&s);
+}
+
+int str_fmt_i64(char *buf, size_t cap, int64_t v) {
+    fmt_sink s = { buf, cap, 0 };
+    char digits[20];
+    int n = fmt_utoa(digits + sizeof(digits), v < 0 ? 0 - (uint64_t)v : (uint64_t)v, 10, 0);
+
+    if (v < 0) sink_putc(&s, '-');
+    sink_write(&s, digits + sizeof(digits) - n, (size_t)n);
+    return sink_end(&s);
+}
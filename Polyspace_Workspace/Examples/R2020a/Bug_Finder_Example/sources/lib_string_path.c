@@ -0,0 +1,734 @@
+/**
+ * Backend behind lib_string.h.
+ * A realpath cache invalidated through inotify.
+ *
+ * Entries are keyed by (dirfd, path), absolute paths by the path alone and
+ * paths relative to the working directory by the absolute path getcwd makes
+ * of them, so that a chdir cannot leave a stale entry behind. They sit in
+ * a hash table whose chains only ever grow at their head: lookups walk them
+ * without a lock and, while the entry is not stale, return its canonical
+ * path without a system call beyond that getcwd. Everything else (resolution, insertion,
+ * invalidation) runs under the cache's mutex.
+ *
+ * A resolution records every (directory, name) lookup it makes, the
+ * directories of the starting point included, and puts an inotify watch on
+ * each directory. Deleting, renaming or replacing one of those names in one
+ * of those directories is what can change the result, so an IN_DELETE,
+ * IN_MOVED_FROM or IN_MOVED_TO event for it marks the entry stale; creating
+ * a name cannot change a lookup that succeeded. Events are read without
+ * blocking at most every PATH_DRAIN_NS (in practice a clock tick, the
+ * resolution of the coarse clock) by whichever lookup finds the drain due,
+ * so a change is seen a few milliseconds after the kernel reports it. An
+ * entry whose directories could not all be watched is kept stale and
+ * resolved on every use.
+ *
+ * The watch descriptors are remembered by directory path, but inotify
+ * watches inodes: a directory renamed keeps its watch, which then reports
+ * on its new place. Deleting or moving a directory away therefore also
+ * forgets the descriptors remembered for it and for the directories below
+ * it, so that the next resolution through that path watches whatever is
+ * there by then. Each watch keeps the list of the lookups made in its
+ * directory, so that an event visits only the entries it may concern, and
+ * the watched directories form a tree, so that forgetting those below one
+ * visits only them.
+ *
+ * A miss puts its watches in place first, so that no change can slip in
+ * unreported, then opens the path with openat2(RESOLVE_NO_SYMLINKS). When
+ * that succeeds no link was involved, and the canonical path is the lexical
+ * normalisation of the starting directory and the path: two system calls
+ * instead of realpath's one readlink per component. When a link is in the
+ * way, or openat2 is missing, the components are resolved one readlink at
+ * a time, as realpath does.
+ *
+ * Canonical paths are interned in the cache's arena: equal paths come back
+ * as the same pointer, and a pointer stays valid until the cache is
+ * destroyed, whatever happens to its entry. Nothing is evicted either: the
+ * lock-free lookups leave no moment at which an entry could safely be
+ * freed, so the cache's memory grows with the distinct paths it has seen.
+ */
+
+#define _GNU_SOURCE  /* For O_PATH, CLOCK_MONOTONIC_COARSE */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#ifdef SYS_openat2
+#include <linux/openat2.h>
+#endif
+#include "lib_memory.h"
+#include "lib_string.h"
+
+enum {
+    PATH_DRAIN_NS         = 1000000,
+    PATH_LINKS_MAX        = 40,         /* the kernel's MAXSYMLINKS */
+    PATH_DEPS_MAX         = 256,        /* lookups recorded per resolution */
+    PATH_DIRFD_ABSOLUTE   = INT_MIN,    /* the key of absolute paths */
+    PATH_DIRFD_FORGOTTEN  = INT_MIN + 1
+};
+
+#define PATH_WATCH_MASK (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW)
+#define PATH_HASH_SEED  0xCBF29CE484222325u  /* FNV-1a offset basis */
+
+/* A name looked up in a watched directory */
+typedef struct path_dep {
+    int wd;
+    uint32_t name_hash;
+    struct path_entry *entry;       /* NULL while on no watch's list */
+    struct path_dep *next;          /* on the list of watch wd */
+    struct path_dep **pprev;
+} path_dep;
+
+typedef struct path_entry {
+    struct path_entry *next;        /* in its bucket; never changes once published */
+    struct path_entry *all_next;    /* in the list of every entry */
+    uint64_t hash;
+    int dirfd;                      /* or PATH_DIRFD_ABSOLUTE, PATH_DIRFD_FORGOTTEN */
+    int stale;
+    const char *path;
+    const char *canonical;
+    path_dep *deps;
+    int ndeps;
+    int deps_cap;                   /* the room in deps, reused by later resolutions */
+} path_entry;
+
+/* A watched directory, or an interned path when the rest is unused */
+typedef struct path_name {
+    struct path_name *next;
+    uint64_t hash;
+    const char *s;
+    int wd;                         /* -1 once the kernel dropped the watch */
+    struct path_name *wd_next;      /* among the names of watch wd */
+    struct path_name *parent;       /* NULL for the root, and until linked */
+    struct path_name *child;        /* the watched directories right below */
+    struct path_name *sibling;
+} path_name;
+
+/* A watch descriptor, with the directories it was handed out for and the
+ * lookups made in them */
+typedef struct path_watch {
+    struct path_watch *next;
+    int wd;
+    path_name *names;
+    path_dep *deps;
+} path_watch;
+
+struct str_path_cache {
+    path_entry **buckets;           /* read without the lock */
+    path_name **watches;
+    path_name **interned;
+    path_watch **wds;
+    size_t mask;
+    path_entry *all;
+    mem_arena *arena;
+    pthread_mutex_t lock;
+    int inotify_fd;                 /* -1 without inotify: nothing is cached */
+    int no_openat2;
+    int64_t next_drain;             /* CLOCK_MONOTONIC_COARSE nanoseconds */
+};
+
+/* FNV-1a from h */
+static uint64_t path_hash(const char *s, size_t len, uint64_t h) {
+    size_t i;
+
+    for (i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 0x100000001B3u;
+    return h;
+}
+
+static uint64_t path_key_hash(int dirfd, const char *path) {
+    return path_hash(path, strlen(path), (PATH_HASH_SEED ^ (uint32_t)dirfd) * 0x100000001B3u);
+}
+
+/*============================================================================
+ * NAMES
+ *==========================================================================*/
+/* The record of s[0..len) in table; NULL when absent */
+static path_name *name_find(str_path_cache *c, path_name **table, const char *s, size_t len) {
+    uint64_t h = path_hash(s, len, PATH_HASH_SEED);
+    path_name *n;
+
+    for (n = table[h & c->mask]; n != NULL; n = n->next) {
+        if (n->hash == h && strncmp(n->s, s, len) == 0 && n->s[len] == '\0') return n;
+    }
+    return NULL;
+}
+
+/* The record of s[0..len) in table, created with wd -1 when absent; NULL
+ * when out of memory */
+static path_name *name_get(str_path_cache *c, path_name **table, const char *s, size_t len) {
+    path_name *n = name_find(c, table, s, len);
+    char *copy;
+
+    if (n != NULL) return n;
+    n = (path_name *)mem_arena_calloc(c->arena, 1, sizeof(*n));
+    copy = (char *)mem_arena_alloc_aligned(c->arena, len + 1, 1);
+    if (n == NULL || copy == NULL) return NULL;
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    n->hash = path_hash(s, len, PATH_HASH_SEED);
+    n->s = copy;
+    n->wd = -1;
+    n->next = table[n->hash & c->mask];
+    table[n->hash & c->mask] = n;
+    return n;
+}
+
+/*============================================================================
+ * WATCHES
+ *==========================================================================*/
+/* The record of watch descriptor wd, created when absent if create is set;
+ * NULL when absent or out of memory. Records are never dropped: the kernel
+ * hands the same descriptor out again for the same directory, and one it
+ * reuses for another directory only costs spurious invalidations */
+static path_watch *watch_of(str_path_cache *c, int wd, int create) {
+    size_t b = (size_t)wd & c->mask;
+    path_watch *w;
+
+    for (w = c->wds[b]; w != NULL; w = w->next) {
+        if (w->wd == wd) return w;
+    }
+    if (!create) return NULL;
+    w = (path_watch *)mem_arena_calloc(c->arena, 1, sizeof(*w));
+    if (w == NULL) return NULL;
+    w->wd = wd;
+    w->next = c->wds[b];
+    c->wds[b] = w;
+    return w;
+}
+
+/* Gives the directory n the watch descriptor wd, -1 for none; 0, or -1
+ * when out of memory */
+static int watch_set(str_path_cache *c, path_name *n, int wd) {
+    path_watch *w;
+    path_name **p;
+
+    if (n->wd >= 0 && (w = watch_of(c, n->wd, 0)) != NULL) {
+        for (p = &w->names; *p != NULL; p = &(*p)->wd_next) {
+            if (*p == n) {
+                *p = n->wd_next;
+                break;
+            }
+        }
+    }
+    n->wd = -1;
+    if (wd < 0) return 0;
+    if ((w = watch_of(c, wd, 1)) == NULL) return -1;
+    n->wd = wd;
+    n->wd_next = w->names;
+    w->names = n;
+    return 0;
+}
+
+/* The record of the directory dir[0..len), "" being the root, linked below
+ * those of its ancestors; NULL when out of memory */
+static path_name *watch_name(str_path_cache *c, const char *dir, size_t len) {
+    path_name *n, *parent;
+    size_t up = len;
+
+    if (len == 0) return name_get(c, c->watches, "/", 1);
+    n = name_get(c, c->watches, dir, len);
+    if (n == NULL || n->parent != NULL) return n;
+    while (up > 0 && dir[--up] != '/') continue;
+    if ((parent = watch_name(c, dir, up)) == NULL) return NULL;
+    n->parent = parent;
+    n->sibling = parent->child;
+    parent->child = n;
+    return n;
+}
+
+/* The watch descriptor of a directory; -1 when it cannot be watched */
+static int watch_dir(str_path_cache *c, const char *dir, size_t len) {
+    path_name *n;
+    int wd;
+
+    if (c->inotify_fd < 0) return -1;
+    n = watch_name(c, dir, len);
+    if (n == NULL) return -1;
+    if (n->wd < 0) {
+        wd = inotify_add_watch(c->inotify_fd, n->s, PATH_WATCH_MASK);
+        if (wd < 0 || watch_set(c, n, wd) != 0) return -1;
+    }
+    return n->wd;
+}
+
+/* Forgets the watch descriptors of the directory n and of those below it */
+static void watch_forget(str_path_cache *c, path_name *n) {
+    path_name *k;
+
+    (void)watch_set(c, n, -1);
+    for (k = n->child; k != NULL; k = k->sibling) watch_forget(c, k);
+}
+
+/* Puts the lookups of e on the lists of their watches; 0, or -1 when a
+ * watch has no record */
+static int deps_link(str_path_cache *c, path_entry *e) {
+    path_watch *w;
+    path_dep *d;
+    int i;
+
+    for (i = 0; i < e->ndeps; i++) {
+        d = &e->deps[i];
+        d->entry = NULL;
+        if ((w = watch_of(c, d->wd, 0)) == NULL) return -1;
+        d->entry = e;
+        d->next = w->deps;
+        d->pprev = &w->deps;
+        if (w->deps != NULL) w->deps->pprev = &d->next;
+        w->deps = d;
+    }
+    return 0;
+}
+
+/* Takes the lookups of e off the lists of their watches */
+static void deps_unlink(path_entry *e) {
+    path_dep *d;
+    int i;
+
+    for (i = 0; i < e->ndeps; i++) {
+        d = &e->deps[i];
+        if (d->entry == NULL) break;  /* deps_link stopped there */
+        *d->pprev = d->next;
+        if (d->next != NULL) d->next->pprev = d->pprev;
+        d->entry = NULL;
+    }
+}
+
+/* Marks stale the entries that looked up a name hashing to name_hash in
+ * watch wd; any name when any_name */
+static void path_invalidate(str_path_cache *c, int wd, uint32_t name_hash, int any_name) {
+    path_watch *w = watch_of(c, wd, 0);
+    path_dep *d;
+
+    for (d = w != NULL ? w->deps : NULL; d != NULL; d = d->next) {
+        if (any_name || d->name_hash == name_hash) __atomic_store_n(&d->entry->stale, 1, __ATOMIC_RELEASE);
+    }
+}
+
+/* Marks every entry stale */
+static void path_invalidate_all(str_path_cache *c) {
+    path_entry *e;
+
+    for (e = c->all; e != NULL; e = e->all_next) __atomic_store_n(&e->stale, 1, __ATOMIC_RELEASE);
+}
+
+/* Forgets the watch descriptors remembered for the directory name in watch
+ * wd and for those below it */
+static void path_unwatch(str_path_cache *c, int wd, const char *name) {
+    path_watch *w = watch_of(c, wd, 0);
+    size_t plen, nlen = strlen(name);
+    char dir[PATH_MAX];
+    path_name *p, *n;
+
+    for (p = w != NULL ? w->names : NULL; p != NULL; p = p->wd_next) {
+        plen = strcmp(p->s, "/") == 0 ? 0 : strlen(p->s);
+        if (plen + 1 + nlen >= sizeof(dir)) continue;  /* too long to have been watched */
+        memcpy(dir, p->s, plen);
+        dir[plen] = '/';
+        memcpy(dir + plen + 1, name, nlen);
+        if ((n = name_find(c, c->watches, dir, plen + 1 + nlen)) != NULL) watch_forget(c, n);
+    }
+}
+
+/* Reads the pending inotify events */
+static void path_drain(str_path_cache *c) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    path_watch *w;
+    ssize_t got;
+    char *p;
+
+    while ((got = read(c->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (p = buf; p < buf + got; p += sizeof(struct inotify_event) + ev->len) {
+            ev = (const struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                path_invalidate_all(c);
+            } else if (ev->mask & IN_IGNORED) {
+                /* The directory is gone; its number may be handed out again */
+                path_invalidate(c, ev->wd, 0, 1);
+                if ((w = watch_of(c, ev->wd, 0)) != NULL) {
+                    while (w->names != NULL) (void)watch_set(c, w->names, -1);
+                }
+            } else if (ev->len > 0) {
+                uint32_t name_hash = (uint32_t)path_hash(ev->name, strlen(ev->name), PATH_HASH_SEED);
+
+                path_invalidate(c, ev->wd, name_hash, 0);
+                if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_DELETE | IN_MOVED_FROM))) {
+                    path_unwatch(c, ev->wd, ev->name);
+                }
+            }
+        }
+    }
+}
+
+static void path_poll(str_path_cache *c) {
+    struct timespec ts;
+    int64_t now;
+
+    if (c->inotify_fd < 0) return;
+    (void)clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (now < __atomic_load_n(&c->next_drain, __ATOMIC_RELAXED)) return;
+    if (pthread_mutex_trylock(&c->lock) != 0) return;  /* draining or resolving already */
+    __atomic_store_n(&c->next_drain, now + PATH_DRAIN_NS, __ATOMIC_RELAXED);
+    path_drain(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+/*============================================================================
+ * RESOLUTION
+ *==========================================================================*/
+typedef struct path_walk {
+    str_path_cache *c;
+    char out[PATH_MAX];             /* the canonical prefix, without a trailing '/'; "" for the root */
+    size_t len;
+    path_dep deps[PATH_DEPS_MAX];
+    int ndeps;
+    int watched;                    /* every lookup is in a watched directory */
+} path_walk;
+
+static void walk_init(path_walk *w, str_path_cache *c) {
+    w->c = c;
+    w->len = 0;
+    w->ndeps = 0;
+    w->watched = 1;
+}
+
+static void walk_lookup(path_walk *w, const char *name, size_t n) {
+    int wd;
+
+    if (!w->watched) return;
+    w->out[w->len] = '\0';
+    wd = watch_dir(w->c, w->out, w->len);
+    if (wd < 0 || w->ndeps == PATH_DEPS_MAX) {
+        w->watched = 0;
+        return;
+    }
+    w->deps[w->ndeps].wd = wd;
+    w->deps[w->ndeps].name_hash = (uint32_t)path_hash(name, n, PATH_HASH_SEED);
+    w->ndeps++;
+}
+
+static int walk_push(path_walk *w, const char *name, size_t n) {
+    if (w->len + 1 + n >= sizeof(w->out)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    w->out[w->len++] = '/';
+    memcpy(w->out + w->len, name, n);
+    w->len += n;
+    return 0;
+}
+
+static void walk_pop(path_walk *w) {
+    while (w->len > 0 && w->out[--w->len] != '/') continue;
+}
+
+/* The next component of *s, advancing past it; 0 at the end */
+static size_t walk_next(const char **s, const char **name) {
+    const char *p = *s;
+
+    while (*p == '/') p++;
+    *name = p;
+    while (*p != '\0' && *p != '/') p++;
+    *s = p;
+    return (size_t)(p - *name);
+}
+
+/* An absolute path known to hold no link, normalised lexically */
+static int walk_lexical(path_walk *w, const char *s) {
+    const char *name;
+    size_t n;
+
+    while ((n = walk_next(&s, &name)) != 0) {
+        if (n == 1 && name[0] == '.') continue;
+        if (n == 2 && name[0] == '.' && name[1] == '.') {
+            walk_pop(w);
+            continue;
+        }
+        walk_lookup(w, name, n);
+        if (walk_push(w, name, n) != 0) return -1;
+    }
+    return 0;
+}
+
+/* An absolute path resolved as realpath does, one readlink per component */
+static int walk_follow(path_walk *w, const char *s) {
+    char rest[PATH_MAX], link[PATH_MAX];
+    const char *p = rest, *name;
+    int links = 0;
+    size_t n;
+
+    if (strlen(s) >= sizeof(rest)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(rest, s);
+    while ((n = walk_next(&p, &name)) != 0) {
+        size_t at = w->len, left;
+        ssize_t k;
+
+        if (n == 1 && name[0] == '.') continue;
+        if (n == 2 && name[0] == '.' && name[1] == '.') {
+            walk_pop(w);
+            continue;
+        }
+        walk_lookup(w, name, n);
+        if (walk_push(w, name, n) != 0) return -1;
+        w->out[w->len] = '\0';
+        k = readlink(w->out, link, sizeof(link));
+        if (k < 0) {
+            if (errno == EINVAL) continue;  /* not a link */
+            return -1;
+        }
+        if (++links > PATH_LINKS_MAX) {
+            errno = ELOOP;
+            return -1;
+        }
+        /* The target, then what was left after the link */
+        left = strlen(p);
+        if ((size_t)k + left >= sizeof(rest)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memmove(rest + k, p, left + 1);
+        memcpy(rest, link, (size_t)k);
+        p = rest;
+        w->len = link[0] == '/' ? 0 : at;
+    }
+    return 0;
+}
+
+/* Whether path, relative to dirfd, opens without meeting a link; -1 with
+ * errno set when it does not open for another reason */
+static int path_link_free(str_path_cache *c, int dirfd, const char *path) {
+#ifdef SYS_openat2
+    struct open_how how;
+    long fd;
+
+    if (!c->no_openat2) {
+        memset(&how, 0, sizeof(how));
+        how.flags = O_PATH | O_CLOEXEC;
+        how.resolve = RESOLVE_NO_SYMLINKS;
+        fd = syscall(SYS_openat2, dirfd, path, &how, sizeof(how));
+        if (fd >= 0) {
+            close((int)fd);
+            return 1;
+        }
+        if (errno == ELOOP) return 0;
+        if (errno != ENOSYS && errno != EPERM) return -1;
+        c->no_openat2 = 1;  /* an old kernel, or a seccomp filter */
+    }
+#else
+    (void)c;
+    (void)dirfd;
+    (void)path;
+#endif
+    return 0;
+}
+
+/* The starting directory and path as one absolute path */
+static int path_absolute(int dirfd, const char *path, char *out, size_t cap) {
+    char proc[32];
+    size_t len, plen = strlen(path);
+    ssize_t k;
+
+    if (path[0] == '/') {
+        len = 0;
+    } else if (dirfd == AT_FDCWD) {
+        if (getcwd(out, cap) == NULL) return -1;
+        len = strlen(out);
+    } else {
+        (void)str_format(proc, sizeof(proc), "/proc/self/fd/%d", dirfd);
+        k = readlink(proc, out, cap);
+        if (k < 0) return -1;
+        len = (size_t)k;
+    }
+    if (len + 1 + plen >= cap) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    out[len] = '/';
+    memcpy(out + len + (len > 0), path, plen + 1);
+    return 0;
+}
+
+/* The entry for (key, path) resolved afresh; NULL with errno set */
+static path_entry *path_resolve_locked(str_path_cache *c, int key, int dirfd, const char *path, uint64_t h) {
+    path_walk *w = NULL;
+    char full[PATH_MAX];
+    path_name *canonical;
+    path_entry *e;
+    int link_free;
+
+    for (e = c->buckets[h & c->mask]; e != NULL; e = e->next) {
+        if (e->hash == h && e->dirfd == key && strcmp(e->path, path) == 0) break;
+    }
+    if (e != NULL && !e->stale) return e;  /* resolved by another thread meanwhile */
+
+    if (path[0] == '\0') {
+        errno = ENOENT;
+        return NULL;
+    }
+    if (path_absolute(dirfd, path, full, sizeof(full)) != 0) return NULL;
+    w = (path_walk *)malloc(sizeof(*w));
+    if (w == NULL) return NULL;
+    walk_init(w, c);
+    link_free = walk_lexical(w, full) == 0 ? path_link_free(c, dirfd, path) : -1;
+    if (link_free == 0) {
+        walk_init(w, c);
+        if (walk_follow(w, full) != 0) link_free = -1;
+    }
+    if (link_free < 0) {
+        free(w);
+        return NULL;
+    }
+    canonical = name_get(c, c->interned, w->len == 0 ? "/" : w->out, w->len == 0 ? 1 : w->len);
+
+    if (canonical != NULL && e == NULL) {
+        e = (path_entry *)mem_arena_calloc(c->arena, 1, sizeof(*e));
+        if (e != NULL) e->path = mem_arena_strdup(c->arena, path);
+        if (e == NULL || e->path == NULL) {
+            free(w);
+            errno = ENOMEM;
+            return NULL;
+        }
+        e->hash = h;
+        e->dirfd = key;
+        e->stale = 1;
+        e->next = c->buckets[h & c->mask];
+        e->all_next = c->all;
+        c->all = e;
+        __atomic_store_n(&c->buckets[h & c->mask], e, __ATOMIC_RELEASE);
+    }
+    if (canonical == NULL) {
+        free(w);
+        errno = ENOMEM;
+        return NULL;
+    }
+    /* The arena never gives memory back: an entry resolved on every use, as
+     * one that cannot be watched is, must not take more of it each time */
+    deps_unlink(e);
+    e->ndeps = 0;
+    if (w->watched) {
+        if (w->ndeps > e->deps_cap) {
+            e->deps = (path_dep *)mem_arena_alloc(c->arena, (size_t)w->ndeps * sizeof(path_dep));
+            e->deps_cap = e->deps != NULL ? w->ndeps : 0;
+        }
+        if (w->ndeps <= e->deps_cap) {
+            if (w->ndeps > 0) memcpy(e->deps, w->deps, (size_t)w->ndeps * sizeof(path_dep));
+            e->ndeps = w->ndeps;
+            if (deps_link(c, e) != 0) w->watched = 0;
+        }
+    }
+    __atomic_store_n(&e->canonical, canonical->s, __ATOMIC_RELEASE);
+    __atomic_store_n(&e->stale, !w->watched || e->ndeps != w->ndeps, __ATOMIC_RELEASE);
+    free(w);
+    return e;
+}
+
+/*============================================================================
+ * CACHE
+ *==========================================================================*/
+str_path_cache *str_path_cache_create(size_t expected) {
+    str_path_cache *c = (str_path_cache *)calloc(1, sizeof(*c));
+    size_t buckets = 64;
+
+    if (c == NULL) return NULL;
+    while (buckets < 2 * expected && buckets < ((size_t)1 << 24)) buckets <<= 1;
+    c->mask = buckets - 1;
+    c->arena = mem_arena_create(0);
+    c->buckets = (path_entry **)calloc(buckets, sizeof(path_entry *));
+    c->watches = (path_name **)calloc(buckets, sizeof(path_name *));
+    c->interned = (path_name **)calloc(buckets, sizeof(path_name *));
+    c->wds = (path_watch **)calloc(buckets, sizeof(path_watch *));
+    if (c->arena == NULL || c->buckets == NULL || c->watches == NULL || c->interned == NULL || c->wds == NULL ||
+        pthread_mutex_init(&c->lock, NULL) != 0) {
+        if (c->arena != NULL) mem_arena_destroy(c->arena);
+        free(c->buckets);
+        free(c->watches);
+        free(c->interned);
+        free(c->wds);
+        free(c);
+        return NULL;
+    }
+    c->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    return c;
+}
+
+void str_path_cache_destroy(str_path_cache *c) {
+    if (c == NULL) return;
+    if (c->inotify_fd >= 0) close(c->inotify_fd);
+    pthread_mutex_destroy(&c->lock);
+    mem_arena_destroy(c->arena);
+    free(c->buckets);
+    free(c->watches);
+    free(c->interned);
+    free(c->wds);
+    free(c);
+}
+
+/* Paths relative to the working directory are made absolute first, at the
+ * cost of a getcwd: an entry keyed by AT_FDCWD would outlive a chdir */
+const char *str_path_resolve(str_path_cache *c, int dirfd, const char *path) {
+    char full[PATH_MAX];
+    int key, saved;
+    uint64_t h;
+    path_entry *e;
+
+    if (dirfd == AT_FDCWD && path[0] != '/' && path[0] != '\0') {
+        if (path_absolute(AT_FDCWD, path, full, sizeof(full)) != 0) return NULL;
+        path = full;
+    }
+    key = path[0] == '/' ? PATH_DIRFD_ABSOLUTE : dirfd;
+    h = path_key_hash(key, path);
+    path_poll(c);
+    for (e = __atomic_load_n(&c->buckets[h & c->mask], __ATOMIC_ACQUIRE); e != NULL; e = e->next) {
+        if (e->hash == h && __atomic_load_n(&e->dirfd, __ATOMIC_RELAXED) == key && strcmp(e->path, path) == 0) {
+            if (!__atomic_load_n(&e->stale, __ATOMIC_ACQUIRE)) return __atomic_load_n(&e->canonical, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&c->lock);
+    e = path_resolve_locked(c, key, dirfd, path, h);
+    saved = errno;
+    pthread_mutex_unlock(&c->lock);
+    errno = saved;
+    return e != NULL ? e->canonical : NULL;
+}
+
+void str_path_cache_forget(str_path_cache *c, int dirfd) {
+    path_entry *e;
+
+    pthread_mutex_lock(&c->lock);
+    for (e = c->all; e != NULL; e = e->all_next) {
+        if (e->dirfd != dirfd) continue;
+        __atomic_store_n(&e->dirfd, PATH_DIRFD_FORGOTTEN, __ATOMIC_RELAXED);
+        __atomic_store_n(&e->stale, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+static str_path_cache *path_default;
+static pthread_once_t path_default_once = PTHREAD_ONCE_INIT;
+
+static void path_default_init(void) {
+    path_default = str_path_cache_create(4096);
+}
+
+const char *str_realpath(const char *path) {
+    pthread_once(&path_default_once, path_default_init);
+    if (path_default == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return str_path_resolve(path_default, AT_FDCWD, path);
+}
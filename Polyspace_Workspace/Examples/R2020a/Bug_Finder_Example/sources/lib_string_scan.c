@@ -0,0 +1,849 @@
+/**
+ * Backend behind lib_string.h.
+ * Bounded, locale-independent scanning: sscanf with a compiled format, and
+ * strtod and strtof.
+ *
+ * str_scan_compile turns a format into an array of directives once: runs of
+ * literal text (pointing into the format), runs of white space, and
+ * conversions with their width, length modifier and, for %[, a 256-bit
+ * character set. str_vscan then walks the directives over the input without
+ * parsing the format again, calling no locale-aware function and allocating
+ * nothing. The string conversions take the capacity of their buffer from
+ * the argument list and fail rather than write past it.
+ *
+ * Decimal numbers are read into their first 19 significant digits w and a
+ * power of ten q. Three paths turn w * 10^q into the nearest binary value:
+ *   - Clinger's: when w and 10^|q| are both exact in the target type, one
+ *     correctly rounded multiplication or division;
+ *   - Eisel-Lemire (Lemire, "Number Parsing at a Gigabyte per Second",
+ *     2021): w times a 128-bit truncation of 10^q, which settles all but
+ *     the inputs within about 2^-64 of a halfway point. With more than 19
+ *     digits, w and w + 1 are tried and must agree;
+ *   - otherwise the C library's strtod or strtof, on the digits rewritten
+ *     as an integer and an exponent ("31415e-4"), which no locale reads
+ *     differently. At most 800 digits are passed, the last standing for any
+ *     that follow: a halfway point between two doubles has at most 767.
+ * The powers of ten are built on first use from exact powers of five in a
+ * small bignum, as the formatting tables are.
+ *
+ * Hexadecimal floating forms ("0x1p-3") are not read: the parse stops
+ * after the "0", as it would in a locale without them.
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For strtof */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib_string.h"
+
+enum {
+    SCAN_BIG_LIMBS      = 26,   /* 832 bits: 5^342 */
+    SCAN_POW10_MIN      = -342, /* below, any 19 digits round to zero */
+    SCAN_POW10_MAX      = 308,  /* above, any digits round to infinity */
+    SCAN_WORD_DIGITS    = 19,   /* significant digits that always fit in 64 bits */
+    SCAN_DIGITS_MAX     = 800,  /* digits passed to the slow path */
+    SCAN_EXP_MAX        = 100000000
+};
+
+/* Directives */
+enum {
+    SCAN_OP_LITERAL,
+    SCAN_OP_SPACE,
+    SCAN_OP_PERCENT,
+    SCAN_OP_DEC,        /* d */
+    SCAN_OP_INT,        /* i */
+    SCAN_OP_UDEC,       /* u */
+    SCAN_OP_OCT,        /* o */
+    SCAN_OP_HEX,        /* x, X */
+    SCAN_OP_FLOAT,      /* e, E, f, F, g, G, a, A */
+    SCAN_OP_STRING,     /* s */
+    SCAN_OP_CHARS,      /* c */
+    SCAN_OP_SET,        /* [ */
+    SCAN_OP_COUNT       /* n */
+};
+
+/* Length modifiers */
+enum {
+    SCAN_SIZE_HH,
+    SCAN_SIZE_H,
+    SCAN_SIZE_NONE,
+    SCAN_SIZE_L,
+    SCAN_SIZE_LL,
+    SCAN_SIZE_J,
+    SCAN_SIZE_Z,
+    SCAN_SIZE_T
+};
+
+static const unsigned char scan_size_bytes[] = {
+    sizeof(char), sizeof(short), sizeof(int), sizeof(long), sizeof(long long), sizeof(intmax_t), sizeof(size_t),
+    sizeof(ptrdiff_t)
+};
+
+static inline int scan_space(char c) {
+    return c == ' ' || (unsigned char)(c - '\t') <= '\r' - '\t';
+}
+
+static inline unsigned int scan_digit(char c) {
+    return (unsigned int)(unsigned char)c - '0';
+}
+
+/* The value of a digit in bases up to 16; 16 for anything else */
+static inline unsigned int scan_xdigit(char c) {
+    unsigned int d = scan_digit(c), l = ((unsigned int)(unsigned char)c | 0x20) - 'a';
+
+    return d < 10 ? d : l < 6 ? l + 10 : 16;
+}
+
+/*============================================================================
+ * POWERS OF TEN
+ *==========================================================================*/
+/* Little-endian 32-bit limbs; d[n - 1] != 0 */
+typedef struct scan_big {
+    uint32_t d[SCAN_BIG_LIMBS];
+    int n;
+} scan_big;
+
+static void big_mul_small(scan_big *b, uint32_t k) {
+    uint64_t carry = 0;
+    int i;
+
+    for (i = 0; i < b->n; i++) {
+        carry += (uint64_t)b->d[i] * k;
+        b->d[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    if (carry != 0) b->d[b->n++] = (uint32_t)carry;
+}
+
+static void big_shl1(scan_big *b) {
+    uint32_t top = b->d[b->n - 1] >> 31;
+    int i;
+
+    for (i = b->n - 1; i > 0; i--) b->d[i] = b->d[i] << 1 | b->d[i - 1] >> 31;
+    b->d[0] <<= 1;
+    if (top != 0) b->d[b->n++] = top;
+}
+
+static int big_cmp(const scan_big *a, const scan_big *b) {
+    int i;
+
+    if (a->n != b->n) return a->n < b->n ? -1 : 1;
+    for (i = a->n - 1; i >= 0; i--) {
+        if (a->d[i] != b->d[i]) return a->d[i] < b->d[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* a -= b, with a >= b */
+static void big_sub(scan_big *a, const scan_big *b) {
+    int64_t borrow = 0;
+    int i;
+
+    for (i = 0; i < a->n; i++) {
+        int64_t t = (int64_t)a->d[i] - (i < b->n ? b->d[i] : 0) - borrow;
+        borrow = t < 0;
+        a->d[i] = (uint32_t)t;
+    }
+    while (a->n > 0 && a->d[a->n - 1] == 0) a->n--;
+}
+
+static int big_bitlen(const scan_big *b) {
+    return 32 * b->n - __builtin_clz(b->d[b->n - 1]);
+}
+
+/* The top 128 bits of b, padded with zeros below when b is shorter */
+static unsigned __int128 big_top(const scan_big *b) {
+    int s = big_bitlen(b) - 128, i;
+    unsigned __int128 v = 0;
+
+    for (i = 0; i < b->n; i++) {
+        int at = 32 * i - s;
+
+        if (at <= -32 || at >= 128) continue;
+        v |= at >= 0 ? (unsigned __int128)b->d[i] << at : (unsigned __int128)(b->d[i] >> -at);
+    }
+    return v;
+}
+
+/* scan_pow10[q - SCAN_POW10_MIN]: 10^q truncated to 128 bits with the top
+ * one set, low word first. The binary exponent follows from q */
+static uint64_t scan_pow10[SCAN_POW10_MAX - SCAN_POW10_MIN + 1][2];
+static pthread_once_t scan_pow10_once = PTHREAD_ONCE_INIT;
+
+static void scan_pow10_init(void) {
+    scan_big p, r;
+    int i, k;
+
+    /* 10^i and 5^i share their mantissa */
+    p.d[0] = 1;
+    p.n = 1;
+    for (i = 0; i <= -SCAN_POW10_MIN; i++) {
+        int len = big_bitlen(&p);
+        unsigned __int128 v = 0;
+
+        if (i <= SCAN_POW10_MAX) {
+            v = big_top(&p);
+            scan_pow10[i - SCAN_POW10_MIN][0] = (uint64_t)v;
+            scan_pow10[i - SCAN_POW10_MIN][1] = (uint64_t)(v >> 64);
+        }
+        if (i > 0) {
+            /* floor(2^(len - 1 + 128) / 5^i), one quotient bit at a time
+             * from 2^(len - 1) < 5^i; the remainder is never zero */
+            memset(&r, 0, sizeof(r));
+            r.d[(len - 1) >> 5] = (uint32_t)1 << ((len - 1) & 31);
+            r.n = ((len - 1) >> 5) + 1;
+            v = 0;
+            for (k = 127; k >= 0; k--) {
+                big_shl1(&r);
+                if (big_cmp(&r, &p) >= 0) {
+                    big_sub(&r, &p);
+                    v |= (unsigned __int128)1 << k;
+                }
+            }
+            scan_pow10[-i - SCAN_POW10_MIN][0] = (uint64_t)v;
+            scan_pow10[-i - SCAN_POW10_MIN][1] = (uint64_t)(v >> 64);
+        }
+        big_mul_small(&p, 5);
+    }
+}
+
+/*============================================================================
+ * DECIMAL TO BINARY
+ *==========================================================================*/
+/* A number read from the input */
+typedef struct scan_decimal {
+    uint64_t w;             /* the first 19 significant digits */
+    int64_t q;              /* the value is w * 10^q, or a little more when truncated */
+    int truncated;          /* a non-zero digit follows the first 19 */
+    int negative;
+    int special;            /* SCAN_FINITE, SCAN_INF or SCAN_NAN */
+    const char *mant;       /* the digits and point, for the slow path */
+    const char *mant_end;
+    int64_t exp;            /* the exponent written after them */
+} scan_decimal;
+
+enum {
+    SCAN_FINITE,
+    SCAN_INF,
+    SCAN_NAN
+};
+
+/* An IEEE binary format */
+typedef struct scan_binary {
+    int mant_bits;          /* stored mantissa bits */
+    int bias;
+    int exp_all_ones;
+    int pow10_min;          /* below, any 19 digits round to zero */
+    int pow10_max;          /* above, any digits round to infinity */
+} scan_binary;
+
+static const scan_binary scan_binary64 = { 52, 1023, 0x7FF, SCAN_POW10_MIN, SCAN_POW10_MAX };
+static const scan_binary scan_binary32 = { 23, 127, 0xFF, -65, 38 };
+
+static const double scan_exact_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+    1e20, 1e21, 1e22
+};
+
+static const float scan_exact_pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+/* Eisel-Lemire, with w != 0 and q within the table; 0 when the product is
+ * too close to a halfway point, or the result is subnormal or infinite.
+ * The bits of the magnitude otherwise */
+static int eisel_lemire(uint64_t w, int q, const scan_binary *fmt, uint64_t *bits) {
+    const uint64_t *pw = scan_pow10[q - SCAN_POW10_MIN];
+    int clz = __builtin_clzll(w);
+    int shift = 61 - fmt->mant_bits;
+    uint64_t mask = ((uint64_t)1 << shift) - 1, m = w << clz, hi, lo, mant, msb;
+    int64_t e2 = (int64_t)((217706 * q) >> 16) + 64 + fmt->bias - clz;  /* floor(q * log2(10)) + ... */
+    unsigned __int128 x = (unsigned __int128)m * pw[1];
+
+    hi = (uint64_t)(x >> 64);
+    lo = (uint64_t)x;
+    if ((hi & mask) == mask && lo + m < m) {
+        /* The truncated low word of 10^q may carry into the bits kept */
+        unsigned __int128 y = (unsigned __int128)m * pw[0];
+        uint64_t y_hi = (uint64_t)(y >> 64), y_lo = (uint64_t)y, merged_lo = lo + y_hi;
+
+        hi += merged_lo < lo;
+        if ((hi & mask) == mask && merged_lo + 1 == 0 && y_lo + m < m) return 0;
+        lo = merged_lo;
+    }
+    msb = hi >> 63;
+    mant = hi >> (msb + (uint64_t)shift);
+    e2 -= (int64_t)(1 ^ msb);
+    if (lo == 0 && (hi & mask) == 0 && (mant & 3) == 1) return 0;  /* exactly halfway, maybe */
+    mant += mant & 1;
+    mant >>= 1;
+    if (mant >> (fmt->mant_bits + 1) != 0) {
+        mant >>= 1;
+        e2++;
+    }
+    if (e2 <= 0 || e2 >= fmt->exp_all_ones) return 0;
+    *bits = (uint64_t)e2 << fmt->mant_bits | (mant & (((uint64_t)1 << fmt->mant_bits) - 1));
+    return 1;
+}
+
+/* The fast paths for d; 0 when they cannot decide */
+static int decimal_fast(const scan_decimal *d, const scan_binary *fmt, uint64_t *bits) {
+    uint64_t up;
+
+    pthread_once(&scan_pow10_once, scan_pow10_init);
+    if (!eisel_lemire(d->w, (int)d->q, fmt, bits)) return 0;
+    if (!d->truncated) return 1;
+    return eisel_lemire(d->w + 1, (int)d->q, fmt, &up) && up == *bits;
+}
+
+/* The digits of d as an integer and an exponent, for strtod: "31415e-4" */
+static void decimal_text(const scan_decimal *d, char *out, size_t cap) {
+    const char *p;
+    size_t n = 0;
+    int64_t dexp = 0;
+    int dot = 0, sticky = 0;
+
+    for (p = d->mant; p < d->mant_end; p++) {
+        if (*p == '.') {
+            dot = 1;
+        } else if (n == 0 && *p == '0') {
+            dexp -= dot;
+        } else if (n < SCAN_DIGITS_MAX) {
+            out[n++] = *p;
+            dexp -= dot;
+        } else {
+            dexp += !dot;
+            sticky |= *p != '0';
+        }
+    }
+    if (sticky) {
+        out[n++] = '1';
+        dexp--;
+    }
+    (void)str_format(out + n, cap - n, "e%lld", (long long)(dexp + d->exp));
+}
+
+static double decimal_to_double(const scan_decimal *d) {
+    uint64_t sign = (uint64_t)d->negative << 63, bits;
+    double v;
+
+    if (d->special == SCAN_FINITE && d->w != 0 && d->q >= scan_binary64.pow10_min &&
+        d->q <= scan_binary64.pow10_max) {
+        if (!d->truncated && d->w <= (uint64_t)1 << 53 && d->q >= -22 && d->q <= 22) {
+            v = (double)d->w;
+            v = d->q < 0 ? v / scan_exact_pow10[-d->q] : v * scan_exact_pow10[d->q];
+            return d->negative ? -v : v;
+        }
+        if (!decimal_fast(d, &scan_binary64, &bits)) {
+            char text[SCAN_DIGITS_MAX + 32];
+            int saved = errno;
+
+            decimal_text(d, text, sizeof(text));
+            v = strtod(text, NULL);
+            errno = saved;
+            return d->negative ? -v : v;
+        }
+    } else if (d->special == SCAN_NAN) {
+        bits = 0x7FF8000000000000u;
+    } else if (d->special == SCAN_INF || (d->w != 0 && d->q > 0)) {
+        bits = 0x7FF0000000000000u;
+    } else {
+        bits = 0;
+    }
+    bits |= sign;
+    memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static float decimal_to_float(const scan_decimal *d) {
+    uint32_t sign = (uint32_t)d->negative << 31, bits32;
+    uint64_t bits;
+    float v;
+
+    if (d->special == SCAN_FINITE && d->w != 0 && d->q >= scan_binary32.pow10_min &&
+        d->q <= scan_binary32.pow10_max) {
+        if (!d->truncated && d->w <= (uint64_t)1 << 24 && d->q >= -10 && d->q <= 10) {
+            v = (float)d->w;
+            v = d->q < 0 ? v / scan_exact_pow10f[-d->q] : v * scan_exact_pow10f[d->q];
+            return d->negative ? -v : v;
+        }
+        if (!decimal_fast(d, &scan_binary32, &bits)) {
+            char text[SCAN_DIGITS_MAX + 32];
+            int saved = errno;
+
+            decimal_text(d, text, sizeof(text));
+            v = strtof(text, NULL);
+            errno = saved;
+            return d->negative ? -v : v;
+        }
+        bits32 = (uint32_t)bits;
+    } else if (d->special == SCAN_NAN) {
+        bits32 = 0x7FC00000u;
+    } else if (d->special == SCAN_INF || (d->w != 0 && d->q > 0)) {
+        bits32 = 0x7F800000u;
+    } else {
+        bits32 = 0;
+    }
+    bits32 |= sign;
+    memcpy(&v, &bits32, sizeof(v));
+    return v;
+}
+
+/*============================================================================
+ * NUMBER SYNTAX
+ *==========================================================================*/
+/* p[i], or a terminator from max on */
+#define SCAN_AT(p, i, max) ((i) < (max) ? (p)[i] : '\0')
+
+/* Whether p[i...] starts with word, ignoring case */
+static int scan_word(const char *p, size_t i, size_t max, const char *word) {
+    for (; *word != '\0'; i++, word++) {
+        if (((unsigned char)SCAN_AT(p, i, max) | 0x20) != (unsigned char)*word) return 0;
+    }
+    return 1;
+}
+
+/* "inf", "infinity", "nan" or "nan(chars)" at p[i...]; the characters of
+ * the whole number, 0 when there is none */
+static size_t scan_special(const char *p, size_t i, size_t max, scan_decimal *d) {
+    if (scan_word(p, i, max, "inf")) {
+        d->special = SCAN_INF;
+        return scan_word(p, i + 3, max, "inity") ? i + 8 : i + 3;
+    }
+    if (scan_word(p, i, max, "nan")) {
+        size_t j = i + 4;
+        char c;
+
+        d->special = SCAN_NAN;
+        if (SCAN_AT(p, i + 3, max) != '(') return i + 3;
+        for (;; j++) {
+            c = SCAN_AT(p, j, max);
+            if (c != '_' && scan_digit(c) >= 10 && ((unsigned int)(unsigned char)c | 0x20) - 'a' >= 26) break;
+        }
+        return c == ')' ? j + 1 : i + 3;
+    }
+    return 0;
+}
+
+/* A number in strtod's decimal syntax from at most max characters of p,
+ * without leading white space; the characters read, 0 when there is no
+ * number */
+static size_t scan_decimal_parse(const char *p, size_t max, scan_decimal *d) {
+    uint64_t w = 0;
+    int64_t dexp = 0;
+    size_t i = 0;
+    int nd = 0, dot = 0, any = 0;
+    char c;
+
+    memset(d, 0, sizeof(*d));
+    c = SCAN_AT(p, 0, max);
+    if (c == '+' || c == '-') {
+        d->negative = c == '-';
+        i++;
+    }
+    c = (char)((unsigned char)SCAN_AT(p, i, max) | 0x20);
+    if (c == 'i' || c == 'n') return scan_special(p, i, max, d);
+
+    d->mant = p + i;
+    for (;; i++) {
+        unsigned int digit = scan_digit(c = SCAN_AT(p, i, max));
+
+        if (digit < 10) {
+            any = 1;
+            if (nd == 0 && digit == 0) {
+                dexp -= dot;
+                continue;
+            }
+            if (nd < SCAN_WORD_DIGITS) {
+                w = w * 10 + digit;
+                dexp -= dot;
+            } else {
+                dexp += !dot;
+                d->truncated |= digit != 0;
+            }
+            nd++;
+        } else if (c == '.' && !dot) {
+            dot = 1;
+        } else {
+            break;
+        }
+    }
+    if (!any) return 0;
+    d->mant_end = p + i;
+
+    if ((SCAN_AT(p, i, max) | 0x20) == 'e') {
+        size_t j = i + 1;
+        int negative = 0;
+        int64_t e = 0;
+
+        c = SCAN_AT(p, j, max);
+        if (c == '+' || c == '-') {
+            negative = c == '-';
+            j++;
+        }
+        if (scan_digit(SCAN_AT(p, j, max)) < 10) {
+            unsigned int digit;
+
+            while ((digit = scan_digit(SCAN_AT(p, j, max))) < 10) {
+                if (e < SCAN_EXP_MAX) e = e * 10 + digit;
+                j++;
+            }
+            d->exp = negative ? -e : e;
+            i = j;
+        }
+    }
+    d->w = w;
+    d->q = dexp + d->exp;
+    return i;
+}
+
+/* An integer in strtoull's syntax for base 0, 8, 10 or 16 from at most max
+ * characters of p; the characters read, 0 when there is none. *overflow
+ * is set when the magnitude does not fit in 64 bits */
+static size_t scan_integer_parse(const char *p, size_t max, unsigned int base, uint64_t *magnitude,
+                                 int *negative, int *overflow) {
+    uint64_t v = 0;
+    size_t i = 0, first;
+    unsigned int digit;
+    char c = SCAN_AT(p, 0, max);
+
+    *negative = 0;
+    *overflow = 0;
+    if (c == '+' || c == '-') {
+        *negative = c == '-';
+        i++;
+    }
+    if ((base == 0 || base == 16) && SCAN_AT(p, i, max) == '0' && (SCAN_AT(p, i + 1, max) | 0x20) == 'x' &&
+        scan_xdigit(SCAN_AT(p, i + 2, max)) < 16) {
+        base = 16;
+        i += 2;
+    } else if (base == 0) {
+        base = SCAN_AT(p, i, max) == '0' ? 8 : 10;
+    }
+    first = i;
+    while ((digit = scan_xdigit(SCAN_AT(p, i, max))) < base) {
+        if (__builtin_mul_overflow(v, base, &v) || __builtin_add_overflow(v, digit, &v)) *overflow = 1;
+        i++;
+    }
+    if (i == first) return 0;
+    *magnitude = v;
+    return i;
+}
+
+double str_to_double(const char *s, char **end) {
+    scan_decimal d;
+    size_t n, skip = 0;
+
+    while (scan_space(s[skip])) skip++;
+    n = scan_decimal_parse(s + skip, SIZE_MAX, &d);
+    if (end != NULL) *end = (char *)(n == 0 ? s : s + skip + n);
+    return n == 0 ? 0.0 : decimal_to_double(&d);
+}
+
+float str_to_float(const char *s, char **end) {
+    scan_decimal d;
+    size_t n, skip = 0;
+
+    while (scan_space(s[skip])) skip++;
+    n = scan_decimal_parse(s + skip, SIZE_MAX, &d);
+    if (end != NULL) *end = (char *)(n == 0 ? s : s + skip + n);
+    return n == 0 ? 0.0f : decimal_to_float(&d);
+}
+
+/*============================================================================
+ * FORMATS
+ *==========================================================================*/
+static inline int set_has(const uint32_t *set, char c) {
+    unsigned char u = (unsigned char)c;
+
+    return (int)(set[u >> 5] >> (u & 31)) & 1;
+}
+
+static inline void set_add(uint32_t *set, unsigned int c) {
+    set[c >> 5] |= (uint32_t)1 << (c & 31);
+}
+
+/* The set of a %[ conversion from p, just after the '['; the character
+ * after the closing ']', NULL when there is none */
+static const char *compile_set(uint32_t *set, const char *p) {
+    int negate = *p == '^', i;
+
+    memset(set, 0, 8 * sizeof(uint32_t));
+    p += negate;
+    if (*p == ']') set_add(set, (unsigned char)*p++);
+    for (; *p != ']'; p++) {
+        unsigned int lo = (unsigned char)*p, hi;
+
+        if (*p == '\0') return NULL;
+        if (p[1] == '-' && p[2] != ']' && p[2] != '\0' && (unsigned char)p[2] >= lo) {
+            hi = (unsigned char)p[2];
+            p += 2;
+        } else {
+            hi = lo;
+        }
+        for (; lo <= hi; lo++) set_add(set, lo);
+    }
+    if (negate) {
+        for (i = 0; i < 8; i++) set[i] = ~set[i];
+    }
+    set[0] &= ~(uint32_t)1;  /* never the terminator */
+    return p + 1;
+}
+
+int str_scan_compile(str_scan_format *f, const char *fmt) {
+    const char *p = fmt;
+    int sets = 0;
+
+    f->steps = 0;
+    while (*p != '\0') {
+        str_scan_step *st;
+
+        if (f->steps == STR_SCAN_STEPS) return -1;
+        st = &f->step[f->steps];
+        memset(st, 0, sizeof(*st));
+        st->size = SCAN_SIZE_NONE;
+        f->steps++;
+
+        if (scan_space(*p)) {
+            st->op = SCAN_OP_SPACE;
+            while (scan_space(*p)) p++;
+            continue;
+        }
+        if (*p != '%') {
+            st->op = SCAN_OP_LITERAL;
+            st->lit = p;
+            while (*p != '\0' && *p != '%' && !scan_space(*p)) p++;
+            st->lit_len = (size_t)(p - st->lit);
+            continue;
+        }
+        if (*++p == '%') {
+            st->op = SCAN_OP_PERCENT;
+            p++;
+            continue;
+        }
+
+        if (*p == '*') {
+            st->suppress = 1;
+            p++;
+        }
+        while (scan_digit(*p) < 10) {
+            if (st->width > (UINT_MAX - 9) / 10) return -1;
+            st->width = st->width * 10 + scan_digit(*p++);
+        }
+        if (scan_digit(p[-1]) < 10 && st->width == 0) return -1;
+        switch (*p) {
+        case 'h':
+            st->size = p[1] == 'h' ? SCAN_SIZE_HH : SCAN_SIZE_H;
+            p += 1 + (p[1] == 'h');
+            break;
+        case 'l':
+            st->size = p[1] == 'l' ? SCAN_SIZE_LL : SCAN_SIZE_L;
+            p += 1 + (p[1] == 'l');
+            break;
+        case 'j': st->size = SCAN_SIZE_J; p++; break;
+        case 'z': st->size = SCAN_SIZE_Z; p++; break;
+        case 't': st->size = SCAN_SIZE_T; p++; break;
+        default: break;
+        }
+
+        switch (*p++) {
+        case 'd': st->op = SCAN_OP_DEC; break;
+        case 'i': st->op = SCAN_OP_INT; break;
+        case 'u': st->op = SCAN_OP_UDEC; break;
+        case 'o': st->op = SCAN_OP_OCT; break;
+        case 'x': case 'X': st->op = SCAN_OP_HEX; break;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+            if (st->size != SCAN_SIZE_NONE && st->size != SCAN_SIZE_L) return -1;
+            st->op = SCAN_OP_FLOAT;
+            break;
+        case 's': st->op = SCAN_OP_STRING; break;
+        case 'c': st->op = SCAN_OP_CHARS; break;
+        case '[':
+            if (sets == STR_SCAN_SETS) return -1;
+            p = compile_set(f->set[sets], p);
+            if (p == NULL) return -1;
+            st->op = SCAN_OP_SET;
+            st->set = (unsigned char)sets++;
+            break;
+        case 'n':
+            if (st->suppress || st->width != 0) return -1;
+            st->op = SCAN_OP_COUNT;
+            break;
+        default:
+            return -1;
+        }
+        if (st->op >= SCAN_OP_STRING && st->op <= SCAN_OP_SET && st->size != SCAN_SIZE_NONE) return -1;
+    }
+    return 0;
+}
+
+/*============================================================================
+ * SCANNING
+ *==========================================================================*/
+/* Stores v through a pointer to an integer of the given length modifier */
+static void store_integer(void *dst, int size, uint64_t v) {
+    switch (scan_size_bytes[size]) {
+    case 1: *(unsigned char *)dst = (unsigned char)v; break;
+    case 2: *(uint16_t *)dst = (uint16_t)v; break;
+    case 4: *(uint32_t *)dst = (uint32_t)v; break;
+    default: *(uint64_t *)dst = v; break;
+    }
+}
+
+/* The two's complement bits of a value read by a d, i, u, o or x
+ * conversion into an integer of the given size; 0 when out of range */
+static int integer_in_range(int op, int size, uint64_t magnitude, int negative, uint64_t *bits) {
+    int width = 8 * scan_size_bytes[size];
+    uint64_t umax = width == 64 ? UINT64_MAX : ((uint64_t)1 << width) - 1, smax = umax >> 1;
+
+    if (op != SCAN_OP_DEC && op != SCAN_OP_INT) {
+        if (negative || magnitude > umax) return 0;
+    } else if (magnitude > smax + negative) {
+        return 0;
+    }
+    *bits = negative ? 0 - magnitude : magnitude;
+    return 1;
+}
+
+int str_vscan(const str_scan_format *f, const char *input, va_list ap) {
+    static const unsigned char bases[] = { 10, 0, 10, 8, 16 };  /* from SCAN_OP_DEC */
+    const char *in = input;
+    int assigned = 0, i;
+
+    for (i = 0; i < f->steps; i++) {
+        const str_scan_step *st = &f->step[i];
+        size_t max = st->width != 0 ? st->width : SIZE_MAX, n = 0, k;
+
+        switch (st->op) {
+        case SCAN_OP_SPACE:
+            while (scan_space(*in)) in++;
+            continue;
+        case SCAN_OP_LITERAL:
+            for (k = 0; k < st->lit_len; k++) {
+                if (in[k] != st->lit[k]) {
+                    if (in[k] == '\0') goto input_failure;
+                    return assigned;
+                }
+            }
+            in += st->lit_len;
+            continue;
+        case SCAN_OP_COUNT:
+            store_integer(va_arg(ap, void *), st->size, (uint64_t)(in - input));
+            continue;
+        case SCAN_OP_CHARS:
+        case SCAN_OP_SET:
+            break;
+        default:
+            while (scan_space(*in)) in++;
+            break;
+        }
+        if (*in == '\0') goto input_failure;
+
+        switch (st->op) {
+        case SCAN_OP_PERCENT:
+            if (*in != '%') return assigned;
+            in++;
+            continue;
+
+        case SCAN_OP_DEC:
+        case SCAN_OP_INT:
+        case SCAN_OP_UDEC:
+        case SCAN_OP_OCT:
+        case SCAN_OP_HEX: {
+            uint64_t magnitude, bits;
+            int negative, overflow;
+
+            n = scan_integer_parse(in, max, bases[st->op - SCAN_OP_DEC], &magnitude, &negative, &overflow);
+            if (n == 0 || overflow || !integer_in_range(st->op, st->size, magnitude, negative, &bits)) {
+                return assigned;
+            }
+            if (!st->suppress) store_integer(va_arg(ap, void *), st->size, bits);
+            break;
+        }
+
+        case SCAN_OP_FLOAT: {
+            scan_decimal d;
+
+            n = scan_decimal_parse(in, max, &d);
+            if (n == 0) return assigned;
+            if (st->suppress) break;
+            if (st->size == SCAN_SIZE_L) {
+                *va_arg(ap, double *) = decimal_to_double(&d);
+            } else {
+                *va_arg(ap, float *) = decimal_to_float(&d);
+            }
+            break;
+        }
+
+        case SCAN_OP_STRING:
+        case SCAN_OP_SET: {
+            const uint32_t *set = f->set[st->set];
+            char *buf;
+            size_t cap;
+
+            if (st->op == SCAN_OP_STRING) {
+                while (n < max && in[n] != '\0' && !scan_space(in[n])) n++;
+            } else {
+                while (n < max && set_has(set, in[n])) n++;
+                if (n == 0) return assigned;
+            }
+            if (st->suppress) break;
+            buf = va_arg(ap, char *);
+            cap = va_arg(ap, size_t);
+            if (n >= cap) return assigned;
+            memcpy(buf, in, n);
+            buf[n] = '\0';
+            break;
+        }
+
+        case SCAN_OP_CHARS: {
+            char *buf;
+            size_t cap;
+
+            max = st->width != 0 ? st->width : 1;
+            while (n < max && in[n] != '\0') n++;
+            if (n < max) goto input_failure;
+            if (st->suppress) break;
+            buf = va_arg(ap, char *);
+            cap = va_arg(ap, size_t);
+            if (n > cap) return assigned;
+            memcpy(buf, in, n);
+            break;
+        }
+
+        default:
+            return assigned;
+        }
+        in += n;
+        assigned += !st->suppress;
+    }
+    return assigned;
+
+input_failure:
+    return assigned == 0 ? -1 : assigned;
+}
+
+int str_scan(const str_scan_format *f, const char *input, ...) {
+    va_list ap;
+    int ret;
+
+    va_start(ap, input);
+    ret = str_vscan(f, input, ap);
+    va_end(ap);
+    return ret;
+}
+
+int str_scanf(const char *input, const char *fmt, ...) {
+    str_scan_format f;
+    va_list ap;
+    int ret;
+
+    if (str_scan_compile(&f, fmt) != 0) return -1;
+    va_start(ap, fmt);
+    ret = str_vscan(&f, input, ap);
+    va_end(ap);
+    return ret;
+}
@@ -0,0 +1,459 @@
+/**
+ * Backend behind lib_string.h.
+ * String kernels with AVX2, SSE2 and scalar implementations.
+ *
+ * Each kernel compares a whole vector of bytes at a time against zero (and
+ * against the other string or the searched character) and turns the result
+ * into a bit mask, whose lowest set bit is the first terminator or
+ * difference. Past the first vector the loops take 64-byte blocks, folded
+ * with an unsigned minimum into one vector and one test per block; the
+ * exact mask is only computed for the block where the loop ends.
+ *
+ * str_len and str_rchr read one string, from aligned addresses: the first
+ * load is rounded down to the vector size and the bytes before the string
+ * are masked out of its result. An aligned load never crosses a page, so
+ * they never touch a page the string does not. str_rchr only remembers the
+ * last block holding the character and finds it again there at the end.
+ *
+ * str_cmp and str_cmp_prefix read two strings whose alignments differ, so
+ * the loads of one of them are unaligned. The blocks run up to the nearer
+ * page end of the two strings; the last vector before it is loaded so as
+ * to end there, overlapping bytes already compared, which compare equal.
+ * Comparison stops at the lowest bit of the mask of differing bytes and
+ * zero bytes of s1: the first difference or the end of s1. Where s2 ends
+ * first the strings differ at its terminator, so neither string is read
+ * beyond the page holding its end.
+ *
+ * The entry points jump through a row of function pointers chosen on the
+ * first call, as the C library's resolvers do.
+ *
+ * The C library routines of glibc are vectorised as well; what these add
+ * over them is the fused prefix comparison (one pass instead of strlen
+ * then memcmp) and identical speed across C libraries.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lib_string.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define STRING_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+enum {
+    STRING_SCALAR,
+    STRING_SSE2,
+    STRING_AVX2
+};
+
+#define STRING_PAGE ((uintptr_t)4096)   /* smallest page size */
+
+static int string_level = -1;
+
+static int string_detect(void) {
+    const char *cap = getenv("STRING_ISA");
+    int level = STRING_SCALAR;
+
+#if defined(STRING_HAVE_X86_SIMD)
+    level = STRING_SSE2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) level = STRING_AVX2;
+#endif
+    if (cap != NULL && strcmp(cap, "scalar") == 0) level = STRING_SCALAR;
+    else if (cap != NULL && strcmp(cap, "sse2") == 0 && level > STRING_SSE2) level = STRING_SSE2;
+    return level;
+}
+
+static inline int string_isa(void) {
+    int level = __atomic_load_n(&string_level, __ATOMIC_RELAXED);
+
+    if (level < 0) {
+        level = string_detect();
+        __atomic_store_n(&string_level, level, __ATOMIC_RELAXED);
+    }
+    return level;
+}
+
+const char *str_isa(void) {
+    static const char *const names[] = { "scalar", "sse2", "avx2" };
+    return names[string_isa()];
+}
+
+/* Whether an n-byte load at p would cross into the next page */
+static inline int near_page_end(const char *p, uintptr_t n) {
+    return ((uintptr_t)p & (STRING_PAGE - 1)) > STRING_PAGE - n;
+}
+
+/* The result of the comparisons at the first byte where s1 and s2 differ
+ * or s1 ends */
+static inline int cmp_result(unsigned char x, unsigned char y, int prefix) {
+    if (prefix && x == 0) return 0;
+    return (int)x - (int)y;
+}
+
+/*============================================================================
+ * SCALAR
+ *==========================================================================*/
+static size_t len_scalar(const char *s) {
+    const char *p = s;
+
+    while (*p != '\0') p++;
+    return (size_t)(p - s);
+}
+
+static int cmp_scalar(const char *s1, const char *s2, int prefix) {
+    const unsigned char *a = (const unsigned char *)s1, *b = (const unsigned char *)s2;
+
+    while (*a != 0 && *a == *b) {
+        a++;
+        b++;
+    }
+    return cmp_result(*a, *b, prefix);
+}
+
+static char *rchr_scalar(const char *s, char c) {
+    const char *last = NULL;
+
+    for (; *s != '\0'; s++) {
+        if (*s == c) last = s;
+    }
+    return (char *)last;
+}
+
+#if defined(STRING_HAVE_X86_SIMD)
+/*============================================================================
+ * SSE2
+ *==========================================================================*/
+/* Bit i set where byte i of the 64 bytes at p equals each byte of v */
+static inline uint64_t eq64_sse2(const char *p, __m128i v) {
+    const __m128i *q = (const __m128i *)p;
+    uint64_t m0 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(q), v));
+    uint64_t m1 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(q + 1), v));
+    uint64_t m2 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(q + 2), v));
+    uint64_t m3 = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(q + 3), v));
+    return m0 | m1 << 16 | m2 << 32 | m3 << 48;
+}
+
+/* Zero where a and b differ or a is zero, as a byte vector */
+static inline __m128i stop_sse2(__m128i a, __m128i b) {
+    return _mm_min_epu8(a, _mm_cmpeq_epi8(a, b));
+}
+
+/* Bit i set where byte i of the 16 bytes at p equals each byte of v */
+static inline unsigned int eq16_sse2(const char *p, __m128i v) {
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128((const __m128i *)p), v));
+}
+
+static size_t len_sse2(const char *s) {
+    const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)15);
+    const __m128i z = _mm_setzero_si128();
+    unsigned int m = eq16_sse2(p, z) >> ((uintptr_t)s & 15);
+
+    if (m != 0) return (size_t)__builtin_ctz(m);
+    for (p += 16; ((uintptr_t)p & 63) != 0; p += 16) {
+        m = eq16_sse2(p, z);
+        if (m != 0) return (size_t)(p - s) + (size_t)__builtin_ctz(m);
+    }
+    for (;; p += 64) {
+        const __m128i *q = (const __m128i *)p;
+        __m128i v = _mm_min_epu8(_mm_min_epu8(_mm_load_si128(q), _mm_load_si128(q + 1)),
+                                 _mm_min_epu8(_mm_load_si128(q + 2), _mm_load_si128(q + 3)));
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, z)) != 0) {
+            return (size_t)(p - s) + (size_t)__builtin_ctzll(eq64_sse2(p, z));
+        }
+    }
+}
+
+static int cmp_sse2(const char *s1, const char *s2, int prefix) {
+    const __m128i z = _mm_setzero_si128();
+    size_t i = 0;
+
+    if (!near_page_end(s1, 16) && !near_page_end(s2, 16)) {
+        /* Short strings end in the first vector */
+        __m128i a = _mm_loadu_si128((const __m128i *)s1), b = _mm_loadu_si128((const __m128i *)s2);
+        unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(stop_sse2(a, b), z));
+
+        if (m != 0) {
+            i = (size_t)__builtin_ctz(m);
+            return cmp_result((unsigned char)s1[i], (unsigned char)s2[i], prefix);
+        }
+        i = 16 - ((uintptr_t)s1 & 15);  /* s1's loads aligned from here on */
+    }
+    for (;;) {
+        uintptr_t room1 = STRING_PAGE - ((uintptr_t)(s1 + i) & (STRING_PAGE - 1));
+        uintptr_t room2 = STRING_PAGE - ((uintptr_t)(s2 + i) & (STRING_PAGE - 1));
+        size_t room = room1 < room2 ? room1 : room2;   /* bytes before either string's next page */
+
+        for (; room >= 64; room -= 64, i += 64) {
+            const __m128i *a = (const __m128i *)(s1 + i), *b = (const __m128i *)(s2 + i);
+            __m128i t0 = stop_sse2(_mm_loadu_si128(a), _mm_loadu_si128(b));
+            __m128i t1 = stop_sse2(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1));
+            __m128i t2 = stop_sse2(_mm_loadu_si128(a + 2), _mm_loadu_si128(b + 2));
+            __m128i t3 = stop_sse2(_mm_loadu_si128(a + 3), _mm_loadu_si128(b + 3));
+            __m128i t = _mm_min_epu8(_mm_min_epu8(t0, t1), _mm_min_epu8(t2, t3));
+
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(t, z)) != 0) {
+                uint64_t m = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(t0, z));
+                m |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(t1, z)) << 16;
+                m |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(t2, z)) << 32;
+                m |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(t3, z)) << 48;
+                i += (size_t)__builtin_ctzll(m);
+                return cmp_result((unsigned char)s1[i], (unsigned char)s2[i], prefix);
+            }
+        }
+        if (i + room < 16) {
+            /* Near the start of a string: one byte at a time up to the page */
+            for (; room > 0; room--, i++) {
+                unsigned char x = (unsigned char)s1[i], y = (unsigned char)s2[i];
+                if (x == 0 || x != y) return cmp_result(x, y, prefix);
+            }
+        }
+        while (room > 0) {
+            /* Loads ending at the page, overlapping bytes already compared */
+            size_t step = room < 16 ? room : 16, at = i + step - 16;
+            __m128i a = _mm_loadu_si128((const __m128i *)(s1 + at));
+            __m128i b = _mm_loadu_si128((const __m128i *)(s2 + at));
+            unsigned int m = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(stop_sse2(a, b), z));
+
+            if (m != 0) {
+                at += (size_t)__builtin_ctz(m);
+                return cmp_result((unsigned char)s1[at], (unsigned char)s2[at], prefix);
+            }
+            i += step;
+            room -= step;
+        }
+    }
+}
+
+static char *rchr_sse2(const char *s, char c) {
+    const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)15), *last = NULL;
+    const __m128i z = _mm_setzero_si128(), vc = _mm_set1_epi8(c);
+    unsigned int head = 0xffffu << ((uintptr_t)s & 15);
+    uint64_t zm = eq16_sse2(p, z) & head, cm = eq16_sse2(p, vc) & head, last_m = 0;
+
+    /* Single vectors up to a 64-byte boundary, then blocks of four; last_m
+     * is 0 for a block, whose matches are found again at the end */
+    while (zm == 0) {
+        if (cm != 0) {
+            last = p;
+            last_m = cm;
+        }
+        p += 16;
+        if (((uintptr_t)p & 63) != 0) {
+            zm = eq16_sse2(p, z);
+            cm = eq16_sse2(p, vc);
+            continue;
+        }
+        for (;; p += 64) {
+            const __m128i *q = (const __m128i *)p;
+            __m128i v0 = _mm_load_si128(q), v1 = _mm_load_si128(q + 1);
+            __m128i v2 = _mm_load_si128(q + 2), v3 = _mm_load_si128(q + 3);
+            __m128i zv = _mm_min_epu8(_mm_min_epu8(v0, v1), _mm_min_epu8(v2, v3));
+            __m128i cv = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v0, vc), _mm_cmpeq_epi8(v1, vc)),
+                                      _mm_or_si128(_mm_cmpeq_epi8(v2, vc), _mm_cmpeq_epi8(v3, vc)));
+            int any = _mm_movemask_epi8(cv) != 0;
+
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(zv, z)) != 0) {
+                zm = eq64_sse2(p, z);
+                cm = any ? eq64_sse2(p, vc) : 0;
+                break;
+            }
+            if (any) {
+                last = p;
+                last_m = 0;
+            }
+        }
+    }
+    cm &= zm ^ (zm - 1);                /* matches before the terminator */
+    if (cm != 0) return (char *)p + 63 - __builtin_clzll(cm);
+    if (last == NULL) return NULL;
+    if (last_m == 0) last_m = eq64_sse2(last, vc);
+    return (char *)last + 63 - __builtin_clzll(last_m);
+}
+
+/*============================================================================
+ * AVX2
+ *==========================================================================*/
+AVX2_TARGET static inline uint64_t eq64_avx2(const char *p, __m256i v) {
+    const __m256i *q = (const __m256i *)p;
+    uint64_t lo = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(q), v));
+    uint64_t hi = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256(q + 1), v));
+    return lo | hi << 32;
+}
+
+AVX2_TARGET static inline __m256i stop_avx2(__m256i a, __m256i b) {
+    return _mm256_min_epu8(a, _mm256_cmpeq_epi8(a, b));
+}
+
+AVX2_TARGET static inline uint32_t eq32_avx2(const char *p, __m256i v) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_load_si256((const __m256i *)p), v));
+}
+
+AVX2_TARGET static size_t len_avx2(const char *s) {
+    const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)31);
+    const __m256i z = _mm256_setzero_si256();
+    uint32_t m = eq32_avx2(p, z) >> ((uintptr_t)s & 31);
+
+    if (m != 0) return (size_t)__builtin_ctz(m);
+    p += 32;
+    if (((uintptr_t)p & 63) != 0) {
+        m = eq32_avx2(p, z);
+        if (m != 0) return (size_t)(p - s) + (size_t)__builtin_ctz(m);
+        p += 32;
+    }
+    for (;; p += 64) {
+        const __m256i *q = (const __m256i *)p;
+        __m256i v = _mm256_min_epu8(_mm256_load_si256(q), _mm256_load_si256(q + 1));
+
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, z)) != 0) {
+            return (size_t)(p - s) + (size_t)__builtin_ctzll(eq64_avx2(p, z));
+        }
+    }
+}
+
+AVX2_TARGET static int cmp_avx2(const char *s1, const char *s2, int prefix) {
+    const __m256i z = _mm256_setzero_si256();
+    size_t i = 0;
+
+    if (!near_page_end(s1, 32) && !near_page_end(s2, 32)) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)s1), b = _mm256_loadu_si256((const __m256i *)s2);
+        uint32_t m = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(stop_avx2(a, b), z));
+
+        if (m != 0) {
+            i = (size_t)__builtin_ctz(m);
+            return cmp_result((unsigned char)s1[i], (unsigned char)s2[i], prefix);
+        }
+        i = 32 - ((uintptr_t)s1 & 31);  /* s1's loads aligned from here on */
+    }
+    for (;;) {
+        uintptr_t room1 = STRING_PAGE - ((uintptr_t)(s1 + i) & (STRING_PAGE - 1));
+        uintptr_t room2 = STRING_PAGE - ((uintptr_t)(s2 + i) & (STRING_PAGE - 1));
+        size_t room = room1 < room2 ? room1 : room2;
+
+        for (; room >= 64; room -= 64, i += 64) {
+            const __m256i *a = (const __m256i *)(s1 + i), *b = (const __m256i *)(s2 + i);
+            __m256i t0 = stop_avx2(_mm256_loadu_si256(a), _mm256_loadu_si256(b));
+            __m256i t1 = stop_avx2(_mm256_loadu_si256(a + 1), _mm256_loadu_si256(b + 1));
+
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(t0, t1), z)) != 0) {
+                uint64_t m = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(t0, z));
+                m |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(t1, z)) << 32;
+                i += (size_t)__builtin_ctzll(m);
+                return cmp_result((unsigned char)s1[i], (unsigned char)s2[i], prefix);
+            }
+        }
+        if (i + room < 32) {
+            for (; room > 0; room--, i++) {
+                unsigned char x = (unsigned char)s1[i], y = (unsigned char)s2[i];
+                if (x == 0 || x != y) return cmp_result(x, y, prefix);
+            }
+        }
+        while (room > 0) {
+            size_t step = room < 32 ? room : 32, at = i + step - 32;
+            __m256i a = _mm256_loadu_si256((const __m256i *)(s1 + at));
+            __m256i b = _mm256_loadu_si256((const __m256i *)(s2 + at));
+            uint32_t m = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(stop_avx2(a, b), z));
+
+            if (m != 0) {
+                at += (size_t)__builtin_ctz(m);
+                return cmp_result((unsigned char)s1[at], (unsigned char)s2[at], prefix);
+            }
+            i += step;
+            room -= step;
+        }
+    }
+}
+
+AVX2_TARGET static char *rchr_avx2(const char *s, char c) {
+    const char *p = (const char *)((uintptr_t)s & ~(uintptr_t)31), *last = NULL;
+    const __m256i z = _mm256_setzero_si256(), vc = _mm256_set1_epi8(c);
+    uint32_t head = 0xffffffffu << ((uintptr_t)s & 31);
+    uint64_t zm = eq32_avx2(p, z) & head, cm = eq32_avx2(p, vc) & head, last_m = 0;
+
+    while (zm == 0) {
+        if (cm != 0) {
+            last = p;
+            last_m = cm;
+        }
+        p += 32;
+        if (((uintptr_t)p & 63) != 0) {
+            zm = eq32_avx2(p, z);
+            cm = eq32_avx2(p, vc);
+            continue;
+        }
+        for (;; p += 64) {
+            const __m256i *q = (const __m256i *)p;
+            __m256i v0 = _mm256_load_si256(q), v1 = _mm256_load_si256(q + 1);
+            __m256i cv = _mm256_or_si256(_mm256_cmpeq_epi8(v0, vc), _mm256_cmpeq_epi8(v1, vc));
+            int any = _mm256_movemask_epi8(cv) != 0;
+
+            if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(v0, v1), z)) != 0) {
+                zm = eq64_avx2(p, z);
+                cm = any ? eq64_avx2(p, vc) : 0;
+                break;
+            }
+            if (any) {
+                last = p;
+                last_m = 0;
+            }
+        }
+    }
+    cm &= zm ^ (zm - 1);
+    if (cm != 0) return (char *)p + 63 - __builtin_clzll(cm);
+    if (last == NULL) return NULL;
+    if (last_m == 0) last_m = eq64_avx2(last, vc);
+    return (char *)last + 63 - __builtin_clzll(last_m);
+}
+#endif /* STRING_HAVE_X86_SIMD */
+
+/*============================================================================
+ * DISPATCH
+ *==========================================================================*/
+/* One row per instruction set, indexed by string_isa(); the public entry
+ * points jump through the row chosen on the first call */
+typedef struct string_kernels {
+    size_t (*len)(const char *s);
+    int (*cmp)(const char *s1, const char *s2, int prefix);
+    char *(*rchr)(const char *s, char c);
+} string_kernels;
+
+static const string_kernels string_table[] = {
+    { len_scalar, cmp_scalar, rchr_scalar },
+#if defined(STRING_HAVE_X86_SIMD)
+    { len_sse2, cmp_sse2, rchr_sse2 },
+    { len_avx2, cmp_avx2, rchr_avx2 }
+#endif
+};
+
+static const string_kernels *string_active;
+
+static inline const string_kernels *string_kernels_get(void) {
+    const string_kernels *k = __atomic_load_n(&string_active, __ATOMIC_RELAXED);
+
+    if (__builtin_expect(k == NULL, 0)) {
+        k = &string_table[string_isa()];
+        __atomic_store_n(&string_active, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+size_t str_len(const char *s) {
+    return string_kernels_get()->len(s);
+}
+
+int str_cmp(const char *s1, const char *s2) {
+    return string_kernels_get()->cmp(s1, s2, 0);
+}
+
+int str_cmp_prefix(const char *prefix, const char *s) {
+    return string_kernels_get()->cmp(prefix, s, 1);
+}
+
+char *str_rchr(const char *s, int c) {
+    if ((char)c == '\0') return (char *)s + str_len(s);
+    return string_kernels_get()->rchr(s, (char)c);
+}
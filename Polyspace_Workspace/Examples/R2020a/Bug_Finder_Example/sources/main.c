@@ -13,6 +13,9 @@
 #include <stdio.h>
 #include <math.h>
 #include "lib_crypto_checkers.h"
+#include "lib_memory.h"
+#include "lib_numeric.h"
+#include "lib_string.h"
 #include "bf_testcases.h"
 
 
@@ -211,6 +214,13 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_partiallyaccessedarray_fib();
         break;
     }
+    case CORRECTED_PARTIALLYACCESSEDARRAY_FIB_SPAN:
+    {
+        extern int corrected_partiallyaccessedarray_fib_span(void);
+        int ret;
+        ret = corrected_partiallyaccessedarray_fib_span();
+        break;
+    }
     case BUG_DEACTIVATEDCODE:
     {
         extern int bug_deactivatedcode(void);
@@ -305,6 +315,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_unprotectedmemoryallocation();
         break;
     }
+    case CORRECTED_UNPROTECTEDMEMORYALLOCATION_SCRATCH:
+    {
+        extern void corrected_unprotectedmemoryallocation_scratch(void);
+        corrected_unprotectedmemoryallocation_scratch();
+        break;
+    }
     case BUG_BADFREE:
     {
         extern void bug_badfree(int);
@@ -321,6 +337,14 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_badfree(arg__0);
         break;
     }
+    case BUG_BADFREE_GUARD:
+    {
+        extern void bug_badfree_guard(int);
+        int arg__0;
+        arg__0 = pst_random_int;
+        bug_badfree_guard(arg__0);
+        break;
+    }
     case BUG_DOUBLEDEALLOCATION:
     {
         extern void bug_doubledeallocation(void);
@@ -333,6 +357,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_doubledeallocation();
         break;
     }
+    case BUG_DOUBLEDEALLOCATION_GUARD:
+    {
+        extern void bug_doubledeallocation_guard(void);
+        bug_doubledeallocation_guard();
+        break;
+    }
     case BUG_FREEDPTR:
     {
         extern int bug_freedptr(void);
@@ -347,6 +377,13 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_freedptr();
         break;
     }
+    case BUG_FREEDPTR_GUARD:
+    {
+        extern int bug_freedptr_guard(void);
+        int ret;
+        ret = bug_freedptr_guard();
+        break;
+    }
     case BUG_MEMLEAK:
     {
         extern void bug_memleak(void);
@@ -371,6 +408,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_memleak_array();
         break;
     }
+    case CORRECTED_MEMLEAK_ARRAY_ARENA:
+    {
+        extern void corrected_memleak_array_arena(void);
+        corrected_memleak_array_arena();
+        break;
+    }
     case BUG_PASSBYVALUE:
     {
         extern void bug_passbyvalue(void);
@@ -383,6 +426,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_passbyvalue();
         break;
     }
+    case CORRECTED_PASSBYVALUE_POOL:
+    {
+        extern void corrected_passbyvalue_pool(void);
+        corrected_passbyvalue_pool();
+        break;
+    }
     case BUG_MORETHANONESTATEMENT:
     {
         extern int bug_morethanonestatement(int);
@@ -579,6 +628,15 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_intconvovfl(arg__0);
         break;
     }
+    case CORRECTED_INTCONVOVFL_SATURATED:
+    {
+        extern short corrected_intconvovfl_saturated(int);
+        short ret;
+        int arg__0;
+        arg__0 = pst_random_int;
+        ret = corrected_intconvovfl_saturated(arg__0);
+        break;
+    }
     case BUG_UINTCONVOVFL:
     {
         extern unsigned short bug_uintconvovfl(int);
@@ -615,6 +673,15 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_signchange(arg__0);
         break;
     }
+    case CORRECTED_SIGNCHANGE_CHECKED:
+    {
+        extern int corrected_signchange_checked(unsigned int);
+        int ret;
+        unsigned int arg__0;
+        arg__0 = pst_random_unsigned_int;
+        ret = corrected_signchange_checked(arg__0);
+        break;
+    }
     case BUG_FLOATCONVOVFL:
     {
         extern void bug_floatconvovfl(int);
@@ -649,6 +716,15 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_intovfl(arg__0);
         break;
     }
+    case CORRECTED_INTOVFL_SATURATED:
+    {
+        extern int corrected_intovfl_saturated(int);
+        int ret;
+        int arg__0;
+        arg__0 = pst_random_int;
+        ret = corrected_intovfl_saturated(arg__0);
+        break;
+    }
     case BUG_UINTOVFL:
     {
         extern unsigned int bug_uintovfl(void);
@@ -699,6 +775,17 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_floatabsorption(arg__0, arg__1);
         break;
     }
+    case CORRECTED_FLOATABSORPTION_COMPENSATED:
+    {
+        extern double corrected_floatabsorption_compensated(double, double);
+        double ret;
+        double arg__0;
+        double arg__1;
+        arg__0 = pst_random_double;
+        arg__1 = pst_random_double;
+        ret = corrected_floatabsorption_compensated(arg__0, arg__1);
+        break;
+    }
     case BUG_INTSTDLIB:
     {
         extern div_t bug_intstdlib(int, int);
@@ -721,6 +808,17 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_intstdlib(arg__0, arg__1);
         break;
     }
+    case CORRECTED_INTSTDLIB_DIVISOR:
+    {
+        extern div_t corrected_intstdlib_divisor(int, int);
+        div_t ret;
+        int arg__0;
+        int arg__1;
+        arg__0 = pst_random_int;
+        arg__1 = pst_random_int;
+        ret = corrected_intstdlib_divisor(arg__0, arg__1);
+        break;
+    }
     case BUG_FLOATSTDLIB:
     {
         extern double bug_floatstdlib(int);
@@ -795,6 +893,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_bitwiseneg();
         break;
     }
+    case CORRECTED_BITWISENEG_FMT:
+    {
+        extern void corrected_bitwiseneg_fmt(void);
+        corrected_bitwiseneg_fmt();
+        break;
+    }
     case BUG_ASSERT:
     {
         extern int bug_assert(void);
@@ -1325,6 +1429,17 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_memcmppaddingdata(arg__0, arg__1);
         break;
     }
+    case CORRECTED_MEMCMPPADDINGDATA_POOL:
+    {
+        extern int corrected_memcmppaddingdata_pool(char, int);
+        int ret;
+        char arg__0;
+        int arg__1;
+        arg__0 = pst_random_char;
+        arg__1 = pst_random_int;
+        ret = corrected_memcmppaddingdata_pool(arg__0, arg__1);
+        break;
+    }
     case BUG_NONREENTRANTSTDRETURN:
     {
         extern int bug_nonreentrantstdreturn(void);
@@ -1339,6 +1454,13 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_nonreentrantstdreturn();
         break;
     }
+    case CORRECTED_NONREENTRANTSTDRETURN_SIMD:
+    {
+        extern int corrected_nonreentrantstdreturn_simd(void);
+        int ret;
+        ret = corrected_nonreentrantstdreturn_simd();
+        break;
+    }
     case DEMO_CALL_BUG_MEMCMPSTRINGS:
     {
         extern int demo_call_bug_memcmpstrings(void);
@@ -1346,6 +1468,13 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = demo_call_bug_memcmpstrings();
         break;
     }
+    case DEMO_CALL_CORRECTED_MEMCMPSTRINGS_SIMD:
+    {
+        extern int demo_call_corrected_memcmpstrings_simd(void);
+        int ret;
+        ret = demo_call_corrected_memcmpstrings_simd();
+        break;
+    }
     case BUG_CLOSEDRESOURCEUSE_FPRINTF:
     {
         extern void bug_closedresourceuse_fprintf(void);
@@ -2031,6 +2160,16 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_cryptocipherweakmode(arg__0, arg__1);
         break;
     }
+    case CORRECTED_CRYPTOCIPHERWEAKMODE_CTR:
+    {
+        extern void corrected_cryptocipherweakmode_ctr(unsigned char*, unsigned char*);
+        unsigned char* arg__0;
+        unsigned char* arg__1;
+        arg__0 = random_unsigned_char_pointer();
+        arg__1 = random_unsigned_char_pointer();
+        corrected_cryptocipherweakmode_ctr(arg__0, arg__1);
+        break;
+    }
     case BUG_CRYPTOPKEYNOPUBLICKEY:
     {
         extern int bug_cryptopkeynopublickey(unsigned char*, size_t);
@@ -2395,6 +2534,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_outboundarray();
         break;
     }
+    case CORRECTED_OUTBOUNDARRAY_SPAN:
+    {
+        extern void corrected_outboundarray_span(void);
+        corrected_outboundarray_span();
+        break;
+    }
     case BUG_OUTBOUNDPTR:
     {
         extern void bug_outboundptr(void);
@@ -2459,6 +2604,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_memstdlib();
         break;
     }
+    case CORRECTED_MEMSTDLIB_SPAN:
+    {
+        extern void corrected_memstdlib_span(void);
+        corrected_memstdlib_span();
+        break;
+    }
     case BUG_STRSTDLIB:
     {
         extern double bug_strstdlib(void);
@@ -2473,6 +2624,13 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_strstdlib();
         break;
     }
+    case CORRECTED_STRSTDLIB_SCAN:
+    {
+        extern double corrected_strstdlib_scan(void);
+        double ret;
+        ret = corrected_strstdlib_scan();
+        break;
+    }
     case BUG_NULLPTRARITH:
     {
         extern void bug_nullptrarith(void);
@@ -2527,6 +2685,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_pathbufferoverflow();
         break;
     }
+    case CORRECTED_PATHBUFFEROVERFLOW_CACHED:
+    {
+        extern void corrected_pathbufferoverflow_cached(void);
+        corrected_pathbufferoverflow_cached();
+        break;
+    }
     case BUG_STRLIBBUFFEROVERFLOW:
     {
         extern void bug_strlibbufferoverflow(float);
@@ -2543,6 +2707,14 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_strlibbufferoverflow(arg__0);
         break;
     }
+    case CORRECTED_STRLIBBUFFEROVERFLOW_FMT:
+    {
+        extern void corrected_strlibbufferoverflow_fmt(float);
+        float arg__0;
+        arg__0 = pst_random_float;
+        corrected_strlibbufferoverflow_fmt(arg__0);
+        break;
+    }
     case BUG_STRLIBBUFFERUNDERFLOW:
     {
         extern void bug_strlibbufferunderflow(int);
@@ -2571,6 +2743,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_strformatbufferoverflow();
         break;
     }
+    case CORRECTED_STRFORMATBUFFEROVERFLOW_SCAN:
+    {
+        extern void corrected_strformatbufferoverflow_scan(void);
+        corrected_strformatbufferoverflow_scan();
+        break;
+    }
     case BUG_TAINTEDARRAYINDEX:
     {
         extern int bug_taintedarrayindex(int);
@@ -2589,6 +2767,15 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_taintedarrayindex(arg__0);
         break;
     }
+    case CORRECTED_TAINTEDARRAYINDEX_SPAN:
+    {
+        extern int corrected_taintedarrayindex_span(int);
+        int ret;
+        int arg__0;
+        arg__0 = pst_random_int;
+        ret = corrected_taintedarrayindex_span(arg__0);
+        break;
+    }
     case BUG_TAINTEDINTDIVISION:
     {
         extern int bug_taintedintdivision(int, int);
@@ -2611,6 +2798,17 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_taintedintdivision(arg__0, arg__1);
         break;
     }
+    case CORRECTED_TAINTEDINTDIVISION_DIVISOR:
+    {
+        extern int corrected_taintedintdivision_divisor(int, int);
+        int ret;
+        int arg__0;
+        int arg__1;
+        arg__0 = pst_random_int;
+        arg__1 = pst_random_int;
+        ret = corrected_taintedintdivision_divisor(arg__0, arg__1);
+        break;
+    }
     case BUG_TAINTEDINTMOD:
     {
         extern int bug_taintedintmod(int);
@@ -2629,6 +2827,15 @@ int main(int argc, char *argv[], char *envp[]) {
         ret = corrected_taintedintmod(arg__0);
         break;
     }
+    case CORRECTED_TAINTEDINTMOD_DIVISOR:
+    {
+        extern int corrected_taintedintmod_divisor(int);
+        int ret;
+        int arg__0;
+        arg__0 = pst_random_int;
+        ret = corrected_taintedintmod_divisor(arg__0);
+        break;
+    }
     case BUG_TAINTEDLOOPBOUNDARY:
     {
         extern int bug_taintedloopboundary(int);
@@ -2679,6 +2886,14 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_taintedstring(arg__0);
         break;
     }
+    case CORRECTED_TAINTEDSTRING_SIMD:
+    {
+        extern void corrected_taintedstring_simd(char*);
+        char* arg__0;
+        arg__0 = random_char_pointer();
+        corrected_taintedstring_simd(arg__0);
+        break;
+    }
     case BUG_TAINTEDSTRINGFORMAT:
     {
         extern void bug_taintedstringformat(char*);
@@ -3068,6 +3283,12 @@ int main(int argc, char *argv[], char *envp[]) {
         corrected_alignmentchange();
         break;
     }
+    case CORRECTED_ALIGNMENTCHANGE_REALLOC:
+    {
+        extern void corrected_alignmentchange_realloc(void);
+        corrected_alignmentchange_realloc();
+        break;
+    }
     case BUG_PUTENVAUTOVAR:
     {
         extern void bug_putenvautovar(int);
@@ -3266,6 +3487,51 @@ int main(int argc, char *argv[], char *envp[]) {
           corrected_inttofloatprecisionloss();
           break;
       }
+    case CORRECTED_INTTOFLOATPRECISIONLOSS_CHECKED:
+      {
+          extern void corrected_inttofloatprecisionloss_checked(void);
+          corrected_inttofloatprecisionloss_checked();
+          break;
+      }
+    case DEMO_CRYPTOBENCHMARK:
+    {
+        int ret;
+        ret = CRYPTO_bench_suite(stdout);
+        ret += CRYPTO_timing_leak_suite(stdout);
+        ret += CRYPTO_ssl_session_suite(stdout);
+        break;
+    }
+    case DEMO_MEMORYBENCHMARK:
+    {
+        int ret;
+        ret = mem_bench_suite(stdout);
+        break;
+    }
+    case DEMO_HEAPPROFILE:
+    {
+        extern void bug_memleak(void);
+        int ret;
+        int i;
+        ret = mem_profile_start(1);     /* 1: every allocation is sampled */
+        for (i = 0; i < SIZE20; i++) {
+            bug_memleak();
+        }
+        fflush(stdout);
+        ret = mem_profile_dump(1);      /* live blocks, i.e. the leaks, to stdout */
+        break;
+    }
+    case DEMO_STRINGBENCHMARK:
+    {
+        int ret;
+        ret = str_bench_suite(stdout);
+        break;
+    }
+    case DEMO_NUMERICBENCHMARK:
+    {
+        int ret;
+        ret = num_bench_suite(stdout);
+        break;
+    }
     default:
         break;
     }
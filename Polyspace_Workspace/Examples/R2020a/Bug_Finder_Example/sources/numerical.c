@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include "lib_numeric.h"
+#include "lib_string.h"
 
 /* External functions */
 extern void do_something_float(float f);
@@ -49,6 +51,19 @@ int corrected_intzerodiv(int p) {
     return i;
 }
 
+int corrected_intzerodiv_divisor(int p) {
+    num_divisor_s32 d;
+    int i;
+    int j = 1;
+
+    if (num_divisor_s32_init(&d, j - p) == 0) { /* Fix: The divisor is checked once */
+        i = num_div_s32(1024, &d);
+    } else {
+        i = 0;
+    }
+    return i;
+}
+
 void call_intzerodiv(void) {
   volatile int random = 0;
   if (random==0) {
@@ -57,6 +72,9 @@ void call_intzerodiv(void) {
   if (random==0) {
       corrected_intzerodiv(1);
     }
+  if (random==0) {
+      corrected_intzerodiv_divisor(1);
+    }
 }
 
 
@@ -123,6 +141,19 @@ short corrected_intconvovfl(int th) {
     return (short)(value & 0xFFFF); /* Fix: Explicitly cast the value       */
 }
 
+short corrected_intconvovfl_saturated(int th) {
+    int64_t value;
+    short result;
+
+    if (th == 42) {
+        value = 0x00FE6F00L;
+    } else {
+        value = 0x00BE6B00L;
+    }
+    (void)num_narrow(&result, NUM_INT16, &value, NUM_INT64, 1, NUM_SATURATE, NULL);
+    return result;                  /* Fix: SHRT_MAX rather than the low-order bits */
+}
+
 
 /*============================================================================
  *  UNSIGNED INTEGER CONVERSION OVERFLOW
@@ -173,6 +204,19 @@ int corrected_signchange(unsigned int rd_uint) {
     return i1;
 }
 
+int corrected_signchange_checked(unsigned int rd_uint) {
+    unsigned int ui1 = 0;
+    int i1 = 0;
+
+    if (rd_uint) {
+        ui1 = UINT_MAX;
+        if (num_narrow(&i1, NUM_INT32, &ui1, NUM_UINT32, 1, NUM_CHECK, NULL).lossy != 0) {
+            i1 = 0;                         /* Fix: Value out of range rejected */
+        }
+    }
+    return i1;
+}
+
 
 /*============================================================================
  *  FLOAT CONVERSION OVERFLOW
@@ -237,6 +281,23 @@ long corrected_intovfl(int val) {
     return result;
 }
 
+int corrected_intovfl_saturated(int val) {
+    int32_t first;
+    int32_t second;
+    int32_t result;
+
+    if (val < 10) {
+        first = INT_MAX - 2;
+        second = 50;
+    } else {
+        first = 80;
+        second = INT_MAX - 30;
+    }
+
+    (void)num_add_sat_i32(&result, &first, &second, 1, NULL);  /* Fix: Sum clamped to INT_MAX, no wrap around */
+    return result;
+}
+
 
 /*============================================================================
  *  UNSIGNED OVERFLOW
@@ -301,6 +362,18 @@ double corrected_floatabsorption(double large, double small) {
     return d;
 }
 
+double corrected_floatabsorption_compensated(double large, double small) {
+    double terms[3];
+    double d = 0.;
+    if ((large >= 1.0e20) && (-1.0 <= small) && (small <= 1.)) {
+        terms[0] = large;
+        terms[1] = small;
+        terms[2] = -large;
+        d = num_sum_f64(terms, 3, NUM_SUM_KAHAN); /* Fix: small is kept in the compensation */
+    }
+    return d;
+}
+
 
 /*============================================================================
  *  INVALID USE OF INTEGER STANDARD LIBRARY
@@ -328,6 +401,17 @@ div_t corrected_intstdlib(int num, int denom) {
     return test;
 }
 
+div_t corrected_intstdlib_divisor(int num, int denom) {
+    div_t test = { .quot=0, .rem=0};
+    num_divisor_s32 d;
+
+    if (num_divisor_s32_init(&d, denom) == 0) {
+        test = num_divmod_s32(num, &d); /* Fix: Zero rejected once, INT_MIN / -1 cannot trap */
+    }
+
+    return test;
+}
+
 
 /*============================================================================
  *  INVALID USE OF FLOAT STANDARD LIBRARY
@@ -453,6 +537,19 @@ static void demo_sprintf(const char *format, ...) {
     va_end(ap);
 }
 
+static void demo_format(const char *format, ...) {
+    int rc;
+    va_list ap;
+    char buf[sizeof("256")];
+
+    va_start(ap, format);
+    rc = str_vformat(buf, sizeof(buf), format, ap);   /* Never writes past buf */
+    if (rc == -1 || rc >= (int)sizeof(buf)) {
+        /* Handle error */
+    }
+    va_end(ap);
+}
+
 void bug_bitwiseneg(void) {
     int stringify = 0x80000000;
     demo_sprintf("%u",
@@ -467,6 +564,12 @@ void corrected_bitwiseneg(void) {
                  stringify >> 24);
 }
 
+void corrected_bitwiseneg_fmt(void) {
+    unsigned int stringify = 0x80000000;
+    demo_format("%u",
+                stringify >> 24);
+}
+
 
 /*============================================================================
  *  PRECISION LOSS OF CONVERSION FROM INTEGER TO FLOAT
@@ -484,3 +587,16 @@ void corrected_inttofloatprecisionloss(void)
     double approx = big;            /* No Defect: Integer value 1234567890 is representable in 'double'. */
     (void)printf ("%ld\n", (big - (long int) approx));
 }
+
+void corrected_inttofloatprecisionloss_checked(void)
+{
+    int64_t big = 1234567890;
+    float approx;
+    double wide;
+    num_narrow_result res = num_i64_to_f32(&approx, &big, 1, NULL, &wide);
+
+    if (res.lossy != 0)             /* Fix: 'wide' holds the value 'approx' rounds */
+        (void)printf ("%ld\n", (long int) (big - (int64_t) wide));
+    else
+        (void)printf ("%ld\n", (long int) (big - (int64_t) approx));
+}
@@ -36,6 +36,8 @@
 #include <sys/socket.h>
 #include <unistd.h>
 #include <math.h>
+#include "lib_memory.h"
+#include "lib_string.h"
 
 #define fatal_error() abort()
 
@@ -936,6 +938,23 @@ int corrected_memcmppaddingdata(const S_Padding *left, const S_Padding *right) {
             (memcmp(left->buffer, right->buffer, SIZE20) == 0)); /* No padding in 'buffer' */
 }
 
+int corrected_memcmppaddingdata_pool(char c, int i) {
+    S_Padding* left = POOL_NEW(S_Padding);
+    S_Padding* right = POOL_NEW(S_Padding);
+    int ret = 0;
+
+    if (left != NULL && right != NULL) {
+        memset(left, 0, sizeof(S_Padding)); /* Fix: a recycled pool object keeps its old padding bytes */
+        left->c = c;
+        left->i = i;
+        *right = *left;                      /* Padding bytes of 'right' are not necessarily copied */
+        ret = corrected_memcmppaddingdata(left, right);
+    }
+    POOL_DELETE(left);
+    POOL_DELETE(right);
+    return ret;
+}
+
 
 /*============================================================================
  *  NON REENTRANT STD RETURN
@@ -1000,6 +1019,29 @@ int corrected_nonreentrantstdreturn(void) {
     return result;
 }
 
+int corrected_nonreentrantstdreturn_simd(void) {
+    int result = 0;
+
+    char *home = getenv("HOME");
+    if (home != NULL) {
+        char *user = NULL;
+        char *user_name_from_home = str_rchr(home, '/'); /* Vectorised strrchr */
+        if (user_name_from_home != NULL) {
+
+            char *saved_user_name_from_home = strdup(user_name_from_home); /* Fix: make a copy */
+            if (saved_user_name_from_home != NULL) {
+                user = getenv("USER");
+                if ((user != NULL) &&
+                    (str_cmp(user, saved_user_name_from_home) == 0)) { /* No Defect: use the copy */
+                    result = 1;
+                }
+                free(saved_user_name_from_home);
+            }
+        }
+    }
+    return result;
+}
+
 
 /*============================================================================
  *  MEMCMP STRINGS
@@ -1017,6 +1059,14 @@ static int corrected_memcmpstrings(const char *s1, const char *s2) {
         return strcmp(s1, s2);             /* Fix: use strcmp instead of memcmp */
     }
 }
+static int corrected_memcmpstrings_simd(const char *s1, const char *s2) {
+    if (some_condition) {
+        return str_cmp_prefix(s1, s2);     /* Fix: limit the size to valid length, in one pass */
+    }
+    else {
+        return str_cmp(s1, s2);            /* Fix: use strcmp instead of memcmp */
+    }
+}
 
 int demo_call_bug_memcmpstrings(void) {
     char s1[SIZE20] =  "abc";
@@ -1028,6 +1078,13 @@ int demo_call_bug_memcmpstrings(void) {
         return corrected_memcmpstrings(s1, s2);
 }
 
+int demo_call_corrected_memcmpstrings_simd(void) {
+    char s1[SIZE20] =  "abc";
+    char s2[SIZE20] =  "abc";
+
+    return corrected_memcmpstrings_simd(s1, s2);
+}
+
 
 /*============================================================================
  *  IO INTERLEAVING
@@ -20,6 +20,8 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include "lib_memory.h"
+#include "lib_string.h"
 
 #define fatal_error() abort()
 
@@ -66,6 +68,23 @@ void corrected_outboundarray(void) {
     (void)printf("Fibonacci raised %lu\n", fib[i-1]); /* Fix: Corrected index */
 }
 
+MEM_SPAN_TYPE(span_ulong, unsigned long);
+
+void corrected_outboundarray_span(void) {
+    int i;
+    unsigned long fib[SIZE10];
+    span_ulong s = MEM_SPAN_OF(fib);
+
+    for (i = 0; i < SIZE10; i++) {
+        if (i < 2) {
+            MEM_SPAN_AT(s, i) = 1;
+        } else {
+            MEM_SPAN_AT(s, i) = MEM_SPAN_AT(s, i-1) + MEM_SPAN_AT(s, i-2);
+        }
+    }
+    (void)printf("Fibonacci raised %lu\n", MEM_SPAN_AT(s, i-1));   /* Fix: Index checked against the span */
+}
+
 
 /*============================================================================
  *  OUT-OF-BOUNDS MEMORY ACCESS
@@ -173,6 +192,17 @@ void corrected_memstdlib(void) {
     print_str(buffer);
 }
 
+MEM_SPAN_TYPE(span_char, char);
+
+void corrected_memstdlib_span(void) {
+    const char* str = "test";
+    char buffer[SIZE2];
+    span_char s = MEM_SPAN_OF(buffer);
+
+    memmove(MEM_SPAN_PTR(s, 0, SIZE2), str, SIZE2); /* Fix: Range checked against the span */
+    print_str(buffer);
+}
+
 
 /*============================================================================
  *  MISUSE OF STRING STANDARD LIBRARY
@@ -195,6 +225,15 @@ double corrected_strstdlib(void) {
     return d;
 }
 
+double corrected_strstdlib_scan(void) {
+    char* str = "3.14";
+    double d;
+
+    d = str_to_double(str, NULL);       /* Fix: Proper arguments, read the same in any locale */
+
+    return d;
+}
+
 
 /*============================================================================
  *  NULL POINTER ARITHMETIC
@@ -283,6 +322,14 @@ void corrected_pathbufferoverflow() {
     }
 }
 
+void corrected_pathbufferoverflow_cached() {
+    const char* resolved = str_realpath(path);  /* Fix: no caller buffer, and cached between calls */
+
+    if (resolved != NULL) {
+        (void)printf("resolved %s is %s\n", path, resolved);
+    }
+}
+
 
 /*============================================================================
  *  BUFFER OVERFLOW USING STANDARD STRING FUNCTIONS
@@ -297,6 +344,12 @@ void corrected_strlibbufferoverflow(float f) {
     (void)sprintf(buf, "Result=%12.2E", f);  /*Fix: Buffer is wide enough */
 }
 
+void corrected_strlibbufferoverflow_fmt(float f) {
+    char buf[SIZE20];
+    (void)str_format(buf, sizeof(buf), "Result=%12.2E", f);  /*Fix: Buffer is wide enough, and never written past */
+    print_str(buf);
+}
+
 
 /*============================================================================
  *  BUFFER UNDERFLOW USING STANDARD STRING FUNCTIONS
@@ -336,6 +389,12 @@ void corrected_strformatbufferoverflow() {
         print_str(buf);
 }
 
+void corrected_strformatbufferoverflow_scan() {
+    char buf[SIZE10];
+    if (str_scanf(str_orig, "%9s", buf, sizeof(buf)) > 0)   /* Fix: Buffer size is passed with the buffer */
+        print_str(buf);
+}
+
 
 /*============================================================================
  * PUTENV AUTO VAR
@@ -22,6 +22,9 @@
 #include <dlfcn.h>
 #include <limits.h>
 #include <errno.h>
+#include "lib_memory.h"
+#include "lib_numeric.h"
+#include "lib_string.h"
 
 enum {
     SIZE10  =  10,
@@ -92,6 +95,9 @@ int corrected_taintedarrayindex(int n) {
         return -9999;
     }
 }
+int corrected_taintedarrayindex_span(int n) {
+    return MEM_ARRAY_HAS(tab, n) ? MEM_ARRAY_AT(tab, n) : -9999; /* Fix: Range of the array itself */
+}
 
 
 /*============================================================================
@@ -113,6 +119,16 @@ int corrected_taintedintdivision(int usernum, int userden) {
     return r;
 }
 
+int corrected_taintedintdivision_divisor(int usernum, int userden) {
+    num_divisor_s32 d;
+    int r = 0;
+    if (num_divisor_s32_init(&d, userden) == 0) {  /* Fix: denominator is checked once, INT_MIN/-1 cannot trap */
+        r = num_div_s32(usernum, &d);
+    }
+    print_int(r);
+    return r;
+}
+
 
 /*============================================================================
  *  USING TAINTED DATA AS DENOMINATOR IN MODULO OPERATION
@@ -132,6 +148,16 @@ int corrected_taintedintmod(int userden) {
     return r;
 }
 
+int corrected_taintedintmod_divisor(int userden) {
+    num_divisor_s32 d;
+    int r = 0;
+    if (userden>0 && num_divisor_s32_init(&d, userden) == 0) {   /* Fix: Parameter is checked once */
+        r = num_mod_s32(128, &d);
+    }
+    print_int(r);
+    return r;
+}
+
 
 /*============================================================================
  *  USING TAINTED DATA AS LOOP BOUNDARY
@@ -188,6 +214,13 @@ void corrected_taintedstring(char* userstr) {
     }
     print_str(str);
 }
+void corrected_taintedstring_simd(char* userstr) {
+    char str[SIZE128] = "Using ";
+    if (str_nonempty(userstr)) {                  /* Fix: same check as sanitize_str, without scanning the string */
+        strncat(str, userstr, SIZE100);
+    }
+    print_str(str);
+}
 
 
 /*============================================================================